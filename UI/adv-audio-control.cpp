@@ -4,6 +4,7 @@
 #include <QSpinBox>
 #include <QComboBox>
 #include <QCheckBox>
+#include <QTimer>
 #include <cmath>
 #include "qt-wrappers.hpp"
 #include "obs-app.hpp"
@@ -42,6 +43,10 @@ OBSAdvAudioCtrl::OBSAdvAudioCtrl(QGridLayout *, obs_source_t *source_)
 	if (obs_audio_monitoring_available())
 		monitoringType = new QComboBox();
 	syncOffset = new QSpinBox();
+	jitterContainer = new QWidget();
+	jitterMax = new QSpinBox();
+	jitterDelay = new QLabel();
+	jitterTimer = new QTimer(this);
 	mixer1 = new QCheckBox();
 	mixer2 = new QCheckBox();
 	mixer3 = new QCheckBox();
@@ -56,6 +61,8 @@ OBSAdvAudioCtrl::OBSAdvAudioCtrl(QGridLayout *, obs_source_t *source_)
 				 this);
 	syncOffsetSignal.Connect(handler, "audio_sync", OBSSourceSyncChanged,
 				 this);
+	jitterMaxSignal.Connect(handler, "audio_jitter_max",
+				OBSSourceJitterMaxChanged, this);
 	flagsSignal.Connect(handler, "update_flags", OBSSourceFlagsChanged,
 			    this);
 	if (obs_audio_monitoring_available())
@@ -161,6 +168,26 @@ OBSAdvAudioCtrl::OBSAdvAudioCtrl(QGridLayout *, obs_source_t *source_)
 	syncOffset->setAccessibleName(
 		QTStr("Basic.AdvAudio.SyncOffsetSource").arg(sourceName));
 
+	uint64_t cur_jitter = obs_source_get_audio_jitter_max(source);
+	jitterMax->setMinimum(0);
+	jitterMax->setMaximum(5000);
+	jitterMax->setSingleStep(10);
+	jitterMax->setSuffix(" ms");
+	jitterMax->setSpecialValueText(
+		QTStr("Basic.AdvAudio.JitterBuffer.Off"));
+	jitterMax->setValue(int(cur_jitter / NSEC_PER_MSEC));
+	jitterMax->setFixedWidth(100);
+	jitterMax->setToolTip(QTStr("Basic.AdvAudio.JitterBuffer.ToolTip"));
+	jitterMax->setAccessibleName(
+		QTStr("Basic.AdvAudio.JitterBufferSource").arg(sourceName));
+
+	hlayout = new QHBoxLayout();
+	hlayout->setContentsMargins(0, 0, 0, 0);
+	hlayout->addWidget(jitterMax);
+	hlayout->addWidget(jitterDelay);
+	jitterContainer->setLayout(hlayout);
+	UpdateJitterDelay();
+
 	int idx;
 	if (obs_audio_monitoring_available()) {
 		monitoringType->addItem(QTStr("Basic.AdvAudio.Monitoring.None"),
@@ -235,6 +262,11 @@ OBSAdvAudioCtrl::OBSAdvAudioCtrl(QGridLayout *, obs_source_t *source_)
 			 SLOT(ResetBalance()));
 	QWidget::connect(syncOffset, SIGNAL(valueChanged(int)), this,
 			 SLOT(syncOffsetChanged(int)));
+	QWidget::connect(jitterMax, SIGNAL(valueChanged(int)), this,
+			 SLOT(jitterMaxChanged(int)));
+	QWidget::connect(jitterTimer, SIGNAL(timeout()), this,
+			 SLOT(UpdateJitterDelay()));
+	jitterTimer->start(500);
 	if (obs_audio_monitoring_available())
 		QWidget::connect(monitoringType,
 				 SIGNAL(currentIndexChanged(int)), this,
@@ -264,6 +296,7 @@ OBSAdvAudioCtrl::~OBSAdvAudioCtrl()
 	forceMono->deleteLater();
 	balanceContainer->deleteLater();
 	syncOffset->deleteLater();
+	jitterContainer->deleteLater();
 	if (obs_audio_monitoring_available())
 		monitoringType->deleteLater();
 	mixerContainer->deleteLater();
@@ -281,6 +314,7 @@ void OBSAdvAudioCtrl::ShowAudioControl(QGridLayout *layout)
 	layout->addWidget(forceMono, lastRow, idx++);
 	layout->addWidget(balanceContainer, lastRow, idx++);
 	layout->addWidget(syncOffset, lastRow, idx++);
+	layout->addWidget(jitterContainer, lastRow, idx++);
 	if (obs_audio_monitoring_available())
 		layout->addWidget(monitoringType, lastRow, idx++);
 	layout->addWidget(mixerContainer, lastRow, idx++);
@@ -326,6 +360,15 @@ void OBSAdvAudioCtrl::OBSSourceSyncChanged(void *param, calldata_t *calldata)
 				  "SourceSyncChanged", Q_ARG(int64_t, offset));
 }
 
+void OBSAdvAudioCtrl::OBSSourceJitterMaxChanged(void *param,
+						calldata_t *calldata)
+{
+	int64_t max = calldata_int(calldata, "max");
+	QMetaObject::invokeMethod(reinterpret_cast<OBSAdvAudioCtrl *>(param),
+				  "SourceJitterMaxChanged",
+				  Q_ARG(int64_t, max));
+}
+
 void OBSAdvAudioCtrl::OBSSourceMonitoringTypeChanged(void *param,
 						     calldata_t *calldata)
 {
@@ -409,6 +452,24 @@ void OBSAdvAudioCtrl::SourceSyncChanged(int64_t offset)
 	syncOffset->blockSignals(false);
 }
 
+void OBSAdvAudioCtrl::SourceJitterMaxChanged(int64_t max)
+{
+	jitterMax->blockSignals(true);
+	jitterMax->setValue(max / NSEC_PER_MSEC);
+	jitterMax->blockSignals(false);
+	UpdateJitterDelay();
+}
+
+void OBSAdvAudioCtrl::UpdateJitterDelay()
+{
+	uint64_t delay = obs_source_get_audio_jitter_delay(source);
+
+	jitterDelay->setVisible(jitterMax->value() != 0);
+	jitterDelay->setText(QString::number(delay / NSEC_PER_MSEC) + " ms");
+	jitterDelay->setToolTip(QTStr("Basic.AdvAudio.JitterBuffer.Delay")
+					.arg(delay / NSEC_PER_MSEC));
+}
+
 void OBSAdvAudioCtrl::SourceMonitoringTypeChanged(int type)
 {
 	int idx = monitoringType->findData(type);
@@ -576,6 +637,31 @@ void OBSAdvAudioCtrl::syncOffsetChanged(int milliseconds)
 		true);
 }
 
+void OBSAdvAudioCtrl::jitterMaxChanged(int milliseconds)
+{
+	uint64_t prev = obs_source_get_audio_jitter_max(source);
+	uint64_t val = uint64_t(milliseconds) * NSEC_PER_MSEC;
+
+	if (prev / NSEC_PER_MSEC == (uint64_t)milliseconds)
+		return;
+
+	obs_source_set_audio_jitter_max(source, val);
+	UpdateJitterDelay();
+
+	auto undo_redo = [](const std::string &name, uint64_t val) {
+		OBSSourceAutoRelease source =
+			obs_get_source_by_name(name.c_str());
+		obs_source_set_audio_jitter_max(source, val);
+	};
+
+	const char *name = obs_source_get_name(source);
+	OBSBasic::Get()->undo_s.add_action(
+		QTStr("Undo.JitterBuffer.Change").arg(name),
+		std::bind(undo_redo, std::placeholders::_1, prev),
+		std::bind(undo_redo, std::placeholders::_1, val), name, name,
+		true);
+}
+
 void OBSAdvAudioCtrl::monitoringTypeChanged(int index)
 {
 	obs_monitoring_type prev = obs_source_get_monitoring_type(source);
@@ -12,6 +12,7 @@ class QLabel;
 class QSpinBox;
 class QCheckBox;
 class QComboBox;
+class QTimer;
 
 enum class VolumeType {
 	dB,
@@ -26,6 +27,7 @@ private:
 
 	QPointer<QWidget> mixerContainer;
 	QPointer<QWidget> balanceContainer;
+	QPointer<QWidget> jitterContainer;
 
 	QPointer<QLabel> iconLabel;
 	QPointer<QLabel> nameLabel;
@@ -38,6 +40,9 @@ private:
 	QPointer<QLabel> labelL;
 	QPointer<QLabel> labelR;
 	QPointer<QSpinBox> syncOffset;
+	QPointer<QSpinBox> jitterMax;
+	QPointer<QLabel> jitterDelay;
+	QPointer<QTimer> jitterTimer;
 	QPointer<QComboBox> monitoringType;
 	QPointer<QCheckBox> mixer1;
 	QPointer<QCheckBox> mixer2;
@@ -48,6 +53,7 @@ private:
 
 	OBSSignal volChangedSignal;
 	OBSSignal syncOffsetSignal;
+	OBSSignal jitterMaxSignal;
 	OBSSignal flagsSignal;
 	OBSSignal monitoringTypeSignal;
 	OBSSignal mixersSignal;
@@ -61,6 +67,8 @@ private:
 	static void OBSSourceFlagsChanged(void *param, calldata_t *calldata);
 	static void OBSSourceVolumeChanged(void *param, calldata_t *calldata);
 	static void OBSSourceSyncChanged(void *param, calldata_t *calldata);
+	static void OBSSourceJitterMaxChanged(void *param,
+					      calldata_t *calldata);
 	static void OBSSourceMonitoringTypeChanged(void *param,
 						   calldata_t *calldata);
 	static void OBSSourceMixersChanged(void *param, calldata_t *calldata);
@@ -82,6 +90,8 @@ public slots:
 	void SourceFlagsChanged(uint32_t flags);
 	void SourceVolumeChanged(float volume);
 	void SourceSyncChanged(int64_t offset);
+	void SourceJitterMaxChanged(int64_t max);
+	void UpdateJitterDelay();
 	void SourceMonitoringTypeChanged(int type);
 	void SourceMixersChanged(uint32_t mixers);
 	void SourceBalanceChanged(int balance);
@@ -92,6 +102,7 @@ public slots:
 	void downmixMonoChanged(bool checked);
 	void balanceChanged(int val);
 	void syncOffsetChanged(int milliseconds);
+	void jitterMaxChanged(int milliseconds);
 	void monitoringTypeChanged(int index);
 	void mixer1Changed(bool checked);
 	void mixer2Changed(bool checked);
@@ -37,6 +37,7 @@
 
 #include <memory>
 #include <cmath>
+#include <string>
 
 using namespace std;
 
@@ -582,7 +583,8 @@ void RemuxQueueModel::endProcessing()
 			 index(queue.length(), RemuxEntryColumn::State));
 }
 
-bool RemuxQueueModel::beginNextEntry(QString &inputPath, QString &outputPath)
+bool RemuxQueueModel::beginPendingEntries(QStringList &inputPaths,
+					  QStringList &outputPaths)
 {
 	bool anyStarted = false;
 
@@ -591,15 +593,14 @@ bool RemuxQueueModel::beginNextEntry(QString &inputPath, QString &outputPath)
 		if (entry.state == RemuxEntryState::Pending) {
 			entry.state = RemuxEntryState::InProgress;
 
-			inputPath = entry.sourcePath;
-			outputPath = entry.targetPath;
+			inputPaths.append(entry.sourcePath);
+			outputPaths.append(entry.targetPath);
 
 			QModelIndex index =
 				this->index(row, RemuxEntryColumn::State);
 			emit dataChanged(index, index);
 
 			anyStarted = true;
-			break;
 		}
 	}
 
@@ -704,6 +705,8 @@ OBSRemux::OBSRemux(const char *path, QWidget *parent, bool autoRemux_)
 	connect(&remuxer, &QThread::finished, worker_, &QObject::deleteLater);
 	connect(worker_, &RemuxWorker::remuxFinished, this,
 		&OBSRemux::remuxFinished);
+	connect(worker_, &RemuxWorker::batchFinished, this,
+		&OBSRemux::remuxBatchFinished);
 	connect(this, &OBSRemux::remux, worker_, &RemuxWorker::remux);
 
 	// Guessing the GCC bug mentioned above would also affect
@@ -860,25 +863,25 @@ void OBSRemux::beginRemux()
 		->setText(QTStr("Remux.Stop"));
 	setAcceptDrops(false);
 
-	remuxNextEntry();
+	remuxPendingEntries();
 }
 
 void OBSRemux::AutoRemux(QString inFile, QString outFile)
 {
 	if (inFile != "" && outFile != "" && autoRemux) {
 		ui->progressBar->setVisible(true);
-		emit remux(inFile, outFile);
+		emit remux(QStringList(inFile), QStringList(outFile));
 		autoRemuxFile = outFile;
 	}
 }
 
-void OBSRemux::remuxNextEntry()
+void OBSRemux::remuxPendingEntries()
 {
 	worker->lastProgress = 0.f;
 
-	QString inputPath, outputPath;
-	if (queueModel->beginNextEntry(inputPath, outputPath)) {
-		emit remux(inputPath, outputPath);
+	QStringList inputPaths, outputPaths;
+	if (queueModel->beginPendingEntries(inputPaths, outputPaths)) {
+		emit remux(inputPaths, outputPaths);
 	} else {
 		queueModel->autoRemux = autoRemux;
 		queueModel->endProcessing();
@@ -923,10 +926,9 @@ void OBSRemux::updateProgress(float percent)
 	ui->progressBar->setValue(percent * 10);
 }
 
+/* called for every file of the batch, in order */
 void OBSRemux::remuxFinished(bool success)
 {
-	ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(true);
-
 	queueModel->finishEntry(success);
 
 	if (autoRemux && autoRemuxFile != "") {
@@ -937,8 +939,13 @@ void OBSRemux::remuxFinished(bool success)
 			QTStr("Basic.StatusBar.AutoRemuxedTo")
 				.arg(autoRemuxFile));
 	}
+}
 
-	remuxNextEntry();
+void OBSRemux::remuxBatchFinished()
+{
+	ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(true);
+
+	remuxPendingEntries();
 }
 
 void OBSRemux::clearFinished()
@@ -965,35 +972,71 @@ void RemuxWorker::UpdateProgress(float percent)
 	lastProgress = percent;
 }
 
-void RemuxWorker::remux(const QString &source, const QString &target)
+void RemuxWorker::remux(const QStringList &sources,
+			const QStringList &targets)
 {
 	isWorking = true;
 
-	auto callback = [](void *data, float percent) {
+	auto callback = [](void *data, size_t index, float percent,
+			   const struct media_remux_stats *stats) {
 		RemuxWorker *rw = static_cast<RemuxWorker *>(data);
 
 		QMutexLocker lock(&rw->updateMutex);
 
-		rw->UpdateProgress(percent);
+		rw->jobProgress[index] = percent;
+		rw->jobStats[index] = *stats;
+
+		float total = 0.f;
+		for (float progress : rw->jobProgress)
+			total += progress;
+		rw->UpdateProgress(total / rw->jobProgress.size());
 
 		return rw->isWorking;
 	};
 
-	bool stopped = false;
-	bool success = false;
+	size_t count = (size_t)sources.size();
+	std::vector<std::string> inputs, outputs;
+	std::vector<const char *> inputPaths, outputPaths;
+	std::unique_ptr<bool[]> results(new bool[count]);
 
-	media_remux_job_t mr_job = nullptr;
-	if (media_remux_job_create(&mr_job, QT_TO_UTF8(source),
-				   QT_TO_UTF8(target))) {
+	for (size_t i = 0; i < count; i++) {
+		inputs.push_back(QT_TO_UTF8(sources[(int)i]));
+		outputs.push_back(QT_TO_UTF8(targets[(int)i]));
+	}
+	for (size_t i = 0; i < count; i++) {
+		inputPaths.push_back(inputs[i].c_str());
+		outputPaths.push_back(outputs[i].c_str());
+	}
 
-		success = media_remux_job_process(mr_job, callback, this);
+	{
+		QMutexLocker lock(&updateMutex);
+		jobProgress.assign(count, 0.f);
+		jobStats.assign(count, {});
+	}
 
-		media_remux_job_destroy(mr_job);
+	/* the files are remuxed in parallel, one per logical core */
+	struct media_remux_options options = {};
+	options.read_ahead = true;
 
-		stopped = !isWorking;
-	}
+	media_remux_batch_process(inputPaths.data(), outputPaths.data(), count,
+				  0, &options, callback, this, results.get());
 
+	bool stopped = !isWorking;
 	isWorking = false;
 
-	emit remuxFinished(!stopped && success);
+	for (size_t i = 0; i < count; i++) {
+		if (results[i]) {
+			const struct media_remux_stats &stats = jobStats[i];
+			blog(LOG_INFO,
+			     "Remuxed '%s' in %.2f s (read %.1f MB/s, "
+			     "write %.1f MB/s)",
+			     inputPaths[i], (double)stats.elapsed_ns / 1e9,
+			     stats.read_throughput / 1e6,
+			     stats.write_throughput / 1e6);
+		}
+
+		emit remuxFinished(!stopped && results[i]);
+	}
+
+	emit batchFinished();
 }
@@ -23,6 +23,7 @@
 #include <QThread>
 #include <QStyledItemDelegate>
 #include <memory>
+#include <vector>
 #include "ui_OBSRemux.h"
 
 #include <media-io/media-remux.h>
@@ -72,7 +73,7 @@ protected:
 	virtual void dropEvent(QDropEvent *ev) override;
 	virtual void dragEnterEvent(QDragEnterEvent *ev) override;
 
-	void remuxNextEntry();
+	void remuxPendingEntries();
 
 private slots:
 	void rowCountChanged(const QModelIndex &parent, int first, int last);
@@ -80,13 +81,14 @@ private slots:
 public slots:
 	void updateProgress(float percent);
 	void remuxFinished(bool success);
+	void remuxBatchFinished();
 	void beginRemux();
 	bool stopRemux();
 	void clearFinished();
 	void clearAll();
 
 signals:
-	void remux(const QString &source, const QString &target);
+	void remux(const QStringList &sources, const QStringList &targets);
 };
 
 class RemuxQueueModel : public QAbstractTableModel {
@@ -112,7 +114,8 @@ public:
 	bool checkForErrors() const;
 	void beginProcessing();
 	void endProcessing();
-	bool beginNextEntry(QString &inputPath, QString &outputPath);
+	bool beginPendingEntries(QStringList &inputPaths,
+				 QStringList &outputPaths);
 	void finishEntry(bool success);
 	bool canClearFinished() const;
 	void clearFinished();
@@ -146,15 +149,21 @@ class RemuxWorker : public QObject {
 	float lastProgress;
 	void UpdateProgress(float percent);
 
+	/* progress and stats of each file of the batch, updated from the
+	 * remux threads with updateMutex held */
+	std::vector<float> jobProgress;
+	std::vector<struct media_remux_stats> jobStats;
+
 	explicit RemuxWorker() : isWorking(false) {}
 	virtual ~RemuxWorker(){};
 
 private slots:
-	void remux(const QString &source, const QString &target);
+	void remux(const QStringList &sources, const QStringList &targets);
 
 signals:
 	void updateProgress(float percent);
 	void remuxFinished(bool success);
+	void batchFinished();
 
 	friend class OBSRemux;
 };
@@ -0,0 +1,547 @@
+#include "cache.h"
+
+/* every Nth compressed frame does not depend on the previous one, so
+ * seeking only has to decode a few frames */
+#define MP_CACHE_KEYFRAME_INTERVAL 30
+
+/* shorter runs of zeros are cheaper to store as literals */
+#define MIN_ZERO_RUN 8
+
+void mp_cache_init(struct mp_cache *c, bool compress, uint64_t max_mem_usage)
+{
+	memset(c, 0, sizeof(*c));
+	c->compress = compress;
+	c->max_mem_usage = max_mem_usage;
+	c->decoded_idx = SIZE_MAX;
+}
+
+void mp_cache_finish(struct mp_cache *c)
+{
+	video_scaler_destroy(c->scaler);
+	c->scaler = NULL;
+
+	bfree(c->converted);
+	bfree(c->prev);
+	bfree(c->encoded);
+	c->converted = NULL;
+	c->prev = NULL;
+	c->encoded = NULL;
+}
+
+void mp_cache_free(struct mp_cache *c)
+{
+	mp_cache_finish(c);
+
+	for (size_t i = 0; i < c->video.num; i++)
+		bfree(c->video.array[i].data);
+	for (size_t i = 0; i < c->audio.num; i++)
+		bfree(c->audio.array[i].data);
+
+	da_free(c->video);
+	da_free(c->audio);
+	bfree(c->decoded);
+
+	memset(c, 0, sizeof(*c));
+	c->decoded_idx = SIZE_MAX;
+}
+
+/* ------------------------------------------------------------------------- */
+/* run length encoding of zeros, which is what most of a frame XOR'd with the
+ * previous one is.  each run is a varint header, (len << 1) for zeros and
+ * (len << 1) | 1 for literal bytes which follow the header. */
+
+static inline uint8_t *write_varint(uint8_t *out, uint64_t val)
+{
+	while (val >= 0x80) {
+		*(out++) = (uint8_t)(val | 0x80);
+		val >>= 7;
+	}
+
+	*(out++) = (uint8_t)val;
+	return out;
+}
+
+static inline bool read_varint(const uint8_t **in, const uint8_t *end,
+			       uint64_t *val)
+{
+	const uint8_t *p = *in;
+	uint64_t result = 0;
+	int shift = 0;
+
+	while (p < end && shift < 64) {
+		uint8_t byte = *(p++);
+		result |= (uint64_t)(byte & 0x7F) << shift;
+
+		if ((byte & 0x80) == 0) {
+			*in = p;
+			*val = result;
+			return true;
+		}
+
+		shift += 7;
+	}
+
+	return false;
+}
+
+static inline uint8_t *write_literal(uint8_t *out, const uint8_t *in,
+				     size_t size)
+{
+	out = write_varint(out, ((uint64_t)size << 1) | 1);
+	memcpy(out, in, size);
+	return out + size;
+}
+
+/* out must hold at least size * 2 + 16 bytes */
+static size_t rle_encode(uint8_t *out, const uint8_t *in, size_t size)
+{
+	uint8_t *p = out;
+	size_t literal = 0;
+	size_t i = 0;
+
+	while (i < size) {
+		if (in[i] != 0) {
+			i++;
+			continue;
+		}
+
+		size_t run_end = i;
+		while (run_end < size && in[run_end] == 0)
+			run_end++;
+
+		if (run_end - i >= MIN_ZERO_RUN || run_end == size) {
+			if (i > literal)
+				p = write_literal(p, in + literal, i - literal);
+
+			p = write_varint(p, (uint64_t)(run_end - i) << 1);
+			literal = run_end;
+		}
+
+		i = run_end;
+	}
+
+	if (size > literal)
+		p = write_literal(p, in + literal, size - literal);
+
+	return (size_t)(p - out);
+}
+
+static bool rle_decode(uint8_t *dst, size_t size, const uint8_t *in,
+		       size_t in_size, bool delta)
+{
+	const uint8_t *end = in + in_size;
+	size_t pos = 0;
+
+	while (in < end) {
+		uint64_t header;
+		if (!read_varint(&in, end, &header))
+			return false;
+
+		size_t len = (size_t)(header >> 1);
+		if (len > size - pos)
+			return false;
+
+		if (header & 1) {
+			if (len > (size_t)(end - in))
+				return false;
+
+			if (delta) {
+				for (size_t i = 0; i < len; i++)
+					dst[pos + i] ^= in[i];
+			} else {
+				memcpy(dst + pos, in, len);
+			}
+
+			in += len;
+
+		} else if (!delta) {
+			memset(dst + pos, 0, len);
+		}
+
+		pos += len;
+	}
+
+	return pos == size;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static enum video_format get_cache_format(enum video_format format)
+{
+	switch (format) {
+	case VIDEO_FORMAT_NV12:
+	case VIDEO_FORMAT_P010:
+	case VIDEO_FORMAT_RGBA:
+	case VIDEO_FORMAT_BGRA:
+	case VIDEO_FORMAT_BGRX:
+		return format;
+
+	case VIDEO_FORMAT_I010:
+	case VIDEO_FORMAT_I210:
+	case VIDEO_FORMAT_I412:
+		return VIDEO_FORMAT_P010;
+
+	case VIDEO_FORMAT_I40A:
+	case VIDEO_FORMAT_I42A:
+	case VIDEO_FORMAT_YUVA:
+	case VIDEO_FORMAT_YA2L:
+	case VIDEO_FORMAT_AYUV:
+	case VIDEO_FORMAT_BGR3:
+		return VIDEO_FORMAT_RGBA;
+
+	default:
+		return VIDEO_FORMAT_NV12;
+	}
+}
+
+static void init_planes(struct mp_cache *c)
+{
+	struct obs_source_frame *info = &c->info;
+	uint32_t even_cx = (info->width + 1) & ~1;
+	uint32_t half_cy = (info->height + 1) / 2;
+
+	switch (info->format) {
+	case VIDEO_FORMAT_NV12:
+		info->linesize[0] = even_cx;
+		info->linesize[1] = even_cx;
+		c->plane_sizes[0] = even_cx * info->height;
+		c->plane_sizes[1] = even_cx * half_cy;
+		break;
+	case VIDEO_FORMAT_P010:
+		info->linesize[0] = even_cx * 2;
+		info->linesize[1] = even_cx * 2;
+		c->plane_sizes[0] = even_cx * 2 * info->height;
+		c->plane_sizes[1] = even_cx * 2 * half_cy;
+		break;
+	default:
+		info->linesize[0] = info->width * 4;
+		c->plane_sizes[0] = info->width * 4 * info->height;
+	}
+
+	c->frame_size = 0;
+	for (size_t i = 0; i < MAX_AV_PLANES; i++)
+		c->frame_size += c->plane_sizes[i];
+}
+
+static bool init_video(struct mp_cache *c, const struct obs_source_frame *frame,
+		       enum video_colorspace space, enum video_range_type range)
+{
+	struct obs_source_frame *info = &c->info;
+
+	info->format = get_cache_format(frame->format);
+	info->width = frame->width;
+	info->height = frame->height;
+	info->trc = frame->trc;
+	info->flip = frame->flip;
+	info->flags = frame->flags;
+	info->max_luminance = frame->max_luminance;
+	c->src_format = frame->format;
+
+	if (info->format != frame->format) {
+		struct video_scale_info src = {
+			.format = frame->format,
+			.width = frame->width,
+			.height = frame->height,
+			.range = range,
+			.colorspace = space,
+		};
+		struct video_scale_info dst = src;
+
+		dst.format = info->format;
+		if (!format_is_yuv(dst.format))
+			dst.range = VIDEO_RANGE_FULL;
+
+		int ret = video_scaler_create(&c->scaler, &dst, &src,
+					      VIDEO_SCALE_POINT);
+		if (ret != VIDEO_SCALER_SUCCESS) {
+			blog(LOG_WARNING, "MP: Failed to create cache scaler");
+			return false;
+		}
+
+		info->full_range = dst.range == VIDEO_RANGE_FULL;
+		video_format_get_parameters_for_format(
+			space, dst.range, dst.format, info->color_matrix,
+			info->color_range_min, info->color_range_max);
+	} else {
+		info->full_range = frame->full_range;
+		memcpy(info->color_matrix, frame->color_matrix,
+		       sizeof(info->color_matrix));
+		memcpy(info->color_range_min, frame->color_range_min,
+		       sizeof(info->color_range_min));
+		memcpy(info->color_range_max, frame->color_range_max,
+		       sizeof(info->color_range_max));
+	}
+
+	init_planes(c);
+
+	c->converted = bmalloc(c->frame_size);
+	if (c->compress) {
+		c->prev = bzalloc(c->frame_size);
+		c->encoded = bmalloc((size_t)c->frame_size * 2 + 16);
+	}
+
+	return true;
+}
+
+static inline void get_planes(const struct mp_cache *c, uint8_t *data,
+			      uint8_t *planes[MAX_AV_PLANES])
+{
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		planes[i] = c->plane_sizes[i] ? data : NULL;
+		data += c->plane_sizes[i];
+	}
+}
+
+static bool convert_frame(struct mp_cache *c,
+			  const struct obs_source_frame *frame)
+{
+	uint8_t *planes[MAX_AV_PLANES];
+	get_planes(c, c->converted, planes);
+
+	if (c->scaler)
+		return video_scaler_scale(c->scaler, planes, c->info.linesize,
+					  (const uint8_t *const *)frame->data,
+					  frame->linesize);
+
+	for (size_t i = 0; i < MAX_AV_PLANES && planes[i]; i++) {
+		uint32_t linesize = c->info.linesize[i];
+		uint32_t rows = c->plane_sizes[i] / linesize;
+
+		if (frame->linesize[i] < linesize)
+			return false;
+
+		for (uint32_t y = 0; y < rows; y++)
+			memcpy(planes[i] + y * linesize,
+			       frame->data[i] + y * frame->linesize[i],
+			       linesize);
+	}
+
+	return true;
+}
+
+static inline bool mp_cache_reserve(struct mp_cache *c, size_t size)
+{
+	if (c->max_mem_usage && c->mem_usage + size > c->max_mem_usage) {
+		c->full = true;
+		return false;
+	}
+
+	c->mem_usage += size;
+	return true;
+}
+
+bool mp_cache_add_video(struct mp_cache *c,
+			const struct obs_source_frame *frame, int64_t pts,
+			enum video_colorspace space, enum video_range_type range)
+{
+	struct mp_cache_frame cf = {.pts = pts, .type = MP_CACHE_FRAME_RAW};
+	const uint8_t *data;
+	size_t size;
+
+	if (c->full)
+		return false;
+	if (c->video_failed)
+		return true;
+
+	if (!c->frame_size && !init_video(c, frame, space, range)) {
+		c->video_failed = true;
+		return true;
+	}
+
+	if (frame->width != c->info.width || frame->height != c->info.height ||
+	    frame->format != c->src_format)
+		return true;
+
+	if (!convert_frame(c, frame))
+		return true;
+
+	data = c->converted;
+	size = c->frame_size;
+
+	if (c->compress) {
+		bool delta = c->video.num % MP_CACHE_KEYFRAME_INTERVAL != 0;
+		size_t encoded_size;
+
+		if (delta) {
+			for (size_t i = 0; i < size; i++)
+				c->prev[i] ^= data[i];
+		}
+
+		encoded_size = rle_encode(c->encoded, delta ? c->prev : data,
+					  size);
+		memcpy(c->prev, data, size);
+
+		if (encoded_size < size) {
+			cf.type = delta ? MP_CACHE_FRAME_DELTA
+					: MP_CACHE_FRAME_INTRA;
+			data = c->encoded;
+			size = encoded_size;
+		}
+	}
+
+	if (!mp_cache_reserve(c, size))
+		return false;
+
+	cf.data = bmemdup(data, size);
+	cf.size = (uint32_t)size;
+	da_push_back(c->video, &cf);
+	return true;
+}
+
+bool mp_cache_add_audio(struct mp_cache *c, const struct obs_source_audio *audio,
+			int64_t pts)
+{
+	struct mp_cache_audio ca = {.pts = pts, .frames = audio->frames};
+
+	if (c->full)
+		return false;
+
+	if (!c->audio.num) {
+		c->audio_format = audio->format;
+		c->speakers = audio->speakers;
+		c->samples_per_sec = audio->samples_per_sec;
+		c->audio_planes = get_audio_planes(audio->format,
+						   audio->speakers);
+	} else if (audio->format != c->audio_format ||
+		   audio->speakers != c->speakers ||
+		   audio->samples_per_sec != c->samples_per_sec) {
+		return true;
+	}
+
+	if (!c->audio_planes || !audio->frames)
+		return true;
+
+	size_t plane_size =
+		get_audio_size(c->audio_format, c->speakers, audio->frames);
+	size_t size = plane_size * c->audio_planes;
+
+	if (!mp_cache_reserve(c, size))
+		return false;
+
+	ca.data = bmalloc(size);
+	for (size_t i = 0; i < c->audio_planes; i++)
+		memcpy(ca.data + i * plane_size, audio->data[i], plane_size);
+
+	da_push_back(c->audio, &ca);
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static bool decode_frame(struct mp_cache *c, size_t idx)
+{
+	size_t start = idx;
+
+	if (c->decoded_idx == idx)
+		return true;
+
+	if (!c->decoded)
+		c->decoded = bmalloc(c->frame_size);
+
+	/* frames are usually played in order, only seeking has to go back
+	 * to the last full frame */
+	if (c->decoded_idx == SIZE_MAX || c->decoded_idx + 1 != idx) {
+		while (start > 0 &&
+		       c->video.array[start].type == MP_CACHE_FRAME_DELTA)
+			start--;
+	}
+
+	for (size_t i = start; i <= idx; i++) {
+		const struct mp_cache_frame *cf = c->video.array + i;
+		bool success = true;
+
+		if (cf->type == MP_CACHE_FRAME_RAW)
+			memcpy(c->decoded, cf->data, c->frame_size);
+		else
+			success = rle_decode(c->decoded, c->frame_size,
+					     cf->data, cf->size,
+					     cf->type == MP_CACHE_FRAME_DELTA);
+
+		if (!success) {
+			c->decoded_idx = SIZE_MAX;
+			return false;
+		}
+	}
+
+	c->decoded_idx = idx;
+	return true;
+}
+
+bool mp_cache_get_video(struct mp_cache *c, size_t idx,
+			struct obs_source_frame *frame)
+{
+	const struct mp_cache_frame *cf;
+	uint8_t *planes[MAX_AV_PLANES];
+
+	if (idx >= c->video.num)
+		return false;
+
+	cf = c->video.array + idx;
+
+	if (cf->type == MP_CACHE_FRAME_RAW) {
+		get_planes(c, cf->data, planes);
+	} else {
+		if (!decode_frame(c, idx))
+			return false;
+		get_planes(c, c->decoded, planes);
+	}
+
+	*frame = c->info;
+	for (size_t i = 0; i < MAX_AV_PLANES; i++)
+		frame->data[i] = planes[i];
+
+	return true;
+}
+
+void mp_cache_get_audio(struct mp_cache *c, size_t idx,
+			struct obs_source_audio *audio)
+{
+	const struct mp_cache_audio *ca = c->audio.array + idx;
+	size_t plane_size =
+		get_audio_size(c->audio_format, c->speakers, ca->frames);
+
+	memset(audio, 0, sizeof(*audio));
+
+	for (size_t i = 0; i < c->audio_planes; i++)
+		audio->data[i] = ca->data + i * plane_size;
+
+	audio->frames = ca->frames;
+	audio->format = c->audio_format;
+	audio->speakers = c->speakers;
+	audio->samples_per_sec = c->samples_per_sec;
+}
+
+/* index of the last item with a pts at or before the given one, pts is the
+ * first member of both the video and the audio items */
+static size_t find_last_before(const void *items, size_t count,
+			       size_t item_size, int64_t pts)
+{
+	const uint8_t *array = items;
+	size_t lo = 0;
+	size_t hi = count;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const int64_t *item_pts =
+			(const int64_t *)(array + mid * item_size);
+
+		if (*item_pts <= pts)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo ? lo - 1 : 0;
+}
+
+size_t mp_cache_find_video(const struct mp_cache *c, int64_t pts)
+{
+	return find_last_before(c->video.array, c->video.num,
+				sizeof(*c->video.array), pts);
+}
+
+size_t mp_cache_find_audio(const struct mp_cache *c, int64_t pts)
+{
+	return find_last_before(c->audio.array, c->audio.num,
+				sizeof(*c->audio.array), pts);
+}
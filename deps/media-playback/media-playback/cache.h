@@ -0,0 +1,107 @@
+#pragma once
+
+#include <obs.h>
+#include <util/darray.h>
+#include <media-io/video-scaler.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum mp_cache_frame_type {
+	MP_CACHE_FRAME_RAW,
+	MP_CACHE_FRAME_INTRA,
+	MP_CACHE_FRAME_DELTA,
+};
+
+struct mp_cache_frame {
+	int64_t pts;
+	uint8_t *data;
+	uint32_t size;
+	enum mp_cache_frame_type type;
+};
+
+struct mp_cache_audio {
+	int64_t pts;
+	uint8_t *data;
+	uint32_t frames;
+};
+
+/*
+ * Fully decoded media, stored as NV12/P010 or RGBA (formats the GPU can take
+ * as-is) with tightly packed planes.  Optionally each frame is run length
+ * encoded against the previous one, with a full frame every
+ * MP_CACHE_KEYFRAME_INTERVAL frames.
+ *
+ * The store is filled once and is read-only afterwards, so playback needs no
+ * locking.  Only the decompression buffer is owned by the playback thread.
+ */
+struct mp_cache {
+	bool compress;
+	uint64_t mem_usage;
+	uint64_t max_mem_usage;
+
+	/* video, every frame has the format and color info of the first */
+	struct obs_source_frame info;
+	enum video_format src_format;
+	uint32_t plane_sizes[MAX_AV_PLANES];
+	uint32_t frame_size;
+	DARRAY(struct mp_cache_frame) video;
+
+	/* audio */
+	enum audio_format audio_format;
+	enum speaker_layout speakers;
+	uint32_t samples_per_sec;
+	size_t audio_planes;
+	DARRAY(struct mp_cache_audio) audio;
+
+	/* used while filling */
+	video_scaler_t *scaler;
+	bool video_failed;
+	uint8_t *converted;
+	uint8_t *prev;
+	uint8_t *encoded;
+	bool full;
+
+	/* used while playing */
+	uint8_t *decoded;
+	size_t decoded_idx;
+};
+
+extern void mp_cache_init(struct mp_cache *cache, bool compress,
+			  uint64_t max_mem_usage);
+extern void mp_cache_free(struct mp_cache *cache);
+
+/**
+ * Adds a video frame.  Frames with a different size than the first one are
+ * dropped.
+ *
+ * @return false if the cache ran out of its memory budget
+ */
+extern bool mp_cache_add_video(struct mp_cache *cache,
+			       const struct obs_source_frame *frame,
+			       int64_t pts, enum video_colorspace space,
+			       enum video_range_type range);
+extern bool mp_cache_add_audio(struct mp_cache *cache,
+			       const struct obs_source_audio *audio,
+			       int64_t pts);
+
+/** Frees everything that is only needed while filling the cache */
+extern void mp_cache_finish(struct mp_cache *cache);
+
+/**
+ * Fills frame with the cached frame at idx.  The data stays valid until the
+ * next call.
+ */
+extern bool mp_cache_get_video(struct mp_cache *cache, size_t idx,
+			       struct obs_source_frame *frame);
+extern void mp_cache_get_audio(struct mp_cache *cache, size_t idx,
+			       struct obs_source_audio *audio);
+
+/** Index of the frame presented at pts, the last one with a pts <= pts */
+extern size_t mp_cache_find_video(const struct mp_cache *cache, int64_t pts);
+extern size_t mp_cache_find_audio(const struct mp_cache *cache, int64_t pts);
+
+#ifdef __cplusplus
+}
+#endif
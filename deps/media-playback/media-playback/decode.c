@@ -17,6 +17,9 @@
 #include "decode.h"
 
 #include "media.h"
+#include "closest-format.h"
+#include <util/platform.h>
+#include <libavutil/imgutils.h>
 #include <libavutil/mastering_display_metadata.h>
 
 #if LIBAVCODEC_VERSION_INT > AV_VERSION_INT(58, 4, 100)
@@ -109,6 +112,11 @@ static int mp_open_codec(struct mp_decode *d, bool hw)
 	    c->codec_id != AV_CODEC_ID_MPEG4 && c->codec_id != AV_CODEC_ID_WEBP)
 		c->thread_count = 0;
 
+	/* frames are decoded ahead of presentation, so the added delay of
+	 * frame threading does not matter */
+	if (!d->hw && c->thread_count != 1)
+		c->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
 	ret = avcodec_open2(c, d->codec, NULL);
 	if (ret < 0)
 		goto fail;
@@ -151,111 +159,100 @@ static uint16_t get_max_luminance(const AVStream *stream)
 	return max_luminance;
 }
 
-bool mp_decode_init(mp_media_t *m, enum AVMediaType type, bool hw)
-{
-	struct mp_decode *d = type == AVMEDIA_TYPE_VIDEO ? &m->v : &m->a;
-	enum AVCodecID id;
-	AVStream *stream;
-	int ret;
-
-	memset(d, 0, sizeof(*d));
-	d->m = m;
-	d->audio = type == AVMEDIA_TYPE_AUDIO;
+extern void mp_media_free_packet(mp_media_t *m, AVPacket *pkt);
 
-	ret = av_find_best_stream(m->fmt, type, -1, -1, NULL, 0);
-	if (ret < 0)
-		return false;
-	stream = d->stream = m->fmt->streams[ret];
+/* call with the mutex held */
+static void mp_decode_release_frame(struct mp_decode *d,
+				    struct mp_decoded_frame *item)
+{
+	if (item->buffer >= 0)
+		d->buffers[item->buffer].used = false;
 
-#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(57, 40, 101)
-	id = stream->codecpar->codec_id;
-#else
-	id = stream->codec->codec_id;
-#endif
+	av_frame_free(&item->frame);
+	item->buffer = -1;
+}
 
-	if (type == AVMEDIA_TYPE_VIDEO)
-		d->max_luminance = get_max_luminance(stream);
+/* decoder state must not be in use, either decode_mutex is held or the
+ * decode thread is not running */
+void mp_decode_clear_packets(struct mp_decode *d)
+{
+	DARRAY(AVPacket *) packets;
 
-	if (id == AV_CODEC_ID_VP8 || id == AV_CODEC_ID_VP9) {
-		AVDictionaryEntry *tag = NULL;
-		tag = av_dict_get(stream->metadata, "alpha_mode", tag,
-				  AV_DICT_IGNORE_SUFFIX);
+	da_init(packets);
 
-		if (tag && strcmp(tag->value, "1") == 0) {
-			char *codec = (id == AV_CODEC_ID_VP8) ? "libvpx"
-							      : "libvpx-vp9";
-			d->codec = avcodec_find_decoder_by_name(codec);
-		}
+	if (d->packet_pending) {
+		av_packet_unref(d->orig_pkt);
+		d->packet_pending = false;
 	}
 
-	if (!d->codec)
-		d->codec = avcodec_find_decoder(id);
-
-	if (!d->codec) {
-		blog(LOG_WARNING, "MP: Failed to find %s codec",
-		     av_get_media_type_string(type));
-		return false;
-	}
+	pthread_mutex_lock(&d->mutex);
 
-	ret = mp_open_codec(d, hw);
-	if (ret < 0) {
-		blog(LOG_WARNING, "MP: Failed to open %s decoder: %s",
-		     av_get_media_type_string(type), av_err2str(ret));
-		return false;
+	while (d->packets.size) {
+		AVPacket *pkt;
+		circlebuf_pop_front(&d->packets, &pkt, sizeof(pkt));
+		da_push_back(packets, &pkt);
 	}
 
-	d->sw_frame = av_frame_alloc();
-	if (!d->sw_frame) {
-		blog(LOG_WARNING, "MP: Failed to allocate %s frame",
-		     av_get_media_type_string(type));
-		return false;
+	while (d->frames.size) {
+		struct mp_decoded_frame item;
+		circlebuf_pop_front(&d->frames, &item, sizeof(item));
+		mp_decode_release_frame(d, &item);
 	}
 
-	if (d->hw) {
-		d->hw_frame = av_frame_alloc();
-		if (!d->hw_frame) {
-			blog(LOG_WARNING, "MP: Failed to allocate %s hw frame",
-			     av_get_media_type_string(type));
-			return false;
-		}
+	d->input_eof = false;
+	d->decode_eof = false;
 
-		d->in_frame = d->hw_frame;
-	} else {
-		d->in_frame = d->sw_frame;
-	}
+	pthread_mutex_unlock(&d->mutex);
 
-	if (d->codec->capabilities & CODEC_CAP_TRUNC)
-		d->decoder->flags |= CODEC_FLAG_TRUNC;
+	for (size_t i = 0; i < packets.num; i++)
+		mp_media_free_packet(d->m, packets.array[i]);
+	da_free(packets);
+}
 
-	d->orig_pkt = av_packet_alloc();
-	d->pkt = av_packet_alloc();
+/* decode_mutex must be held, or the decode thread not running */
+static void mp_decode_clear_preroll(struct mp_decode *d)
+{
+	for (size_t i = 0; i < d->preroll.num; i++)
+		av_frame_free(&d->preroll.array[i].frame);
+	da_free(d->preroll);
 
-	return true;
+	d->preroll_complete = false;
 }
 
-extern void mp_media_free_packet(mp_media_t *m, AVPacket *pkt);
-
-void mp_decode_clear_packets(struct mp_decode *d)
+static void mp_decode_stop_thread(struct mp_decode *d)
 {
-	if (d->packet_pending) {
-		av_packet_unref(d->orig_pkt);
-		d->packet_pending = false;
-	}
-
-	while (d->packets.size) {
-		AVPacket *pkt;
-		circlebuf_pop_front(&d->packets, &pkt, sizeof(pkt));
-		mp_media_free_packet(d->m, pkt);
+	if (d->thread_valid) {
+		os_atomic_set_bool(&d->kill, true);
+		os_event_signal(d->event);
+		pthread_join(d->thread, NULL);
+		d->thread_valid = false;
 	}
 }
 
 void mp_decode_free(struct mp_decode *d)
 {
+	mp_decode_stop_thread(d);
+
+	/* unreferences a pending orig_pkt, so it goes before the packets are
+	 * freed */
+	if (d->m) {
+		mp_decode_clear_packets(d);
+
+		pthread_mutex_lock(&d->mutex);
+		mp_decode_release_frame(d, &d->cur);
+		pthread_mutex_unlock(&d->mutex);
+	}
+
 	av_packet_free(&d->pkt);
 	av_packet_free(&d->orig_pkt);
 
-	mp_decode_clear_packets(d);
 	circlebuf_free(&d->packets);
+	circlebuf_free(&d->frames);
+	mp_decode_clear_preroll(d);
+
+	for (size_t i = 0; i < MP_MAX_VIDEO_FRAMES + 1; i++)
+		av_freep(&d->buffers[i].data[0]);
+	sws_freeContext(d->swscale);
 
 	if (d->hw_frame) {
 		av_frame_unref(d->hw_frame);
@@ -276,12 +273,68 @@ void mp_decode_free(struct mp_decode *d)
 	}
 #endif
 
+	if (d->m) {
+		os_event_destroy(d->event);
+		pthread_mutex_destroy(&d->mutex);
+		pthread_mutex_destroy(&d->decode_mutex);
+	}
+
 	memset(d, 0, sizeof(*d));
 }
 
 void mp_decode_push_packet(struct mp_decode *decode, AVPacket *packet)
 {
+	pthread_mutex_lock(&decode->mutex);
 	circlebuf_push_back(&decode->packets, &packet, sizeof(packet));
+	pthread_mutex_unlock(&decode->mutex);
+
+	os_event_signal(decode->event);
+}
+
+void mp_decode_set_eof(struct mp_decode *d, bool eof)
+{
+	pthread_mutex_lock(&d->mutex);
+	d->input_eof = eof;
+	pthread_mutex_unlock(&d->mutex);
+
+	os_event_signal(d->event);
+}
+
+/* keeps enough packets queued for the decode thread to stay busy */
+#define MIN_QUEUED_PACKETS 8
+
+static inline size_t queued_packets(const struct mp_decode *d)
+{
+	return d->packets.size / sizeof(AVPacket *);
+}
+
+static inline size_t queued_frames(const struct mp_decode *d)
+{
+	return d->frames.size / sizeof(struct mp_decoded_frame);
+}
+
+bool mp_decode_wants_packets(struct mp_decode *d)
+{
+	bool wants;
+
+	pthread_mutex_lock(&d->mutex);
+	wants = !d->input_eof && !d->decode_eof &&
+		queued_packets(d) < MIN_QUEUED_PACKETS &&
+		queued_frames(d) < d->max_frames;
+	pthread_mutex_unlock(&d->mutex);
+
+	return wants;
+}
+
+size_t mp_decode_queued_packets(struct mp_decode *d)
+{
+	size_t count;
+
+	pthread_mutex_lock(&d->mutex);
+	count = queued_packets(d);
+	pthread_mutex_unlock(&d->mutex);
+
+	return count;
 }
 
 static inline int64_t get_estimated_duration(struct mp_decode *d,
@@ -293,7 +346,7 @@ static inline int64_t get_estimated_duration(struct mp_decode *d,
 				    (AVRational){1, 1000000000});
 	} else {
 		if (last_pts)
-			return d->frame_pts - last_pts;
+			return d->decode_pts - last_pts;
 
 		if (d->last_duration)
 			return d->last_duration;
@@ -341,7 +394,7 @@ static int decode_packet(struct mp_decode *d, int *got_frame)
 #ifdef USE_NEW_HARDWARE_CODEC_METHOD
 	if (*got_frame && d->hw) {
 		if (d->hw_frame->format != d->hw_format) {
-			d->frame = d->hw_frame;
+			d->out_frame = d->hw_frame;
 			return ret;
 		}
 
@@ -359,104 +412,406 @@ static int decode_packet(struct mp_decode *d, int *got_frame)
 	}
 #endif
 
-	d->frame = d->sw_frame;
+	d->out_frame = d->sw_frame;
 	return ret;
 }
 
-bool mp_decode_next(struct mp_decode *d)
+static inline int get_sws_colorspace(enum AVColorSpace cs)
+{
+	switch (cs) {
+	case AVCOL_SPC_BT709:
+		return SWS_CS_ITU709;
+	case AVCOL_SPC_FCC:
+		return SWS_CS_FCC;
+	case AVCOL_SPC_BT470BG:
+		return SWS_CS_ITU624;
+	case AVCOL_SPC_SMPTE170M:
+		return SWS_CS_SMPTE170M;
+	case AVCOL_SPC_SMPTE240M:
+		return SWS_CS_SMPTE240M;
+	case AVCOL_SPC_BT2020_NCL:
+		return SWS_CS_BT2020;
+	default:
+		break;
+	}
+
+	return SWS_CS_ITU709;
+}
+
+static inline int get_sws_range(enum AVColorRange r)
+{
+	return r == AVCOL_RANGE_JPEG ? 1 : 0;
+}
+
+#define FIXED_1_0 (1 << 16)
+
+/* converts the decoded frame into a free scale buffer */
+static bool mp_decode_scale(struct mp_decode *d, AVFrame *out,
+			    enum AVPixelFormat format, int *buffer)
+{
+	const AVFrame *in = d->out_frame;
+	struct mp_scale_buffer *buf = NULL;
+	int idx = -1;
+
+	pthread_mutex_lock(&d->mutex);
+	for (int i = 0; i < MP_MAX_VIDEO_FRAMES + 1; i++) {
+		if (!d->buffers[i].used) {
+			d->buffers[i].used = true;
+			idx = i;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&d->mutex);
+
+	if (idx < 0)
+		return false;
+
+	buf = &d->buffers[idx];
+
+	if (!buf->data[0] || buf->width != in->width ||
+	    buf->height != in->height || buf->format != format) {
+		av_freep(&buf->data[0]);
+
+		int ret = av_image_alloc(buf->data, buf->linesize, in->width,
+					 in->height, format, 32);
+		if (ret < 0) {
+			blog(LOG_WARNING,
+			     "MP: Failed to create scale pic data");
+			goto fail;
+		}
+
+		buf->width = in->width;
+		buf->height = in->height;
+		buf->format = format;
+	}
+
+	struct SwsContext *swscale = sws_getCachedContext(
+		d->swscale, in->width, in->height, in->format, in->width,
+		in->height, format, SWS_POINT, NULL, NULL, NULL);
+	if (!swscale) {
+		blog(LOG_WARNING, "MP: Failed to initialize scaler");
+		goto fail;
+	}
+
+	int space = get_sws_colorspace(in->colorspace);
+	int range = get_sws_range(in->color_range);
+
+	if (swscale != d->swscale || space != d->sws_space ||
+	    range != d->sws_range) {
+		const int *coeff = sws_getCoefficients(space);
+
+		sws_setColorspaceDetails(swscale, coeff, range, coeff, range,
+					 0, FIXED_1_0, FIXED_1_0);
+		d->swscale = swscale;
+		d->sws_space = space;
+		d->sws_range = range;
+	}
+
+	int ret = sws_scale(swscale, (const uint8_t *const *)in->data,
+			    in->linesize, 0, in->height, buf->data,
+			    buf->linesize);
+	if (ret < 0)
+		goto fail;
+
+	av_frame_copy_props(out, in);
+	out->format = format;
+	out->width = in->width;
+	out->height = in->height;
+	for (size_t i = 0; i < 4; i++) {
+		out->data[i] = buf->data[i];
+		out->linesize[i] = buf->linesize[i];
+	}
+
+	*buffer = idx;
+	return true;
+
+fail:
+	pthread_mutex_lock(&d->mutex);
+	buf->used = false;
+	pthread_mutex_unlock(&d->mutex);
+	return false;
+}
+
+static AVFrame *mp_decode_copy_frame(const AVFrame *src)
+{
+	AVFrame *dst;
+
+	/* frames converted into scale buffers are not reference counted */
+	if (src->buf[0])
+		return av_frame_clone(src);
+
+	dst = av_frame_alloc();
+	if (!dst)
+		return NULL;
+
+	dst->format = src->format;
+	dst->width = src->width;
+	dst->height = src->height;
+
+	if (av_frame_get_buffer(dst, 0) < 0 || av_frame_copy(dst, src) < 0 ||
+	    av_frame_copy_props(dst, src) < 0)
+		av_frame_free(&dst);
+
+	return dst;
+}
+
+static inline void mp_decode_finish_preroll(struct mp_decode *d,
+					    int64_t end_pts)
+{
+	d->preroll_end_pts = end_pts;
+	d->preroll_recording = false;
+	d->preroll_complete = true;
+}
+
+static void mp_decode_record_preroll(struct mp_decode *d,
+				     const struct mp_decoded_frame *item)
+{
+	struct mp_decoded_frame copy = *item;
+	int64_t start = d->preroll.num ? d->preroll.array[0].pts : item->pts;
+
+	if (item->pts - start >= d->preroll_duration) {
+		mp_decode_finish_preroll(d, item->pts);
+		return;
+	}
+
+	copy.frame = mp_decode_copy_frame(item->frame);
+	copy.buffer = -1;
+
+	if (!copy.frame) {
+		mp_decode_clear_preroll(d);
+		d->preroll_recording = false;
+		return;
+	}
+
+	da_push_back(d->preroll, &copy);
+}
+
+static void mp_decode_push_frame(struct mp_decode *d)
 {
-	bool eof = d->m->eof;
+	struct mp_decoded_frame item = {.buffer = -1};
+	int64_t last_pts = d->decode_pts;
+
+	if (d->in_frame->best_effort_timestamp == AV_NOPTS_VALUE)
+		d->decode_pts = d->decode_next_pts;
+	else
+		d->decode_pts =
+			av_rescale_q(d->in_frame->best_effort_timestamp,
+				     d->stream->time_base,
+				     (AVRational){1, 1000000000});
+
+	int64_t duration = d->in_frame->pkt_duration;
+	if (!duration)
+		duration = get_estimated_duration(d, last_pts);
+	else
+		duration = av_rescale_q(duration, d->stream->time_base,
+					(AVRational){1, 1000000000});
+
+	if (d->m->speed != 100) {
+		d->decode_pts = av_rescale_q(d->decode_pts,
+					     (AVRational){1, d->m->speed},
+					     (AVRational){1, 100});
+		duration = av_rescale_q(duration, (AVRational){1, d->m->speed},
+					(AVRational){1, 100});
+	}
+
+	d->last_duration = duration;
+	d->decode_next_pts = d->decode_pts + duration;
+
+	/* already presented from the preroll cache */
+	if (d->decode_pts < d->skip_pts)
+		return;
+
+	item.pts = d->decode_pts;
+	item.next_pts = d->decode_next_pts;
+	item.frame = av_frame_alloc();
+	if (!item.frame)
+		return;
+
+	enum AVPixelFormat format = d->out_frame->format;
+	if (!d->audio)
+		format = closest_format(format);
+
+	if (format != d->out_frame->format) {
+		if (!mp_decode_scale(d, item.frame, format, &item.buffer)) {
+			av_frame_free(&item.frame);
+			return;
+		}
+	} else {
+		av_frame_move_ref(item.frame, d->out_frame);
+	}
+
+	if (d->preroll_recording)
+		mp_decode_record_preroll(d, &item);
+
+	pthread_mutex_lock(&d->mutex);
+	circlebuf_push_back(&d->frames, &item, sizeof(item));
+	pthread_mutex_unlock(&d->mutex);
+
+	os_event_signal(d->m->decode_event);
+}
+
+/* decodes the next packet, returns false if there is nothing to do */
+static bool mp_decode_step(struct mp_decode *d)
+{
+	AVPacket *consumed = NULL;
 	int got_frame;
 	int ret;
 
-	d->frame_ready = false;
+	pthread_mutex_lock(&d->mutex);
 
-	if (!eof && !d->packets.size)
-		return true;
+	if (d->decode_eof || queued_frames(d) >= d->max_frames) {
+		pthread_mutex_unlock(&d->mutex);
+		return false;
+	}
 
-	while (!d->frame_ready) {
-		if (!d->packet_pending) {
-			if (!d->packets.size) {
-				if (eof) {
-					d->pkt->data = NULL;
-					d->pkt->size = 0;
-				} else {
-					return true;
-				}
-			} else {
-				mp_media_free_packet(d->m, d->orig_pkt);
-				circlebuf_pop_front(&d->packets, &d->orig_pkt,
-						    sizeof(d->orig_pkt));
-				av_packet_ref(d->pkt, d->orig_pkt);
-				d->packet_pending = true;
+	if (!d->packet_pending) {
+		if (!d->packets.size) {
+			if (!d->input_eof) {
+				pthread_mutex_unlock(&d->mutex);
+				return false;
 			}
+
+			d->pkt->data = NULL;
+			d->pkt->size = 0;
+		} else {
+			consumed = d->orig_pkt;
+			circlebuf_pop_front(&d->packets, &d->orig_pkt,
+					    sizeof(d->orig_pkt));
+			av_packet_ref(d->pkt, d->orig_pkt);
+			d->packet_pending = true;
 		}
+	}
 
-		ret = decode_packet(d, &got_frame);
+	pthread_mutex_unlock(&d->mutex);
 
-		if (!got_frame && ret == 0) {
-			d->eof = true;
-			return true;
-		}
-		if (ret < 0) {
+	if (consumed)
+		mp_media_free_packet(d->m, consumed);
+
+	ret = decode_packet(d, &got_frame);
+
+	if (!got_frame && ret == 0) {
+		/* the whole file fits in the preroll cache */
+		if (d->preroll_recording)
+			mp_decode_finish_preroll(d, INT64_MAX);
+
+		pthread_mutex_lock(&d->mutex);
+		d->decode_eof = true;
+		pthread_mutex_unlock(&d->mutex);
+
+		os_event_signal(d->m->decode_event);
+		return false;
+	}
+	if (ret < 0) {
 #ifdef DETAILED_DEBUG_INFO
-			blog(LOG_DEBUG, "MP: decode failed: %s",
-			     av_err2str(ret));
+		blog(LOG_DEBUG, "MP: decode failed: %s", av_err2str(ret));
 #endif
 
-			if (d->packet_pending) {
-				av_packet_unref(d->orig_pkt);
-				av_packet_unref(d->pkt);
-				d->packet_pending = false;
-			}
-			return true;
+		if (d->packet_pending) {
+			av_packet_unref(d->orig_pkt);
+			av_packet_unref(d->pkt);
+			d->packet_pending = false;
 		}
+		return true;
+	}
 
-		d->frame_ready = !!got_frame;
-
-		if (d->packet_pending) {
-			if (d->pkt->size) {
-				d->pkt->data += ret;
-				d->pkt->size -= ret;
-			}
+	if (d->packet_pending) {
+		if (d->pkt->size) {
+			d->pkt->data += ret;
+			d->pkt->size -= ret;
+		}
 
-			if (d->pkt->size <= 0) {
-				av_packet_unref(d->orig_pkt);
-				av_packet_unref(d->pkt);
-				d->packet_pending = false;
-			}
+		if (d->pkt->size <= 0) {
+			av_packet_unref(d->orig_pkt);
+			av_packet_unref(d->pkt);
+			d->packet_pending = false;
 		}
 	}
 
-	if (d->frame_ready) {
-		int64_t last_pts = d->frame_pts;
-
-		if (d->in_frame->best_effort_timestamp == AV_NOPTS_VALUE)
-			d->frame_pts = d->next_pts;
-		else
-			d->frame_pts =
-				av_rescale_q(d->in_frame->best_effort_timestamp,
-					     d->stream->time_base,
-					     (AVRational){1, 1000000000});
-
-		int64_t duration = d->in_frame->pkt_duration;
-		if (!duration)
-			duration = get_estimated_duration(d, last_pts);
-		else
-			duration = av_rescale_q(duration, d->stream->time_base,
-						(AVRational){1, 1000000000});
-
-		if (d->m->speed != 100) {
-			d->frame_pts = av_rescale_q(
-				d->frame_pts, (AVRational){1, d->m->speed},
-				(AVRational){1, 100});
-			duration = av_rescale_q(duration,
-						(AVRational){1, d->m->speed},
-						(AVRational){1, 100});
+	if (got_frame)
+		mp_decode_push_frame(d);
+
+	return true;
+}
+
+static void *mp_decode_thread(void *opaque)
+{
+	struct mp_decode *d = opaque;
+
+	os_set_thread_name(d->audio ? "mp_audio_decode" : "mp_video_decode");
+
+	while (os_event_wait(d->event) == 0) {
+		if (os_atomic_load_bool(&d->kill))
+			break;
+
+		for (;;) {
+			bool progress;
+
+			/* let mp_decode_flush have the decoder */
+			if (os_atomic_load_bool(&d->flushing) ||
+			    os_atomic_load_bool(&d->kill))
+				break;
+
+			pthread_mutex_lock(&d->decode_mutex);
+			progress = mp_decode_step(d);
+			pthread_mutex_unlock(&d->decode_mutex);
+
+			if (!progress)
+				break;
 		}
+	}
+
+	return NULL;
+}
+
+static bool mp_decode_start_thread(struct mp_decode *d)
+{
+	if (pthread_mutex_init(&d->mutex, NULL) != 0)
+		return false;
+	if (pthread_mutex_init(&d->decode_mutex, NULL) != 0)
+		return false;
+	if (os_event_init(&d->event, OS_EVENT_TYPE_AUTO) != 0)
+		return false;
+	if (pthread_create(&d->thread, NULL, mp_decode_thread, d) != 0)
+		return false;
 
-		d->last_duration = duration;
-		d->next_pts = d->frame_pts + duration;
+	d->thread_valid = true;
+	return true;
+}
+
+bool mp_decode_next(struct mp_decode *d)
+{
+	struct mp_decoded_frame item;
+	bool got_frame = false;
+
+	d->frame_ready = false;
+
+	pthread_mutex_lock(&d->mutex);
+
+	/* the previous frame has been output by now */
+	mp_decode_release_frame(d, &d->cur);
+	d->frame = NULL;
+
+	if (d->preroll_playing && d->preroll_pos < d->preroll.num) {
+		item = d->preroll.array[d->preroll_pos++];
+		item.frame = av_frame_clone(item.frame);
+		got_frame = item.frame != NULL;
+	} else if (d->frames.size) {
+		circlebuf_pop_front(&d->frames, &item, sizeof(item));
+		got_frame = true;
+	} else if (d->decode_eof) {
+		d->eof = true;
+	}
+
+	pthread_mutex_unlock(&d->mutex);
+
+	if (got_frame) {
+		os_event_signal(d->event);
+
+		d->cur = item;
+		d->frame = item.frame;
+		d->frame_pts = item.pts;
+		d->next_pts = item.next_pts;
+		d->frame_ready = true;
 	}
 
 	return true;
@@ -464,10 +819,144 @@ bool mp_decode_next(struct mp_decode *d)
 
 void mp_decode_flush(struct mp_decode *d)
 {
+	os_atomic_set_bool(&d->flushing, true);
+	pthread_mutex_lock(&d->decode_mutex);
+
 	avcodec_flush_buffers(d->decoder);
 	mp_decode_clear_packets(d);
+	d->decode_pts = 0;
+	d->decode_next_pts = 0;
+	d->skip_pts = INT64_MIN;
+
+	/* an incomplete preroll is useless after a seek */
+	if (d->preroll_recording) {
+		mp_decode_clear_preroll(d);
+		d->preroll_recording = false;
+	}
+
+	pthread_mutex_unlock(&d->decode_mutex);
+	os_atomic_set_bool(&d->flushing, false);
+
+	pthread_mutex_lock(&d->mutex);
+	mp_decode_release_frame(d, &d->cur);
+	pthread_mutex_unlock(&d->mutex);
+
+	d->frame = NULL;
 	d->eof = false;
 	d->frame_pts = 0;
 	d->frame_ready = false;
 	d->next_pts = 0;
+	d->preroll_playing = false;
+}
+
+void mp_decode_start_preroll(struct mp_decode *d)
+{
+	if (!d->preroll_duration)
+		return;
+
+	pthread_mutex_lock(&d->decode_mutex);
+
+	if (d->preroll_complete) {
+		d->skip_pts = d->preroll_end_pts;
+		d->preroll_pos = 0;
+		d->preroll_playing = true;
+	} else {
+		mp_decode_clear_preroll(d);
+		d->preroll_recording = true;
+	}
+
+	pthread_mutex_unlock(&d->decode_mutex);
+}
+
+bool mp_decode_init(mp_media_t *m, enum AVMediaType type, bool hw)
+{
+	struct mp_decode *d = type == AVMEDIA_TYPE_VIDEO ? &m->v : &m->a;
+	enum AVCodecID id;
+	AVStream *stream;
+	int ret;
+
+	memset(d, 0, sizeof(*d));
+	d->m = m;
+	d->audio = type == AVMEDIA_TYPE_AUDIO;
+	d->cur.buffer = -1;
+	d->skip_pts = INT64_MIN;
+	pthread_mutex_init_value(&d->mutex);
+	pthread_mutex_init_value(&d->decode_mutex);
+
+	ret = av_find_best_stream(m->fmt, type, -1, -1, NULL, 0);
+	if (ret < 0)
+		return false;
+	stream = d->stream = m->fmt->streams[ret];
+
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(57, 40, 101)
+	id = stream->codecpar->codec_id;
+#else
+	id = stream->codec->codec_id;
+#endif
+
+	if (type == AVMEDIA_TYPE_VIDEO)
+		d->max_luminance = get_max_luminance(stream);
+
+	if (id == AV_CODEC_ID_VP8 || id == AV_CODEC_ID_VP9) {
+		AVDictionaryEntry *tag = NULL;
+		tag = av_dict_get(stream->metadata, "alpha_mode", tag,
+				  AV_DICT_IGNORE_SUFFIX);
+
+		if (tag && strcmp(tag->value, "1") == 0) {
+			char *codec = (id == AV_CODEC_ID_VP8) ? "libvpx"
+							      : "libvpx-vp9";
+			d->codec = avcodec_find_decoder_by_name(codec);
+		}
+	}
+
+	if (!d->codec)
+		d->codec = avcodec_find_decoder(id);
+
+	if (!d->codec) {
+		blog(LOG_WARNING, "MP: Failed to find %s codec",
+		     av_get_media_type_string(type));
+		return false;
+	}
+
+	ret = mp_open_codec(d, hw);
+	if (ret < 0) {
+		blog(LOG_WARNING, "MP: Failed to open %s decoder: %s",
+		     av_get_media_type_string(type), av_err2str(ret));
+		return false;
+	}
+
+	d->sw_frame = av_frame_alloc();
+	if (!d->sw_frame) {
+		blog(LOG_WARNING, "MP: Failed to allocate %s frame",
+		     av_get_media_type_string(type));
+		return false;
+	}
+
+	if (d->hw) {
+		d->hw_frame = av_frame_alloc();
+		if (!d->hw_frame) {
+			blog(LOG_WARNING, "MP: Failed to allocate %s hw frame",
+			     av_get_media_type_string(type));
+			return false;
+		}
+
+		d->in_frame = d->hw_frame;
+	} else {
+		d->in_frame = d->sw_frame;
+	}
+
+	if (d->codec->capabilities & CODEC_CAP_TRUNC)
+		d->decoder->flags |= CODEC_FLAG_TRUNC;
+
+	d->orig_pkt = av_packet_alloc();
+	d->pkt = av_packet_alloc();
+	d->max_frames = d->audio ? MP_MAX_AUDIO_FRAMES : MP_MAX_VIDEO_FRAMES;
+
+	if (!mp_decode_start_thread(d)) {
+		blog(LOG_WARNING, "MP: Failed to create %s decode thread",
+		     av_get_media_type_string(type));
+		return false;
+	}
+
+	return true;
 }
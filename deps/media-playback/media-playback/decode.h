@@ -21,6 +21,7 @@ extern "C" {
 #endif
 
 #include <util/circlebuf.h>
+#include <util/darray.h>
 
 #ifdef _MSC_VER
 #pragma warning(push)
@@ -30,6 +31,7 @@ extern "C" {
 
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
 #include <util/threading.h>
 
 #ifdef _MSC_VER
@@ -46,6 +48,26 @@ extern "C" {
 
 struct mp_media;
 
+#define MP_MAX_VIDEO_FRAMES 8
+#define MP_MAX_AUDIO_FRAMES 32
+
+struct mp_decoded_frame {
+	AVFrame *frame;
+	int64_t pts;
+	int64_t next_pts;
+	int buffer;
+};
+
+/* video frames converted to a format libobs can use */
+struct mp_scale_buffer {
+	uint8_t *data[4];
+	int linesize[4];
+	int width;
+	int height;
+	enum AVPixelFormat format;
+	bool used;
+};
+
 struct mp_decode {
 	struct mp_media *m;
 	AVStream *stream;
@@ -55,24 +77,62 @@ struct mp_decode {
 	AVBufferRef *hw_ctx;
 	AVCodec *codec;
 
-	int64_t last_duration;
+	/* the frame currently presented by the media thread */
+	struct mp_decoded_frame cur;
 	int64_t frame_pts;
 	int64_t next_pts;
+	AVFrame *frame;
+	bool frame_ready;
+	bool eof;
+	bool got_first_keyframe;
+	uint16_t max_luminance;
+
+	/* packets are decoded (and video frames converted) ahead of time on
+	 * the decode thread.  decoder state is only touched with
+	 * decode_mutex held, the queues are protected by mutex. */
+	pthread_t thread;
+	bool thread_valid;
+	os_event_t *event;
+	volatile bool kill;
+	volatile bool flushing;
+	pthread_mutex_t decode_mutex;
+	pthread_mutex_t mutex;
+
+	int64_t last_duration;
+	int64_t decode_pts;
+	int64_t decode_next_pts;
 	AVFrame *in_frame;
 	AVFrame *sw_frame;
 	AVFrame *hw_frame;
-	AVFrame *frame;
+	AVFrame *out_frame;
 	enum AVPixelFormat hw_format;
-	bool got_first_keyframe;
-	bool frame_ready;
-	bool eof;
 	bool hw;
-	uint16_t max_luminance;
+
+	struct SwsContext *swscale;
+	int sws_space;
+	int sws_range;
+	struct mp_scale_buffer buffers[MP_MAX_VIDEO_FRAMES + 1];
 
 	AVPacket *orig_pkt;
 	AVPacket *pkt;
 	bool packet_pending;
 	struct circlebuf packets;
+	struct circlebuf frames;
+	size_t max_frames;
+	bool input_eof;
+	bool decode_eof;
+
+	/* the first decoded frames of the file, kept so restarting can
+	 * present them right away while the decoder skips ahead.  recorded
+	 * on the decode thread, read-only once complete. */
+	DARRAY(struct mp_decoded_frame) preroll;
+	int64_t preroll_duration;
+	int64_t preroll_end_pts;
+	int64_t skip_pts;
+	size_t preroll_pos;
+	bool preroll_recording;
+	bool preroll_complete;
+	bool preroll_playing;
 };
 
 extern bool mp_decode_init(struct mp_media *media, enum AVMediaType type,
@@ -85,6 +145,20 @@ extern void mp_decode_push_packet(struct mp_decode *decode, AVPacket *pkt);
 extern bool mp_decode_next(struct mp_decode *decode);
 extern void mp_decode_flush(struct mp_decode *decode);
 
+/**
+ * Called after mp_decode_flush when decoding starts over from the beginning
+ * of the file.  Presents the cached first frames if they are available,
+ * otherwise starts caching them.
+ */
+extern void mp_decode_start_preroll(struct mp_decode *decode);
+
+/** Tells the decoder whether the demuxer has reached the end of the input */
+extern void mp_decode_set_eof(struct mp_decode *decode, bool eof);
+
+/** Whether the decoder is running low on packets to decode */
+extern bool mp_decode_wants_packets(struct mp_decode *decode);
+extern size_t mp_decode_queued_packets(struct mp_decode *decode);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,365 @@
+#include "keyframe-index.h"
+
+#include <obs.h>
+#include <util/platform.h>
+#include <util/dstr.h>
+#include <sys/stat.h>
+
+#define INDEX_MAGIC 0x494B504D /* "MPKI" */
+#define INDEX_VERSION 2
+
+struct index_header {
+	uint32_t magic;
+	uint32_t version;
+	int64_t file_size;
+	int64_t mtime_ns;
+	int32_t stream_index;
+	int32_t time_base_num;
+	int32_t time_base_den;
+	uint32_t path_len;
+	uint64_t count;
+};
+
+static uint64_t hash_path(const char *path)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	while (*path) {
+		hash ^= (uint8_t)*(path++);
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+static void get_cache_file(struct mp_keyframe_index *index, struct dstr *file)
+{
+	dstr_printf(file, "%s/%016llx.kfi", index->cache_dir,
+		    (unsigned long long)hash_path(index->path));
+}
+
+static bool get_header(struct mp_keyframe_index *index,
+		       struct index_header *header)
+{
+	struct stat st;
+
+	if (os_stat(index->path, &st) != 0)
+		return false;
+
+	memset(header, 0, sizeof(*header));
+	header->magic = INDEX_MAGIC;
+	header->version = INDEX_VERSION;
+	header->file_size = (int64_t)st.st_size;
+#if defined(__APPLE__)
+	header->mtime_ns = (int64_t)st.st_mtimespec.tv_sec * 1000000000 +
+			   st.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+	header->mtime_ns = (int64_t)st.st_mtime * 1000000000;
+#else
+	header->mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 +
+			   st.st_mtim.tv_nsec;
+#endif
+	header->stream_index = index->stream_index;
+	header->time_base_num = index->time_base.num;
+	header->time_base_den = index->time_base.den;
+	header->path_len = (uint32_t)strlen(index->path);
+	return true;
+}
+
+static bool load_cache(struct mp_keyframe_index *index)
+{
+	struct index_header expected;
+	struct index_header header;
+	struct dstr file = {0};
+	char *path = NULL;
+	bool success = false;
+	FILE *f;
+
+	if (!index->cache_dir || !get_header(index, &expected))
+		return false;
+
+	get_cache_file(index, &file);
+	f = os_fopen(file.array, "rb");
+	dstr_free(&file);
+	if (!f)
+		return false;
+
+	if (fread(&header, sizeof(header), 1, f) != 1)
+		goto finish;
+
+	expected.count = header.count;
+	if (memcmp(&header, &expected, sizeof(header)) != 0)
+		goto finish;
+
+	/* different files can share a hash */
+	path = bmalloc(header.path_len + 1);
+	if (fread(path, 1, header.path_len, f) != header.path_len)
+		goto finish;
+	path[header.path_len] = 0;
+	if (strcmp(path, index->path) != 0)
+		goto finish;
+
+	da_resize(index->keyframes, (size_t)header.count);
+	if (fread(index->keyframes.array, sizeof(struct mp_keyframe),
+		  (size_t)header.count, f) != header.count) {
+		da_free(index->keyframes);
+		goto finish;
+	}
+
+	success = header.count > 0;
+
+finish:
+	bfree(path);
+	fclose(f);
+	return success;
+}
+
+static void save_cache(struct mp_keyframe_index *index)
+{
+	struct index_header header;
+	struct dstr file = {0};
+	struct dstr temp = {0};
+	bool success = false;
+	FILE *f;
+
+	if (!index->cache_dir || !get_header(index, &header))
+		return;
+
+	header.count = index->keyframes.num;
+
+	os_mkdirs(index->cache_dir);
+	get_cache_file(index, &file);
+	dstr_copy_dstr(&temp, &file);
+	dstr_cat(&temp, ".tmp");
+
+	f = os_fopen(temp.array, "wb");
+	if (f) {
+		success = fwrite(&header, sizeof(header), 1, f) == 1 &&
+			  fwrite(index->path, 1, header.path_len, f) ==
+				  header.path_len &&
+			  fwrite(index->keyframes.array,
+				 sizeof(struct mp_keyframe),
+				 index->keyframes.num,
+				 f) == index->keyframes.num;
+		fclose(f);
+
+		if (success)
+			success = os_safe_replace(file.array, temp.array,
+						  NULL) == 0;
+		if (!success)
+			os_unlink(temp.array);
+	}
+
+	if (!success)
+		blog(LOG_WARNING, "MP: Failed to save keyframe index '%s'",
+		     file.array);
+
+	dstr_free(&file);
+	dstr_free(&temp);
+}
+
+static int interrupt_callback(void *data)
+{
+	struct mp_keyframe_index *index = data;
+	return os_atomic_load_bool(&index->kill);
+}
+
+static int cmp_keyframe(const void *a, const void *b)
+{
+	const struct mp_keyframe *kf_a = a;
+	const struct mp_keyframe *kf_b = b;
+
+	return kf_a->pts < kf_b->pts ? -1 : (kf_a->pts > kf_b->pts ? 1 : 0);
+}
+
+static void *build_thread(void *data)
+{
+	struct mp_keyframe_index *index = data;
+	DARRAY(struct mp_keyframe) keyframes;
+	AVFormatContext *fmt = NULL;
+	AVPacket *pkt = NULL;
+	uint64_t start = os_gettime_ns();
+
+	os_set_thread_name("mp_keyframe_index");
+	da_init(keyframes);
+
+	fmt = avformat_alloc_context();
+	if (!fmt)
+		return NULL;
+
+	fmt->interrupt_callback.callback = interrupt_callback;
+	fmt->interrupt_callback.opaque = index;
+
+	if (avformat_open_input(&fmt, index->path, NULL, NULL) < 0)
+		return NULL;
+	if (avformat_find_stream_info(fmt, NULL) < 0)
+		goto finish;
+	if (index->stream_index >= (int)fmt->nb_streams)
+		goto finish;
+
+	AVStream *stream = fmt->streams[index->stream_index];
+	if (av_cmp_q(stream->time_base, index->time_base) != 0)
+		goto finish;
+
+	/* only the packet headers of the video stream are needed */
+	for (unsigned int i = 0; i < fmt->nb_streams; i++) {
+		if ((int)i != index->stream_index)
+			fmt->streams[i]->discard = AVDISCARD_ALL;
+	}
+
+	pkt = av_packet_alloc();
+	if (!pkt)
+		goto finish;
+
+	while (!os_atomic_load_bool(&index->kill) &&
+	       av_read_frame(fmt, pkt) >= 0) {
+		if (pkt->stream_index == index->stream_index &&
+		    (pkt->flags & AV_PKT_FLAG_KEY) != 0) {
+			struct mp_keyframe kf = {
+				.pts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts
+								  : pkt->dts,
+				.pos = pkt->pos,
+				.size = pkt->size,
+			};
+
+			if (kf.pts != AV_NOPTS_VALUE)
+				da_push_back(keyframes, &kf);
+		}
+
+		av_packet_unref(pkt);
+	}
+
+	if (os_atomic_load_bool(&index->kill) || !keyframes.num)
+		goto finish;
+
+	qsort(keyframes.array, keyframes.num, sizeof(struct mp_keyframe),
+	      cmp_keyframe);
+
+	pthread_mutex_lock(&index->mutex);
+	da_move(index->keyframes, keyframes);
+	index->ready = true;
+	pthread_mutex_unlock(&index->mutex);
+
+	blog(LOG_DEBUG,
+	     "MP: Built keyframe index of '%s' (%zu keyframes) in %llu ms",
+	     index->path, index->keyframes.num,
+	     (unsigned long long)((os_gettime_ns() - start) / 1000000));
+
+	/* the index does not change anymore once it is ready */
+	save_cache(index);
+
+finish:
+	da_free(keyframes);
+	av_packet_free(&pkt);
+	avformat_close_input(&fmt);
+	return NULL;
+}
+
+void mp_keyframe_index_init(struct mp_keyframe_index *index, const char *path,
+			    const char *cache_dir, const AVStream *stream)
+{
+	memset(index, 0, sizeof(*index));
+	pthread_mutex_init_value(&index->mutex);
+
+	if (pthread_mutex_init(&index->mutex, NULL) != 0)
+		return;
+
+	index->path = bstrdup(path);
+	index->cache_dir = cache_dir && *cache_dir ? bstrdup(cache_dir) : NULL;
+	index->stream_index = stream->index;
+	index->time_base = stream->time_base;
+
+	if (load_cache(index)) {
+		index->ready = true;
+		return;
+	}
+
+	if (pthread_create(&index->thread, NULL, build_thread, index) == 0)
+		index->thread_valid = true;
+}
+
+void mp_keyframe_index_free(struct mp_keyframe_index *index)
+{
+	if (index->thread_valid) {
+		os_atomic_set_bool(&index->kill, true);
+		pthread_join(index->thread, NULL);
+	}
+
+	da_free(index->keyframes);
+	bfree(index->path);
+	bfree(index->cache_dir);
+	pthread_mutex_destroy(&index->mutex);
+
+	memset(index, 0, sizeof(*index));
+	pthread_mutex_init_value(&index->mutex);
+}
+
+static inline int get_index_entry_count(AVStream *stream)
+{
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+	return avformat_index_get_entries_count(stream);
+#else
+	return stream->nb_index_entries;
+#endif
+}
+
+void mp_keyframe_index_apply(struct mp_keyframe_index *index,
+			     AVFormatContext *fmt)
+{
+	if (index->applied || index->stream_index >= (int)fmt->nb_streams)
+		return;
+
+	pthread_mutex_lock(&index->mutex);
+
+	if (index->ready) {
+		AVStream *stream = fmt->streams[index->stream_index];
+
+		/* demuxers with a complete index of their own (mp4 for
+		 * example) are left alone */
+		if (get_index_entry_count(stream) < (int)index->keyframes.num) {
+			for (size_t i = 0; i < index->keyframes.num; i++) {
+				struct mp_keyframe *kf =
+					index->keyframes.array + i;
+				if (kf->pos < 0)
+					continue;
+
+				av_add_index_entry(stream, kf->pos, kf->pts,
+						   kf->size, 0,
+						   AVINDEX_KEYFRAME);
+			}
+		}
+
+		index->applied = true;
+	}
+
+	pthread_mutex_unlock(&index->mutex);
+}
+
+bool mp_keyframe_index_find(struct mp_keyframe_index *index, int64_t pts,
+			    int64_t *keyframe_pts)
+{
+	bool found = false;
+
+	pthread_mutex_lock(&index->mutex);
+
+	if (index->ready && index->keyframes.num &&
+	    index->keyframes.array[0].pts <= pts) {
+		size_t lo = 0;
+		size_t hi = index->keyframes.num;
+
+		/* last keyframe with pts <= the target */
+		while (hi - lo > 1) {
+			size_t mid = lo + (hi - lo) / 2;
+			if (index->keyframes.array[mid].pts <= pts)
+				lo = mid;
+			else
+				hi = mid;
+		}
+
+		*keyframe_pts = index->keyframes.array[lo].pts;
+		found = true;
+	}
+
+	pthread_mutex_unlock(&index->mutex);
+	return found;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <util/darray.h>
+#include <util/threading.h>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#pragma warning(disable : 4204)
+#endif
+
+#include <libavformat/avformat.h>
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+struct mp_keyframe {
+	int64_t pts;
+	int64_t pos;
+	int size;
+};
+
+/*
+ * Keyframe positions of the video stream of a local file.  The index is
+ * built by demuxing the whole file once on a separate thread (no decoding),
+ * and is stored in the cache directory so it is only built once per file.
+ */
+struct mp_keyframe_index {
+	char *path;
+	char *cache_dir;
+	int stream_index;
+	AVRational time_base;
+
+	pthread_mutex_t mutex;
+	pthread_t thread;
+	bool thread_valid;
+	volatile bool kill;
+
+	bool ready;
+	bool applied;
+	DARRAY(struct mp_keyframe) keyframes;
+};
+
+/** Loads the index from the cache or starts building it */
+extern void mp_keyframe_index_init(struct mp_keyframe_index *index,
+				   const char *path, const char *cache_dir,
+				   const AVStream *stream);
+extern void mp_keyframe_index_free(struct mp_keyframe_index *index);
+
+/**
+ * Adds the keyframes to the demuxer's own index once the index is ready,
+ * so seeking does not need to search the file.  Call from the thread that
+ * owns the format context.
+ */
+extern void mp_keyframe_index_apply(struct mp_keyframe_index *index,
+				    AVFormatContext *fmt);
+
+/**
+ * Finds the last keyframe at or before pts (in the stream time base).
+ *
+ * @return false if the index is not ready or pts is before the first
+ *         keyframe
+ */
+extern bool mp_keyframe_index_find(struct mp_keyframe_index *index,
+				   int64_t pts, int64_t *keyframe_pts);
+
+#ifdef __cplusplus
+}
+#endif
@@ -18,12 +18,11 @@
 #include <util/platform.h>
 
 #include <assert.h>
+#include <inttypes.h>
 
 #include "media.h"
-#include "closest-format.h"
 
 #include <libavdevice/avdevice.h>
-#include <libavutil/imgutils.h>
 
 static int64_t base_sys_ts = 0;
 
@@ -161,22 +160,30 @@ static inline struct mp_decode *get_packet_decoder(mp_media_t *media,
 	return NULL;
 }
 
+/* packets are returned to the pool from the decode threads */
 void mp_media_free_packet(struct mp_media *media, AVPacket *pkt)
 {
 	av_packet_unref(pkt);
+
+	pthread_mutex_lock(&media->packet_pool_mutex);
 	da_push_back(media->packet_pool, &pkt);
+	pthread_mutex_unlock(&media->packet_pool_mutex);
 }
 
 static int mp_media_next_packet(mp_media_t *media)
 {
-	AVPacket *pkt;
+	AVPacket *pkt = NULL;
+
+	pthread_mutex_lock(&media->packet_pool_mutex);
 	AVPacket **const cached = da_end(media->packet_pool);
 	if (cached) {
 		pkt = *cached;
 		da_pop_back(media->packet_pool);
-	} else {
-		pkt = av_packet_alloc();
 	}
+	pthread_mutex_unlock(&media->packet_pool_mutex);
+
+	if (!pkt)
+		pkt = av_packet_alloc();
 
 	int ret = av_read_frame(media->fmt, pkt);
 	if (ret < 0) {
@@ -210,61 +217,54 @@ static inline bool mp_decode_frame(struct mp_decode *d)
 	return d->frame_ready || mp_decode_next(d);
 }
 
-static inline int get_sws_colorspace(enum AVColorSpace cs)
+static void mp_media_set_eof(mp_media_t *m, bool eof)
 {
-	switch (cs) {
-	case AVCOL_SPC_BT709:
-		return SWS_CS_ITU709;
-	case AVCOL_SPC_FCC:
-		return SWS_CS_FCC;
-	case AVCOL_SPC_BT470BG:
-		return SWS_CS_ITU624;
-	case AVCOL_SPC_SMPTE170M:
-		return SWS_CS_SMPTE170M;
-	case AVCOL_SPC_SMPTE240M:
-		return SWS_CS_SMPTE240M;
-	case AVCOL_SPC_BT2020_NCL:
-		return SWS_CS_BT2020;
-	default:
-		break;
-	}
+	m->eof = eof;
 
-	return SWS_CS_ITU709;
+	if (m->has_video)
+		mp_decode_set_eof(&m->v, eof);
+	if (m->has_audio)
+		mp_decode_set_eof(&m->a, eof);
 }
 
-static inline int get_sws_range(enum AVColorRange r)
+static inline bool mp_media_waiting_for(struct mp_decode *d, bool has)
 {
-	return r == AVCOL_RANGE_JPEG ? 1 : 0;
+	return has && !d->frame_ready && !d->eof && mp_decode_wants_packets(d);
 }
 
-#define FIXED_1_0 (1 << 16)
+/* stops reading ahead when one stream has this many packets queued */
+#define MAX_QUEUED_PACKETS 512
+#define MAX_READ_AHEAD 32
 
-static bool mp_media_init_scaling(mp_media_t *m)
+static inline bool mp_media_wants_packets(struct mp_decode *d, bool has)
 {
-	int space = get_sws_colorspace(m->v.decoder->colorspace);
-	int range = get_sws_range(m->v.decoder->color_range);
-	const int *coeff = sws_getCoefficients(space);
+	return has && mp_decode_wants_packets(d);
+}
 
-	m->swscale = sws_getCachedContext(NULL, m->v.decoder->width,
-					  m->v.decoder->height,
-					  m->v.decoder->pix_fmt,
-					  m->v.decoder->width,
-					  m->v.decoder->height, m->scale_format,
-					  SWS_POINT, NULL, NULL, NULL);
-	if (!m->swscale) {
-		blog(LOG_WARNING, "MP: Failed to initialize scaler");
-		return false;
-	}
+static inline bool mp_media_packets_full(mp_media_t *m)
+{
+	return (m->has_video &&
+		mp_decode_queued_packets(&m->v) >= MAX_QUEUED_PACKETS) ||
+	       (m->has_audio &&
+		mp_decode_queued_packets(&m->a) >= MAX_QUEUED_PACKETS);
+}
 
-	sws_setColorspaceDetails(m->swscale, coeff, range, coeff, range, 0,
-				 FIXED_1_0, FIXED_1_0);
+/* keeps the decode threads fed, so frames are decoded ahead of the time
+ * they are presented */
+static bool mp_media_read_ahead(mp_media_t *m)
+{
+	for (int i = 0; i < MAX_READ_AHEAD && !m->eof; i++) {
+		if (!mp_media_wants_packets(&m->v, m->has_video) &&
+		    !mp_media_wants_packets(&m->a, m->has_audio))
+			break;
+		if (mp_media_packets_full(m))
+			break;
 
-	int ret = av_image_alloc(m->scale_pic, m->scale_linesizes,
-				 m->v.decoder->width, m->v.decoder->height,
-				 m->scale_format, 32);
-	if (ret < 0) {
-		blog(LOG_WARNING, "MP: Failed to create scale pic data");
-		return false;
+		int ret = mp_media_next_packet(m);
+		if (ret == AVERROR_EOF || ret == AVERROR_EXIT)
+			mp_media_set_eof(m, true);
+		else if (ret < 0)
+			return false;
 	}
 
 	return true;
@@ -275,17 +275,23 @@ static bool mp_media_prepare_frames(mp_media_t *m)
 	bool actively_seeking = m->seek_next_ts && m->pause;
 
 	while (!mp_media_ready_to_start(m)) {
-		if (!m->eof) {
+		bool waiting = mp_media_waiting_for(&m->v, m->has_video) ||
+			       mp_media_waiting_for(&m->a, m->has_audio);
+
+		if (!m->eof && waiting) {
 			int ret = mp_media_next_packet(m);
 			if (ret == AVERROR_EOF || ret == AVERROR_EXIT) {
 				if (!actively_seeking) {
-					m->eof = true;
+					mp_media_set_eof(m, true);
 				} else {
 					break;
 				}
 			} else if (ret < 0) {
 				return false;
 			}
+		} else {
+			/* the decoders have enough to work with */
+			os_event_timedwait(m->decode_event, 10);
 		}
 
 		if (m->has_video && !mp_decode_frame(&m->v))
@@ -294,14 +300,8 @@ static bool mp_media_prepare_frames(mp_media_t *m)
 			return false;
 	}
 
-	if (m->has_video && m->v.frame_ready && !m->swscale) {
-		m->scale_format = closest_format(m->v.frame->format);
-		if (m->scale_format != m->v.frame->format) {
-			if (!mp_media_init_scaling(m)) {
-				return false;
-			}
-		}
-	}
+	if (!actively_seeking && !mp_media_read_ahead(m))
+		return false;
 
 	return true;
 }
@@ -343,37 +343,45 @@ static inline bool mp_media_can_play_frame(mp_media_t *m, struct mp_decode *d)
 				  (d->frame_pts - m->next_pts_ns > MAX_TS_VAR));
 }
 
-static void mp_media_next_audio(mp_media_t *m)
+static bool mp_media_get_audio(mp_media_t *m, struct obs_source_audio *audio)
 {
 	struct mp_decode *d = &m->a;
-	struct obs_source_audio audio = {0};
 	AVFrame *f = d->frame;
 
-	if (!mp_media_can_play_frame(m, d))
-		return;
-
-	d->frame_ready = false;
-	if (!m->a_cb)
-		return;
+	memset(audio, 0, sizeof(*audio));
 
 	for (size_t i = 0; i < MAX_AV_PLANES; i++)
-		audio.data[i] = f->data[i];
+		audio->data[i] = f->data[i];
+
+	audio->samples_per_sec = f->sample_rate * m->speed / 100;
+	audio->speakers = convert_speaker_layout(f->channels);
+	audio->format = convert_sample_format(f->format);
+	audio->frames = f->nb_samples;
+
+	audio->timestamp = m->base_ts + d->frame_pts - m->start_ts +
+			   m->play_sys_ts - base_sys_ts;
+
+	return audio->format != AUDIO_FORMAT_UNKNOWN;
+}
 
-	audio.samples_per_sec = f->sample_rate * m->speed / 100;
-	audio.speakers = convert_speaker_layout(f->channels);
-	audio.format = convert_sample_format(f->format);
-	audio.frames = f->nb_samples;
+static void mp_media_next_audio(mp_media_t *m)
+{
+	struct mp_decode *d = &m->a;
+	struct obs_source_audio audio;
 
-	audio.timestamp = m->base_ts + d->frame_pts - m->start_ts +
-			  m->play_sys_ts - base_sys_ts;
+	if (!mp_media_can_play_frame(m, d))
+		return;
 
-	if (audio.format == AUDIO_FORMAT_UNKNOWN)
+	d->frame_ready = false;
+	if (!m->a_cb)
 		return;
 
-	m->a_cb(m->opaque, &audio);
+	if (mp_media_get_audio(m, &audio))
+		m->a_cb(m->opaque, &audio);
 }
 
-static void mp_media_next_video(mp_media_t *m, bool preload)
+/* fills m->obsframe from the current video frame */
+static bool mp_media_get_video_frame(mp_media_t *m)
 {
 	struct mp_decode *d = &m->v;
 	struct obs_source_frame *frame = &m->obsframe;
@@ -382,45 +390,17 @@ static void mp_media_next_video(mp_media_t *m, bool preload)
 	enum video_range_type new_range;
 	AVFrame *f = d->frame;
 
-	if (!preload) {
-		if (!mp_media_can_play_frame(m, d))
-			return;
-
-		d->frame_ready = false;
-
-		if (!m->v_cb)
-			return;
-	} else if (!d->frame_ready) {
-		return;
-	}
-
-	bool flip = false;
-	if (m->swscale) {
-		int ret = sws_scale(m->swscale, (const uint8_t *const *)f->data,
-				    f->linesize, 0, f->height, m->scale_pic,
-				    m->scale_linesizes);
-		if (ret < 0)
-			return;
-
-		flip = m->scale_linesizes[0] < 0 && m->scale_linesizes[1] == 0;
-		for (size_t i = 0; i < 4; i++) {
-			frame->data[i] = m->scale_pic[i];
-			frame->linesize[i] = abs(m->scale_linesizes[i]);
-		}
-
-	} else {
-		flip = f->linesize[0] < 0 && f->linesize[1] == 0;
+	bool flip = f->linesize[0] < 0 && f->linesize[1] == 0;
 
-		for (size_t i = 0; i < MAX_AV_PLANES; i++) {
-			frame->data[i] = f->data[i];
-			frame->linesize[i] = abs(f->linesize[i]);
-		}
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		frame->data[i] = f->data[i];
+		frame->linesize[i] = abs(f->linesize[i]);
 	}
 
 	if (flip)
 		frame->data[0] -= frame->linesize[0] * ((size_t)f->height - 1);
 
-	new_format = convert_pixel_format(m->scale_format);
+	new_format = convert_pixel_format(f->format);
 	new_space = convert_color_space(f->colorspace, f->color_trc);
 	new_range = m->force_range == VIDEO_RANGE_DEFAULT
 			    ? convert_color_range(f->color_range)
@@ -443,12 +423,12 @@ static void mp_media_next_video(mp_media_t *m, bool preload)
 
 		if (!success) {
 			frame->format = VIDEO_FORMAT_NONE;
-			return;
+			return false;
 		}
 	}
 
 	if (frame->format == VIDEO_FORMAT_NONE)
-		return;
+		return false;
 
 	frame->timestamp = m->base_ts + d->frame_pts - m->start_ts +
 			   m->play_sys_ts - base_sys_ts;
@@ -479,11 +459,34 @@ static void mp_media_next_video(mp_media_t *m, bool preload)
 
 	if (!m->is_local_file && !d->got_first_keyframe) {
 		if (!f->key_frame)
-			return;
+			return false;
 
 		d->got_first_keyframe = true;
 	}
 
+	return true;
+}
+
+static void mp_media_next_video(mp_media_t *m, bool preload)
+{
+	struct mp_decode *d = &m->v;
+	struct obs_source_frame *frame = &m->obsframe;
+
+	if (!preload) {
+		if (!mp_media_can_play_frame(m, d))
+			return;
+
+		d->frame_ready = false;
+
+		if (!m->v_cb)
+			return;
+	} else if (!d->frame_ready) {
+		return;
+	}
+
+	if (!mp_media_get_video_frame(m))
+		return;
+
 	if (preload) {
 		if (m->seek_next_ts && m->v_seek_cb) {
 			m->v_seek_cb(m->opaque, frame);
@@ -517,7 +520,7 @@ static void mp_media_calc_next_ns(mp_media_t *m)
 	m->next_pts_ns = min_next_ns;
 }
 
-static void seek_to(mp_media_t *m, int64_t pos)
+static void seek_to(mp_media_t *m, int64_t pos, bool restart)
 {
 	AVStream *stream = m->fmt->streams[0];
 	int64_t seek_pos = pos;
@@ -534,21 +537,48 @@ static void seek_to(mp_media_t *m, int64_t pos)
 				      : seek_pos;
 
 	if (m->is_local_file) {
-		int ret = av_seek_frame(m->fmt, 0, seek_target, seek_flags);
+		int64_t keyframe_pts;
+		int ret;
+
+		if (m->has_index)
+			mp_keyframe_index_apply(&m->index, m->fmt);
+
+		/* seek straight to the keyframe instead of letting the demuxer
+		 * search for it */
+		if (m->has_index && seek_flags == AVSEEK_FLAG_BACKWARD &&
+		    mp_keyframe_index_find(
+			    &m->index,
+			    av_rescale_q(seek_pos, AV_TIME_BASE_Q,
+					 m->v.stream->time_base),
+			    &keyframe_pts))
+			ret = av_seek_frame(m->fmt, m->v.stream->index,
+					    keyframe_pts, AVSEEK_FLAG_BACKWARD);
+		else
+			ret = av_seek_frame(m->fmt, 0, seek_target,
+					    seek_flags);
 		if (ret < 0) {
 			blog(LOG_WARNING, "MP: Failed to seek: %s",
 			     av_err2str(ret));
 		}
+
+		/* the decoders would otherwise wait for packets that are
+		 * never read */
+		mp_media_set_eof(m, false);
 	}
 
 	if (m->has_video && m->is_local_file) {
 		mp_decode_flush(&m->v);
+		if (restart)
+			mp_decode_start_preroll(&m->v);
 		if (m->seek_next_ts && m->pause && m->v_preload_cb &&
 		    mp_media_prepare_frames(m))
 			mp_media_next_video(m, true);
 	}
-	if (m->has_audio && m->is_local_file)
+	if (m->has_audio && m->is_local_file) {
 		mp_decode_flush(&m->a);
+		if (restart)
+			mp_decode_start_preroll(&m->a);
+	}
 }
 
 static bool mp_media_reset(mp_media_t *m)
@@ -559,11 +589,11 @@ static bool mp_media_reset(mp_media_t *m)
 	int64_t next_ts = mp_media_get_base_pts(m);
 	int64_t offset = next_ts - m->next_pts_ns;
 
-	m->eof = false;
+	mp_media_set_eof(m, false);
 	m->base_ts += next_ts;
 	m->seek_next_ts = false;
 
-	seek_to(m, m->fmt->start_time);
+	seek_to(m, m->fmt->start_time, true);
 
 	pthread_mutex_lock(&m->mutex);
 	stopping = m->stopping;
@@ -659,6 +689,29 @@ static int interrupt_callback(void *data)
 
 #define RIST_PROTO "rist"
 
+static void mp_media_init_preroll(mp_media_t *m)
+{
+	AVRational rate = {30, 1};
+
+	if (m->has_video) {
+		AVRational guess =
+			av_guess_frame_rate(m->fmt, m->v.stream, NULL);
+		if (guess.num > 0 && guess.den > 0)
+			rate = guess;
+	}
+
+	int64_t duration = av_rescale_q(m->preroll_frames, av_inv_q(rate),
+					(AVRational){1, 1000000000});
+
+	/* frame timestamps are scaled by the playback speed */
+	duration = duration * 100 / m->speed;
+
+	if (m->has_video)
+		m->v.preroll_duration = duration;
+	if (m->has_audio)
+		m->a.preroll_duration = duration;
+}
+
 static bool init_avformat(mp_media_t *m)
 {
 #if LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(59, 0, 100)
@@ -733,6 +786,15 @@ static bool init_avformat(mp_media_t *m)
 		return false;
 	}
 
+	if (m->is_local_file && m->has_video && m->index_cache_dir) {
+		mp_keyframe_index_init(&m->index, m->path, m->index_cache_dir,
+				       m->v.stream);
+		m->has_index = true;
+	}
+
+	if (m->preroll_frames > 0)
+		mp_media_init_preroll(m);
+
 	return true;
 }
 
@@ -744,6 +806,315 @@ static void reset_ts(mp_media_t *m)
 	m->next_ns = 0;
 }
 
+/* ------------------------------------------------------------------------- */
+/* fully decoded playback                                                    */
+
+#define MAX_CACHE_MEM_USAGE (2048ULL * 1024ULL * 1024ULL)
+#define MAX_CACHE_SLEEP_NS 200000000LL
+
+static inline bool mp_media_killed(mp_media_t *m)
+{
+	bool kill;
+
+	pthread_mutex_lock(&m->mutex);
+	kill = m->kill;
+	pthread_mutex_unlock(&m->mutex);
+
+	return kill;
+}
+
+static inline void mp_cache_update_end(mp_media_t *m, struct mp_decode *d)
+{
+	if (d->frame_pts < m->cache_start_pts)
+		m->cache_start_pts = d->frame_pts;
+	if (d->next_pts > m->cache_end_pts)
+		m->cache_end_pts = d->next_pts;
+}
+
+/* decodes the whole file once, playback then only reads from memory */
+static bool mp_media_fill_cache(mp_media_t *m)
+{
+	struct mp_cache *c = &m->cache;
+	uint64_t start_time = os_gettime_ns();
+	bool success = true;
+
+	m->cache_start_pts = INT64_MAX;
+	m->cache_end_pts = 0;
+
+	mp_media_set_eof(m, false);
+	seek_to(m, m->fmt->start_time, false);
+
+	while (success) {
+		if (mp_media_killed(m) || !mp_media_prepare_frames(m)) {
+			mp_cache_free(c);
+			return false;
+		}
+
+		bool v_ready = m->has_video && m->v.frame_ready;
+		bool a_ready = m->has_audio && m->a.frame_ready;
+		if (!v_ready && !a_ready)
+			break;
+
+		if (v_ready) {
+			if (mp_media_get_video_frame(m))
+				success = mp_cache_add_video(c, &m->obsframe,
+							     m->v.frame_pts,
+							     m->cur_space,
+							     m->cur_range);
+			mp_cache_update_end(m, &m->v);
+			m->v.frame_ready = false;
+		}
+		if (a_ready) {
+			struct obs_source_audio audio;
+
+			if (success && mp_media_get_audio(m, &audio))
+				success = mp_cache_add_audio(c, &audio,
+							     m->a.frame_pts);
+			mp_cache_update_end(m, &m->a);
+			m->a.frame_ready = false;
+		}
+	}
+
+	if (!success || (!c->video.num && !c->audio.num)) {
+		blog(LOG_INFO,
+		     "MP: '%s' does not fit in memory, decoding it while "
+		     "playing instead",
+		     m->path);
+		mp_cache_free(c);
+		return false;
+	}
+
+	mp_cache_finish(c);
+
+	/* the decoders are not needed anymore */
+	mp_decode_free(&m->v);
+	mp_decode_free(&m->a);
+
+	blog(LOG_INFO,
+	     "MP: Decoded '%s' into memory in %" PRIu64 " ms, %zu video "
+	     "frames, %zu audio frames, %" PRIu64 " MB",
+	     m->path, (os_gettime_ns() - start_time) / 1000000, c->video.num,
+	     c->audio.num, c->mem_usage / (1024 * 1024));
+
+	os_atomic_set_bool(&m->cache_ready, true);
+	return true;
+}
+
+static inline int64_t mp_cache_frame_ts(mp_media_t *m, int64_t pts)
+{
+	return pts - m->start_ts + m->play_sys_ts - base_sys_ts;
+}
+
+static void mp_cache_output_video(mp_media_t *m, size_t idx,
+				  mp_video_cb callback)
+{
+	struct mp_cache *c = &m->cache;
+
+	if (!callback || idx >= c->video.num)
+		return;
+	if (!mp_cache_get_video(c, idx, &m->obsframe))
+		return;
+
+	m->obsframe.timestamp =
+		mp_cache_frame_ts(m, c->video.array[idx].pts);
+	callback(m->opaque, &m->obsframe);
+}
+
+static void mp_cache_restart(mp_media_t *m)
+{
+	bool stopping;
+	bool active;
+
+	pthread_mutex_lock(&m->mutex);
+	stopping = m->stopping;
+	active = m->active;
+	m->stopping = false;
+	m->pause = false;
+	pthread_mutex_unlock(&m->mutex);
+
+	m->cache_v_idx = 0;
+	m->cache_a_idx = 0;
+	m->start_ts = m->cache_pos = m->cache_start_pts;
+	m->play_sys_ts = (int64_t)os_gettime_ns();
+
+	if (!active)
+		mp_cache_output_video(m, 0, m->v_preload_cb);
+	if (stopping && m->stop_cb)
+		m->stop_cb(m->opaque);
+}
+
+static void mp_cache_seek(mp_media_t *m, int64_t seek_pos, bool pause)
+{
+	struct mp_cache *c = &m->cache;
+	int64_t pts = seek_pos * 1000 * 100 / m->speed;
+
+	if (pts < m->cache_start_pts)
+		pts = m->cache_start_pts;
+	if (pts > m->cache_end_pts)
+		pts = m->cache_end_pts;
+
+	m->cache_v_idx = mp_cache_find_video(c, pts);
+	m->cache_a_idx = mp_cache_find_audio(c, pts);
+	while (m->cache_a_idx < c->audio.num &&
+	       c->audio.array[m->cache_a_idx].pts < pts)
+		m->cache_a_idx++;
+
+	m->start_ts = m->cache_pos = pts;
+	m->play_sys_ts = (int64_t)os_gettime_ns();
+
+	if (pause)
+		mp_cache_output_video(m, m->cache_v_idx,
+				      m->v_seek_cb ? m->v_seek_cb
+						   : m->v_preload_cb);
+}
+
+static inline int64_t mp_cache_next_pts(mp_media_t *m)
+{
+	struct mp_cache *c = &m->cache;
+	int64_t next = m->cache_end_pts;
+
+	if (m->cache_v_idx < c->video.num &&
+	    c->video.array[m->cache_v_idx].pts < next)
+		next = c->video.array[m->cache_v_idx].pts;
+	if (m->cache_a_idx < c->audio.num &&
+	    c->audio.array[m->cache_a_idx].pts < next)
+		next = c->audio.array[m->cache_a_idx].pts;
+
+	return next;
+}
+
+static void mp_cache_sleep(mp_media_t *m)
+{
+	int64_t now = (int64_t)os_gettime_ns();
+	int64_t due = m->play_sys_ts + mp_cache_next_pts(m) - m->start_ts;
+
+	if (due > now + MAX_CACHE_SLEEP_NS)
+		due = now + MAX_CACHE_SLEEP_NS;
+	if (due > now)
+		os_sleepto_ns((uint64_t)due);
+}
+
+/* outputs everything that is due, returns true when the end is reached */
+static bool mp_cache_output(mp_media_t *m)
+{
+	struct mp_cache *c = &m->cache;
+	int64_t pos = m->start_ts + (int64_t)os_gettime_ns() - m->play_sys_ts;
+
+	/* only the most recent frame that is due is shown, late frames are
+	 * skipped */
+	if (m->cache_v_idx < c->video.num &&
+	    c->video.array[m->cache_v_idx].pts <= pos) {
+		size_t idx = mp_cache_find_video(c, pos);
+
+		mp_cache_output_video(m, idx, m->v_cb);
+		m->cache_v_idx = idx + 1;
+	}
+
+	while (m->cache_a_idx < c->audio.num &&
+	       c->audio.array[m->cache_a_idx].pts <= pos) {
+		struct obs_source_audio audio;
+		int64_t pts = c->audio.array[m->cache_a_idx].pts;
+
+		mp_cache_get_audio(c, m->cache_a_idx++, &audio);
+		audio.timestamp = mp_cache_frame_ts(m, pts);
+		if (m->a_cb)
+			m->a_cb(m->opaque, &audio);
+	}
+
+	m->cache_pos = pos < m->cache_end_pts ? pos : m->cache_end_pts;
+
+	return m->cache_v_idx >= c->video.num &&
+	       m->cache_a_idx >= c->audio.num && pos >= m->cache_end_pts;
+}
+
+static void mp_cache_eof(mp_media_t *m)
+{
+	bool looping;
+
+	pthread_mutex_lock(&m->mutex);
+	looping = m->looping;
+	if (!looping) {
+		m->active = false;
+		m->stopping = true;
+	}
+	pthread_mutex_unlock(&m->mutex);
+
+	if (!looping) {
+		mp_cache_restart(m);
+		return;
+	}
+
+	/* continue on the same clock so looping is seamless */
+	m->play_sys_ts += m->cache_end_pts - m->start_ts;
+	m->start_ts = m->cache_pos = m->cache_start_pts;
+	m->cache_v_idx = 0;
+	m->cache_a_idx = 0;
+}
+
+static bool mp_media_cache_thread(mp_media_t *m)
+{
+	mp_cache_restart(m);
+
+	for (;;) {
+		bool reset, kill, is_active, seek, pause, reset_time;
+		int64_t seek_pos;
+
+		pthread_mutex_lock(&m->mutex);
+		is_active = m->active;
+		pause = m->pause;
+		pthread_mutex_unlock(&m->mutex);
+
+		if (!is_active || pause) {
+			if (os_sem_wait(m->sem) < 0)
+				return false;
+		} else {
+			mp_cache_sleep(m);
+		}
+
+		pthread_mutex_lock(&m->mutex);
+
+		reset = m->reset;
+		kill = m->kill;
+		m->reset = false;
+		m->kill = false;
+
+		is_active = m->active;
+		pause = m->pause;
+		seek_pos = m->seek_pos;
+		seek = m->seek;
+		reset_time = m->reset_ts;
+		m->seek = false;
+		m->reset_ts = false;
+
+		pthread_mutex_unlock(&m->mutex);
+
+		if (kill)
+			break;
+		if (reset) {
+			mp_cache_restart(m);
+			continue;
+		}
+		if (seek) {
+			mp_cache_seek(m, seek_pos, pause);
+			continue;
+		}
+		if (reset_time) {
+			m->start_ts = m->cache_pos;
+			m->play_sys_ts = (int64_t)os_gettime_ns();
+			continue;
+		}
+		if (pause)
+			continue;
+
+		if (is_active && mp_cache_output(m))
+			mp_cache_eof(m);
+	}
+
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
 static inline bool mp_media_thread(mp_media_t *m)
 {
 	os_set_thread_name("mp_media_thread");
@@ -751,6 +1122,14 @@ static inline bool mp_media_thread(mp_media_t *m)
 	if (!init_avformat(m)) {
 		return false;
 	}
+	if (m->full_decode) {
+		bool cached = mp_media_fill_cache(m);
+
+		if (mp_media_killed(m))
+			return true;
+		if (cached)
+			return mp_media_cache_thread(m);
+	}
 	if (!mp_media_reset(m)) {
 		return false;
 	}
@@ -800,7 +1179,7 @@ static inline bool mp_media_thread(mp_media_t *m)
 
 		if (seek) {
 			m->seek_next_ts = true;
-			seek_to(m, seek_pos);
+			seek_to(m, seek_pos, false);
 			continue;
 		}
 
@@ -851,13 +1230,24 @@ static inline bool mp_media_init_internal(mp_media_t *m,
 		blog(LOG_WARNING, "MP: Failed to init mutex");
 		return false;
 	}
+	if (pthread_mutex_init(&m->packet_pool_mutex, NULL) != 0) {
+		blog(LOG_WARNING, "MP: Failed to init mutex");
+		return false;
+	}
 	if (os_sem_init(&m->sem, 0) != 0) {
 		blog(LOG_WARNING, "MP: Failed to init semaphore");
 		return false;
 	}
+	if (os_event_init(&m->decode_event, OS_EVENT_TYPE_AUTO) != 0) {
+		blog(LOG_WARNING, "MP: Failed to init event");
+		return false;
+	}
 
 	m->path = info->path ? bstrdup(info->path) : NULL;
 	m->format_name = info->format ? bstrdup(info->format) : NULL;
+	m->index_cache_dir = info->index_cache_dir
+				     ? bstrdup(info->index_cache_dir)
+				     : NULL;
 	m->hw = info->hardware_decoding;
 
 	if (pthread_create(&m->thread, NULL, mp_media_thread_start, m) != 0) {
@@ -873,6 +1263,7 @@ bool mp_media_init(mp_media_t *media, const struct mp_media_info *info)
 {
 	memset(media, 0, sizeof(*media));
 	pthread_mutex_init_value(&media->mutex);
+	pthread_mutex_init_value(&media->packet_pool_mutex);
 	media->opaque = info->opaque;
 	media->v_cb = info->v_cb;
 	media->a_cb = info->a_cb;
@@ -885,6 +1276,9 @@ bool mp_media_init(mp_media_t *media, const struct mp_media_info *info)
 	media->buffering = info->buffering;
 	media->speed = info->speed;
 	media->is_local_file = info->is_local_file;
+	media->preroll_frames = info->is_local_file ? info->preroll_frames : 0;
+	media->full_decode = info->is_local_file && info->full_decode;
+	mp_cache_init(&media->cache, info->compress_cache, MAX_CACHE_MEM_USAGE);
 	da_init(media->packet_pool);
 
 	if (!info->is_local_file || media->speed < 1 || media->speed > 200)
@@ -936,15 +1330,20 @@ void mp_media_free(mp_media_t *media)
 	for (size_t i = 0; i < media->packet_pool.num; i++)
 		av_packet_free(&media->packet_pool.array[i]);
 	da_free(media->packet_pool);
+	if (media->has_index)
+		mp_keyframe_index_free(&media->index);
+	mp_cache_free(&media->cache);
 	avformat_close_input(&media->fmt);
 	pthread_mutex_destroy(&media->mutex);
+	pthread_mutex_destroy(&media->packet_pool_mutex);
 	os_sem_destroy(media->sem);
-	sws_freeContext(media->swscale);
-	av_freep(&media->scale_pic[0]);
+	os_event_destroy(media->decode_event);
 	bfree(media->path);
 	bfree(media->format_name);
+	bfree(media->index_cache_dir);
 	memset(media, 0, sizeof(*media));
 	pthread_mutex_init_value(&media->mutex);
+	pthread_mutex_init_value(&media->packet_pool_mutex);
 }
 
 void mp_media_play(mp_media_t *m, bool loop, bool reconnecting)
@@ -990,7 +1389,16 @@ void mp_media_stop(mp_media_t *m)
 
 int64_t mp_get_current_time(mp_media_t *m)
 {
-	return mp_media_get_base_pts(m) * (int64_t)m->speed / 100000000LL;
+	int64_t pts = os_atomic_load_bool(&m->cache_ready)
+			      ? m->cache_pos
+			      : mp_media_get_base_pts(m);
+
+	return pts * (int64_t)m->speed / 100000000LL;
+}
+
+uint64_t mp_media_get_cache_size(mp_media_t *m)
+{
+	return os_atomic_load_bool(&m->cache_ready) ? m->cache.mem_usage : 0;
 }
 
 void mp_media_seek_to(mp_media_t *m, int64_t pos)
@@ -18,6 +18,8 @@
 
 #include <obs.h>
 #include "decode.h"
+#include "keyframe-index.h"
+#include "cache.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -58,14 +60,29 @@ struct mp_media {
 	int buffering;
 	int speed;
 
-	enum AVPixelFormat scale_format;
-	struct SwsContext *swscale;
-	int scale_linesizes[4];
-	uint8_t *scale_pic[4];
-
+	/* demuxing and presentation happen on the media thread, decoding
+	 * on a thread per stream */
+	pthread_mutex_t packet_pool_mutex;
 	DARRAY(AVPacket *) packet_pool;
+	os_event_t *decode_event;
 	struct mp_decode v;
 	struct mp_decode a;
+	char *index_cache_dir;
+	struct mp_keyframe_index index;
+	bool has_index;
+	int preroll_frames;
+
+	/* fully decoded playback, the media thread reads from the cache and
+	 * the decoders are freed once it is filled */
+	bool full_decode;
+	struct mp_cache cache;
+	volatile bool cache_ready;
+	size_t cache_v_idx;
+	size_t cache_a_idx;
+	int64_t cache_start_pts;
+	int64_t cache_end_pts;
+	int64_t cache_pos;
+
 	bool is_local_file;
 	bool reconnecting;
 	bool has_video;
@@ -127,6 +144,22 @@ struct mp_media_info {
 	bool hardware_decoding;
 	bool is_local_file;
 	bool reconnecting;
+
+	/* directory keyframe indexes of local files are cached in, no index
+	 * is built if NULL */
+	const char *index_cache_dir;
+
+	/* number of frames from the start of the file to keep decoded in
+	 * memory, so restarting the file does not need to wait for the
+	 * decoder */
+	int preroll_frames;
+
+	/* decode local files into memory completely before playing them,
+	 * falls back to regular playback if they do not fit */
+	bool full_decode;
+
+	/* delta compress the frames kept in memory */
+	bool compress_cache;
 };
 
 extern bool mp_media_init(mp_media_t *media, const struct mp_media_info *info);
@@ -138,6 +171,9 @@ extern void mp_media_play_pause(mp_media_t *media, bool pause);
 extern int64_t mp_get_current_time(mp_media_t *m);
 extern void mp_media_seek_to(mp_media_t *m, int64_t pos);
 
+/** Memory used by fully decoded media, 0 if the media is not fully decoded */
+extern uint64_t mp_media_get_cache_size(mp_media_t *m);
+
 /* #define DETAILED_DEBUG_INFO */
 
 #ifdef __cplusplus
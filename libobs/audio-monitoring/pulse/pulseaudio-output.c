@@ -4,6 +4,8 @@
 #define PULSE_DATA(voidptr) struct audio_monitor *data = voidptr;
 #define blog(level, msg, ...) blog(level, "pulse-am: " msg, ##__VA_ARGS__)
 
+#define DEFAULT_TARGET_LATENCY_MS 25
+
 struct audio_monitor {
 	obs_source_t *source;
 	pa_stream *stream;
@@ -482,14 +484,22 @@ static bool audio_monitor_init(struct audio_monitor *monitor,
 		return false;
 	}
 
+	/* with a user set latency, pulse also lowers the sink latency so the
+	 * whole playback path fits into the target length */
+	uint32_t latency_ms = obs->audio.monitoring_latency_ms;
+
 	monitor->attr.fragsize = (uint32_t)-1;
 	monitor->attr.maxlength = (uint32_t)-1;
 	monitor->attr.minreq = (uint32_t)-1;
 	monitor->attr.prebuf = (uint32_t)-1;
-	monitor->attr.tlength = pa_usec_to_bytes(25000, &spec);
+	monitor->attr.tlength = pa_usec_to_bytes(
+		(latency_ms ? latency_ms : DEFAULT_TARGET_LATENCY_MS) * 1000,
+		&spec);
 
 	pa_stream_flags_t flags = PA_STREAM_INTERPOLATE_TIMING |
 				  PA_STREAM_AUTO_TIMING_UPDATE;
+	if (latency_ms)
+		flags |= PA_STREAM_ADJUST_LATENCY;
 
 	if (pthread_mutex_init(&monitor->playback_mutex, NULL) != 0) {
 		blog(LOG_WARNING, "%s: %s", __FUNCTION__,
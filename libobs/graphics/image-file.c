@@ -19,7 +19,11 @@
 #include "../util/base.h"
 #include "../util/platform.h"
 #include "../util/dstr.h"
+#include "../util/darray.h"
+#include "../util/threading.h"
+#include "../media-io/video-scaler.h"
 #include "vec4.h"
+#include <sys/stat.h>
 
 #define blog(level, format, ...) \
 	blog(level, "%s: " format, __FUNCTION__, __VA_ARGS__)
@@ -72,6 +76,259 @@ static inline void *alloc_mem(gs_image_file_t *image, uint64_t *mem_usage,
 	return bzalloc(size);
 }
 
+static inline void premultiply_frame(uint8_t *data, size_t area,
+				     enum gs_image_alpha_mode alpha_mode)
+{
+	if (alpha_mode == GS_IMAGE_ALPHA_PREMULTIPLY_SRGB)
+		gs_premultiply_xyza_srgb_loop(data, area);
+	else if (alpha_mode == GS_IMAGE_ALPHA_PREMULTIPLY)
+		gs_premultiply_xyza_loop(data, area);
+}
+
+/* ------------------------------------------------------------------------- */
+/* GIF memory budget and streaming playback */
+
+#define DEFAULT_GIF_BUDGET (1024ULL * 1024ULL * 1024ULL)
+#define GIF_STREAM_FRAMES 4
+
+static pthread_mutex_t gif_budget_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t gif_budget = DEFAULT_GIF_BUDGET;
+static uint64_t gif_budget_used = 0;
+
+void gs_image_file_set_gif_budget(uint64_t bytes)
+{
+	pthread_mutex_lock(&gif_budget_mutex);
+	gif_budget = bytes;
+	pthread_mutex_unlock(&gif_budget_mutex);
+}
+
+uint64_t gs_image_file_get_gif_budget(void)
+{
+	uint64_t bytes;
+
+	pthread_mutex_lock(&gif_budget_mutex);
+	bytes = gif_budget;
+	pthread_mutex_unlock(&gif_budget_mutex);
+
+	return bytes;
+}
+
+static bool gif_budget_reserve(uint64_t size)
+{
+	bool success;
+
+	pthread_mutex_lock(&gif_budget_mutex);
+	success = gif_budget_used + size <= gif_budget;
+	if (success)
+		gif_budget_used += size;
+	pthread_mutex_unlock(&gif_budget_mutex);
+
+	return success;
+}
+
+static void gif_budget_release(uint64_t size)
+{
+	pthread_mutex_lock(&gif_budget_mutex);
+	gif_budget_used -= size;
+	pthread_mutex_unlock(&gif_budget_mutex);
+}
+
+/*
+ * libnsgif can only decode frames in order, so the thread decodes frame
+ * after frame and keeps the ones that fall within the window starting at
+ * the frame playback wants.  It goes idle once the whole window is decoded.
+ */
+struct gs_gif_stream {
+	gs_image_file_t *image;
+	enum gs_image_alpha_mode alpha_mode;
+
+	pthread_t thread;
+	bool thread_active;
+	os_event_t *event;
+	volatile bool stop;
+
+	pthread_mutex_t mutex;
+	uint8_t *frames;
+	int frame_ids[GIF_STREAM_FRAMES];
+	int next_decode;
+	int wanted;
+};
+
+static inline size_t gif_frame_size(const gs_image_file_t *image)
+{
+	return (size_t)image->gif.width * image->gif.height * 4;
+}
+
+static inline int gif_window_size(const gs_image_file_t *image)
+{
+	int count = (int)image->gif.frame_count;
+	return count < GIF_STREAM_FRAMES ? count : GIF_STREAM_FRAMES;
+}
+
+static inline int gif_stream_find(struct gs_gif_stream *stream, int frame)
+{
+	for (int i = 0; i < GIF_STREAM_FRAMES; i++) {
+		if (stream->frame_ids[i] == frame)
+			return i;
+	}
+
+	return -1;
+}
+
+static inline bool gif_stream_resident(struct gs_gif_stream *stream,
+				       int frame)
+{
+	return gif_stream_find(stream, frame) != -1;
+}
+
+/* the frame must be resident */
+static inline uint8_t *gif_stream_slot(struct gs_gif_stream *stream, int frame)
+{
+	return stream->frames + (size_t)gif_stream_find(stream, frame) *
+					gif_frame_size(stream->image);
+}
+
+static bool gif_stream_in_window(struct gs_gif_stream *stream, int frame)
+{
+	int count = (int)stream->image->gif.frame_count;
+	int offset = (frame - stream->wanted + count) % count;
+	return offset < gif_window_size(stream->image);
+}
+
+/* the window is never larger than the number of slots, so there always is a
+ * slot holding a frame that isn't needed anymore */
+static int gif_stream_free_slot(struct gs_gif_stream *stream)
+{
+	for (int i = 0; i < GIF_STREAM_FRAMES; i++) {
+		int id = stream->frame_ids[i];
+		if (id == -1 || !gif_stream_in_window(stream, id))
+			return i;
+	}
+
+	return -1;
+}
+
+static bool gif_stream_window_complete(struct gs_gif_stream *stream)
+{
+	int count = (int)stream->image->gif.frame_count;
+
+	for (int i = 0; i < gif_window_size(stream->image); i++) {
+		if (!gif_stream_resident(stream, (stream->wanted + i) % count))
+			return false;
+	}
+
+	return true;
+}
+
+static void *gif_stream_thread(void *param)
+{
+	struct gs_gif_stream *stream = param;
+	gs_image_file_t *image = stream->image;
+	const size_t area = (size_t)image->gif.width * image->gif.height;
+	const int count = (int)image->gif.frame_count;
+
+	os_set_thread_name("libobs: gif decode thread");
+
+	while (!stream->stop) {
+		pthread_mutex_lock(&stream->mutex);
+		bool idle = gif_stream_window_complete(stream);
+		int frame = stream->next_decode;
+		pthread_mutex_unlock(&stream->mutex);
+
+		if (idle) {
+			os_event_wait(stream->event);
+			continue;
+		}
+
+		if (gif_decode_frame(&image->gif, frame) == GIF_OK)
+			premultiply_frame(image->gif.frame_image, area,
+					  stream->alpha_mode);
+
+		pthread_mutex_lock(&stream->mutex);
+		if (gif_stream_in_window(stream, frame) &&
+		    !gif_stream_resident(stream, frame)) {
+			int slot = gif_stream_free_slot(stream);
+			if (slot != -1) {
+				memcpy(stream->frames + slot * area * 4,
+				       image->gif.frame_image, area * 4);
+				stream->frame_ids[slot] = frame;
+			}
+		}
+		stream->next_decode = (frame + 1) % count;
+		pthread_mutex_unlock(&stream->mutex);
+	}
+
+	return NULL;
+}
+
+static void gif_stream_destroy(struct gs_gif_stream *stream)
+{
+	if (!stream)
+		return;
+
+	if (stream->thread_active) {
+		stream->stop = true;
+		os_event_signal(stream->event);
+		pthread_join(stream->thread, NULL);
+	}
+
+	os_event_destroy(stream->event);
+	pthread_mutex_destroy(&stream->mutex);
+	bfree(stream->frames);
+	bfree(stream);
+}
+
+/* expects frame 0 to be decoded and premultiplied in gif.frame_image */
+static struct gs_gif_stream *
+gif_stream_create(gs_image_file_t *image, uint64_t *mem_usage,
+		  enum gs_image_alpha_mode alpha_mode)
+{
+	struct gs_gif_stream *stream = bzalloc(sizeof(*stream));
+	const size_t frame_size = gif_frame_size(image);
+
+	stream->image = image;
+	stream->alpha_mode = alpha_mode;
+	stream->frames = alloc_mem(image, mem_usage,
+				   frame_size * GIF_STREAM_FRAMES);
+
+	for (int i = 0; i < GIF_STREAM_FRAMES; i++)
+		stream->frame_ids[i] = -1;
+
+	memcpy(stream->frames, image->gif.frame_image, frame_size);
+	stream->frame_ids[0] = 0;
+	stream->next_decode = 1;
+
+	pthread_mutex_init_value(&stream->mutex);
+	if (pthread_mutex_init(&stream->mutex, NULL) != 0)
+		goto fail;
+	if (os_event_init(&stream->event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+	if (pthread_create(&stream->thread, NULL, gif_stream_thread, stream) !=
+	    0)
+		goto fail;
+
+	stream->thread_active = true;
+	return stream;
+
+fail:
+	gif_stream_destroy(stream);
+	return NULL;
+}
+
+/* returns whether the frame is available yet */
+static bool gif_stream_request(struct gs_gif_stream *stream, int frame)
+{
+	bool resident;
+
+	pthread_mutex_lock(&stream->mutex);
+	stream->wanted = frame;
+	resident = gif_stream_resident(stream, frame);
+	pthread_mutex_unlock(&stream->mutex);
+
+	os_event_signal(stream->event);
+	return resident;
+}
+
 static bool init_animated_gif(gs_image_file_t *image, const char *path,
 			      uint64_t *mem_usage,
 			      enum gs_image_alpha_mode alpha_mode)
@@ -136,41 +393,59 @@ static bool init_animated_gif(gs_image_file_t *image, const char *path,
 
 	image->is_animated_gif = (image->gif.frame_count > 1 && result >= 0);
 	if (image->is_animated_gif) {
-		gif_decode_frame(&image->gif, 0);
-
-		image->animation_frame_cache =
-			alloc_mem(image, mem_usage,
-				  image->gif.frame_count * sizeof(uint8_t *));
-		image->animation_frame_data = alloc_mem(
-			image, mem_usage, get_full_decoded_gif_size(image));
-
-		for (unsigned int i = 0; i < image->gif.frame_count; i++) {
-			if (gif_decode_frame(&image->gif, i) != GIF_OK)
-				blog(LOG_WARNING,
-				     "Couldn't decode frame %u "
-				     "of '%s'",
-				     i, path);
-		}
-
-		gif_decode_frame(&image->gif, 0);
+		const uint64_t full_size =
+			(uint64_t)get_full_decoded_gif_size(image);
+		bool stream = !gif_budget_reserve(full_size);
 
 		image->cx = (uint32_t)image->gif.width;
 		image->cy = (uint32_t)image->gif.height;
 		image->format = GS_RGBA;
 
+		if (stream) {
+			blog(LOG_INFO,
+			     "'%s' exceeds the GIF memory budget, "
+			     "decoding frames while playing",
+			     path);
+
+			gif_decode_frame(&image->gif, 0);
+			premultiply_frame(image->gif.frame_image,
+					  (size_t)image->cx * image->cy,
+					  alpha_mode);
+
+			image->gif_stream =
+				gif_stream_create(image, mem_usage, alpha_mode);
+			if (!image->gif_stream)
+				goto fail;
+		} else {
+			gif_decode_frame(&image->gif, 0);
+
+			image->animation_frame_cache = alloc_mem(
+				image, mem_usage,
+				image->gif.frame_count * sizeof(uint8_t *));
+			image->animation_frame_data = alloc_mem(
+				image, mem_usage,
+				get_full_decoded_gif_size(image));
+
+			for (unsigned int i = 0; i < image->gif.frame_count;
+			     i++) {
+				if (gif_decode_frame(&image->gif, i) != GIF_OK)
+					blog(LOG_WARNING,
+					     "Couldn't decode frame %u "
+					     "of '%s'",
+					     i, path);
+			}
+
+			gif_decode_frame(&image->gif, 0);
+
+			premultiply_frame(image->gif.frame_image,
+					  (size_t)image->cx * image->cy,
+					  alpha_mode);
+		}
+
 		if (mem_usage) {
 			*mem_usage += (size_t)4 * image->cx * image->cy;
 			*mem_usage += size;
 		}
-
-		if (alpha_mode == GS_IMAGE_ALPHA_PREMULTIPLY_SRGB) {
-			gs_premultiply_xyza_srgb_loop(image->gif.frame_image,
-						      (size_t)image->cx *
-							      image->cy);
-		} else if (alpha_mode == GS_IMAGE_ALPHA_PREMULTIPLY) {
-			gs_premultiply_xyza_loop(image->gif.frame_image,
-						 (size_t)image->cx * image->cy);
-		}
 	} else {
 		gif_finalise(&image->gif);
 		bfree(image->gif_data);
@@ -191,13 +466,17 @@ not_animated:
 	return is_animated_gif;
 }
 
+bool gs_image_file_is_gif(const char *file)
+{
+	const char *ext = file ? os_get_path_extension(file) : NULL;
+	return ext && astrcmpi(ext, ".gif") == 0;
+}
+
 static void gs_image_file_init_internal(gs_image_file_t *image,
 					const char *file, uint64_t *mem_usage,
 					enum gs_color_space *space,
 					enum gs_image_alpha_mode alpha_mode)
 {
-	size_t len;
-
 	if (!image)
 		return;
 
@@ -206,9 +485,7 @@ static void gs_image_file_init_internal(gs_image_file_t *image,
 	if (!file)
 		return;
 
-	len = strlen(file);
-
-	if (len > 4 && astrcmpi(file + len - 4, ".gif") == 0) {
+	if (gs_image_file_is_gif(file)) {
 		if (init_animated_gif(image, file, mem_usage, alpha_mode)) {
 			return;
 		}
@@ -244,6 +521,13 @@ void gs_image_file_free(gs_image_file_t *image)
 
 	if (image->loaded) {
 		if (image->is_animated_gif) {
+			/* the stream thread uses the decoder until stopped */
+			if (image->gif_stream)
+				gif_stream_destroy(image->gif_stream);
+			else
+				gif_budget_release(
+					get_full_decoded_gif_size(image));
+
 			gif_finalise(&image->gif);
 			bfree(image->animation_frame_cache);
 			bfree(image->animation_frame_data);
@@ -288,7 +572,21 @@ void gs_image_file_init_texture(gs_image_file_t *image)
 	if (!image->loaded)
 		return;
 
-	if (image->is_animated_gif) {
+	if (image->gif_stream) {
+		struct gs_gif_stream *stream = image->gif_stream;
+
+		pthread_mutex_lock(&stream->mutex);
+		const uint8_t *data =
+			gif_stream_resident(stream, image->cur_frame)
+				? gif_stream_slot(stream, image->cur_frame)
+				: NULL;
+		image->texture = gs_texture_create(image->cx, image->cy,
+						   image->format, 1,
+						   data ? &data : NULL,
+						   GS_DYNAMIC);
+		pthread_mutex_unlock(&stream->mutex);
+
+	} else if (image->is_animated_gif) {
 		image->texture = gs_texture_create(
 			image->cx, image->cy, image->format, 1,
 			(const uint8_t **)&image->gif.frame_image, GS_DYNAMIC);
@@ -310,22 +608,25 @@ static inline uint64_t get_time(gs_image_file_t *image, int i)
 	return val;
 }
 
+/* advances cur_time and cur_loop, which are only stored back by the caller
+ * once the new frame can be shown */
 static inline int calculate_new_frame(gs_image_file_t *image,
+				      uint64_t *cur_time, int *cur_loop,
 				      uint64_t elapsed_time_ns, int loops)
 {
 	int new_frame = image->cur_frame;
 
-	image->cur_time += elapsed_time_ns;
+	*cur_time += elapsed_time_ns;
 	for (;;) {
 		uint64_t t = get_time(image, new_frame);
-		if (image->cur_time <= t)
+		if (*cur_time <= t)
 			break;
 
-		image->cur_time -= t;
+		*cur_time -= t;
 		if ((unsigned int)++new_frame == image->gif.frame_count) {
-			if (!loops || ++image->cur_loop < loops) {
+			if (!loops || ++*cur_loop < loops) {
 				new_frame = 0;
-			} else if (image->cur_loop == loops) {
+			} else if (*cur_loop == loops) {
 				new_frame--;
 				break;
 			}
@@ -392,11 +693,28 @@ static bool gs_image_file_tick_internal(gs_image_file_t *image,
 		loops = 0;
 
 	if (!loops || image->cur_loop < loops) {
-		int new_frame =
-			calculate_new_frame(image, elapsed_time_ns, loops);
+		uint64_t cur_time = image->cur_time;
+		int cur_loop = image->cur_loop;
+		int new_frame = calculate_new_frame(image, &cur_time, &cur_loop,
+						    elapsed_time_ns, loops);
+
+		/* keeps showing the current frame if the decoder has not
+		 * caught up yet, the elapsed time is added to it so that the
+		 * next tick advances from there */
+		if (new_frame != image->cur_frame && image->gif_stream &&
+		    !gif_stream_request(image->gif_stream, new_frame)) {
+			image->cur_time += elapsed_time_ns;
+			return false;
+		}
+
+		image->cur_time = cur_time;
+		image->cur_loop = cur_loop;
 
 		if (new_frame != image->cur_frame) {
-			decode_new_frame(image, new_frame, alpha_mode);
+			if (image->gif_stream)
+				image->cur_frame = new_frame;
+			else
+				decode_new_frame(image, new_frame, alpha_mode);
 			return true;
 		}
 	}
@@ -434,6 +752,20 @@ gs_image_file_update_texture_internal(gs_image_file_t *image,
 	if (!image->is_animated_gif || !image->loaded)
 		return;
 
+	if (image->gif_stream) {
+		struct gs_gif_stream *stream = image->gif_stream;
+
+		if (!gif_stream_request(stream, image->cur_frame))
+			return;
+
+		pthread_mutex_lock(&stream->mutex);
+		gs_texture_set_image(image->texture,
+				     gif_stream_slot(stream, image->cur_frame),
+				     image->gif.width * 4, false);
+		pthread_mutex_unlock(&stream->mutex);
+		return;
+	}
+
 	if (!image->animation_frame_cache[image->cur_frame])
 		decode_new_frame(image, image->cur_frame, alpha_mode);
 
@@ -463,3 +795,407 @@ void gs_image_file4_update_texture(gs_image_file4_t *if4)
 	gs_image_file_update_texture_internal(&if4->image3.image2.image,
 					      if4->image3.alpha_mode);
 }
+
+/* ------------------------------------------------------------------------- */
+/* shared images */
+
+#define DEFAULT_IMAGE_CACHE_BUDGET (256ULL * 1024ULL * 1024ULL)
+
+struct gs_shared_image {
+	char *path;
+	int64_t mtime_ns;
+	int64_t file_size;
+	enum gs_image_alpha_mode alpha_mode;
+	uint32_t max_cx;
+	uint32_t max_cy;
+	long refs;
+	uint64_t last_used;
+
+	uint8_t *data;
+	gs_texture_t *texture;
+	enum gs_color_format format;
+	enum gs_color_space space;
+	uint32_t cx;
+	uint32_t cy;
+
+	/* the decoded pixels are freed once the texture has been created */
+	uint64_t data_size;
+	uint64_t texture_size;
+};
+
+static pthread_mutex_t image_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DARRAY(struct gs_shared_image *) image_cache;
+static uint64_t image_cache_budget = DEFAULT_IMAGE_CACHE_BUDGET;
+static uint64_t image_cache_size = 0;
+static uint64_t image_cache_counter = 0;
+
+static void shared_image_destroy(struct gs_shared_image *image)
+{
+	gs_texture_destroy(image->texture);
+	bfree(image->data);
+	bfree(image->path);
+	bfree(image);
+}
+
+static int cmp_last_used(const void *a, const void *b)
+{
+	const struct gs_shared_image *ia =
+		*(const struct gs_shared_image *const *)a;
+	const struct gs_shared_image *ib =
+		*(const struct gs_shared_image *const *)b;
+
+	if (ia->last_used == ib->last_used)
+		return 0;
+	return ia->last_used < ib->last_used ? -1 : 1;
+}
+
+/* frees unreferenced images, least recently used first, until the cache is
+ * within budget.  images with a texture can only be freed within the
+ * graphics context. */
+static void image_cache_trim(uint64_t budget, bool graphics)
+{
+	DARRAY(struct gs_shared_image *) unused;
+
+	if (image_cache_size <= budget)
+		return;
+
+	da_init(unused);
+	for (size_t i = 0; i < image_cache.num; i++) {
+		struct gs_shared_image *image = image_cache.array[i];
+		if (!image->refs && (graphics || !image->texture))
+			da_push_back(unused, &image);
+	}
+
+	qsort(unused.array, unused.num, sizeof(struct gs_shared_image *),
+	      cmp_last_used);
+
+	for (size_t i = 0; i < unused.num && image_cache_size > budget; i++) {
+		struct gs_shared_image *image = unused.array[i];
+
+		da_erase_item(image_cache, &image);
+		image_cache_size -= image->data_size + image->texture_size;
+		shared_image_destroy(image);
+	}
+
+	if (!image_cache.num)
+		da_free(image_cache);
+	da_free(unused);
+}
+
+/* unreferenced images with a texture are only freed when the budget is
+ * applied from within the graphics context */
+static inline void image_cache_trim_budget(void)
+{
+	image_cache_trim(image_cache_budget, gs_get_context() != NULL);
+}
+
+static struct gs_shared_image *
+image_cache_find(const struct gs_shared_image *key)
+{
+	for (size_t i = 0; i < image_cache.num; i++) {
+		struct gs_shared_image *image = image_cache.array[i];
+		if (image->mtime_ns == key->mtime_ns &&
+		    image->file_size == key->file_size &&
+		    image->alpha_mode == key->alpha_mode &&
+		    image->max_cx == key->max_cx &&
+		    image->max_cy == key->max_cy &&
+		    strcmp(image->path, key->path) == 0)
+			return image;
+	}
+
+	return NULL;
+}
+
+/* a file rewritten within the same second still has to miss the cache, so
+ * the sub-second modification time is used where the platform has it */
+static void get_file_stamp(const char *path, int64_t *mtime_ns, int64_t *size)
+{
+	struct stat st;
+
+	if (os_stat(path, &st) != 0) {
+		*mtime_ns = -1;
+		*size = -1;
+		return;
+	}
+
+#if defined(__APPLE__)
+	*mtime_ns = (int64_t)st.st_mtimespec.tv_sec * 1000000000 +
+		    st.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+	*mtime_ns = (int64_t)st.st_mtime * 1000000000;
+#else
+	*mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 +
+		    st.st_mtim.tv_nsec;
+#endif
+	*size = (int64_t)st.st_size;
+}
+
+static inline void shared_image_addref(struct gs_shared_image *image)
+{
+	image->refs++;
+	image->last_used = ++image_cache_counter;
+}
+
+static inline enum video_format
+shared_image_video_format(enum gs_color_format format)
+{
+	switch (format) {
+	case GS_RGBA:
+		return VIDEO_FORMAT_RGBA;
+	case GS_BGRA:
+		return VIDEO_FORMAT_BGRA;
+	case GS_BGRX:
+		return VIDEO_FORMAT_BGRX;
+	default:
+		return VIDEO_FORMAT_NONE;
+	}
+}
+
+/* downscales the decoded pixels to fit within max_cx x max_cy, keeping the
+ * aspect ratio.  only 8-bit formats are scaled, others are left as is. */
+static void shared_image_fit(struct gs_shared_image *image)
+{
+	struct video_scale_info src = {0};
+	struct video_scale_info dst = {0};
+	video_scaler_t *scaler = NULL;
+	uint8_t *data;
+
+	uint32_t max_cx = image->max_cx ? image->max_cx : image->cx;
+	uint32_t max_cy = image->max_cy ? image->max_cy : image->cy;
+
+	if (image->cx <= max_cx && image->cy <= max_cy)
+		return;
+
+	src.format = shared_image_video_format(image->format);
+	if (src.format == VIDEO_FORMAT_NONE)
+		return;
+
+	src.width = image->cx;
+	src.height = image->cy;
+	src.range = VIDEO_RANGE_FULL;
+	src.colorspace = VIDEO_CS_SRGB;
+	dst = src;
+
+	double scale_x = (double)max_cx / (double)image->cx;
+	double scale_y = (double)max_cy / (double)image->cy;
+	double scale = scale_x < scale_y ? scale_x : scale_y;
+
+	dst.width = (uint32_t)((double)image->cx * scale + 0.5);
+	dst.height = (uint32_t)((double)image->cy * scale + 0.5);
+	if (!dst.width)
+		dst.width = 1;
+	if (!dst.height)
+		dst.height = 1;
+
+	if (video_scaler_create(&scaler, &dst, &src, VIDEO_SCALE_BILINEAR) !=
+	    VIDEO_SCALER_SUCCESS)
+		return;
+
+	data = bmalloc((size_t)dst.width * dst.height * 4);
+
+	const uint8_t *input[] = {image->data};
+	const uint32_t in_linesize[] = {image->cx * 4};
+	uint8_t *output[] = {data};
+	const uint32_t out_linesize[] = {dst.width * 4};
+
+	if (video_scaler_scale(scaler, output, out_linesize, input,
+			       in_linesize)) {
+		bfree(image->data);
+		image->data = data;
+		image->cx = dst.width;
+		image->cy = dst.height;
+	} else {
+		bfree(data);
+	}
+
+	video_scaler_destroy(scaler);
+}
+
+static gs_shared_image_t *
+shared_image_get_internal(const char *file, enum gs_image_alpha_mode alpha_mode,
+			  uint32_t max_cx, uint32_t max_cy)
+{
+	struct gs_shared_image *image;
+	struct gs_shared_image *existing;
+
+	if (!file || !*file)
+		return NULL;
+
+	image = bzalloc(sizeof(*image));
+	image->path = os_get_abs_path_ptr(file);
+	if (!image->path)
+		image->path = bstrdup(file);
+	image->alpha_mode = alpha_mode;
+	image->max_cx = max_cx;
+	image->max_cy = max_cy;
+	get_file_stamp(image->path, &image->mtime_ns, &image->file_size);
+
+	pthread_mutex_lock(&image_cache_mutex);
+	existing = image_cache_find(image);
+	if (existing)
+		shared_image_addref(existing);
+	pthread_mutex_unlock(&image_cache_mutex);
+
+	if (existing) {
+		bfree(image->path);
+		bfree(image);
+		return existing;
+	}
+
+	/* decode outside of the lock, other users may be loading too */
+	image->data = gs_create_texture_file_data3(image->path, alpha_mode,
+						   &image->format, &image->cx,
+						   &image->cy, &image->space);
+	if (!image->data) {
+		blog(LOG_WARNING, "Failed to load file '%s'", file);
+		bfree(image->path);
+		bfree(image);
+		return NULL;
+	}
+
+	shared_image_fit(image);
+
+	image->data_size = (uint64_t)image->cx * image->cy *
+			   gs_get_format_bpp(image->format) / 8;
+
+	pthread_mutex_lock(&image_cache_mutex);
+
+	existing = image_cache_find(image);
+	if (existing) {
+		shared_image_addref(existing);
+	} else {
+		shared_image_addref(image);
+		da_push_back(image_cache, &image);
+		image_cache_size += image->data_size;
+		image_cache_trim_budget();
+	}
+
+	pthread_mutex_unlock(&image_cache_mutex);
+
+	if (existing) {
+		bfree(image->data);
+		bfree(image->path);
+		bfree(image);
+		image = existing;
+	}
+
+	return image;
+}
+
+gs_shared_image_t *gs_shared_image_get(const char *file,
+				       enum gs_image_alpha_mode alpha_mode)
+{
+	return shared_image_get_internal(file, alpha_mode, 0, 0);
+}
+
+gs_shared_image_t *gs_shared_image_get_scaled(const char *file,
+					      enum gs_image_alpha_mode alpha_mode,
+					      uint32_t max_cx, uint32_t max_cy)
+{
+	return shared_image_get_internal(file, alpha_mode, max_cx, max_cy);
+}
+
+void gs_shared_image_release(gs_shared_image_t *image)
+{
+	if (!image)
+		return;
+
+	pthread_mutex_lock(&image_cache_mutex);
+	if (--image->refs == 0)
+		image_cache_trim(image_cache_budget, true);
+	pthread_mutex_unlock(&image_cache_mutex);
+}
+
+gs_texture_t *gs_shared_image_get_texture(gs_shared_image_t *image)
+{
+	gs_texture_t *texture;
+
+	if (!image)
+		return NULL;
+
+	pthread_mutex_lock(&image_cache_mutex);
+
+	if (!image->texture && image->data) {
+		image->texture = gs_texture_create(
+			image->cx, image->cy, image->format, 1,
+			(const uint8_t **)&image->data, 0);
+
+		/* the texture holds the pixels from now on */
+		if (image->texture) {
+			image->texture_size = image->data_size;
+			bfree(image->data);
+			image->data = NULL;
+			image->data_size = 0;
+		}
+	}
+	texture = image->texture;
+
+	pthread_mutex_unlock(&image_cache_mutex);
+
+	return texture;
+}
+
+uint32_t gs_shared_image_get_width(const gs_shared_image_t *image)
+{
+	return image ? image->cx : 0;
+}
+
+uint32_t gs_shared_image_get_height(const gs_shared_image_t *image)
+{
+	return image ? image->cy : 0;
+}
+
+enum gs_color_space gs_shared_image_get_space(const gs_shared_image_t *image)
+{
+	return image ? image->space : GS_CS_SRGB;
+}
+
+uint64_t gs_shared_image_get_mem_usage(const gs_shared_image_t *image)
+{
+	uint64_t size = 0;
+
+	if (image) {
+		pthread_mutex_lock(&image_cache_mutex);
+		size = image->data_size;
+		pthread_mutex_unlock(&image_cache_mutex);
+	}
+
+	return size;
+}
+
+void gs_image_cache_set_budget(uint64_t bytes)
+{
+	pthread_mutex_lock(&image_cache_mutex);
+	image_cache_budget = bytes;
+	image_cache_trim_budget();
+	pthread_mutex_unlock(&image_cache_mutex);
+}
+
+uint64_t gs_image_cache_get_budget(void)
+{
+	uint64_t budget;
+
+	pthread_mutex_lock(&image_cache_mutex);
+	budget = image_cache_budget;
+	pthread_mutex_unlock(&image_cache_mutex);
+
+	return budget;
+}
+
+uint64_t gs_image_cache_get_resident_size(void)
+{
+	uint64_t size;
+
+	pthread_mutex_lock(&image_cache_mutex);
+	size = image_cache_size;
+	pthread_mutex_unlock(&image_cache_mutex);
+
+	return size;
+}
+
+void gs_image_cache_purge(void)
+{
+	pthread_mutex_lock(&image_cache_mutex);
+	image_cache_trim(0, true);
+	pthread_mutex_unlock(&image_cache_mutex);
+}
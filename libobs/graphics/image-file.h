@@ -44,6 +44,10 @@ struct gs_image_file {
 
 	uint8_t *texture_data;
 	gif_bitmap_callback_vt bitmap_callbacks;
+
+	/* set when the GIF is too large for the GIF memory budget, frames
+	 * are then decoded ahead on a thread into a small window */
+	struct gs_gif_stream *gif_stream;
 };
 
 struct gs_image_file2 {
@@ -66,6 +70,9 @@ typedef struct gs_image_file2 gs_image_file2_t;
 typedef struct gs_image_file3 gs_image_file3_t;
 typedef struct gs_image_file4 gs_image_file4_t;
 
+/** Whether the file has a .gif extension and may be animated */
+EXPORT bool gs_image_file_is_gif(const char *file);
+
 EXPORT void gs_image_file_init(gs_image_file_t *image, const char *file);
 EXPORT void gs_image_file_free(gs_image_file_t *image);
 
@@ -125,6 +132,73 @@ static void gs_image_file4_init_texture(gs_image_file4_t *if4)
 	gs_image_file3_init_texture(&if4->image3);
 }
 
+/**
+ * Sets the memory budget for fully decoded animated GIFs.  GIFs that would
+ * exceed it keep only a few decoded frames and decode the next ones on a
+ * background thread while playing.
+ */
+EXPORT void gs_image_file_set_gif_budget(uint64_t bytes);
+EXPORT uint64_t gs_image_file_get_gif_budget(void);
+
+/* ------------------------------------------------------------------------- */
+/* shared images */
+
+/*
+ * Decoded images shared by everything that references the same file with
+ * the same alpha mode.  Entries are keyed by canonical path, file size,
+ * modification time and alpha mode, so a changed file gets a new entry.
+ * Only the first frame is decoded, animated GIFs still need their own
+ * gs_image_file.
+ *
+ * Unreferenced entries are kept until the cache exceeds its memory budget,
+ * then the least recently used ones are freed.  Entries with a texture are
+ * only freed within the graphics context.
+ */
+struct gs_shared_image;
+typedef struct gs_shared_image gs_shared_image_t;
+
+/**
+ * Gets a reference to a shared image, decoding the file if necessary.  Can
+ * be called outside of the graphics context.
+ *
+ * @return NULL if the file could not be loaded
+ */
+EXPORT gs_shared_image_t *
+gs_shared_image_get(const char *file, enum gs_image_alpha_mode alpha_mode);
+
+/**
+ * Same as gs_shared_image_get, but larger images are downscaled to fit
+ * within max_cx x max_cy while keeping their aspect ratio.  Scaled images
+ * are cached separately from the full size image.
+ */
+EXPORT gs_shared_image_t *
+gs_shared_image_get_scaled(const char *file,
+			   enum gs_image_alpha_mode alpha_mode,
+			   uint32_t max_cx, uint32_t max_cy);
+
+/** Requires the graphics context */
+EXPORT void gs_shared_image_release(gs_shared_image_t *image);
+
+/** Requires the graphics context, creates the texture on first use */
+EXPORT gs_texture_t *gs_shared_image_get_texture(gs_shared_image_t *image);
+
+EXPORT uint32_t gs_shared_image_get_width(const gs_shared_image_t *image);
+EXPORT uint32_t gs_shared_image_get_height(const gs_shared_image_t *image);
+EXPORT enum gs_color_space
+gs_shared_image_get_space(const gs_shared_image_t *image);
+
+/** System memory of the decoded pixels, 0 once the texture exists */
+EXPORT uint64_t gs_shared_image_get_mem_usage(const gs_shared_image_t *image);
+
+EXPORT void gs_image_cache_set_budget(uint64_t bytes);
+EXPORT uint64_t gs_image_cache_get_budget(void);
+
+/** Memory used by all cached images, referenced or not, with textures */
+EXPORT uint64_t gs_image_cache_get_resident_size(void);
+
+/** Frees all unreferenced images, requires the graphics context */
+EXPORT void gs_image_cache_purge(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,298 @@
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include "../util/sse-intrin.h"
+#include "audio-io.h"
+#include "audio-dsp.h"
+
+/* 20 * log10(2) and log2(10) / 20 */
+#define DB_PER_LOG2 6.0205999132796239f
+#define LOG2_PER_DB 0.1660964047443681f
+
+/* exp2 inputs below this are flushed to zero */
+#define MIN_EXP2 -126.0f
+#define MAX_EXP2 127.99f
+
+/* log2(m) = (m - 1) * P(m - 1) for m in [1, 2), max error 8.7e-6 */
+#define LOG2_C0 1.442683252f
+#define LOG2_C1 -0.7204423707f
+#define LOG2_C2 0.4693016887f
+#define LOG2_C3 -0.3033896713f
+#define LOG2_C4 0.1464336188f
+#define LOG2_C5 -0.03459521276f
+
+/* 2^f for f in [0, 1), exact at 0 so 0 dB stays unity gain, max relative
+ * error 2.1e-7 */
+#define EXP2_C0 1.0f
+#define EXP2_C1 0.69314757747f
+#define EXP2_C2 0.24020687403f
+#define EXP2_C3 0.055658664297f
+#define EXP2_C4 0.0091968019324f
+#define EXP2_C5 0.0017896650987f
+
+/* ------------------------------------------------------------------------- */
+/* scalar versions, used for the ends of blocks                              */
+
+union float_bits {
+	float f;
+	uint32_t u;
+};
+
+static inline float fast_log2(float x)
+{
+	union float_bits v;
+
+	/* also covers zero and denormals */
+	v.f = x < FLT_MIN ? FLT_MIN : x;
+
+	float e = (float)((int32_t)(v.u >> 23) - 127);
+	v.u = (v.u & 0x007fffff) | 0x3f800000;
+
+	float t = v.f - 1.0f;
+	float p = LOG2_C5;
+	p = p * t + LOG2_C4;
+	p = p * t + LOG2_C3;
+	p = p * t + LOG2_C2;
+	p = p * t + LOG2_C1;
+	p = p * t + LOG2_C0;
+	return e + p * t;
+}
+
+static inline float fast_exp2(float x)
+{
+	union float_bits v;
+
+	if (!(x >= MIN_EXP2))
+		return 0.0f;
+	if (x > MAX_EXP2)
+		x = MAX_EXP2;
+
+	float fi = floorf(x);
+	float f = x - fi;
+	float p = EXP2_C5;
+	p = p * f + EXP2_C4;
+	p = p * f + EXP2_C3;
+	p = p * f + EXP2_C2;
+	p = p * f + EXP2_C1;
+	p = p * f + EXP2_C0;
+
+	v.u = (uint32_t)((int32_t)fi + 127) << 23;
+	return p * v.f;
+}
+
+/* ------------------------------------------------------------------------- */
+/* SSE versions                                                              */
+
+static inline __m128 fast_log2_ps(__m128 x)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	x = _mm_max_ps(x, _mm_set1_ps(FLT_MIN));
+
+	__m128i bits = _mm_castps_si128(x);
+	__m128i exp = _mm_sub_epi32(_mm_srli_epi32(bits, 23),
+				    _mm_set1_epi32(127));
+	__m128 m = _mm_castsi128_ps(
+		_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)),
+			     _mm_set1_epi32(0x3f800000)));
+
+	__m128 t = _mm_sub_ps(m, one);
+	__m128 p = _mm_set1_ps(LOG2_C5);
+	p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(LOG2_C4));
+	p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(LOG2_C3));
+	p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(LOG2_C2));
+	p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(LOG2_C1));
+	p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(LOG2_C0));
+
+	return _mm_add_ps(_mm_cvtepi32_ps(exp), _mm_mul_ps(p, t));
+}
+
+static inline __m128 fast_exp2_ps(__m128 x)
+{
+	/* false for NaN as well */
+	__m128 valid = _mm_cmpge_ps(x, _mm_set1_ps(MIN_EXP2));
+
+	x = _mm_min_ps(x, _mm_set1_ps(MAX_EXP2));
+	x = _mm_max_ps(x, _mm_set1_ps(MIN_EXP2));
+
+	/* truncation rounds negative numbers up, correct that to floor */
+	__m128i i = _mm_cvttps_epi32(x);
+	__m128 fi = _mm_cvtepi32_ps(i);
+	__m128 round_up = _mm_cmpgt_ps(fi, x);
+	i = _mm_add_epi32(i, _mm_castps_si128(round_up));
+	fi = _mm_sub_ps(fi, _mm_and_ps(round_up, _mm_set1_ps(1.0f)));
+
+	__m128 f = _mm_sub_ps(x, fi);
+	__m128 p = _mm_set1_ps(EXP2_C5);
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(EXP2_C4));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(EXP2_C3));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(EXP2_C2));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(EXP2_C1));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(EXP2_C0));
+
+	__m128 pow2i = _mm_castsi128_ps(
+		_mm_slli_epi32(_mm_add_epi32(i, _mm_set1_epi32(127)), 23));
+
+	return _mm_and_ps(_mm_mul_ps(p, pow2i), valid);
+}
+
+/* ------------------------------------------------------------------------- */
+
+float audio_dsp_mul_to_db(float mul)
+{
+	return fast_log2(mul) * DB_PER_LOG2;
+}
+
+float audio_dsp_db_to_mul(float db)
+{
+	return fast_exp2(db * LOG2_PER_DB);
+}
+
+void audio_dsp_mul_to_db_block(float *dst, const float *src, size_t frames)
+{
+	const __m128 scale = _mm_set1_ps(DB_PER_LOG2);
+	size_t i = 0;
+
+	for (; i + 4 <= frames; i += 4) {
+		__m128 x = _mm_loadu_ps(src + i);
+		_mm_storeu_ps(dst + i, _mm_mul_ps(fast_log2_ps(x), scale));
+	}
+	for (; i < frames; i++)
+		dst[i] = audio_dsp_mul_to_db(src[i]);
+}
+
+void audio_dsp_db_to_mul_block(float *dst, const float *src, size_t frames)
+{
+	const __m128 scale = _mm_set1_ps(LOG2_PER_DB);
+	size_t i = 0;
+
+	for (; i + 4 <= frames; i += 4) {
+		__m128 x = _mm_loadu_ps(src + i);
+		_mm_storeu_ps(dst + i, fast_exp2_ps(_mm_mul_ps(x, scale)));
+	}
+	for (; i < frames; i++)
+		dst[i] = audio_dsp_db_to_mul(src[i]);
+}
+
+static inline float hmax_ps(__m128 v)
+{
+	v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtss_f32(v);
+}
+
+/* the recursion can't be vectorized over time, so up to four channels are
+ * processed at once, one per lane */
+static void peak_envelope_x4(float *env_buf, const float *const *chans,
+			     size_t frames, float envelope, float attack_gain,
+			     float release_gain)
+{
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	const __m128 attack = _mm_set1_ps(attack_gain);
+	const __m128 release = _mm_set1_ps(release_gain);
+	__m128 env = _mm_set1_ps(envelope);
+
+	for (size_t i = 0; i < frames; i++) {
+		__m128 in = _mm_set_ps(chans[3][i], chans[2][i], chans[1][i],
+				       chans[0][i]);
+		in = _mm_and_ps(in, abs_mask);
+
+		__m128 rising = _mm_cmplt_ps(env, in);
+		__m128 gain = _mm_or_ps(_mm_and_ps(rising, attack),
+					_mm_andnot_ps(rising, release));
+
+		env = _mm_add_ps(in, _mm_mul_ps(gain, _mm_sub_ps(env, in)));
+		env_buf[i] = fmaxf(env_buf[i], hmax_ps(env));
+	}
+}
+
+void audio_dsp_peak_envelope(float *env_buf, float *const *samples,
+			     size_t channels, size_t frames, float envelope,
+			     float attack_gain, float release_gain)
+{
+	const float *chans[MAX_AUDIO_CHANNELS];
+	size_t num_chans = 0;
+
+	memset(env_buf, 0, frames * sizeof(float));
+
+	for (size_t i = 0; i < channels && i < MAX_AUDIO_CHANNELS; i++) {
+		if (samples[i])
+			chans[num_chans++] = samples[i];
+	}
+
+	for (size_t i = 0; i < num_chans; i += 4) {
+		const float *group[4];
+
+		/* unused lanes repeat the first channel of the group, which
+		 * does not change the maximum */
+		for (size_t lane = 0; lane < 4; lane++)
+			group[lane] = i + lane < num_chans ? chans[i + lane]
+							   : chans[i];
+
+		peak_envelope_x4(env_buf, group, frames, envelope,
+				 attack_gain, release_gain);
+	}
+}
+
+void audio_dsp_compressor_gain(float *gain, const float *env, size_t frames,
+			       float threshold, float slope, float output_gain)
+{
+	const __m128 to_db = _mm_set1_ps(DB_PER_LOG2);
+	const __m128 to_log2 = _mm_set1_ps(LOG2_PER_DB);
+	const __m128 thres = _mm_set1_ps(threshold);
+	const __m128 slp = _mm_set1_ps(slope);
+	const __m128 out = _mm_set1_ps(output_gain);
+	const __m128 zero = _mm_setzero_ps();
+	size_t i = 0;
+
+	for (; i + 4 <= frames; i += 4) {
+		__m128 env_db = _mm_mul_ps(fast_log2_ps(_mm_loadu_ps(env + i)),
+					   to_db);
+		__m128 g = _mm_mul_ps(slp, _mm_sub_ps(thres, env_db));
+		g = _mm_min_ps(g, zero);
+		g = fast_exp2_ps(_mm_mul_ps(g, to_log2));
+		_mm_storeu_ps(gain + i, _mm_mul_ps(g, out));
+	}
+	for (; i < frames; i++) {
+		float g = slope * (threshold - audio_dsp_mul_to_db(env[i]));
+		gain[i] = audio_dsp_db_to_mul(fminf(0.0f, g)) * output_gain;
+	}
+}
+
+void audio_dsp_db_to_gain(float *gain, const float *db, size_t frames,
+			  float output_gain)
+{
+	const __m128 to_log2 = _mm_set1_ps(LOG2_PER_DB);
+	const __m128 out = _mm_set1_ps(output_gain);
+	const __m128 zero = _mm_setzero_ps();
+	size_t i = 0;
+
+	for (; i + 4 <= frames; i += 4) {
+		__m128 g = _mm_min_ps(_mm_loadu_ps(db + i), zero);
+		g = fast_exp2_ps(_mm_mul_ps(g, to_log2));
+		_mm_storeu_ps(gain + i, _mm_mul_ps(g, out));
+	}
+	for (; i < frames; i++)
+		gain[i] = audio_dsp_db_to_mul(fminf(0.0f, db[i])) * output_gain;
+}
+
+void audio_dsp_apply_gain(float *const *samples, size_t channels,
+			  const float *gain, size_t frames)
+{
+	for (size_t c = 0; c < channels; c++) {
+		float *data = samples[c];
+		size_t i = 0;
+
+		if (!data)
+			continue;
+
+		for (; i + 4 <= frames; i += 4) {
+			__m128 v = _mm_loadu_ps(data + i);
+			v = _mm_mul_ps(v, _mm_loadu_ps(gain + i));
+			_mm_storeu_ps(data + i, v);
+		}
+		for (; i < frames; i++)
+			data[i] *= gain[i];
+	}
+}
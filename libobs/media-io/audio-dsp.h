@@ -0,0 +1,67 @@
+#pragma once
+
+#include "../util/c99defs.h"
+
+/*
+ * Block processing kernels for dynamics filters (compressor, limiter,
+ * expander).  The dB conversions use polynomial approximations of log2/exp2
+ * instead of log10f/powf and process four samples at a time.
+ *
+ * Accuracy compared to mul_to_db/db_to_mul from audio-math.h:
+ *   audio_dsp_mul_to_db: absolute error below AUDIO_DSP_DB_MAX_ERROR dB for
+ *                        normal numbers, values below FLT_MIN are treated as
+ *                        FLT_MIN (about -758 dB) instead of -inf
+ *   audio_dsp_db_to_mul: relative error below AUDIO_DSP_MUL_MAX_ERROR, values
+ *                        below -758 dB (and -inf) return 0
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AUDIO_DSP_DB_MAX_ERROR 0.0001f
+#define AUDIO_DSP_MUL_MAX_ERROR 0.00001f
+
+EXPORT float audio_dsp_mul_to_db(float mul);
+EXPORT float audio_dsp_db_to_mul(float db);
+
+EXPORT void audio_dsp_mul_to_db_block(float *dst, const float *src,
+				      size_t frames);
+EXPORT void audio_dsp_db_to_mul_block(float *dst, const float *src,
+				      size_t frames);
+
+/**
+ * Peak envelope follower.  Every channel starts at envelope, env_buf receives
+ * the maximum of the channel envelopes.  NULL channels are skipped, env_buf is
+ * all zero if every channel is NULL.
+ */
+EXPORT void audio_dsp_peak_envelope(float *env_buf, float *const *samples,
+				    size_t channels, size_t frames,
+				    float envelope, float attack_gain,
+				    float release_gain);
+
+/**
+ * Compressor/limiter gain computation:
+ *   gain = db_to_mul(min(0, slope * (threshold - mul_to_db(env)))) *
+ *          output_gain
+ * gain and env may point to the same buffer.
+ */
+EXPORT void audio_dsp_compressor_gain(float *gain, const float *env,
+				      size_t frames, float threshold,
+				      float slope, float output_gain);
+
+/**
+ * Converts a gain reduction in dB to a multiplier:
+ *   gain = db_to_mul(min(0, db)) * output_gain
+ * gain and db may point to the same buffer.
+ */
+EXPORT void audio_dsp_db_to_gain(float *gain, const float *db, size_t frames,
+				 float output_gain);
+
+/** Multiplies every channel with gain, NULL channels are skipped */
+EXPORT void audio_dsp_apply_gain(float *const *samples, size_t channels,
+				 const float *gain, size_t frames);
+
+#ifdef __cplusplus
+}
+#endif
@@ -66,6 +66,7 @@ struct audio_output {
 	size_t block_size;
 	size_t channels;
 	size_t planes;
+	uint32_t frames;
 
 	pthread_t thread;
 	os_event_t *stop_event;
@@ -157,7 +158,7 @@ static inline void clamp_audio_output(struct audio_output *audio, size_t bytes)
 static void input_and_output(struct audio_output *audio, uint64_t audio_time,
 			     uint64_t prev_time)
 {
-	size_t bytes = AUDIO_OUTPUT_FRAMES * audio->block_size;
+	size_t bytes = audio->frames * audio->block_size;
 	struct audio_output_data data[MAX_AUDIO_MIXES];
 	uint32_t active_mixes = 0;
 	uint64_t new_ts = 0;
@@ -182,10 +183,10 @@ static void input_and_output(struct audio_output *audio, uint64_t audio_time,
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
 		struct audio_mix *mix = &audio->mixes[mix_idx];
 
-		memset(mix->buffer, 0, sizeof(mix->buffer));
-
-		for (size_t i = 0; i < audio->planes; i++)
+		for (size_t i = 0; i < audio->planes; i++) {
+			memset(mix->buffer[i], 0, bytes);
 			data[mix_idx].data[i] = mix->buffer[i];
+		}
 	}
 
 	/* get new audio data */
@@ -199,7 +200,7 @@ static void input_and_output(struct audio_output *audio, uint64_t audio_time,
 
 	/* output */
 	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++)
-		do_audio_output(audio, i, new_ts, AUDIO_OUTPUT_FRAMES);
+		do_audio_output(audio, i, new_ts, audio->frames);
 }
 
 static void *audio_thread(void *param)
@@ -222,7 +223,7 @@ static void *audio_thread(void *param)
 				   "audio_thread(%s)", audio->info.name);
 
 	while (os_event_try(audio->stop_event) == EAGAIN) {
-		samples += AUDIO_OUTPUT_FRAMES;
+		samples += audio->frames;
 		uint64_t audio_time =
 			start_time + audio_frames_to_ns(rate, samples);
 
@@ -357,7 +358,9 @@ void audio_output_disconnect(audio_t *audio, size_t mix_idx,
 static inline bool valid_audio_params(const struct audio_output_info *info)
 {
 	return info->format && info->name && info->samples_per_sec > 0 &&
-	       info->speakers > 0;
+	       info->speakers > 0 &&
+	       (!info->frames_per_tick ||
+		valid_audio_frames_per_tick(info->frames_per_tick));
 }
 
 int audio_output_open(audio_t **audio, struct audio_output_info *info)
@@ -379,6 +382,9 @@ int audio_output_open(audio_t **audio, struct audio_output_info *info)
 	out->input_param = info->input_param;
 	out->block_size = (planar ? 1 : out->channels) *
 			  get_audio_bytes_per_channel(info->format);
+	out->frames = info->frames_per_tick ? info->frames_per_tick
+					    : AUDIO_OUTPUT_FRAMES;
+	out->info.frames_per_tick = out->frames;
 
 	if (pthread_mutex_init_recursive(&out->input_mutex) != 0)
 		goto fail0;
@@ -464,3 +470,8 @@ uint32_t audio_output_get_sample_rate(const audio_t *audio)
 {
 	return audio ? audio->info.samples_per_sec : 0;
 }
+
+uint32_t audio_output_get_frames_per_tick(const audio_t *audio)
+{
+	return audio ? audio->frames : 0;
+}
@@ -27,7 +27,10 @@ extern "C" {
 
 #define MAX_AUDIO_MIXES 6
 #define MAX_AUDIO_CHANNELS 8
+
+/* default and largest audio tick, per-tick audio buffers are sized for it */
 #define AUDIO_OUTPUT_FRAMES 1024
+#define MIN_AUDIO_OUTPUT_FRAMES 128
 
 #define TOTAL_AUDIO_SIZE                                              \
 	(MAX_AUDIO_MIXES * MAX_AUDIO_CHANNELS * AUDIO_OUTPUT_FRAMES * \
@@ -99,6 +102,11 @@ struct audio_output_info {
 
 	audio_input_callback_t input_callback;
 	void *input_param;
+
+	/* frames mixed per audio tick, a power of two between
+	 * MIN_AUDIO_OUTPUT_FRAMES and AUDIO_OUTPUT_FRAMES.  0 uses
+	 * AUDIO_OUTPUT_FRAMES. */
+	uint32_t frames_per_tick;
 };
 
 struct audio_convert_info {
@@ -198,6 +206,12 @@ static inline uint64_t audio_frames_to_ns(size_t sample_rate, uint64_t frames)
 	return util_mul_div64(frames, 1000000000ULL, sample_rate);
 }
 
+static inline bool valid_audio_frames_per_tick(uint32_t frames)
+{
+	return frames >= MIN_AUDIO_OUTPUT_FRAMES &&
+	       frames <= AUDIO_OUTPUT_FRAMES && (frames & (frames - 1)) == 0;
+}
+
 static inline uint64_t ns_to_audio_frames(size_t sample_rate, uint64_t frames)
 {
 	return util_mul_div64(frames, sample_rate, 1000000000ULL);
@@ -226,6 +240,7 @@ EXPORT size_t audio_output_get_block_size(const audio_t *audio);
 EXPORT size_t audio_output_get_planes(const audio_t *audio);
 EXPORT size_t audio_output_get_channels(const audio_t *audio);
 EXPORT uint32_t audio_output_get_sample_rate(const audio_t *audio);
+EXPORT uint32_t audio_output_get_frames_per_tick(const audio_t *audio);
 EXPORT const struct audio_output_info *
 audio_output_get_info(const audio_t *audio);
 
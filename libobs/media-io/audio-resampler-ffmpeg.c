@@ -17,12 +17,15 @@
 
 #include "../util/bmem.h"
 #include "audio-resampler.h"
+#include "audio-resampler-native.h"
 #include "audio-io.h"
 #include <libavutil/avutil.h>
 #include <libavformat/avformat.h>
 #include <libswresample/swresample.h>
 
 struct audio_resampler {
+	struct native_resampler *native;
+
 	struct SwrContext *context;
 	bool opened;
 
@@ -94,9 +97,31 @@ static inline uint64_t convert_speaker_layout(enum speaker_layout layout)
 audio_resampler_t *audio_resampler_create(const struct resample_info *dst,
 					  const struct resample_info *src)
 {
-	struct audio_resampler *rs = bzalloc(sizeof(struct audio_resampler));
+	return audio_resampler_create_type(dst, src, AUDIO_RESAMPLER_AUTO);
+}
+
+audio_resampler_t *
+audio_resampler_create_type(const struct resample_info *dst,
+			    const struct resample_info *src,
+			    enum audio_resampler_type type)
+{
+	struct audio_resampler *rs;
 	int errcode;
 
+	if (type != AUDIO_RESAMPLER_FFMPEG) {
+		struct native_resampler *native =
+			native_resampler_create(dst, src);
+
+		if (native) {
+			rs = bzalloc(sizeof(struct audio_resampler));
+			rs->native = native;
+			return rs;
+		}
+		if (type == AUDIO_RESAMPLER_NATIVE)
+			return NULL;
+	}
+
+	rs = bzalloc(sizeof(struct audio_resampler));
 	rs->opened = false;
 	rs->input_freq = src->samples_per_sec;
 	rs->input_layout = convert_speaker_layout(src->speakers);
@@ -151,6 +176,7 @@ audio_resampler_t *audio_resampler_create(const struct resample_info *dst,
 void audio_resampler_destroy(audio_resampler_t *rs)
 {
 	if (rs) {
+		native_resampler_destroy(rs->native);
 		if (rs->context)
 			swr_free(&rs->context);
 		if (rs->output_buffer[0])
@@ -166,6 +192,9 @@ bool audio_resampler_resample(audio_resampler_t *rs, uint8_t *output[],
 {
 	if (!rs)
 		return false;
+	if (rs->native)
+		return native_resampler_resample(rs->native, output, out_frames,
+						 ts_offset, input, in_frames);
 
 	struct SwrContext *context = rs->context;
 	int ret;
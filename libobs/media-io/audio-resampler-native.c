@@ -0,0 +1,632 @@
+#include <math.h>
+#include <string.h>
+
+#include "../util/bmem.h"
+#include "../util/sse-intrin.h"
+#include "../util/util_uint64.h"
+#include "audio-resampler-native.h"
+#include "audio-io.h"
+
+#ifndef M_PI
+#define M_PI 3.1415926535897932384626433832795
+#endif
+
+/* taps per phase when upsampling, scaled up by the ratio when downsampling so
+ * that the transition band stays the same relative to the output rate */
+#define NATIVE_TAPS 64
+#define NATIVE_MAX_DOWNSAMPLE 8
+
+/* cutoff relative to the lower nyquist frequency, the kaiser window gives
+ * about 85 dB of stopband attenuation */
+#define NATIVE_CUTOFF 0.94
+#define NATIVE_KAISER_BETA 8.6
+
+struct native_resampler {
+	enum audio_format in_format;
+	enum audio_format out_format;
+	enum speaker_layout out_speakers;
+	size_t in_ch;
+	size_t out_ch;
+	uint32_t in_freq;
+
+	/* input channel of each output channel, -1 for silence */
+	int map[MAX_AUDIO_CHANNELS];
+	/* output channel that converted input channels are written to when
+	 * the output is float planar */
+	int direct[MAX_AUDIO_CHANNELS];
+
+	/* polyphase filter, phases is 0 if the rate does not change.  the
+	 * output rate is in_freq * phases / step */
+	uint32_t phases;
+	uint32_t step;
+	size_t taps;
+	float *coefs;
+
+	/* input history per input channel, the next output sample is
+	 * computed from hist[pos .. pos + taps) with the filter of phase */
+	float *hist[MAX_AUDIO_CHANNELS];
+	size_t hist_size;
+	size_t hist_cap;
+	size_t pos;
+	uint32_t phase;
+
+	float *tmp[MAX_AUDIO_CHANNELS];
+	uint8_t *out_buf[MAX_AV_PLANES];
+	size_t out_cap;
+};
+
+/* same as the matrix used for mono upmixing with swresample */
+static const float mono_upmix[MAX_AUDIO_CHANNELS][MAX_AUDIO_CHANNELS] = {
+	{1},
+	{1, 1},
+	{1, 1, 0},
+	{1, 1, 1, 1},
+	{1, 1, 1, 0, 1},
+	{1, 1, 1, 1, 1, 1},
+	{1, 1, 1, 0, 1, 1, 1},
+	{1, 1, 1, 0, 1, 1, 1, 1},
+};
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+	while (b) {
+		uint32_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/* ------------------------------------------------------------------------- */
+/* format conversion                                                         */
+
+static void read_s16(float *dst, const int16_t *src, size_t stride,
+		     size_t offset, size_t frames)
+{
+	const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+	size_t i = 0;
+
+	if (stride == 1) {
+		for (; i + 8 <= frames; i += 8) {
+			__m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+			__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v),
+						    16);
+			__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v),
+						    16);
+			_mm_storeu_ps(dst + i,
+				      _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+			_mm_storeu_ps(dst + i + 4,
+				      _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+		}
+
+	} else if (stride == 2) {
+		/* interleaved stereo, the lanes of each 32 bit pair hold
+		 * the left and right channel */
+		for (; i + 4 <= frames; i += 4) {
+			__m128i v = _mm_loadu_si128(
+				(const __m128i *)(src + i * 2));
+			if (offset == 0)
+				v = _mm_slli_epi32(v, 16);
+			v = _mm_srai_epi32(v, 16);
+			_mm_storeu_ps(dst + i,
+				      _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+		}
+	}
+
+	for (; i < frames; i++)
+		dst[i] = (float)src[i * stride + offset] * (1.0f / 32768.0f);
+}
+
+static void read_float(float *dst, const float *src, size_t stride,
+		       size_t offset, size_t frames)
+{
+	size_t i = 0;
+
+	if (stride == 1) {
+		memcpy(dst, src, frames * sizeof(float));
+		return;
+	}
+
+	if (stride == 2) {
+		for (; i + 4 <= frames; i += 4) {
+			__m128 a = _mm_loadu_ps(src + i * 2);
+			__m128 b = _mm_loadu_ps(src + i * 2 + 4);
+			__m128 v = offset == 0
+					   ? _mm_shuffle_ps(a, b,
+							    _MM_SHUFFLE(2, 0, 2,
+									0))
+					   : _mm_shuffle_ps(a, b,
+							    _MM_SHUFFLE(3, 1, 3,
+									1));
+			_mm_storeu_ps(dst + i, v);
+		}
+	}
+
+	for (; i < frames; i++)
+		dst[i] = src[i * stride + offset];
+}
+
+/* converts one input channel to float */
+static void read_channel(const struct native_resampler *rs, float *dst,
+			 const uint8_t *const input[], size_t ch, size_t frames)
+{
+	bool planar = is_audio_planar(rs->in_format);
+	const uint8_t *plane = planar ? input[ch] : input[0];
+	size_t stride = planar ? 1 : rs->in_ch;
+	size_t offset = planar ? 0 : ch;
+
+	switch (rs->in_format) {
+	case AUDIO_FORMAT_U8BIT:
+	case AUDIO_FORMAT_U8BIT_PLANAR:
+		for (size_t i = 0; i < frames; i++)
+			dst[i] = ((float)plane[i * stride + offset] - 128.0f) *
+				 (1.0f / 128.0f);
+		break;
+
+	case AUDIO_FORMAT_16BIT:
+	case AUDIO_FORMAT_16BIT_PLANAR:
+		read_s16(dst, (const int16_t *)plane, stride, offset, frames);
+		break;
+
+	case AUDIO_FORMAT_32BIT:
+	case AUDIO_FORMAT_32BIT_PLANAR: {
+		const int32_t *src = (const int32_t *)plane;
+		for (size_t i = 0; i < frames; i++)
+			dst[i] = (float)((double)src[i * stride + offset] *
+					 (1.0 / 2147483648.0));
+		break;
+	}
+
+	case AUDIO_FORMAT_FLOAT:
+	case AUDIO_FORMAT_FLOAT_PLANAR:
+		read_float(dst, (const float *)plane, stride, offset, frames);
+		break;
+
+	case AUDIO_FORMAT_UNKNOWN:
+		break;
+	}
+}
+
+static void write_s16(int16_t *dst, const float *src, size_t stride,
+		      size_t frames)
+{
+	const __m128 scale = _mm_set1_ps(32768.0f);
+	const __m128 min = _mm_set1_ps(-32768.0f);
+	const __m128 max = _mm_set1_ps(32767.0f);
+	size_t i = 0;
+
+	if (stride == 1 && src) {
+		for (; i + 8 <= frames; i += 8) {
+			__m128 a = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+			__m128 b = _mm_mul_ps(_mm_loadu_ps(src + i + 4), scale);
+			a = _mm_min_ps(_mm_max_ps(a, min), max);
+			b = _mm_min_ps(_mm_max_ps(b, min), max);
+			_mm_storeu_si128((__m128i *)(dst + i),
+					 _mm_packs_epi32(_mm_cvtps_epi32(a),
+							 _mm_cvtps_epi32(b)));
+		}
+
+	} else if (src) {
+		/* interleaved, only the rounding is vectorized */
+		for (; i + 4 <= frames; i += 4) {
+			__m128 v = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+			int32_t tmp[4];
+
+			v = _mm_min_ps(_mm_max_ps(v, min), max);
+			_mm_storeu_si128((__m128i *)tmp, _mm_cvtps_epi32(v));
+
+			for (size_t j = 0; j < 4; j++)
+				dst[(i + j) * stride] = (int16_t)tmp[j];
+		}
+	}
+
+	for (; i < frames; i++) {
+		float v = src ? src[i] * 32768.0f : 0.0f;
+		if (v < -32768.0f)
+			v = -32768.0f;
+		else if (v > 32767.0f)
+			v = 32767.0f;
+		dst[i * stride] = (int16_t)lrintf(v);
+	}
+}
+
+/* writes one output channel, src is NULL for silence */
+static void write_channel(struct native_resampler *rs, const float *src,
+			  size_t ch, size_t frames)
+{
+	bool planar = is_audio_planar(rs->out_format);
+	uint8_t *plane = planar ? rs->out_buf[ch] : rs->out_buf[0];
+	size_t stride = planar ? 1 : rs->out_ch;
+	size_t offset = planar ? 0 : ch;
+
+	switch (rs->out_format) {
+	case AUDIO_FORMAT_U8BIT:
+	case AUDIO_FORMAT_U8BIT_PLANAR:
+		for (size_t i = 0; i < frames; i++) {
+			long v = src ? lrintf(src[i] * 128.0f) + 128 : 128;
+			plane[i * stride + offset] =
+				(uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+		}
+		break;
+
+	case AUDIO_FORMAT_16BIT:
+	case AUDIO_FORMAT_16BIT_PLANAR:
+		write_s16((int16_t *)plane + offset, src, stride, frames);
+		break;
+
+	case AUDIO_FORMAT_32BIT:
+	case AUDIO_FORMAT_32BIT_PLANAR: {
+		int32_t *dst = (int32_t *)plane + offset;
+		for (size_t i = 0; i < frames; i++) {
+			double v = src ? (double)src[i] * 2147483648.0 : 0.0;
+			if (v < -2147483648.0)
+				v = -2147483648.0;
+			else if (v > 2147483647.0)
+				v = 2147483647.0;
+			dst[i * stride] = (int32_t)llrint(v);
+		}
+		break;
+	}
+
+	case AUDIO_FORMAT_FLOAT:
+	case AUDIO_FORMAT_FLOAT_PLANAR: {
+		float *dst = (float *)plane + offset;
+		if (stride == 1 && !src)
+			memset(dst, 0, frames * sizeof(float));
+		else if (stride == 1 && src != dst)
+			memcpy(dst, src, frames * sizeof(float));
+		else if (stride != 1)
+			for (size_t i = 0; i < frames; i++)
+				dst[i * stride] = src ? src[i] : 0.0f;
+		break;
+	}
+
+	case AUDIO_FORMAT_UNKNOWN:
+		break;
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* polyphase filter                                                          */
+
+static double bessel_i0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+
+	for (int k = 1; k < 64; k++) {
+		double t = x / (2.0 * k);
+		term *= t * t;
+		sum += term;
+		if (term < sum * 1e-12)
+			break;
+	}
+
+	return sum;
+}
+
+/* windowed sinc, phase p is offset by p / phases input samples.  every phase
+ * is normalized to unity gain at DC. */
+static void build_filter(struct native_resampler *rs)
+{
+	double ratio = (double)rs->phases / (double)rs->step;
+	double fc = NATIVE_CUTOFF * (ratio < 1.0 ? ratio : 1.0);
+	double half = (double)rs->taps / 2.0;
+	double i0_beta = bessel_i0(NATIVE_KAISER_BETA);
+
+	for (uint32_t p = 0; p < rs->phases; p++) {
+		float *coefs = rs->coefs + p * rs->taps;
+		double frac = (double)p / (double)rs->phases;
+		double sum = 0.0;
+
+		for (size_t k = 0; k < rs->taps; k++) {
+			double d = (double)k - (half - 1.0) - frac;
+			double x = d / half;
+			double h, w;
+
+			if (fabs(d) < 1e-9)
+				h = fc;
+			else
+				h = sin(M_PI * fc * d) / (M_PI * d);
+
+			w = x * x < 1.0 ? bessel_i0(NATIVE_KAISER_BETA *
+						    sqrt(1.0 - x * x)) /
+						  i0_beta
+					: 0.0;
+
+			coefs[k] = (float)(h * w);
+			sum += h * w;
+		}
+
+		for (size_t k = 0; k < rs->taps; k++)
+			coefs[k] = (float)(coefs[k] / sum);
+	}
+}
+
+/* taps is a multiple of 8 */
+static inline float dot_product(const float *x, const float *coefs,
+				size_t taps)
+{
+	__m128 acc0 = _mm_setzero_ps();
+	__m128 acc1 = _mm_setzero_ps();
+
+	for (size_t i = 0; i < taps; i += 8) {
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(x + i),
+						   _mm_loadu_ps(coefs + i)));
+		acc1 = _mm_add_ps(acc1,
+				  _mm_mul_ps(_mm_loadu_ps(x + i + 4),
+					     _mm_loadu_ps(coefs + i + 4)));
+	}
+
+	acc0 = _mm_add_ps(acc0, acc1);
+	acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+	acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+	return _mm_cvtss_f32(acc0);
+}
+
+static void run_filter(const struct native_resampler *rs, float *dst,
+		       const float *hist, size_t frames)
+{
+	const uint32_t step_int = rs->step / rs->phases;
+	const uint32_t step_frac = rs->step % rs->phases;
+	size_t pos = rs->pos;
+	uint32_t phase = rs->phase;
+
+	for (size_t i = 0; i < frames; i++) {
+		dst[i] = dot_product(hist + pos, rs->coefs + phase * rs->taps,
+				     rs->taps);
+
+		pos += step_int;
+		phase += step_frac;
+		if (phase >= rs->phases) {
+			phase -= rs->phases;
+			pos++;
+		}
+	}
+}
+
+/* number of output frames the buffered input is enough for */
+static size_t available_frames(const struct native_resampler *rs)
+{
+	uint64_t last;
+
+	if (rs->hist_size < rs->pos + rs->taps)
+		return 0;
+
+	/* the furthest position the filter can start at */
+	last = rs->hist_size - rs->taps - rs->pos;
+	return (size_t)(((last + 1) * rs->phases - 1 - rs->phase) / rs->step +
+			1);
+}
+
+/* time between the next output frame and the end of the buffered input */
+static uint64_t buffered_delay(const struct native_resampler *rs)
+{
+	int64_t center = (int64_t)(rs->pos + rs->taps / 2 - 1) * rs->phases +
+			 rs->phase;
+	int64_t delay = (int64_t)rs->hist_size * rs->phases - center;
+
+	if (delay <= 0)
+		return 0;
+	return util_mul_div64((uint64_t)delay, 1000000000ULL,
+			      (uint64_t)rs->phases * rs->in_freq);
+}
+
+static void append_input(struct native_resampler *rs,
+			 const uint8_t *const input[], uint32_t frames)
+{
+	if (rs->hist_size + frames > rs->hist_cap) {
+		rs->hist_cap = rs->hist_size + frames;
+		for (size_t ch = 0; ch < rs->in_ch; ch++)
+			rs->hist[ch] = brealloc(rs->hist[ch],
+						rs->hist_cap * sizeof(float));
+	}
+
+	for (size_t ch = 0; ch < rs->in_ch; ch++)
+		read_channel(rs, rs->hist[ch] + rs->hist_size, input, ch,
+			     frames);
+
+	rs->hist_size += frames;
+}
+
+static void advance(struct native_resampler *rs, size_t frames)
+{
+	uint64_t total = rs->phase + (uint64_t)frames * rs->step;
+	size_t pos = rs->pos + (size_t)(total / rs->phases);
+
+	rs->phase = (uint32_t)(total % rs->phases);
+
+	for (size_t ch = 0; ch < rs->in_ch; ch++)
+		memmove(rs->hist[ch], rs->hist[ch] + pos,
+			(rs->hist_size - pos) * sizeof(float));
+
+	rs->hist_size -= pos;
+	rs->pos = 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void ensure_output(struct native_resampler *rs, size_t frames)
+{
+	size_t planes;
+	size_t size;
+
+	if (frames <= rs->out_cap)
+		return;
+
+	planes = get_audio_planes(rs->out_format, rs->out_speakers);
+	size = get_audio_size(rs->out_format, rs->out_speakers,
+			      (uint32_t)frames);
+
+	for (size_t i = 0; i < planes; i++) {
+		bfree(rs->out_buf[i]);
+		rs->out_buf[i] = bmalloc(size);
+	}
+
+	if (rs->out_format != AUDIO_FORMAT_FLOAT_PLANAR) {
+		for (size_t ch = 0; ch < rs->in_ch; ch++) {
+			bfree(rs->tmp[ch]);
+			rs->tmp[ch] = bmalloc(frames * sizeof(float));
+		}
+	}
+
+	rs->out_cap = frames;
+}
+
+/* where input channel ch is converted or resampled to */
+static inline float *channel_buffer(struct native_resampler *rs, size_t ch)
+{
+	if (rs->out_format == AUDIO_FORMAT_FLOAT_PLANAR)
+		return (float *)rs->out_buf[rs->direct[ch]];
+	return rs->tmp[ch];
+}
+
+bool native_resampler_supported(const struct resample_info *dst,
+				const struct resample_info *src)
+{
+	uint32_t in_ch = get_audio_channels(src->speakers);
+	uint32_t out_ch = get_audio_channels(dst->speakers);
+
+	if (!in_ch || !out_ch || !get_audio_bytes_per_channel(src->format) ||
+	    !get_audio_bytes_per_channel(dst->format))
+		return false;
+	if (src->speakers != dst->speakers && src->speakers != SPEAKERS_MONO)
+		return false;
+	if (!src->samples_per_sec || !dst->samples_per_sec)
+		return false;
+
+	if (src->samples_per_sec != dst->samples_per_sec) {
+		uint32_t div = gcd(src->samples_per_sec, dst->samples_per_sec);
+		uint32_t phases = dst->samples_per_sec / div;
+		uint32_t step = src->samples_per_sec / div;
+
+		if (phases > NATIVE_MAX_PHASES ||
+		    step > phases * NATIVE_MAX_DOWNSAMPLE)
+			return false;
+	}
+
+	return true;
+}
+
+struct native_resampler *
+native_resampler_create(const struct resample_info *dst,
+			const struct resample_info *src)
+{
+	struct native_resampler *rs;
+
+	if (!native_resampler_supported(dst, src))
+		return NULL;
+
+	rs = bzalloc(sizeof(struct native_resampler));
+	rs->in_format = src->format;
+	rs->out_format = dst->format;
+	rs->out_speakers = dst->speakers;
+	rs->in_ch = get_audio_channels(src->speakers);
+	rs->out_ch = get_audio_channels(dst->speakers);
+	rs->in_freq = src->samples_per_sec;
+
+	for (size_t ch = 0; ch < rs->out_ch; ch++) {
+		if (src->speakers == dst->speakers)
+			rs->map[ch] = (int)ch;
+		else
+			rs->map[ch] = mono_upmix[rs->out_ch - 1][ch] ? 0 : -1;
+	}
+	for (size_t ch = rs->out_ch; ch-- > 0;)
+		if (rs->map[ch] >= 0)
+			rs->direct[rs->map[ch]] = (int)ch;
+
+	if (src->samples_per_sec != dst->samples_per_sec) {
+		uint32_t div = gcd(src->samples_per_sec, dst->samples_per_sec);
+		size_t taps = NATIVE_TAPS;
+
+		rs->phases = dst->samples_per_sec / div;
+		rs->step = src->samples_per_sec / div;
+		if (rs->step > rs->phases)
+			taps = (NATIVE_TAPS * rs->step + rs->phases - 1) /
+			       rs->phases;
+		rs->taps = (taps + 7) & ~(size_t)7;
+
+		rs->coefs = bmalloc(rs->phases * rs->taps * sizeof(float));
+		build_filter(rs);
+
+		/* the first output frame is centered on the first input
+		 * frame */
+		rs->hist_size = rs->taps / 2 - 1;
+		rs->hist_cap = rs->taps + AUDIO_OUTPUT_FRAMES;
+		for (size_t ch = 0; ch < rs->in_ch; ch++)
+			rs->hist[ch] =
+				bzalloc(rs->hist_cap * sizeof(float));
+	}
+
+	ensure_output(rs, AUDIO_OUTPUT_FRAMES);
+	return rs;
+}
+
+void native_resampler_destroy(struct native_resampler *rs)
+{
+	if (!rs)
+		return;
+
+	for (size_t i = 0; i < MAX_AV_PLANES; i++)
+		bfree(rs->out_buf[i]);
+	for (size_t ch = 0; ch < MAX_AUDIO_CHANNELS; ch++) {
+		bfree(rs->hist[ch]);
+		bfree(rs->tmp[ch]);
+	}
+	bfree(rs->coefs);
+	bfree(rs);
+}
+
+bool native_resampler_resample(struct native_resampler *rs, uint8_t *output[],
+			       uint32_t *out_frames, uint64_t *ts_offset,
+			       const uint8_t *const input[], uint32_t in_frames)
+{
+	const float *channels[MAX_AUDIO_CHANNELS];
+	size_t frames;
+
+	if (!rs->phases) {
+		/* format or layout conversion only */
+		frames = in_frames;
+		ensure_output(rs, frames);
+
+		for (size_t ch = 0; ch < rs->in_ch; ch++) {
+			if (rs->in_format == AUDIO_FORMAT_FLOAT_PLANAR) {
+				channels[ch] = (const float *)input[ch];
+			} else {
+				float *buf = channel_buffer(rs, ch);
+				read_channel(rs, buf, input, ch, frames);
+				channels[ch] = buf;
+			}
+		}
+
+		*ts_offset = 0;
+	} else {
+		*ts_offset = buffered_delay(rs);
+
+		append_input(rs, input, in_frames);
+		frames = available_frames(rs);
+		ensure_output(rs, frames);
+
+		for (size_t ch = 0; ch < rs->in_ch; ch++) {
+			float *buf = channel_buffer(rs, ch);
+			run_filter(rs, buf, rs->hist[ch], frames);
+			channels[ch] = buf;
+		}
+
+		advance(rs, frames);
+	}
+
+	for (size_t ch = 0; ch < rs->out_ch; ch++) {
+		int in_ch = rs->map[ch];
+		write_channel(rs, in_ch >= 0 ? channels[in_ch] : NULL, ch,
+			      frames);
+	}
+
+	for (size_t i = 0; i < get_audio_planes(rs->out_format,
+						rs->out_speakers);
+	     i++)
+		output[i] = rs->out_buf[i];
+
+	*out_frames = (uint32_t)frames;
+	return true;
+}
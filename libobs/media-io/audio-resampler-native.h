@@ -0,0 +1,40 @@
+#pragma once
+
+#include "audio-resampler.h"
+
+/*
+ * Native resampler backend, used by audio_resampler_create before falling back
+ * to swresample.  Supports any format conversion, an unchanged speaker layout
+ * or a mono upmix, and rate conversion for rational ratios with up to
+ * NATIVE_MAX_PHASES filter phases (44.1 <-> 48 kHz, 32 -> 48 kHz, etc).
+ *
+ * Conversions without a rate change do not allocate after the first call
+ * with the largest frame count.  Rate changes use a windowed sinc polyphase
+ * filter with SSE dot products.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NATIVE_MAX_PHASES 1024
+
+struct native_resampler;
+
+extern bool native_resampler_supported(const struct resample_info *dst,
+				       const struct resample_info *src);
+
+extern struct native_resampler *
+native_resampler_create(const struct resample_info *dst,
+			const struct resample_info *src);
+extern void native_resampler_destroy(struct native_resampler *rs);
+
+extern bool native_resampler_resample(struct native_resampler *rs,
+				      uint8_t *output[], uint32_t *out_frames,
+				      uint64_t *ts_offset,
+				      const uint8_t *const input[],
+				      uint32_t in_frames);
+
+#ifdef __cplusplus
+}
+#endif
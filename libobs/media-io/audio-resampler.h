@@ -33,9 +33,20 @@ struct resample_info {
 	enum speaker_layout speakers;
 };
 
+enum audio_resampler_type {
+	/* native when it supports the conversion, swresample otherwise */
+	AUDIO_RESAMPLER_AUTO,
+	AUDIO_RESAMPLER_NATIVE,
+	AUDIO_RESAMPLER_FFMPEG,
+};
+
 EXPORT audio_resampler_t *
 audio_resampler_create(const struct resample_info *dst,
 		       const struct resample_info *src);
+EXPORT audio_resampler_t *
+audio_resampler_create_type(const struct resample_info *dst,
+			    const struct resample_info *src,
+			    enum audio_resampler_type type);
 EXPORT void audio_resampler_destroy(audio_resampler_t *resampler);
 
 EXPORT bool audio_resampler_resample(audio_resampler_t *resampler,
@@ -19,7 +19,9 @@
 
 #include "../util/base.h"
 #include "../util/bmem.h"
+#include "../util/circlebuf.h"
 #include "../util/platform.h"
+#include "../util/threading.h"
 
 #include <libavformat/avformat.h>
 #if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(59, 20, 100)
@@ -34,11 +36,98 @@
 #define CODEC_FLAG_GLOBAL_H CODEC_FLAG_GLOBAL_HEADER
 #endif
 
+#define DEFAULT_IO_BUFFER_SIZE (1024 * 1024)
+#define READ_AHEAD_PACKETS 256
+
 struct media_remux_job {
 	int64_t in_size;
 	AVFormatContext *ifmt_ctx, *ofmt_ctx;
+
+	struct media_remux_options options;
+
+	FILE *in_file;
+	FILE *out_file;
+	AVIOContext *in_pb;
+
+	/* the byte counts are updated by the demux and mux threads and read by
+	 * media_remux_job_get_stats */
+	pthread_mutex_t stats_mutex;
+	uint64_t bytes_read;
+	uint64_t bytes_written;
+	uint64_t start_ts;
+	uint64_t end_ts;
+
+	/* read-ahead queue, filled by the demux thread */
+	pthread_t read_thread;
+	pthread_mutex_t queue_mutex;
+	struct circlebuf queue;
+	os_sem_t *queue_free;
+	os_sem_t *queue_filled;
+	volatile bool read_stop;
+	int read_error;
+
+	/* time bases of the streams known when processing starts, the demux
+	 * thread may add streams to ifmt_ctx while packets are processed */
+	AVRational *time_bases;
+	unsigned num_streams;
 };
 
+static int read_av_buffer(void *opaque, uint8_t *buf, int buf_size)
+{
+	media_remux_job_t job = opaque;
+	size_t size = fread(buf, 1, buf_size, job->in_file);
+
+	if (!size)
+		return feof(job->in_file) ? AVERROR_EOF : AVERROR(EIO);
+
+	pthread_mutex_lock(&job->stats_mutex);
+	job->bytes_read += size;
+	pthread_mutex_unlock(&job->stats_mutex);
+	return (int)size;
+}
+
+static int write_av_buffer(void *opaque, uint8_t *buf, int buf_size)
+{
+	media_remux_job_t job = opaque;
+	size_t size = fwrite(buf, 1, buf_size, job->out_file);
+
+	pthread_mutex_lock(&job->stats_mutex);
+	job->bytes_written += size;
+	pthread_mutex_unlock(&job->stats_mutex);
+	return size == (size_t)buf_size ? (int)size : AVERROR(EIO);
+}
+
+static int64_t seek_file(FILE *file, int64_t size, int64_t offset,
+			 int whence)
+{
+	if (whence == AVSEEK_SIZE)
+		return size;
+
+	if (os_fseeki64(file, offset, whence & ~AVSEEK_FORCE) != 0)
+		return -1;
+	return os_ftelli64(file);
+}
+
+static int64_t seek_in_av_buffer(void *opaque, int64_t offset, int whence)
+{
+	media_remux_job_t job = opaque;
+	return seek_file(job->in_file, job->in_size, offset, whence);
+}
+
+static int64_t seek_out_av_buffer(void *opaque, int64_t offset, int whence)
+{
+	media_remux_job_t job = opaque;
+	return seek_file(job->out_file, -1, offset, whence);
+}
+
+static inline void free_pb(AVIOContext **pb)
+{
+	if (*pb) {
+		av_freep(&(*pb)->buffer);
+		avio_context_free(pb);
+	}
+}
+
 static inline void init_size(media_remux_job_t job, const char *in_filename)
 {
 #ifdef _MSC_VER
@@ -53,7 +142,26 @@ static inline void init_size(media_remux_job_t job, const char *in_filename)
 
 static inline bool init_input(media_remux_job_t job, const char *in_filename)
 {
-	int ret = avformat_open_input(&job->ifmt_ctx, in_filename, NULL, NULL);
+	int buf_size = (int)job->options.io_buffer_size;
+	int ret;
+
+	job->in_file = os_fopen(in_filename, "rb");
+	if (!job->in_file) {
+		blog(LOG_ERROR, "media_remux: Could not open input file '%s'",
+		     in_filename);
+		return false;
+	}
+
+	/* large sequential reads instead of libavformat's default 32k */
+	job->in_pb = avio_alloc_context(av_malloc(buf_size), buf_size, 0, job,
+					read_av_buffer, NULL,
+					seek_in_av_buffer);
+
+	job->ifmt_ctx = avformat_alloc_context();
+	job->ifmt_ctx->pb = job->in_pb;
+	job->ifmt_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+	ret = avformat_open_input(&job->ifmt_ctx, in_filename, NULL, NULL);
 	if (ret < 0) {
 		blog(LOG_ERROR, "media_remux: Could not open input file '%s'",
 		     in_filename);
@@ -163,15 +271,20 @@ static inline bool init_output(media_remux_job_t job, const char *out_filename)
 #endif
 
 	if (!(job->ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
-		ret = avio_open(&job->ofmt_ctx->pb, out_filename,
-				AVIO_FLAG_WRITE);
-		if (ret < 0) {
+		int buf_size = (int)job->options.io_buffer_size;
+
+		job->out_file = os_fopen(out_filename, "wb");
+		if (!job->out_file) {
 			blog(LOG_ERROR,
 			     "media_remux: Failed to open output"
 			     " file '%s'",
 			     out_filename);
 			return false;
 		}
+
+		job->ofmt_ctx->pb = avio_alloc_context(
+			av_malloc(buf_size), buf_size, 1, job, NULL,
+			write_av_buffer, seek_out_av_buffer);
 	}
 
 	return true;
@@ -179,6 +292,19 @@ static inline bool init_output(media_remux_job_t job, const char *out_filename)
 
 bool media_remux_job_create(media_remux_job_t *job, const char *in_filename,
 			    const char *out_filename)
+{
+	struct media_remux_options options = {
+		.io_buffer_size = DEFAULT_IO_BUFFER_SIZE,
+		.read_ahead = true,
+	};
+
+	return media_remux_job_create2(job, in_filename, out_filename,
+				       &options);
+}
+
+bool media_remux_job_create2(media_remux_job_t *job, const char *in_filename,
+			     const char *out_filename,
+			     const struct media_remux_options *options)
 {
 	if (!job)
 		return false;
@@ -194,6 +320,16 @@ bool media_remux_job_create(media_remux_job_t *job, const char *in_filename,
 	if (!*job)
 		return false;
 
+	if (options)
+		(*job)->options = *options;
+	if (!(*job)->options.io_buffer_size)
+		(*job)->options.io_buffer_size = DEFAULT_IO_BUFFER_SIZE;
+
+	pthread_mutex_init_value(&(*job)->queue_mutex);
+	pthread_mutex_init_value(&(*job)->stats_mutex);
+	if (pthread_mutex_init(&(*job)->stats_mutex, NULL) != 0)
+		goto fail;
+
 	init_size(*job, in_filename);
 
 #if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(58, 9, 100)
@@ -213,20 +349,119 @@ fail:
 	return false;
 }
 
-static inline void process_packet(AVPacket *pkt, AVStream *in_stream,
-				  AVStream *out_stream)
+static inline void process_packet(AVPacket *pkt, AVRational in_time_base,
+				  AVRational out_time_base)
 {
-	pkt->pts = av_rescale_q_rnd(pkt->pts, in_stream->time_base,
-				    out_stream->time_base,
+	pkt->pts = av_rescale_q_rnd(pkt->pts, in_time_base, out_time_base,
 				    AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX);
-	pkt->dts = av_rescale_q_rnd(pkt->dts, in_stream->time_base,
-				    out_stream->time_base,
+	pkt->dts = av_rescale_q_rnd(pkt->dts, in_time_base, out_time_base,
 				    AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX);
-	pkt->duration = (int)av_rescale_q(pkt->duration, in_stream->time_base,
-					  out_stream->time_base);
+	pkt->duration = (int)av_rescale_q(pkt->duration, in_time_base,
+					  out_time_base);
 	pkt->pos = -1;
 }
 
+/* stream i of the input is muxed to stream i of the output, the input and
+ * output time bases are stored in pairs */
+static void init_time_bases(media_remux_job_t job)
+{
+	job->num_streams = job->ofmt_ctx->nb_streams;
+	if (!job->num_streams)
+		return;
+
+	job->time_bases = bmalloc(sizeof(AVRational) * 2 * job->num_streams);
+
+	for (unsigned i = 0; i < job->num_streams; i++) {
+		job->time_bases[i * 2] = job->ifmt_ctx->streams[i]->time_base;
+		job->time_bases[i * 2 + 1] =
+			job->ofmt_ctx->streams[i]->time_base;
+	}
+}
+
+static void *read_thread(void *data)
+{
+	media_remux_job_t job = data;
+
+	os_set_thread_name("media_remux: read_thread");
+
+	for (;;) {
+		AVPacket *pkt = NULL;
+
+		if (os_sem_wait(job->queue_free) != 0 ||
+		    os_atomic_load_bool(&job->read_stop))
+			break;
+
+		pkt = av_packet_alloc();
+		job->read_error = av_read_frame(job->ifmt_ctx, pkt);
+		if (job->read_error < 0)
+			av_packet_free(&pkt);
+
+		/* a NULL packet marks the end of the stream */
+		pthread_mutex_lock(&job->queue_mutex);
+		circlebuf_push_back(&job->queue, &pkt, sizeof(pkt));
+		pthread_mutex_unlock(&job->queue_mutex);
+		os_sem_post(job->queue_filled);
+
+		if (!pkt)
+			break;
+	}
+
+	return NULL;
+}
+
+static bool start_read_ahead(media_remux_job_t job)
+{
+	if (pthread_mutex_init(&job->queue_mutex, NULL) != 0)
+		return false;
+	if (os_sem_init(&job->queue_free, READ_AHEAD_PACKETS) != 0)
+		return false;
+	if (os_sem_init(&job->queue_filled, 0) != 0)
+		return false;
+
+	return pthread_create(&job->read_thread, NULL, read_thread, job) == 0;
+}
+
+static void stop_read_ahead(media_remux_job_t job)
+{
+	os_atomic_set_bool(&job->read_stop, true);
+	os_sem_post(job->queue_free);
+	pthread_join(job->read_thread, NULL);
+
+	while (job->queue.size) {
+		AVPacket *pkt;
+		circlebuf_pop_front(&job->queue, &pkt, sizeof(pkt));
+		av_packet_free(&pkt);
+	}
+}
+
+static int read_packet(media_remux_job_t job, AVPacket *pkt)
+{
+	AVPacket *queued;
+
+	if (!job->options.read_ahead)
+		return av_read_frame(job->ifmt_ctx, pkt);
+
+	os_sem_wait(job->queue_filled);
+
+	pthread_mutex_lock(&job->queue_mutex);
+	circlebuf_pop_front(&job->queue, &queued, sizeof(queued));
+	pthread_mutex_unlock(&job->queue_mutex);
+
+	if (!queued) {
+		/* keep the end marker so any further reads also see it */
+		pthread_mutex_lock(&job->queue_mutex);
+		circlebuf_push_front(&job->queue, &queued, sizeof(queued));
+		pthread_mutex_unlock(&job->queue_mutex);
+		os_sem_post(job->queue_filled);
+		return job->read_error;
+	}
+
+	av_packet_move_ref(pkt, queued);
+	av_packet_free(&queued);
+	os_sem_post(job->queue_free);
+	return 0;
+}
+
 static inline int process_packets(media_remux_job_t job,
 				  media_remux_progress_callback callback,
 				  void *data)
@@ -235,7 +470,7 @@ static inline int process_packets(media_remux_job_t job,
 
 	int ret, throttle = 0;
 	for (;;) {
-		ret = av_read_frame(job->ifmt_ctx, &pkt);
+		ret = read_packet(job, &pkt);
 		if (ret < 0) {
 			if (ret != AVERROR_EOF)
 				blog(LOG_ERROR,
@@ -252,8 +487,14 @@ static inline int process_packets(media_remux_job_t job,
 			throttle = 0;
 		}
 
-		process_packet(&pkt, job->ifmt_ctx->streams[pkt.stream_index],
-			       job->ofmt_ctx->streams[pkt.stream_index]);
+		/* streams added after the header have no output stream */
+		if ((unsigned)pkt.stream_index >= job->num_streams) {
+			av_packet_unref(&pkt);
+			continue;
+		}
+
+		process_packet(&pkt, job->time_bases[pkt.stream_index * 2],
+			       job->time_bases[pkt.stream_index * 2 + 1]);
 
 		ret = av_interleaved_write_frame(job->ofmt_ctx, &pkt);
 		av_packet_unref(&pkt);
@@ -293,9 +534,23 @@ bool media_remux_job_process(media_remux_job_t job,
 	if (callback != NULL)
 		callback(data, 0.f);
 
+	job->start_ts = os_gettime_ns();
+
+	/* the output time bases are final once the header is written */
+	init_time_bases(job);
+
+	if (job->options.read_ahead && !start_read_ahead(job)) {
+		blog(LOG_WARNING, "media_remux: Failed to start read-ahead "
+				  "thread, reading synchronously");
+		job->options.read_ahead = false;
+	}
+
 	ret = process_packets(job, callback, data);
 	success = ret >= 0 || ret == AVERROR_EOF;
 
+	if (job->options.read_ahead)
+		stop_read_ahead(job);
+
 	ret = av_write_trailer(job->ofmt_ctx);
 	if (ret < 0) {
 		blog(LOG_ERROR, "media_remux: av_write_trailer: %s",
@@ -303,23 +558,194 @@ bool media_remux_job_process(media_remux_job_t job,
 		success = false;
 	}
 
+	if (job->out_file)
+		avio_flush(job->ofmt_ctx->pb);
+
+	job->end_ts = os_gettime_ns();
+
 	if (callback != NULL)
 		callback(data, 100.f);
 
 	return success;
 }
 
+void media_remux_job_get_stats(media_remux_job_t job,
+			       struct media_remux_stats *stats)
+{
+	uint64_t end_ts;
+	double seconds;
+
+	memset(stats, 0, sizeof(*stats));
+	if (!job || !job->start_ts)
+		return;
+
+	end_ts = job->end_ts ? job->end_ts : os_gettime_ns();
+
+	pthread_mutex_lock(&job->stats_mutex);
+	stats->bytes_read = job->bytes_read;
+	stats->bytes_written = job->bytes_written;
+	pthread_mutex_unlock(&job->stats_mutex);
+	stats->elapsed_ns = end_ts - job->start_ts;
+
+	seconds = (double)stats->elapsed_ns / 1000000000.0;
+	if (seconds > 0.0) {
+		stats->read_throughput = (double)stats->bytes_read / seconds;
+		stats->write_throughput =
+			(double)stats->bytes_written / seconds;
+	}
+}
+
 void media_remux_job_destroy(media_remux_job_t job)
 {
 	if (!job)
 		return;
 
 	avformat_close_input(&job->ifmt_ctx);
+	free_pb(&job->in_pb);
 
 	if (job->ofmt_ctx && !(job->ofmt_ctx->oformat->flags & AVFMT_NOFILE))
-		avio_close(job->ofmt_ctx->pb);
+		free_pb(&job->ofmt_ctx->pb);
 
 	avformat_free_context(job->ofmt_ctx);
 
+	if (job->in_file)
+		fclose(job->in_file);
+	if (job->out_file)
+		fclose(job->out_file);
+
+	circlebuf_free(&job->queue);
+	os_sem_destroy(job->queue_free);
+	os_sem_destroy(job->queue_filled);
+	pthread_mutex_destroy(&job->queue_mutex);
+	pthread_mutex_destroy(&job->stats_mutex);
+	bfree(job->time_bases);
+
 	bfree(job);
 }
+
+/* ------------------------------------------------------------------------- */
+
+struct remux_batch {
+	const char **in_filenames;
+	const char **out_filenames;
+	size_t count;
+	const struct media_remux_options *options;
+
+	media_remux_batch_progress_callback *callback;
+	void *data;
+	bool *results;
+
+	volatile long next;
+	volatile long failed;
+	volatile bool cancel;
+};
+
+struct remux_batch_job {
+	struct remux_batch *batch;
+	media_remux_job_t job;
+	size_t index;
+};
+
+static bool batch_job_progress(void *data, float percent)
+{
+	struct remux_batch_job *bj = data;
+	struct remux_batch *batch = bj->batch;
+	struct media_remux_stats stats;
+
+	if (os_atomic_load_bool(&batch->cancel))
+		return false;
+	if (!batch->callback)
+		return true;
+
+	media_remux_job_get_stats(bj->job, &stats);
+	if (!batch->callback(batch->data, bj->index, percent, &stats)) {
+		os_atomic_set_bool(&batch->cancel, true);
+		return false;
+	}
+
+	return true;
+}
+
+static void *batch_thread(void *data)
+{
+	struct remux_batch *batch = data;
+
+	os_set_thread_name("media_remux: batch_thread");
+
+	for (;;) {
+		struct remux_batch_job bj = {.batch = batch};
+		bool success = false;
+		long idx = os_atomic_inc_long(&batch->next) - 1;
+
+		if (idx >= (long)batch->count ||
+		    os_atomic_load_bool(&batch->cancel))
+			break;
+
+		bj.index = (size_t)idx;
+
+		if (media_remux_job_create2(&bj.job, batch->in_filenames[idx],
+					    batch->out_filenames[idx],
+					    batch->options)) {
+			success = media_remux_job_process(
+				bj.job, batch_job_progress, &bj);
+			media_remux_job_destroy(bj.job);
+		}
+
+		if (batch->results)
+			batch->results[idx] = success;
+		if (!success)
+			os_atomic_inc_long(&batch->failed);
+	}
+
+	return NULL;
+}
+
+bool media_remux_batch_process(const char **in_filenames,
+			       const char **out_filenames, size_t count,
+			       size_t max_jobs,
+			       const struct media_remux_options *options,
+			       media_remux_batch_progress_callback callback,
+			       void *data, bool *results)
+{
+	struct remux_batch batch = {
+		.in_filenames = in_filenames,
+		.out_filenames = out_filenames,
+		.count = count,
+		.options = options,
+		.callback = callback,
+		.data = data,
+		.results = results,
+	};
+	pthread_t *threads;
+	size_t num_threads = 0;
+
+	if (!count)
+		return true;
+
+	if (!max_jobs)
+		max_jobs = (size_t)os_get_logical_cores();
+	if (max_jobs > count)
+		max_jobs = count;
+	if (!max_jobs)
+		max_jobs = 1;
+
+	if (results)
+		memset(results, 0, sizeof(bool) * count);
+
+	threads = bzalloc(sizeof(pthread_t) * max_jobs);
+	for (size_t i = 0; i < max_jobs; i++) {
+		if (pthread_create(&threads[num_threads], NULL, batch_thread,
+				   &batch) == 0)
+			num_threads++;
+	}
+
+	/* if no thread could be created, do the work on this one */
+	if (!num_threads)
+		batch_thread(&batch);
+
+	for (size_t i = 0; i < num_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	bfree(threads);
+	return !batch.failed && !batch.cancel;
+}
@@ -24,6 +24,29 @@ typedef struct media_remux_job *media_remux_job_t;
 
 typedef bool(media_remux_progress_callback)(void *data, float percent);
 
+struct media_remux_options {
+	/* size of the input and output I/O buffers, 0 for the default */
+	size_t io_buffer_size;
+
+	/* demux on a separate thread while the previous packets are muxed */
+	bool read_ahead;
+};
+
+struct media_remux_stats {
+	uint64_t bytes_read;
+	uint64_t bytes_written;
+	uint64_t elapsed_ns;
+
+	/* in bytes per second */
+	double read_throughput;
+	double write_throughput;
+};
+
+/* called from the worker threads, must be thread safe */
+typedef bool(media_remux_batch_progress_callback)(
+	void *data, size_t index, float percent,
+	const struct media_remux_stats *stats);
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -31,11 +54,28 @@ extern "C" {
 EXPORT bool media_remux_job_create(media_remux_job_t *job,
 				   const char *in_filename,
 				   const char *out_filename);
+EXPORT bool media_remux_job_create2(media_remux_job_t *job,
+				    const char *in_filename,
+				    const char *out_filename,
+				    const struct media_remux_options *options);
 EXPORT bool media_remux_job_process(media_remux_job_t job,
 				    media_remux_progress_callback callback,
 				    void *data);
+EXPORT void media_remux_job_get_stats(media_remux_job_t job,
+				     struct media_remux_stats *stats);
 EXPORT void media_remux_job_destroy(media_remux_job_t job);
 
+/**
+ * Remuxes several files at once, with up to max_jobs files in flight (0 uses
+ * the number of logical cores).  results receives the success state of each
+ * file and may be NULL.  Returns true if every file was remuxed.
+ */
+EXPORT bool media_remux_batch_process(
+	const char **in_filenames, const char **out_filenames, size_t count,
+	size_t max_jobs, const struct media_remux_options *options,
+	media_remux_batch_progress_callback callback, void *data,
+	bool *results);
+
 #ifdef __cplusplus
 }
 #endif
@@ -34,6 +34,9 @@ extern profiler_name_store_t *obs_get_profiler_name_store(void);
 #define MAX_CONVERT_BUFFERS 3
 #define MAX_CACHE_SIZE 16
 
+/* placeholder source index forcing update_scale_pyramid to pick a new one */
+#define SCALE_SOURCE_RESET (DARRAY_INVALID - 1)
+
 struct cached_frame_info {
 	struct video_data frame;
 	int skipped;
@@ -46,6 +49,18 @@ struct video_input {
 	struct video_frame frame[MAX_CONVERT_BUFFERS];
 	int cur_frame;
 
+	/* Inputs are kept sorted from largest to smallest, and each input is
+	 * scaled from the smallest larger compatible input (its source) rather
+	 * than from the full resolution frame, so that a set of renditions is
+	 * produced as a downscale pyramid.  DARRAY_INVALID when scaled from the
+	 * video output frame itself. */
+	size_t source_idx;
+	struct video_data output;
+	bool output_valid;
+
+	uint64_t scaled_frames;
+	uint64_t scale_time_ns;
+
 	void (*callback)(void *param, struct video_data *frame);
 	void *param;
 };
@@ -92,6 +107,7 @@ static inline bool scale_video_output(struct video_input *input,
 
 	if (input->scaler) {
 		struct video_frame *frame;
+		uint64_t start_ns = os_gettime_ns();
 
 		if (++input->cur_frame == MAX_CONVERT_BUFFERS)
 			input->cur_frame = 0;
@@ -103,6 +119,9 @@ static inline bool scale_video_output(struct video_input *input,
 					     (const uint8_t *const *)data->data,
 					     data->linesize);
 
+		input->scale_time_ns += os_gettime_ns() - start_ns;
+		input->scaled_frames++;
+
 		if (success) {
 			for (size_t i = 0; i < MAX_AV_PLANES; i++) {
 				data->data[i] = frame->data[i];
@@ -138,8 +157,22 @@ static inline bool video_output_cur_frame(struct video_output *video)
 		struct video_input *input = video->inputs.array + i;
 		struct video_data frame = frame_info->frame;
 
-		if (scale_video_output(input, &frame))
+		if (input->source_idx != DARRAY_INVALID) {
+			struct video_input *source =
+				video->inputs.array + input->source_idx;
+			if (!source->output_valid) {
+				input->output_valid = false;
+				continue;
+			}
+
+			frame = source->output;
+		}
+
+		input->output_valid = scale_video_output(input, &frame);
+		if (input->output_valid) {
+			input->output = frame;
 			input->callback(input->param, &frame);
+		}
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
@@ -295,33 +328,62 @@ static size_t video_get_input_idx(const video_t *video,
 	return DARRAY_INVALID;
 }
 
+static inline void get_output_scale_info(const struct video_output *video,
+					 struct video_scale_info *info)
+{
+	info->format = video->info.format;
+	info->width = video->info.width;
+	info->height = video->info.height;
+	info->range = video->info.range;
+	info->colorspace = video->info.colorspace;
+}
+
+static inline bool same_scale_info(const struct video_scale_info *a,
+				   const struct video_scale_info *b)
+{
+	return a->format == b->format && a->width == b->width &&
+	       a->height == b->height;
+}
+
+static inline uint64_t input_area(const struct video_input *input)
+{
+	return (uint64_t)input->conversion.width * input->conversion.height;
+}
+
+static int create_input_scaler(struct video_input *input,
+			       const struct video_scale_info *from)
+{
+	video_scaler_destroy(input->scaler);
+	input->scaler = NULL;
+
+	if (same_scale_info(&input->conversion, from))
+		return VIDEO_SCALER_SUCCESS;
+
+	return video_scaler_create(&input->scaler, &input->conversion, from,
+				   VIDEO_SCALE_FAST_BILINEAR);
+}
+
 static inline bool video_input_init(struct video_input *input,
 				    struct video_output *video)
 {
-	if (input->conversion.width != video->info.width ||
-	    input->conversion.height != video->info.height ||
-	    input->conversion.format != video->info.format) {
-		struct video_scale_info from = {.format = video->info.format,
-						.width = video->info.width,
-						.height = video->info.height,
-						.range = video->info.range,
-						.colorspace =
-							video->info.colorspace};
-
-		int ret = video_scaler_create(&input->scaler,
-					      &input->conversion, &from,
-					      VIDEO_SCALE_FAST_BILINEAR);
-		if (ret != VIDEO_SCALER_SUCCESS) {
-			if (ret == VIDEO_SCALER_BAD_CONVERSION)
-				blog(LOG_ERROR, "video_input_init: Bad "
-						"scale conversion type");
-			else
-				blog(LOG_ERROR, "video_input_init: Failed to "
-						"create scaler");
-
-			return false;
-		}
+	struct video_scale_info from;
+	get_output_scale_info(video, &from);
+
+	input->source_idx = DARRAY_INVALID;
+
+	int ret = create_input_scaler(input, &from);
+	if (ret != VIDEO_SCALER_SUCCESS) {
+		if (ret == VIDEO_SCALER_BAD_CONVERSION)
+			blog(LOG_ERROR, "video_input_init: Bad "
+					"scale conversion type");
+		else
+			blog(LOG_ERROR, "video_input_init: Failed to "
+					"create scaler");
+
+		return false;
+	}
 
+	if (input->scaler) {
 		for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
 			video_frame_init(&input->frame[i],
 					 input->conversion.format,
@@ -332,6 +394,97 @@ static inline bool video_input_init(struct video_input *input,
 	return true;
 }
 
+/* An input can be scaled from another one if it is the same kind of image
+ * and no larger.  The source has to be an actual scaled level, otherwise the
+ * output frame itself is just as good. */
+static inline bool can_scale_from(const struct video_input *source,
+				  const struct video_input *input)
+{
+	const struct video_scale_info *src = &source->conversion;
+	const struct video_scale_info *dst = &input->conversion;
+
+	return source->scaler && !same_scale_info(src, dst) &&
+	       src->format == dst->format &&
+	       src->range == dst->range && src->colorspace == dst->colorspace &&
+	       src->width >= dst->width && src->height >= dst->height;
+}
+
+static void update_scale_pyramid(struct video_output *video)
+{
+	struct video_scale_info out_info;
+	get_output_scale_info(video, &out_info);
+
+	for (size_t i = 0; i < video->inputs.num; i++) {
+		struct video_input *input = video->inputs.array + i;
+		size_t source_idx = DARRAY_INVALID;
+
+		/* only inputs that need scaling in the first place */
+		if (!input->scaler && input->source_idx == DARRAY_INVALID)
+			continue;
+
+		for (size_t j = 0; j < i; j++) {
+			struct video_input *source = video->inputs.array + j;
+			if (!can_scale_from(source, input))
+				continue;
+			if (source_idx == DARRAY_INVALID ||
+			    input_area(source) <
+				    input_area(video->inputs.array +
+					       source_idx))
+				source_idx = j;
+		}
+
+		if (source_idx == input->source_idx)
+			continue;
+
+		const struct video_scale_info *from =
+			source_idx == DARRAY_INVALID
+				? &out_info
+				: &video->inputs.array[source_idx].conversion;
+
+		if (create_input_scaler(input, from) != VIDEO_SCALER_SUCCESS) {
+			/* fall back to scaling from the output frame, which
+			 * already worked when the input was connected */
+			source_idx = DARRAY_INVALID;
+			create_input_scaler(input, &out_info);
+		}
+
+		input->source_idx = source_idx;
+		input->scaled_frames = 0;
+		input->scale_time_ns = 0;
+	}
+}
+
+static inline size_t get_insert_idx(const struct video_output *video,
+				    const struct video_input *input)
+{
+	size_t idx = 0;
+	while (idx < video->inputs.num &&
+	       input_area(video->inputs.array + idx) >= input_area(input))
+		idx++;
+	return idx;
+}
+
+static void log_scale_stats(const struct video_output *video,
+			    const struct video_input *input)
+{
+	const struct video_scale_info *from =
+		input->source_idx == DARRAY_INVALID
+			? NULL
+			: &video->inputs.array[input->source_idx].conversion;
+
+	if (!input->scaled_frames)
+		return;
+
+	blog(LOG_INFO,
+	     "video-io: %" PRIu32 "x%" PRIu32 " scaled from %" PRIu32
+	     "x%" PRIu32 ", %" PRIu64 " frames, %.3f ms average",
+	     input->conversion.width, input->conversion.height,
+	     from ? from->width : video->info.width,
+	     from ? from->height : video->info.height, input->scaled_frames,
+	     (double)input->scale_time_ns / (double)input->scaled_frames /
+		     1000000.0);
+}
+
 static inline void reset_frames(video_t *video)
 {
 	os_atomic_set_long(&video->skipped_frames, 0);
@@ -377,7 +530,17 @@ bool video_output_connect(
 				}
 				os_atomic_set_bool(&video->raw_active, true);
 			}
-			da_push_back(video->inputs, &input);
+			size_t idx = get_insert_idx(video, &input);
+			da_insert(video->inputs, idx, &input);
+
+			for (size_t i = idx + 1; i < video->inputs.num; i++) {
+				struct video_input *cur =
+					video->inputs.array + i;
+				if (cur->source_idx != DARRAY_INVALID &&
+				    cur->source_idx >= idx)
+					cur->source_idx++;
+			}
+			update_scale_pyramid(video);
 		}
 	}
 
@@ -415,9 +578,22 @@ void video_output_disconnect(video_t *video,
 
 	size_t idx = video_get_input_idx(video, callback, param);
 	if (idx != DARRAY_INVALID) {
+		log_scale_stats(video, video->inputs.array + idx);
 		video_input_free(video->inputs.array + idx);
 		da_erase(video->inputs, idx);
 
+		/* indices shifted; inputs that were scaled from this one
+		 * need a new source */
+		for (size_t i = idx; i < video->inputs.num; i++) {
+			struct video_input *input = video->inputs.array + i;
+			if (input->source_idx == idx)
+				input->source_idx = SCALE_SOURCE_RESET;
+			else if (input->source_idx != DARRAY_INVALID &&
+				 input->source_idx > idx)
+				input->source_idx--;
+		}
+		update_scale_pyramid(video);
+
 		if (video->inputs.num == 0) {
 			os_atomic_set_bool(&video->raw_active, false);
 			if (!os_atomic_load_long(&video->gpu_refs)) {
@@ -429,6 +605,40 @@ void video_output_disconnect(video_t *video,
 	pthread_mutex_unlock(&video->input_mutex);
 }
 
+bool video_output_get_scale_stats(video_t *video,
+				  void (*callback)(void *param,
+						   struct video_data *frame),
+				  void *param, struct video_scale_stats *stats)
+{
+	bool success = false;
+
+	if (!video || !callback || !stats)
+		return false;
+
+	pthread_mutex_lock(&video->input_mutex);
+
+	size_t idx = video_get_input_idx(video, callback, param);
+	if (idx != DARRAY_INVALID) {
+		struct video_input *input = video->inputs.array + idx;
+		const struct video_scale_info *from =
+			input->source_idx == DARRAY_INVALID
+				? NULL
+				: &video->inputs.array[input->source_idx]
+					   .conversion;
+
+		stats->source_width = from ? from->width : video->info.width;
+		stats->source_height = from ? from->height
+					    : video->info.height;
+		stats->scaled_frames = input->scaled_frames;
+		stats->scale_time_ns = input->scale_time_ns;
+		success = true;
+	}
+
+	pthread_mutex_unlock(&video->input_mutex);
+
+	return success;
+}
+
 bool video_output_active(const video_t *video)
 {
 	if (!video)
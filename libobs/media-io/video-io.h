@@ -305,6 +305,20 @@ EXPORT uint32_t video_output_get_width(const video_t *video);
 EXPORT uint32_t video_output_get_height(const video_t *video);
 EXPORT double video_output_get_frame_rate(const video_t *video);
 
+struct video_scale_stats {
+	/** Size of the image the input is scaled from, which is either the
+	 * output itself or the next larger input in the downscale pyramid */
+	uint32_t source_width;
+	uint32_t source_height;
+
+	uint64_t scaled_frames;
+	uint64_t scale_time_ns;
+};
+
+EXPORT bool video_output_get_scale_stats(
+	video_t *video, void (*callback)(void *param, struct video_data *frame),
+	void *param, struct video_scale_stats *stats);
+
 EXPORT uint32_t video_output_get_skipped_frames(const video_t *video);
 EXPORT uint32_t video_output_get_total_frames(const video_t *video);
 
@@ -36,6 +36,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #define CLAMP(x, min, max) ((x) < min ? min : ((x) > max ? max : (x)))
 
+#define DEFAULT_VOLMETER_INTERVAL_MS 33
+
 typedef float (*obs_fader_conversion_t)(const float val);
 
 struct fader_cb {
@@ -76,10 +78,30 @@ struct obs_volmeter {
 	unsigned int update_ms;
 	float prev_samples[MAX_AUDIO_CHANNELS][4];
 
-	float magnitude[MAX_AUDIO_CHANNELS];
+	/* levels since the last update, accumulated by the audio tap of the
+	 * source and published by the volume meter thread */
+	int nr_channels;
+	bool silenced;
 	float peak[MAX_AUDIO_CHANNELS];
+	double sum_squares[MAX_AUDIO_CHANNELS];
+	size_t frames;
+};
+
+/* reports the levels of every volume meter and calls their callbacks in one
+ * batch per interval */
+struct volmeter_service {
+	pthread_mutex_t mutex;
+	DARRAY(struct obs_volmeter *) meters;
+	pthread_t thread;
+	os_event_t *stop_event;
+	bool active;
 };
 
+static struct volmeter_service volmeter_service = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+static volatile long volmeter_interval_ms = DEFAULT_VOLMETER_INTERVAL_MS;
+
 static float cubic_def_to_db(const float def)
 {
 	if (def == 1.0f)
@@ -261,16 +283,6 @@ static void volmeter_source_destroyed(void *vptr, calldata_t *calldata)
 	obs_volmeter_detach_source(volmeter);
 }
 
-static int get_nr_channels_from_audio_data(const struct audio_data *data)
-{
-	int nr_channels = 0;
-	for (int i = 0; i < MAX_AV_PLANES; i++) {
-		if (data->data[i])
-			nr_channels++;
-	}
-	return CLAMP(nr_channels, 0, MAX_AUDIO_CHANNELS);
-}
-
 /* msb(h, g, f, e) lsb(d, c, b, a)   -->  msb(h, h, g, f) lsb(e, d, c, b)
  */
 #define SHIFT_RIGHT_2PS(msb, lsb)                                          \
@@ -433,126 +445,210 @@ static void volmeter_process_peak_last_samples(obs_volmeter_t *volmeter,
 	}
 }
 
-static void volmeter_process_peak(obs_volmeter_t *volmeter,
-				  const struct audio_data *data,
-				  int nr_channels)
+static void volmeter_process_samples(obs_volmeter_t *volmeter,
+				     int channel_nr, float *samples,
+				     size_t nr_samples)
 {
-	int nr_samples = data->frames;
-	int channel_nr = 0;
-	for (int plane_nr = 0; channel_nr < nr_channels; plane_nr++) {
-		float *samples = (float *)data->data[plane_nr];
-		if (!samples) {
-			continue;
-		}
-		if (((uintptr_t)samples & 0xf) > 0) {
-			printf("Audio plane %i is not aligned %p skipping "
-			       "peak volume measurement.\n",
-			       plane_nr, samples);
-			volmeter->peak[channel_nr] = 1.0;
-			channel_nr++;
-			continue;
-		}
-
-		/* volmeter->prev_samples may not be aligned to 16 bytes;
-		 * use unaligned load. */
-		__m128 previous_samples =
-			_mm_loadu_ps(volmeter->prev_samples[channel_nr]);
-
-		float peak;
-		switch (volmeter->peak_meter_type) {
-		case TRUE_PEAK_METER:
-			peak = get_true_peak(previous_samples, samples,
-					     nr_samples);
-			break;
-
-		case SAMPLE_PEAK_METER:
-		default:
-			peak = get_sample_peak(previous_samples, samples,
-					       nr_samples);
-			break;
-		}
+	/* volmeter->prev_samples may not be aligned to 16 bytes;
+	 * use unaligned load. */
+	__m128 previous_samples =
+		_mm_loadu_ps(volmeter->prev_samples[channel_nr]);
+
+	float peak;
+	switch (volmeter->peak_meter_type) {
+	case TRUE_PEAK_METER:
+		peak = get_true_peak(previous_samples, samples, nr_samples);
+		break;
 
-		volmeter_process_peak_last_samples(volmeter, channel_nr,
-						   samples, nr_samples);
+	case SAMPLE_PEAK_METER:
+	default:
+		peak = get_sample_peak(previous_samples, samples, nr_samples);
+		break;
+	}
 
-		volmeter->peak[channel_nr] = peak;
+	volmeter_process_peak_last_samples(volmeter, channel_nr, samples,
+					   nr_samples);
 
-		channel_nr++;
+	float sum = 0.0;
+	for (size_t i = 0; i < nr_samples; i++) {
+		float sample = samples[i];
+		sum += sample * sample;
 	}
 
-	/* Clear the peak of the channels that have not been handled. */
-	for (; channel_nr < MAX_AUDIO_CHANNELS; channel_nr++) {
-		volmeter->peak[channel_nr] = 0.0;
-	}
+	volmeter->peak[channel_nr] = fmaxf(volmeter->peak[channel_nr], peak);
+	volmeter->sum_squares[channel_nr] += sum;
 }
 
-static void volmeter_process_magnitude(obs_volmeter_t *volmeter,
-				       const struct audio_data *data,
-				       int nr_channels)
+/* called on an audio tap thread, every plane of the tap starts 16 byte
+ * aligned */
+static void volmeter_source_audio_tap(void *vptr, obs_source_t *source,
+				      obs_audio_tap_t *tap)
 {
-	size_t nr_samples = data->frames;
+	struct obs_volmeter *volmeter = (struct obs_volmeter *)vptr;
+	const struct audio_data *data = obs_audio_tap_get_data(tap);
+	size_t nr_channels = obs_audio_tap_get_channels(tap);
 
-	int channel_nr = 0;
-	for (int plane_nr = 0; channel_nr < nr_channels; plane_nr++) {
-		float *samples = (float *)data->data[plane_nr];
-		if (!samples) {
-			continue;
-		}
+	if (nr_channels > MAX_AUDIO_CHANNELS)
+		nr_channels = MAX_AUDIO_CHANNELS;
 
-		float sum = 0.0;
-		for (size_t i = 0; i < nr_samples; i++) {
-			float sample = samples[i];
-			sum += sample * sample;
-		}
-		volmeter->magnitude[channel_nr] = sqrtf(sum / nr_samples);
+	pthread_mutex_lock(&volmeter->mutex);
 
-		channel_nr++;
-	}
-}
+	for (size_t ch = 0; ch < nr_channels; ch++)
+		volmeter_process_samples(volmeter, (int)ch,
+					 (float *)data->data[ch], data->frames);
 
-static void volmeter_process_audio_data(obs_volmeter_t *volmeter,
-					const struct audio_data *data)
-{
-	int nr_channels = get_nr_channels_from_audio_data(data);
+	volmeter->nr_channels = (int)nr_channels;
+	volmeter->silenced = obs_audio_tap_muted(tap) &&
+			     !obs_source_muted(source);
+	volmeter->frames += data->frames;
 
-	volmeter_process_peak(volmeter, data, nr_channels);
-	volmeter_process_magnitude(volmeter, data, nr_channels);
+	pthread_mutex_unlock(&volmeter->mutex);
 }
 
-static void volmeter_source_data_received(void *vptr, obs_source_t *source,
-					  const struct audio_data *data,
-					  bool muted)
+static void volmeter_update_levels(obs_volmeter_t *volmeter)
 {
-	struct obs_volmeter *volmeter = (struct obs_volmeter *)vptr;
 	float mul;
 	float magnitude[MAX_AUDIO_CHANNELS];
 	float peak[MAX_AUDIO_CHANNELS];
 	float input_peak[MAX_AUDIO_CHANNELS];
+	float levels[MAX_AUDIO_CHANNELS];
+	double sum_squares[MAX_AUDIO_CHANNELS];
+	int nr_channels;
+	size_t frames;
 
 	pthread_mutex_lock(&volmeter->mutex);
 
-	volmeter_process_audio_data(volmeter, data);
+	frames = volmeter->frames;
+	nr_channels = volmeter->nr_channels;
+	mul = volmeter->silenced ? 0.0f : db_to_mul(volmeter->cur_db);
+	memcpy(levels, volmeter->peak, sizeof(levels));
+	memcpy(sum_squares, volmeter->sum_squares, sizeof(sum_squares));
+
+	volmeter->frames = 0;
+	memset(volmeter->peak, 0, sizeof(volmeter->peak));
+	memset(volmeter->sum_squares, 0, sizeof(volmeter->sum_squares));
+
+	pthread_mutex_unlock(&volmeter->mutex);
+
+	if (!frames)
+		return;
 
 	// Adjust magnitude/peak based on the volume level set by the user.
 	// And convert to dB.
-	mul = muted && !obs_source_muted(source) ? 0.0f
-						 : db_to_mul(volmeter->cur_db);
 	for (int channel_nr = 0; channel_nr < MAX_AUDIO_CHANNELS;
 	     channel_nr++) {
-		magnitude[channel_nr] =
-			mul_to_db(volmeter->magnitude[channel_nr] * mul);
-		peak[channel_nr] = mul_to_db(volmeter->peak[channel_nr] * mul);
+		float channel_magnitude = 0.0f;
+		float channel_peak = 0.0f;
+
+		/* Channels that have not been handled stay silent. */
+		if (channel_nr < nr_channels) {
+			channel_magnitude = (float)sqrt(
+				sum_squares[channel_nr] / (double)frames);
+			channel_peak = levels[channel_nr];
+		}
+
+		magnitude[channel_nr] = mul_to_db(channel_magnitude * mul);
+		peak[channel_nr] = mul_to_db(channel_peak * mul);
 
 		/* The input-peak is NOT adjusted with volume, so that the user
 		 * can check the input-gain. */
-		input_peak[channel_nr] = mul_to_db(volmeter->peak[channel_nr]);
+		input_peak[channel_nr] = mul_to_db(channel_peak);
 	}
 
-	pthread_mutex_unlock(&volmeter->mutex);
-
 	signal_levels_updated(volmeter, magnitude, peak, input_peak);
+}
+
+static void *volmeter_thread(void *param)
+{
+	os_event_t *stop_event = param;
+	uint64_t last_update = os_gettime_ns();
+
+	os_set_thread_name("libobs: volume meters");
+
+	for (;;) {
+		long interval = os_atomic_load_long(&volmeter_interval_ms);
+		uint64_t next_update =
+			last_update + (uint64_t)interval * 1000000ULL;
+		uint64_t now = os_gettime_ns();
+		uint64_t wait_ns = next_update > now ? next_update - now : 0;
+
+		if (os_event_timedwait(stop_event,
+				       (unsigned long)(wait_ns / 1000000)) !=
+		    ETIMEDOUT)
+			break;
+
+		last_update = os_gettime_ns();
+
+		pthread_mutex_lock(&volmeter_service.mutex);
+		for (size_t i = 0; i < volmeter_service.meters.num; i++)
+			volmeter_update_levels(
+				volmeter_service.meters.array[i]);
+		pthread_mutex_unlock(&volmeter_service.mutex);
+	}
+
+	os_event_destroy(stop_event);
+	return NULL;
+}
+
+static bool volmeter_service_add(obs_volmeter_t *volmeter)
+{
+	bool success = true;
+
+	pthread_mutex_lock(&volmeter_service.mutex);
+
+	if (!volmeter_service.active) {
+		os_event_t *stop_event;
+
+		if (os_event_init(&stop_event, OS_EVENT_TYPE_MANUAL) != 0) {
+			success = false;
+		} else if (pthread_create(&volmeter_service.thread, NULL,
+					  volmeter_thread, stop_event) != 0) {
+			os_event_destroy(stop_event);
+			success = false;
+		} else {
+			volmeter_service.stop_event = stop_event;
+			volmeter_service.active = true;
+		}
+	}
+
+	if (success)
+		da_push_back(volmeter_service.meters, &volmeter);
+
+	pthread_mutex_unlock(&volmeter_service.mutex);
 
-	UNUSED_PARAMETER(source);
+	if (!success)
+		blog(LOG_ERROR, "Failed to start the volume meter thread");
+	return success;
+}
+
+static void volmeter_service_remove(obs_volmeter_t *volmeter)
+{
+	pthread_t thread;
+	os_event_t *stop_event = NULL;
+	size_t idx;
+
+	pthread_mutex_lock(&volmeter_service.mutex);
+
+	idx = da_find(volmeter_service.meters, &volmeter, 0);
+	if (idx != DARRAY_INVALID)
+		da_erase(volmeter_service.meters, idx);
+
+	/* the thread is joined outside of the lock, a new volume meter
+	 * starts a new thread in the meantime */
+	if (idx != DARRAY_INVALID && !volmeter_service.meters.num) {
+		da_free(volmeter_service.meters);
+		thread = volmeter_service.thread;
+		stop_event = volmeter_service.stop_event;
+		volmeter_service.stop_event = NULL;
+		volmeter_service.active = false;
+	}
+
+	pthread_mutex_unlock(&volmeter_service.mutex);
+
+	if (stop_event) {
+		os_event_signal(stop_event);
+		pthread_join(thread, NULL);
+	}
 }
 
 obs_fader_t *obs_fader_create(enum obs_fader_type type)
@@ -784,6 +880,9 @@ obs_volmeter_t *obs_volmeter_create(enum obs_fader_type type)
 
 	volmeter->type = type;
 
+	if (!volmeter_service_add(volmeter))
+		goto fail;
+
 	return volmeter;
 fail:
 	obs_volmeter_destroy(volmeter);
@@ -796,6 +895,7 @@ void obs_volmeter_destroy(obs_volmeter_t *volmeter)
 		return;
 
 	obs_volmeter_detach_source(volmeter);
+	volmeter_service_remove(volmeter);
 	da_free(volmeter->callbacks);
 	pthread_mutex_destroy(&volmeter->callback_mutex);
 	pthread_mutex_destroy(&volmeter->mutex);
@@ -813,13 +913,21 @@ bool obs_volmeter_attach_source(obs_volmeter_t *volmeter, obs_source_t *source)
 
 	obs_volmeter_detach_source(volmeter);
 
+	/* drop what is left from the previous source */
+	pthread_mutex_lock(&volmeter->mutex);
+	volmeter->frames = 0;
+	memset(volmeter->prev_samples, 0, sizeof(volmeter->prev_samples));
+	memset(volmeter->peak, 0, sizeof(volmeter->peak));
+	memset(volmeter->sum_squares, 0, sizeof(volmeter->sum_squares));
+	pthread_mutex_unlock(&volmeter->mutex);
+
 	sh = obs_source_get_signal_handler(source);
 	signal_handler_connect(sh, "volume", volmeter_source_volume_changed,
 			       volmeter);
 	signal_handler_connect(sh, "destroy", volmeter_source_destroyed,
 			       volmeter);
-	obs_source_add_audio_capture_callback(
-		source, volmeter_source_data_received, volmeter);
+	obs_source_add_audio_tap(source, volmeter_source_audio_tap, volmeter,
+				 true);
 	vol = obs_source_get_volume(source);
 
 	pthread_mutex_lock(&volmeter->mutex);
@@ -853,8 +961,8 @@ void obs_volmeter_detach_source(obs_volmeter_t *volmeter)
 				  volmeter);
 	signal_handler_disconnect(sh, "destroy", volmeter_source_destroyed,
 				  volmeter);
-	obs_source_remove_audio_capture_callback(
-		source, volmeter_source_data_received, volmeter);
+	obs_source_remove_audio_tap(source, volmeter_source_audio_tap,
+				    volmeter);
 }
 
 void obs_volmeter_set_peak_meter_type(obs_volmeter_t *volmeter,
@@ -936,6 +1044,19 @@ void obs_volmeter_remove_callback(obs_volmeter_t *volmeter,
 	pthread_mutex_unlock(&volmeter->callback_mutex);
 }
 
+void obs_set_volmeter_update_interval(unsigned int ms)
+{
+	if (!ms)
+		return;
+
+	os_atomic_store_long(&volmeter_interval_ms, (long)ms);
+}
+
+unsigned int obs_get_volmeter_update_interval(void)
+{
+	return (unsigned int)os_atomic_load_long(&volmeter_interval_ms);
+}
+
 float obs_mul_to_db(float mul)
 {
 	return mul_to_db(mul);
@@ -248,6 +248,9 @@ obs_volmeter_set_peak_meter_type(obs_volmeter_t *volmeter,
  * On the other hand data might be received in a way that will cause the signal
  * to be emitted in shorter intervals than specified here under some
  * circumstances.
+ *
+ * The interval is no longer used per volume meter, see
+ * obs_set_volmeter_update_interval.
  */
 OBS_DEPRECATED
 EXPORT void obs_volmeter_set_update_interval(obs_volmeter_t *volmeter,
@@ -279,6 +282,24 @@ EXPORT void obs_volmeter_remove_callback(obs_volmeter_t *volmeter,
 					 obs_volmeter_updated_t callback,
 					 void *param);
 
+/**
+ * @brief Set the interval at which volume meters report their levels
+ * @param ms update interval in ms, 33 by default
+ *
+ * Volume meters receive the audio of attached sources through asynchronous
+ * audio taps, the audio thread only queues it.  Once per interval, the
+ * callbacks of all volume meters that received audio are called in one batch
+ * from a separate thread with the levels of all audio received since the
+ * previous update.
+ */
+EXPORT void obs_set_volmeter_update_interval(unsigned int ms);
+
+/**
+ * @brief Get the interval at which volume meters report their levels
+ * @return update interval in ms
+ */
+EXPORT unsigned int obs_get_volmeter_update_interval(void);
+
 EXPORT float obs_mul_to_db(float mul);
 EXPORT float obs_db_to_mul(float db);
 
@@ -0,0 +1,500 @@
+#include "util/threading.h"
+#include "util/circlebuf.h"
+#include "util/platform.h"
+#include "util/bmem.h"
+#include "obs-internal.h"
+
+/* audio of a source that an asynchronous tap can have queued.  every tap has
+ * its own queue, a tap that falls behind only drops its own audio. */
+#define MAX_AUDIO_TAP_JOBS 64
+
+/* the callbacks of a tap never run in parallel, so a tap that is slower than
+ * real time only holds up one of the threads */
+#define AUDIO_TAP_THREADS 4
+
+/* one call of obs_source_output_audio after the filters, shared by every tap
+ * of the source.  the buffer of the previous call is reused when no consumer
+ * holds a reference to it anymore. */
+struct obs_audio_tap {
+	volatile long refs;
+	struct audio_data data;
+	size_t channels;
+	bool muted;
+
+	float *buffer;
+	size_t capacity;
+};
+
+/* an asynchronous tap and the audio queued for it */
+struct audio_tap_consumer {
+	obs_source_audio_tap_t callback;
+	void *param;
+	obs_source_t *source;
+
+	struct circlebuf jobs;
+	bool overflow;
+
+	/* set while a dispatcher thread runs the callback.  a tap removed from
+	 * a callback is freed by the dispatcher thread once it returns,
+	 * otherwise the remover waits for idle_event. */
+	bool busy;
+	bool removed;
+	os_event_t *idle_event;
+};
+
+struct audio_tap_threads {
+	os_sem_t *sem;
+	pthread_t threads[AUDIO_TAP_THREADS];
+	size_t num;
+	volatile long running;
+	bool stop;
+	bool detached;
+};
+
+/* calls the asynchronous taps of all sources, taking the queued audio of the
+ * taps in turn */
+struct audio_tap_service {
+	pthread_mutex_t mutex;
+	DARRAY(struct audio_tap_consumer *) consumers;
+	size_t next_consumer;
+	size_t queued_jobs;
+	struct audio_tap_threads *threads;
+};
+
+static struct audio_tap_service audio_tap_service = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static THREAD_LOCAL bool on_audio_tap_thread = false;
+
+void obs_audio_tap_addref(obs_audio_tap_t *tap)
+{
+	if (tap)
+		os_atomic_inc_long(&tap->refs);
+}
+
+void obs_audio_tap_release(obs_audio_tap_t *tap)
+{
+	if (tap && os_atomic_dec_long(&tap->refs) == 0) {
+		bfree(tap->buffer);
+		bfree(tap);
+	}
+}
+
+const struct audio_data *obs_audio_tap_get_data(const obs_audio_tap_t *tap)
+{
+	return tap ? &tap->data : NULL;
+}
+
+size_t obs_audio_tap_get_channels(const obs_audio_tap_t *tap)
+{
+	return tap ? tap->channels : 0;
+}
+
+bool obs_audio_tap_muted(const obs_audio_tap_t *tap)
+{
+	return tap ? tap->muted : false;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void consumer_free_jobs(struct audio_tap_consumer *consumer)
+{
+	struct obs_audio_tap *tap;
+
+	while (consumer->jobs.size) {
+		circlebuf_pop_front(&consumer->jobs, &tap, sizeof(tap));
+		obs_audio_tap_release(tap);
+		audio_tap_service.queued_jobs--;
+	}
+	circlebuf_free(&consumer->jobs);
+}
+
+static inline void consumer_destroy(struct audio_tap_consumer *consumer)
+{
+	os_event_destroy(consumer->idle_event);
+	bfree(consumer);
+}
+
+/* takes the next job of a tap whose callback is not running, round robin so
+ * that a tap with a long queue does not hold back the others */
+static struct audio_tap_consumer *
+audio_tap_service_pop(struct obs_audio_tap **tap)
+{
+	size_t num = audio_tap_service.consumers.num;
+
+	for (size_t i = 0; i < num; i++) {
+		size_t idx = (audio_tap_service.next_consumer + i) % num;
+		struct audio_tap_consumer *consumer =
+			audio_tap_service.consumers.array[idx];
+
+		if (consumer->busy || !consumer->jobs.size)
+			continue;
+
+		circlebuf_pop_front(&consumer->jobs, tap, sizeof(*tap));
+		audio_tap_service.queued_jobs--;
+		audio_tap_service.next_consumer = idx + 1;
+		consumer->busy = true;
+		return consumer;
+	}
+
+	return NULL;
+}
+
+static void audio_tap_run(struct audio_tap_threads *data,
+			  struct audio_tap_consumer *consumer,
+			  struct obs_audio_tap *tap)
+{
+	bool removed;
+
+	consumer->callback(consumer->param, consumer->source, tap);
+	obs_audio_tap_release(tap);
+
+	pthread_mutex_lock(&audio_tap_service.mutex);
+
+	consumer->busy = false;
+	removed = consumer->removed;
+	if (consumer->idle_event)
+		os_event_signal(consumer->idle_event);
+
+	/* jobs of this tap that other threads had to skip */
+	if (audio_tap_service.queued_jobs)
+		os_sem_post(data->sem);
+
+	pthread_mutex_unlock(&audio_tap_service.mutex);
+
+	if (removed)
+		consumer_destroy(consumer);
+}
+
+static void *audio_tap_thread(void *param)
+{
+	struct audio_tap_threads *data = param;
+	struct audio_tap_consumer *consumer;
+	struct obs_audio_tap *tap;
+	bool stop;
+	bool detached = false;
+
+	os_set_thread_name("libobs: audio taps");
+	on_audio_tap_thread = true;
+
+	for (;;) {
+		if (os_sem_wait(data->sem) != 0)
+			break;
+
+		pthread_mutex_lock(&audio_tap_service.mutex);
+
+		stop = data->stop;
+		if (stop)
+			detached = data->detached;
+		consumer = !stop ? audio_tap_service_pop(&tap) : NULL;
+
+		pthread_mutex_unlock(&audio_tap_service.mutex);
+
+		if (stop)
+			break;
+		if (consumer)
+			audio_tap_run(data, consumer, tap);
+	}
+
+	/* the threads are joined and freed by the remover unless the last
+	 * tap was removed from a callback of one of them */
+	if (detached && os_atomic_dec_long(&data->running) == 0) {
+		os_sem_destroy(data->sem);
+		bfree(data);
+	}
+	return NULL;
+}
+
+static struct audio_tap_threads *audio_tap_threads_create(void)
+{
+	struct audio_tap_threads *data = bzalloc(sizeof(*data));
+
+	if (os_sem_init(&data->sem, 0) != 0) {
+		bfree(data);
+		return NULL;
+	}
+
+	for (size_t i = 0; i < AUDIO_TAP_THREADS; i++) {
+		if (pthread_create(&data->threads[data->num], NULL,
+				   audio_tap_thread, data) == 0)
+			data->num++;
+	}
+
+	if (!data->num) {
+		os_sem_destroy(data->sem);
+		bfree(data);
+		return NULL;
+	}
+
+	data->running = (long)data->num;
+	return data;
+}
+
+static void audio_tap_threads_stop(struct audio_tap_threads *data)
+{
+	if (data->detached) {
+		for (size_t i = 0; i < data->num; i++)
+			pthread_detach(data->threads[i]);
+		return;
+	}
+
+	for (size_t i = 0; i < data->num; i++)
+		pthread_join(data->threads[i], NULL);
+	os_sem_destroy(data->sem);
+	bfree(data);
+}
+
+static struct audio_tap_consumer *
+audio_tap_service_add(obs_source_t *source, obs_source_audio_tap_t callback,
+		      void *param)
+{
+	struct audio_tap_consumer *consumer = NULL;
+
+	pthread_mutex_lock(&audio_tap_service.mutex);
+
+	if (!audio_tap_service.threads)
+		audio_tap_service.threads = audio_tap_threads_create();
+
+	if (audio_tap_service.threads) {
+		consumer = bzalloc(sizeof(*consumer));
+		consumer->callback = callback;
+		consumer->param = param;
+		consumer->source = source;
+		da_push_back(audio_tap_service.consumers, &consumer);
+	}
+
+	pthread_mutex_unlock(&audio_tap_service.mutex);
+
+	if (!consumer)
+		blog(LOG_ERROR, "Failed to start the audio tap threads");
+	return consumer;
+}
+
+/* drops the queued audio of the removed taps, then waits until callbacks that
+ * may still be running have returned */
+static void audio_tap_service_remove(struct audio_tap_consumer **consumers,
+				     size_t num)
+{
+	struct audio_tap_threads *stop_threads = NULL;
+	size_t wait_num = 0;
+
+	if (!num)
+		return;
+
+	pthread_mutex_lock(&audio_tap_service.mutex);
+
+	for (size_t i = 0; i < num; i++) {
+		struct audio_tap_consumer *consumer = consumers[i];
+
+		da_erase_item(audio_tap_service.consumers, &consumer);
+		consumer_free_jobs(consumer);
+
+		if (!consumer->busy) {
+			consumers[wait_num++] = consumer;
+		} else if (on_audio_tap_thread) {
+			consumer->removed = true;
+		} else {
+			os_event_init(&consumer->idle_event,
+				      OS_EVENT_TYPE_MANUAL);
+			consumers[wait_num++] = consumer;
+		}
+	}
+
+	if (!audio_tap_service.consumers.num) {
+		da_free(audio_tap_service.consumers);
+		audio_tap_service.next_consumer = 0;
+		stop_threads = audio_tap_service.threads;
+		stop_threads->stop = true;
+		stop_threads->detached = on_audio_tap_thread;
+		for (size_t i = 0; i < stop_threads->num; i++)
+			os_sem_post(stop_threads->sem);
+		audio_tap_service.threads = NULL;
+	}
+
+	pthread_mutex_unlock(&audio_tap_service.mutex);
+
+	for (size_t i = 0; i < wait_num; i++) {
+		if (consumers[i]->idle_event)
+			os_event_wait(consumers[i]->idle_event);
+		consumer_destroy(consumers[i]);
+	}
+
+	if (stop_threads)
+		audio_tap_threads_stop(stop_threads);
+}
+
+static void audio_tap_service_push(obs_source_t *source,
+				   struct audio_tap_consumer *consumer,
+				   struct obs_audio_tap *tap)
+{
+	bool overflow = false;
+
+	pthread_mutex_lock(&audio_tap_service.mutex);
+
+	if (!consumer->jobs.size)
+		consumer->overflow = false;
+
+	if (consumer->jobs.size / sizeof(tap) < MAX_AUDIO_TAP_JOBS) {
+		obs_audio_tap_addref(tap);
+		circlebuf_push_back(&consumer->jobs, &tap, sizeof(tap));
+		audio_tap_service.queued_jobs++;
+		os_sem_post(audio_tap_service.threads->sem);
+
+	} else if (!consumer->overflow) {
+		consumer->overflow = true;
+		overflow = true;
+	}
+
+	pthread_mutex_unlock(&audio_tap_service.mutex);
+
+	if (overflow)
+		blog(LOG_WARNING,
+		     "Audio tap of source '%s' is falling behind, dropping "
+		     "its audio",
+		     obs_source_get_name(source));
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* every plane starts 16 byte aligned, so that consumers can use SSE loads */
+static inline uint32_t get_plane_frames(uint32_t frames)
+{
+	return (frames + 3) & ~3U;
+}
+
+static struct obs_audio_tap *get_audio_tap(obs_source_t *source,
+					   size_t channels, uint32_t frames)
+{
+	struct obs_audio_tap *tap = source->audio_tap;
+	size_t size = channels * get_plane_frames(frames);
+
+	/* a consumer that still holds the previous buffer keeps it, no one
+	 * else can take a reference while the source holds the only one */
+	if (tap && (os_atomic_load_long(&tap->refs) > 1 ||
+		    tap->capacity < size)) {
+		obs_audio_tap_release(tap);
+		tap = NULL;
+	}
+
+	if (!tap) {
+		tap = bzalloc(sizeof(*tap));
+		tap->refs = 1;
+		tap->capacity = size > channels * AUDIO_OUTPUT_FRAMES
+					? size
+					: channels * AUDIO_OUTPUT_FRAMES;
+		tap->buffer = bmalloc(tap->capacity * sizeof(float));
+		source->audio_tap = tap;
+	}
+
+	return tap;
+}
+
+/* called with audio_cb_mutex held on the thread that outputs the audio of the
+ * source.  the audio is copied once no matter how many taps there are. */
+void obs_source_output_audio_taps(obs_source_t *source,
+				  const struct audio_data *in,
+				  uint64_t timestamp, bool muted)
+{
+	size_t channels = audio_output_get_channels(obs->audio.audio);
+	struct obs_audio_tap *tap;
+
+	if (!source->audio_tap_list.num || !in->frames)
+		return;
+
+	tap = get_audio_tap(source, channels, in->frames);
+	memset(tap->data.data, 0, sizeof(tap->data.data));
+	tap->data.frames = in->frames;
+	tap->data.timestamp = timestamp;
+	tap->channels = channels;
+	tap->muted = muted;
+
+	for (size_t ch = 0; ch < channels; ch++) {
+		float *out = tap->buffer + ch * get_plane_frames(in->frames);
+
+		if (in->data[ch])
+			memcpy(out, in->data[ch], in->frames * sizeof(float));
+		else
+			memset(out, 0, in->frames * sizeof(float));
+		tap->data.data[ch] = (uint8_t *)out;
+	}
+
+	for (size_t i = source->audio_tap_list.num; i > 0; i--) {
+		struct audio_tap_info info =
+			source->audio_tap_list.array[i - 1];
+
+		if (info.consumer)
+			audio_tap_service_push(source, info.consumer, tap);
+		else
+			info.callback(info.param, source, tap);
+	}
+}
+
+/* removes every tap of a source that is being destroyed */
+void obs_source_free_audio_taps(obs_source_t *source)
+{
+	DARRAY(struct audio_tap_consumer *) consumers;
+
+	da_init(consumers);
+
+	pthread_mutex_lock(&source->audio_cb_mutex);
+	for (size_t i = 0; i < source->audio_tap_list.num; i++) {
+		struct audio_tap_info *info = &source->audio_tap_list.array[i];
+
+		if (info->consumer)
+			da_push_back(consumers, &info->consumer);
+	}
+	da_free(source->audio_tap_list);
+	obs_audio_tap_release(source->audio_tap);
+	source->audio_tap = NULL;
+	pthread_mutex_unlock(&source->audio_cb_mutex);
+
+	audio_tap_service_remove(consumers.array, consumers.num);
+	da_free(consumers);
+}
+
+void obs_source_add_audio_tap(obs_source_t *source,
+			      obs_source_audio_tap_t callback, void *param,
+			      bool async)
+{
+	struct audio_tap_info info = {callback, param, NULL};
+
+	if (!obs_source_valid(source, "obs_source_add_audio_tap"))
+		return;
+	if (!obs_ptr_valid(callback, "obs_source_add_audio_tap"))
+		return;
+
+	if (async) {
+		info.consumer = audio_tap_service_add(source, callback, param);
+		if (!info.consumer)
+			return;
+	}
+
+	pthread_mutex_lock(&source->audio_cb_mutex);
+	da_push_back(source->audio_tap_list, &info);
+	pthread_mutex_unlock(&source->audio_cb_mutex);
+}
+
+void obs_source_remove_audio_tap(obs_source_t *source,
+				 obs_source_audio_tap_t callback, void *param)
+{
+	struct audio_tap_consumer *consumer = NULL;
+
+	if (!obs_source_valid(source, "obs_source_remove_audio_tap"))
+		return;
+
+	pthread_mutex_lock(&source->audio_cb_mutex);
+	for (size_t i = 0; i < source->audio_tap_list.num; i++) {
+		struct audio_tap_info *info = &source->audio_tap_list.array[i];
+
+		if (info->callback == callback && info->param == param) {
+			consumer = info->consumer;
+			da_erase(source->audio_tap_list, i);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&source->audio_cb_mutex);
+
+	if (consumer)
+		audio_tap_service_remove(&consumer, 1);
+}
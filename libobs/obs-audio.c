@@ -27,6 +27,9 @@ struct ts_info {
 #define DEBUG_AUDIO 0
 #define DEBUG_LAGGED_AUDIO 0
 
+/* how long audio has to stay buffered ahead before buffering is removed */
+#define HEADROOM_WINDOW_NS (10 * 1000000000ULL)
+
 static void push_audio_tree(obs_source_t *parent, obs_source_t *source, void *p)
 {
 	struct obs_core_audio *audio = p;
@@ -49,7 +52,7 @@ static inline void mix_audio(struct audio_output_data *mixes,
 			     obs_source_t *source, size_t channels,
 			     size_t sample_rate, struct ts_info *ts)
 {
-	size_t total_floats = AUDIO_OUTPUT_FRAMES;
+	size_t total_floats = obs->audio.frames_per_tick;
 	size_t start_point = 0;
 
 	if (source->audio_ts < ts->start || ts->end <= source->audio_ts)
@@ -58,7 +61,7 @@ static inline void mix_audio(struct audio_output_data *mixes,
 	if (source->audio_ts != ts->start) {
 		start_point = convert_time_to_frames(
 			sample_rate, source->audio_ts - ts->start);
-		if (start_point == AUDIO_OUTPUT_FRAMES)
+		if (start_point == total_floats)
 			return;
 
 		total_floats -= start_point;
@@ -192,16 +195,12 @@ static bool discard_if_stopped(obs_source_t *source, size_t channels)
 	}
 }
 
-#define MAX_AUDIO_SIZE (AUDIO_OUTPUT_FRAMES * sizeof(float))
-
 static inline void discard_audio(struct obs_core_audio *audio,
 				 obs_source_t *source, size_t channels,
 				 size_t sample_rate, struct ts_info *ts)
 {
-	size_t total_floats = AUDIO_OUTPUT_FRAMES;
+	size_t total_floats = audio->frames_per_tick;
 	size_t size;
-	/* debug assert only */
-	UNUSED_PARAMETER(audio);
 
 #if DEBUG_AUDIO == 1
 	bool is_audio_source = source->info.output_flags & OBS_SOURCE_AUDIO;
@@ -225,7 +224,8 @@ static inline void discard_audio(struct obs_core_audio *audio,
 
 	if (source->audio_ts < (ts->start - 1)) {
 		if (source->audio_pending &&
-		    source->audio_input_buf[0].size < MAX_AUDIO_SIZE &&
+		    source->audio_input_buf[0].size <
+			    total_floats * sizeof(float) &&
 		    discard_if_stopped(source, channels))
 			return;
 
@@ -252,7 +252,7 @@ static inline void discard_audio(struct obs_core_audio *audio,
 	    source->audio_ts != (ts->start - 1)) {
 		size_t start_point = convert_time_to_frames(
 			sample_rate, source->audio_ts - ts->start);
-		if (start_point == AUDIO_OUTPUT_FRAMES) {
+		if (start_point == total_floats) {
 #if DEBUG_AUDIO == 1
 			if (is_audio_source)
 				blog(LOG_DEBUG, "can't discard, start point is "
@@ -297,6 +297,13 @@ static inline bool audio_buffering_maxed(struct obs_core_audio *audio)
 	return audio->total_buffering_ticks == audio->max_buffering_ticks;
 }
 
+static inline void reset_buffering_window(struct obs_core_audio *audio,
+					  uint64_t ts)
+{
+	audio->buffering_headroom = UINT64_MAX;
+	audio->buffering_window_ts = ts;
+}
+
 static void set_fixed_audio_buffering(struct obs_core_audio *audio,
 				      size_t sample_rate, struct ts_info *ts)
 {
@@ -314,9 +321,9 @@ static void set_fixed_audio_buffering(struct obs_core_audio *audio,
 	ticks = audio->max_buffering_ticks - audio->total_buffering_ticks;
 	audio->total_buffering_ticks += ticks;
 
-	ms = ticks * AUDIO_OUTPUT_FRAMES * 1000 / sample_rate;
-	total_ms = audio->total_buffering_ticks * AUDIO_OUTPUT_FRAMES * 1000 /
-		   sample_rate;
+	ms = ticks * audio->frames_per_tick * 1000 / sample_rate;
+	total_ms = audio->total_buffering_ticks * audio->frames_per_tick *
+		   1000 / sample_rate;
 
 	blog(LOG_INFO,
 	     "\n"
@@ -328,7 +335,7 @@ static void set_fixed_audio_buffering(struct obs_core_audio *audio,
 	new_ts.start =
 		audio->buffered_ts -
 		audio_frames_to_ns(sample_rate, audio->buffering_wait_ticks *
-							AUDIO_OUTPUT_FRAMES);
+							audio->frames_per_tick);
 
 	while (ticks--) {
 		const uint64_t cur_ticks = ++audio->buffering_wait_ticks;
@@ -337,7 +344,7 @@ static void set_fixed_audio_buffering(struct obs_core_audio *audio,
 		new_ts.start =
 			audio->buffered_ts -
 			audio_frames_to_ns(sample_rate,
-					   cur_ticks * AUDIO_OUTPUT_FRAMES);
+					   cur_ticks * audio->frames_per_tick);
 
 #if DEBUG_AUDIO == 1
 		blog(LOG_DEBUG, "add buffered ts: %" PRIu64 "-%" PRIu64,
@@ -370,9 +377,11 @@ static void add_audio_buffering(struct obs_core_audio *audio,
 
 	offset = ts->start - min_ts;
 	frames = ns_to_audio_frames(sample_rate, offset);
-	ticks = (int)((frames + AUDIO_OUTPUT_FRAMES - 1) / AUDIO_OUTPUT_FRAMES);
+	ticks = (int)((frames + audio->frames_per_tick - 1) /
+		      audio->frames_per_tick);
 
 	audio->total_buffering_ticks += ticks;
+	reset_buffering_window(audio, ts->start);
 
 	if (audio->total_buffering_ticks >= audio->max_buffering_ticks) {
 		ticks -= audio->total_buffering_ticks -
@@ -381,9 +390,9 @@ static void add_audio_buffering(struct obs_core_audio *audio,
 		blog(LOG_WARNING, "Max audio buffering reached!");
 	}
 
-	ms = ticks * AUDIO_OUTPUT_FRAMES * 1000 / sample_rate;
-	total_ms = audio->total_buffering_ticks * AUDIO_OUTPUT_FRAMES * 1000 /
-		   sample_rate;
+	ms = ticks * audio->frames_per_tick * 1000 / sample_rate;
+	total_ms = audio->total_buffering_ticks * audio->frames_per_tick *
+		   1000 / sample_rate;
 
 	blog(LOG_INFO,
 	     "adding %d milliseconds of audio buffering, total "
@@ -402,7 +411,7 @@ static void add_audio_buffering(struct obs_core_audio *audio,
 	new_ts.start =
 		audio->buffered_ts -
 		audio_frames_to_ns(sample_rate, audio->buffering_wait_ticks *
-							AUDIO_OUTPUT_FRAMES);
+							audio->frames_per_tick);
 
 	while (ticks--) {
 		const uint64_t cur_ticks = ++audio->buffering_wait_ticks;
@@ -411,7 +420,7 @@ static void add_audio_buffering(struct obs_core_audio *audio,
 		new_ts.start =
 			audio->buffered_ts -
 			audio_frames_to_ns(sample_rate,
-					   cur_ticks * AUDIO_OUTPUT_FRAMES);
+					   cur_ticks * audio->frames_per_tick);
 
 #if DEBUG_AUDIO == 1
 		blog(LOG_DEBUG, "add buffered ts: %" PRIu64 "-%" PRIu64,
@@ -428,7 +437,7 @@ static void add_audio_buffering(struct obs_core_audio *audio,
 static bool audio_buffer_insuffient(struct obs_source *source,
 				    size_t sample_rate, uint64_t min_ts)
 {
-	size_t total_floats = AUDIO_OUTPUT_FRAMES;
+	size_t total_floats = obs->audio.frames_per_tick;
 	size_t size;
 
 	if (source->info.audio_render || source->audio_pending ||
@@ -439,7 +448,7 @@ static bool audio_buffer_insuffient(struct obs_source *source,
 	if (source->audio_ts != min_ts && source->audio_ts != (min_ts - 1)) {
 		size_t start_point = convert_time_to_frames(
 			sample_rate, source->audio_ts - min_ts);
-		if (start_point >= AUDIO_OUTPUT_FRAMES)
+		if (start_point >= total_floats)
 			return false;
 
 		total_floats -= start_point;
@@ -496,6 +505,189 @@ static inline const char *calc_min_ts(struct obs_core_data *data,
 	return buffering_name;
 }
 
+/* ------------------------------------------------------------------------- */
+/* per-source jitter buffer                                                  */
+
+static void delay_late_source(obs_source_t *source, uint64_t tick_ns,
+			      uint64_t start_ts)
+{
+	uint64_t late;
+	uint64_t delay;
+
+	if (!source->audio_ts || source->audio_ts >= start_ts ||
+	    !source->audio_input_buf[0].size)
+		return;
+
+	/* round up to whole ticks so that the next bit of jitter does not
+	 * need another increase right away */
+	late = start_ts - source->audio_ts;
+	delay = (late + tick_ns - 1) / tick_ns * tick_ns;
+
+	/* too late for the jitter buffer, audio buffering handles it */
+	if (source->audio_jitter_delay + delay > source->audio_jitter_max)
+		return;
+
+	source->audio_jitter_delay += delay;
+	source->audio_ts += delay;
+	source->audio_jitter_headroom = UINT64_MAX;
+	source->audio_jitter_window_ts = start_ts;
+
+	blog(LOG_INFO,
+	     "Source %s audio is late by %.02f ms, jitter buffer delay "
+	     "is now %d milliseconds",
+	     obs_source_get_name(source), late / 1000000.,
+	     (int)(source->audio_jitter_delay / 1000000));
+}
+
+/* gives late sources their own delay before they are rendered, instead of
+ * increasing the audio buffering of every source */
+static void delay_late_sources(struct obs_core_data *data, uint64_t tick_ns,
+			       uint64_t start_ts)
+{
+	struct obs_source *source = data->first_audio_source;
+
+	while (source) {
+		if (source->audio_jitter_max && !source->info.audio_render) {
+			pthread_mutex_lock(&source->audio_buf_mutex);
+			delay_late_source(source, tick_ns, start_ts);
+			pthread_mutex_unlock(&source->audio_buf_mutex);
+		}
+
+		source = (struct obs_source *)source->next_audio_source;
+	}
+}
+
+/* how much audio a source has buffered past the current tick */
+static uint64_t get_audio_headroom(struct obs_core_audio *audio,
+				   obs_source_t *source, size_t sample_rate,
+				   const struct ts_info *ts)
+{
+	size_t frames = source->audio_input_buf[0].size / sizeof(float);
+	uint64_t max_buffering_ns;
+	uint64_t end_ts;
+
+	if (source->info.audio_render || !source->audio_ts)
+		return UINT64_MAX;
+
+	end_ts = source->audio_ts + audio_frames_to_ns(sample_rate, frames);
+
+	/* a pending source whose audio ends further back than the maximum
+	 * buffering has stopped sending audio, it must not keep the audio
+	 * buffering of every other source from being reduced */
+	if (source->audio_pending) {
+		max_buffering_ns = audio_frames_to_ns(
+			sample_rate,
+			audio->max_buffering_ticks * audio->frames_per_tick);
+		return end_ts + max_buffering_ns < ts->start ? UINT64_MAX : 0;
+	}
+
+	return end_ts > ts->end ? end_ts - ts->end : 0;
+}
+
+/* called after the tick has been discarded.  drops the jitter buffer delay
+ * down to the maximum if that was lowered, otherwise removes the delay that
+ * has not been needed for HEADROOM_WINDOW_NS, keeping a tick in reserve */
+static void shrink_jitter_delay(obs_source_t *source, size_t channels,
+				size_t sample_rate, uint64_t tick_ns,
+				uint64_t end_ts)
+{
+	uint64_t delay = source->audio_jitter_delay;
+	uint64_t reduce = 0;
+	size_t size;
+
+	if (!delay)
+		return;
+
+	if (delay > source->audio_jitter_max) {
+		reduce = delay - source->audio_jitter_max;
+
+	} else if (end_ts - source->audio_jitter_window_ts >=
+		   HEADROOM_WINDOW_NS) {
+		uint64_t headroom = source->audio_jitter_headroom;
+
+		if (headroom > tick_ns) {
+			reduce = (headroom - tick_ns) / tick_ns * tick_ns;
+			if (reduce > delay)
+				reduce = delay;
+		}
+
+		source->audio_jitter_headroom = UINT64_MAX;
+		source->audio_jitter_window_ts = end_ts;
+	}
+
+	if (!reduce)
+		return;
+
+	size = ns_to_audio_frames(sample_rate, reduce) * sizeof(float);
+	if (size > source->audio_input_buf[0].size)
+		size = source->audio_input_buf[0].size;
+
+	for (size_t ch = 0; ch < channels; ch++)
+		circlebuf_pop_front(&source->audio_input_buf[ch], NULL, size);
+
+	source->audio_jitter_delay -= reduce;
+
+	blog(LOG_INFO, "Source %s jitter buffer delay is now %d milliseconds",
+	     obs_source_get_name(source),
+	     (int)(source->audio_jitter_delay / 1000000));
+}
+
+/* removes a tick of audio buffering once every source has had at least three
+ * ticks of audio buffered past the current one for HEADROOM_WINDOW_NS, which
+ * leaves a tick in reserve.  skipping a tick leaves a gap in the output
+ * timestamps that encoders do not handle, so this only happens while nothing
+ * is connected to the audio output.  while outputs are active, sources that
+ * are late by less than their jitter buffer maximum are delayed on their own
+ * instead, which can be reduced at any time. */
+static void remove_audio_buffering(struct obs_core_audio *audio,
+				   struct obs_core_data *data, size_t channels,
+				   size_t sample_rate, uint64_t tick_ns,
+				   const struct ts_info *ts)
+{
+	struct ts_info skip_ts;
+	bool remove;
+
+	if (!audio->total_buffering_ticks || audio->fixed_buffer ||
+	    audio->buffering_wait_ticks)
+		return;
+	if (ts->end - audio->buffering_window_ts < HEADROOM_WINDOW_NS)
+		return;
+
+	remove = audio->buffering_headroom >= 3 * tick_ns &&
+		 audio->buffered_timestamps.size >= sizeof(skip_ts) &&
+		 !audio_output_active(audio->audio);
+
+	reset_buffering_window(audio, ts->end);
+	if (!remove)
+		return;
+
+	circlebuf_pop_front(&audio->buffered_timestamps, &skip_ts,
+			    sizeof(skip_ts));
+
+	pthread_mutex_lock(&data->audio_sources_mutex);
+
+	struct obs_source *source = data->first_audio_source;
+	while (source) {
+		pthread_mutex_lock(&source->audio_buf_mutex);
+		discard_audio(audio, source, channels, sample_rate, &skip_ts);
+		pthread_mutex_unlock(&source->audio_buf_mutex);
+
+		source = (struct obs_source *)source->next_audio_source;
+	}
+
+	pthread_mutex_unlock(&data->audio_sources_mutex);
+
+	audio->total_buffering_ticks--;
+
+	blog(LOG_INFO,
+	     "removing %d milliseconds of audio buffering, total "
+	     "audio buffering is now %d milliseconds",
+	     (int)(tick_ns / 1000000),
+	     (int)(audio->total_buffering_ticks * tick_ns / 1000000));
+}
+
+/* ------------------------------------------------------------------------- */
+
 static inline void release_audio_sources(struct obs_core_audio *audio)
 {
 	for (size_t i = 0; i < audio->render_order.num; i++)
@@ -529,6 +721,8 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 	size_t sample_rate = audio_output_get_sample_rate(audio->audio);
 	size_t channels = audio_output_get_channels(audio->audio);
 	struct ts_info ts = {start_ts_in, end_ts_in};
+	uint64_t tick_ns =
+		audio_frames_to_ns(sample_rate, audio->frames_per_tick);
 	size_t audio_size;
 	uint64_t min_ts;
 
@@ -539,7 +733,7 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 	circlebuf_peek_front(&audio->buffered_timestamps, &ts, sizeof(ts));
 	min_ts = ts.start;
 
-	audio_size = AUDIO_OUTPUT_FRAMES * sizeof(float);
+	audio_size = audio->frames_per_tick * sizeof(float);
 
 #if DEBUG_AUDIO == 1
 	blog(LOG_DEBUG, "ts %llu-%llu", ts.start, ts.end);
@@ -567,6 +761,8 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 		source = (struct obs_source *)source->next_audio_source;
 	}
 
+	delay_late_sources(data, tick_ns, ts.start);
+
 	pthread_mutex_unlock(&data->audio_sources_mutex);
 
 	/* ------------------------------------------------ */
@@ -649,10 +845,24 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 	/* discard audio */
 	pthread_mutex_lock(&data->audio_sources_mutex);
 
+	if (!audio->buffering_window_ts)
+		reset_buffering_window(audio, ts.start);
+
 	source = data->first_audio_source;
 	while (source) {
 		pthread_mutex_lock(&source->audio_buf_mutex);
+
+		uint64_t headroom =
+			get_audio_headroom(audio, source, sample_rate, &ts);
+		if (headroom < audio->buffering_headroom)
+			audio->buffering_headroom = headroom;
+		if (headroom < source->audio_jitter_headroom)
+			source->audio_jitter_headroom = headroom;
+
 		discard_audio(audio, source, channels, sample_rate, &ts);
+		shrink_jitter_delay(source, channels, sample_rate, tick_ns,
+				    ts.end);
+
 		pthread_mutex_unlock(&source->audio_buf_mutex);
 
 		source = (struct obs_source *)source->next_audio_source;
@@ -666,6 +876,9 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 
 	circlebuf_pop_front(&audio->buffered_timestamps, NULL, sizeof(ts));
 
+	remove_audio_buffering(audio, data, channels, sample_rate, tick_ns,
+			       &ts);
+
 	*out_ts = ts.start;
 
 	if (audio->buffering_wait_ticks) {
@@ -18,8 +18,28 @@
 #include "obs-avc.h"
 
 #include "obs.h"
+#include "obs-internal.h"
 #include "obs-nal.h"
 #include "util/array-serializer.h"
+#include "util/threading.h"
+
+/* NAL unit offsets of recently parsed H.264 packets.  every output parses
+ * its own copy of an encoder packet, the copies share the encoder, dts and
+ * size, so only the first output has to scan the data. */
+#define AVC_CACHE_ENTRIES 16
+#define MAX_CACHED_NAL_UNITS 64
+
+struct avc_cache_entry {
+	const obs_encoder_t *encoder;
+	int64_t dts;
+	size_t size;
+	size_t num_units;
+	struct obs_nal_unit units[MAX_CACHED_NAL_UNITS];
+};
+
+static struct avc_cache_entry avc_cache[AVC_CACHE_ENTRIES];
+static size_t avc_cache_next = 0;
+static pthread_mutex_t avc_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 bool obs_avc_keyframe(const uint8_t *data, size_t size)
 {
@@ -87,19 +107,132 @@ static void serialize_avc_data(struct serializer *s, const uint8_t *data,
 	}
 }
 
+static inline bool cache_entry_matches(const struct avc_cache_entry *entry,
+				       const struct encoder_packet *packet)
+{
+	return entry->encoder == packet->encoder && entry->dts == packet->dts &&
+	       entry->size == packet->size;
+}
+
+/* every cached unit has to follow a start code in this packet, a packet
+ * that was modified without changing its size is scanned again */
+static bool units_valid(const struct encoder_packet *packet,
+			const struct obs_nal_unit *units, size_t num_units)
+{
+	if (!num_units || units[num_units - 1].end != packet->size)
+		return false;
+
+	for (size_t i = 0; i < num_units; i++) {
+		const uint8_t *nal = packet->data + units[i].start;
+
+		if (units[i].start < 3 || units[i].start >= units[i].end ||
+		    nal[-1] != 1 || nal[-2] != 0 || nal[-3] != 0)
+			return false;
+	}
+
+	return true;
+}
+
+static size_t get_nal_units(const struct encoder_packet *packet,
+			    struct obs_nal_unit *units)
+{
+	struct avc_cache_entry *entry;
+	size_t num_units = 0;
+
+	if (!packet->encoder)
+		return obs_nal_find_units(packet->data, packet->size, units,
+					  MAX_CACHED_NAL_UNITS);
+
+	pthread_mutex_lock(&avc_cache_mutex);
+	for (size_t i = 0; i < AVC_CACHE_ENTRIES; i++) {
+		entry = &avc_cache[i];
+
+		if (cache_entry_matches(entry, packet)) {
+			num_units = entry->num_units;
+			memcpy(units, entry->units,
+			       num_units * sizeof(*units));
+			break;
+		}
+	}
+	pthread_mutex_unlock(&avc_cache_mutex);
+
+	if (units_valid(packet, units, num_units))
+		return num_units;
+
+	num_units = obs_nal_find_units(packet->data, packet->size, units,
+				       MAX_CACHED_NAL_UNITS);
+	if (!num_units)
+		return 0;
+
+	pthread_mutex_lock(&avc_cache_mutex);
+	entry = &avc_cache[avc_cache_next];
+	avc_cache_next = (avc_cache_next + 1) % AVC_CACHE_ENTRIES;
+	entry->encoder = packet->encoder;
+	entry->dts = packet->dts;
+	entry->size = packet->size;
+	entry->num_units = num_units;
+	memcpy(entry->units, units, num_units * sizeof(*units));
+	pthread_mutex_unlock(&avc_cache_mutex);
+
+	return num_units;
+}
+
+void obs_avc_cache_remove_encoder(const obs_encoder_t *encoder)
+{
+	pthread_mutex_lock(&avc_cache_mutex);
+	for (size_t i = 0; i < AVC_CACHE_ENTRIES; i++) {
+		if (avc_cache[i].encoder == encoder)
+			memset(&avc_cache[i], 0, sizeof(avc_cache[i]));
+	}
+	pthread_mutex_unlock(&avc_cache_mutex);
+}
+
+/* same as serialize_avc_data, using already located unit offsets */
+static void serialize_avc_units(struct serializer *s, const uint8_t *data,
+				const struct obs_nal_unit *units,
+				size_t num_units, bool *is_keyframe,
+				int *priority)
+{
+	for (size_t i = 0; i < num_units; i++) {
+		const struct obs_nal_unit *unit = &units[i];
+		const uint8_t *nal = data + unit->start;
+		uint32_t size = unit->end - unit->start;
+		int type = nal[0] & 0x1F;
+
+		if (type == OBS_NAL_SLICE_IDR || type == OBS_NAL_SLICE) {
+			if (is_keyframe)
+				*is_keyframe = (type == OBS_NAL_SLICE_IDR);
+			if (priority)
+				*priority = nal[0] >> 5;
+		}
+
+		s_wb32(s, size);
+		s_write(s, nal, size);
+	}
+}
+
 void obs_parse_avc_packet(struct encoder_packet *avc_packet,
 			  const struct encoder_packet *src)
 {
+	struct obs_nal_unit units[MAX_CACHED_NAL_UNITS];
 	struct array_output_data output;
 	struct serializer s;
+	size_t num_units;
 	long ref = 1;
 
 	array_output_serializer_init(&s, &output);
 	*avc_packet = *src;
 
 	serialize(&s, &ref, sizeof(ref));
-	serialize_avc_data(&s, src->data, src->size, &avc_packet->keyframe,
-			   &avc_packet->priority);
+	num_units = get_nal_units(src, units);
+	if (num_units)
+		serialize_avc_units(&s, src->data, units, num_units,
+				    &avc_packet->keyframe,
+				    &avc_packet->priority);
+	else
+		serialize_avc_data(&s, src->data, src->size,
+				   &avc_packet->keyframe,
+				   &avc_packet->priority);
 
 	avc_packet->data = output.bytes.array + sizeof(ref);
 	avc_packet->size = output.bytes.num - sizeof(ref);
@@ -262,6 +262,7 @@ static void obs_encoder_actually_destroy(obs_encoder_t *encoder)
 		     encoder->context.name);
 
 		free_audio_buffers(encoder);
+		obs_avc_cache_remove_encoder(encoder);
 
 		if (encoder->context.data)
 			encoder->info.destroy(encoder->context.data);
@@ -705,6 +706,18 @@ bool obs_encoder_scaling_enabled(const obs_encoder_t *encoder)
 	return encoder->scaled_width || encoder->scaled_height;
 }
 
+bool obs_encoder_get_scale_stats(const obs_encoder_t *encoder,
+				 struct video_scale_stats *stats)
+{
+	if (!obs_encoder_valid(encoder, "obs_encoder_get_scale_stats"))
+		return false;
+	if (encoder->info.type != OBS_ENCODER_VIDEO || !encoder->media)
+		return false;
+
+	return video_output_get_scale_stats(encoder->media, receive_video,
+					    (void *)encoder, stats);
+}
+
 uint32_t obs_encoder_get_width(const obs_encoder_t *encoder)
 {
 	if (!obs_encoder_valid(encoder, "obs_encoder_get_width"))
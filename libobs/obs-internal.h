@@ -45,6 +45,11 @@
 #define NUM_ENCODE_TEXTURES 3
 #define NUM_ENCODE_TEXTURE_FRAMES_TO_WAIT 1
 
+/* audio that is this much later than its video is still not noticeable
+ * (ITU-R BT.1359), so sources that arrive late by up to this are delayed on
+ * their own by default instead of buffering the audio of every source */
+#define DEFAULT_AUDIO_JITTER_MAX_NS (60 * 1000000ULL)
+
 static inline int64_t packet_dts_usec(struct encoder_packet *packet)
 {
 	return packet->dts * MICROSECOND_DEN / packet->timebase_den;
@@ -346,6 +351,12 @@ struct obs_core_audio {
 	int total_buffering_ticks;
 	int max_buffering_ticks;
 	bool fixed_buffer;
+	uint32_t frames_per_tick;
+
+	/* smallest amount of audio any source had buffered past the current
+	 * tick since buffering_window_ts, used to remove buffering again */
+	uint64_t buffering_headroom;
+	uint64_t buffering_window_ts;
 
 	float user_volume;
 
@@ -353,6 +364,7 @@ struct obs_core_audio {
 	DARRAY(struct audio_monitor *) monitors;
 	char *monitoring_device_name;
 	char *monitoring_device_id;
+	uint32_t monitoring_latency_ms;
 
 	pthread_mutex_t task_mutex;
 	struct circlebuf tasks;
@@ -451,6 +463,7 @@ struct obs_core {
 	struct obs_core_hotkeys hotkeys;
 
 	os_task_queue_t *destruction_task_thread;
+	os_task_pool_t *audio_task_pool;
 
 	obs_task_handler_t ui_task_handler;
 };
@@ -627,6 +640,16 @@ struct audio_cb_info {
 	void *param;
 };
 
+struct audio_tap_consumer;
+
+struct audio_tap_info {
+	obs_source_audio_tap_t callback;
+	void *param;
+
+	/* the queue of an asynchronous tap, NULL for synchronous taps */
+	struct audio_tap_consumer *consumer;
+};
+
 struct caption_cb_info {
 	obs_source_caption_t callback;
 	void *param;
@@ -706,6 +729,8 @@ struct obs_source {
 	pthread_mutex_t audio_mutex;
 	pthread_mutex_t audio_cb_mutex;
 	DARRAY(struct audio_cb_info) audio_cb_list;
+	DARRAY(struct audio_tap_info) audio_tap_list;
+	struct obs_audio_tap *audio_tap;
 	struct obs_audio_data audio_data;
 	size_t audio_storage_size;
 	uint32_t audio_mixers;
@@ -715,6 +740,12 @@ struct obs_source {
 	int64_t last_sync_offset;
 	float balance;
 
+	/* per-source audio jitter buffer, see obs-audio.c */
+	uint64_t audio_jitter_max;
+	uint64_t audio_jitter_delay;
+	uint64_t audio_jitter_headroom;
+	uint64_t audio_jitter_window_ts;
+
 	/* async video data */
 	gs_texture_t *async_textures[MAX_AV_PLANES];
 	gs_texrender_t *async_texrender;
@@ -931,6 +962,10 @@ extern void obs_source_set_texcoords_centered(obs_source_t *source,
 extern void obs_source_activate(obs_source_t *source, enum view_type type);
 extern void obs_source_deactivate(obs_source_t *source, enum view_type type);
 extern void obs_source_video_tick(obs_source_t *source, float seconds);
+extern void obs_source_output_audio_taps(obs_source_t *source,
+					 const struct audio_data *in,
+					 uint64_t timestamp, bool muted);
+extern void obs_source_free_audio_taps(obs_source_t *source);
 extern float obs_source_get_target_volume(obs_source_t *source,
 					  obs_source_t *target);
 
@@ -1201,6 +1236,7 @@ struct obs_encoder {
 };
 
 extern struct obs_encoder_info *find_encoder(const char *id);
+extern void obs_avc_cache_remove_encoder(const obs_encoder_t *encoder);
 
 extern bool obs_encoder_initialize(obs_encoder_t *encoder);
 extern void obs_encoder_shutdown(obs_encoder_t *encoder);
@@ -17,51 +17,96 @@
 
 #include "obs-nal.h"
 
-/* NOTE: I noticed that FFmpeg does some unusual special handling of certain
- * scenarios that I was unaware of, so instead of just searching for {0, 0, 1}
- * we'll just use the code from FFmpeg - http://www.ffmpeg.org/ */
-static const uint8_t *ff_avc_find_startcode_internal(const uint8_t *p,
-						     const uint8_t *end)
+#include "util/sse-intrin.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static inline unsigned lowest_set_bit(unsigned mask)
 {
-	const uint8_t *a = p + 4 - ((intptr_t)p & 3);
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanForward(&idx, mask);
+	return (unsigned)idx;
+#else
+	return (unsigned)__builtin_ctz(mask);
+#endif
+}
 
-	for (end -= 3; p < a && p < end; p++) {
-		if (p[0] == 0 && p[1] == 0 && p[2] == 1)
-			return p;
-	}
+/* Returns the first {0, 0, 1} sequence in [p, end), or end if there is none.
+ *
+ * This used to be a port of FFmpeg's word-at-a-time search, which still
+ * touched every byte several times.  Encoded packets at high bitrates are
+ * scanned repeatedly (keyframe detection, FLV/MP4 conversion, captions), so
+ * compare 16 bytes at a time instead.  The second byte of a start code has to
+ * be zero, so blocks without any zero at p + 1 are skipped outright, which is
+ * the common case for slice data. */
+static const uint8_t *find_startcode_internal(const uint8_t *p,
+					      const uint8_t *end)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi8(1);
+
+	while (end - p >= 18) {
+		__m128i b1 = _mm_loadu_si128((const __m128i *)(p + 1));
+		__m128i z1 = _mm_cmpeq_epi8(b1, zero);
 
-	for (end -= 3; p < end; p += 4) {
-		uint32_t x = *(const uint32_t *)p;
-
-		if ((x - 0x01010101) & (~x) & 0x80808080) {
-			if (p[1] == 0) {
-				if (p[0] == 0 && p[2] == 1)
-					return p;
-				if (p[2] == 0 && p[3] == 1)
-					return p + 1;
-			}
-
-			if (p[3] == 0) {
-				if (p[2] == 0 && p[4] == 1)
-					return p + 2;
-				if (p[4] == 0 && p[5] == 1)
-					return p + 3;
-			}
+		if (_mm_movemask_epi8(z1)) {
+			__m128i b0 = _mm_loadu_si128((const __m128i *)p);
+			__m128i b2 = _mm_loadu_si128((const __m128i *)(p + 2));
+			__m128i hit = _mm_and_si128(_mm_cmpeq_epi8(b0, zero),
+						    z1);
+			hit = _mm_and_si128(hit, _mm_cmpeq_epi8(b2, one));
+
+			unsigned mask = (unsigned)_mm_movemask_epi8(hit);
+			if (mask)
+				return p + lowest_set_bit(mask);
 		}
+
+		p += 16;
 	}
 
-	for (end += 3; p < end; p++) {
+	for (; end - p >= 3; p++) {
 		if (p[0] == 0 && p[1] == 0 && p[2] == 1)
 			return p;
 	}
 
-	return end + 3;
+	return end;
 }
 
 const uint8_t *obs_nal_find_startcode(const uint8_t *p, const uint8_t *end)
 {
-	const uint8_t *out = ff_avc_find_startcode_internal(p, end);
+	const uint8_t *out = find_startcode_internal(p, end);
 	if (p < out && out < end && !out[-1])
 		out--;
 	return out;
 }
+
+size_t obs_nal_find_units(const uint8_t *data, size_t size,
+			  struct obs_nal_unit *units, size_t max_units)
+{
+	const uint8_t *nal_start, *nal_end;
+	const uint8_t *end = data + size;
+	size_t count = 0;
+
+	nal_start = obs_nal_find_startcode(data, end);
+	while (true) {
+		while (nal_start < end && !*(nal_start++))
+			;
+
+		if (nal_start == end)
+			break;
+		if (count == max_units)
+			return 0;
+
+		nal_end = obs_nal_find_startcode(nal_start, end);
+		units[count].start = (uint32_t)(nal_start - data);
+		units[count].end = (uint32_t)(nal_end - data);
+		count++;
+
+		nal_start = nal_end;
+	}
+
+	return count;
+}
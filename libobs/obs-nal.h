@@ -23,9 +23,24 @@
 extern "C" {
 #endif
 
+/* Offsets of a NAL unit payload (after its start code) within a packet */
+struct obs_nal_unit {
+	uint32_t start;
+	uint32_t end;
+};
+
 EXPORT const uint8_t *obs_nal_find_startcode(const uint8_t *p,
 					     const uint8_t *end);
 
+/**
+ * Finds every NAL unit of an Annex B packet in a single pass.
+ *
+ * @return  Number of units stored in units, or 0 if the packet has no NAL
+ *          units or more than max_units
+ */
+EXPORT size_t obs_nal_find_units(const uint8_t *data, size_t size,
+				 struct obs_nal_unit *units, size_t max_units);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1819,6 +1819,7 @@ static void default_raw_audio_callback(void *param, size_t mix_idx,
 {
 	struct obs_output *output = param;
 	struct audio_data out;
+	uint32_t frames = audio_output_get_frames_per_tick(output->audio);
 	size_t frame_size_bytes;
 
 	if (!data_active(output))
@@ -1834,7 +1835,7 @@ static void default_raw_audio_callback(void *param, size_t mix_idx,
 		output->audio_start_ts = out.timestamp;
 	}
 
-	frame_size_bytes = AUDIO_OUTPUT_FRAMES * output->audio_size;
+	frame_size_bytes = frames * output->audio_size;
 
 	for (size_t i = 0; i < output->planes; i++)
 		circlebuf_push_back(&output->audio_buffer[mix_idx][i],
@@ -1851,7 +1852,7 @@ static void default_raw_audio_callback(void *param, size_t mix_idx,
 			out.data[i] = (uint8_t *)output->audio_data[i];
 		}
 
-		out.frames = AUDIO_OUTPUT_FRAMES;
+		out.frames = frames;
 		out.timestamp = output->audio_start_ts +
 				audio_frames_to_ns(output->sample_rate,
 						   output->total_audio_frames);
@@ -1860,7 +1861,7 @@ static void default_raw_audio_callback(void *param, size_t mix_idx,
 		out.timestamp += output->pause.ts_offset;
 		pthread_mutex_unlock(&output->pause.mutex);
 
-		output->total_audio_frames += AUDIO_OUTPUT_FRAMES;
+		output->total_audio_frames += frames;
 
 		if (output->info.raw_audio2)
 			output->info.raw_audio2(output->context.data, mix_idx,
@@ -1295,7 +1295,7 @@ static void apply_scene_item_audio_actions(struct obs_scene_item *item,
 		new_frame_num = util_mul_div64(timestamp - ts, sample_rate,
 					       1000000000ULL);
 
-		if (ts && new_frame_num >= AUDIO_OUTPUT_FRAMES)
+		if (ts && new_frame_num >= obs->audio.frames_per_tick)
 			break;
 
 		da_erase(item->audio_actions, i--);
@@ -1313,7 +1313,7 @@ static void apply_scene_item_audio_actions(struct obs_scene_item *item,
 	}
 
 	if (buf) {
-		for (; frame_num < AUDIO_OUTPUT_FRAMES; frame_num++)
+		for (; frame_num < obs->audio.frames_per_tick; frame_num++)
 			buf[frame_num] = cur_visible ? 1.0f : 0.0f;
 	}
 
@@ -1342,7 +1342,7 @@ static bool apply_scene_item_volume(struct obs_scene_item *item, float *buf,
 	pthread_mutex_unlock(&item->actions_mutex);
 
 	if (actions_pending) {
-		uint64_t duration = util_mul_div64(AUDIO_OUTPUT_FRAMES,
+		uint64_t duration = util_mul_div64(obs->audio.frames_per_tick,
 						   1000000000ULL, sample_rate);
 
 		if (!ts || action.timestamp < (ts + duration)) {
@@ -1464,7 +1464,7 @@ static bool scene_audio_render(void *data, uint64_t *ts_out,
 
 		pos = (size_t)ns_to_audio_frames(sample_rate,
 						 source_ts - timestamp);
-		count = AUDIO_OUTPUT_FRAMES - pos;
+		count = obs->audio.frames_per_tick - pos;
 
 		if (!apply_buf && !item->visible &&
 		    !transition_active(item->hide_transition)) {
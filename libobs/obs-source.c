@@ -94,6 +94,7 @@ static const char *source_signals[] = {
 	"void update_properties(ptr source)",
 	"void update_flags(ptr source, int flags)",
 	"void audio_sync(ptr source, int out int offset)",
+	"void audio_jitter_max(ptr source, int max)",
 	"void audio_balance(ptr source, in out float balance)",
 	"void audio_mixers(ptr source, in out int mixers)",
 	"void audio_monitoring(ptr source, int type)",
@@ -185,6 +186,7 @@ static bool obs_source_init(struct obs_source *source)
 	source->volume = 1.0f;
 	source->sync_offset = 0;
 	source->balance = 0.5f;
+	source->audio_jitter_max = DEFAULT_AUDIO_JITTER_MAX_NS;
 	source->audio_active = true;
 	pthread_mutex_init_value(&source->filter_mutex);
 	pthread_mutex_init_value(&source->async_mutex);
@@ -574,6 +576,7 @@ obs_source_t *obs_source_duplicate(obs_source_t *source, const char *new_name,
 
 	new_source->audio_mixers = source->audio_mixers;
 	new_source->sync_offset = source->sync_offset;
+	new_source->audio_jitter_max = source->audio_jitter_max;
 	new_source->user_volume = source->user_volume;
 	new_source->user_muted = source->user_muted;
 	new_source->volume = source->volume;
@@ -638,6 +641,8 @@ void obs_source_destroy(struct obs_source *source)
 		pthread_mutex_unlock(&source->audio_cb_mutex);
 	}
 
+	obs_source_free_audio_taps(source);
+
 	pthread_mutex_lock(&source->caption_cb_mutex);
 	da_free(source->caption_cb_list);
 	pthread_mutex_unlock(&source->caption_cb_mutex);
@@ -1345,7 +1350,8 @@ static void handle_ts_jump(obs_source_t *source, uint64_t expected, uint64_t ts,
 }
 
 static void source_signal_audio_data(obs_source_t *source,
-				     const struct audio_data *in, bool muted)
+				     const struct audio_data *in,
+				     uint64_t timestamp, bool muted)
 {
 	pthread_mutex_lock(&source->audio_cb_mutex);
 
@@ -1354,6 +1360,8 @@ static void source_signal_audio_data(obs_source_t *source,
 		info.callback(info.param, source, in, muted);
 	}
 
+	obs_source_output_audio_taps(source, in, timestamp, muted);
+
 	pthread_mutex_unlock(&source->audio_cb_mutex);
 }
 
@@ -1519,6 +1527,7 @@ static void source_output_audio_data(obs_source_t *source,
 
 	sync_offset = source->sync_offset;
 	in.timestamp += sync_offset;
+	in.timestamp += source->audio_jitter_delay;
 	in.timestamp -= source->resample_offset;
 
 	source->next_audio_sys_ts_min =
@@ -1539,7 +1548,8 @@ static void source_output_audio_data(obs_source_t *source,
 
 	pthread_mutex_unlock(&source->audio_buf_mutex);
 
-	source_signal_audio_data(source, data, source_muted(source, os_time));
+	source_signal_audio_data(source, data, in.timestamp,
+				 source_muted(source, os_time));
 }
 
 enum convert_type {
@@ -4507,6 +4517,38 @@ int64_t obs_source_get_sync_offset(const obs_source_t *source)
 		       : 0;
 }
 
+void obs_source_set_audio_jitter_max(obs_source_t *source, uint64_t max)
+{
+	if (!obs_source_valid(source, "obs_source_set_audio_jitter_max"))
+		return;
+
+	struct calldata data;
+	uint8_t stack[128];
+
+	calldata_init_fixed(&data, stack, sizeof(stack));
+	calldata_set_ptr(&data, "source", source);
+	calldata_set_int(&data, "max", (long long)max);
+
+	signal_handler_signal(source->context.signals, "audio_jitter_max",
+			      &data);
+
+	source->audio_jitter_max = max;
+}
+
+uint64_t obs_source_get_audio_jitter_max(const obs_source_t *source)
+{
+	return obs_source_valid(source, "obs_source_get_audio_jitter_max")
+		       ? source->audio_jitter_max
+		       : 0;
+}
+
+uint64_t obs_source_get_audio_jitter_delay(const obs_source_t *source)
+{
+	return obs_source_valid(source, "obs_source_get_audio_jitter_delay")
+		       ? source->audio_jitter_delay
+		       : 0;
+}
+
 struct source_enum_data {
 	obs_source_enum_proc_t enum_callback;
 	void *param;
@@ -5211,14 +5253,27 @@ static float get_source_volume(obs_source_t *source, uint64_t os_time)
 	return source->volume;
 }
 
+/* channel buffers are AUDIO_OUTPUT_FRAMES apart, but only the first
+ * frames_per_tick frames of each are used */
+static inline void clear_output_audio(obs_source_t *source, size_t mix,
+				      size_t channels)
+{
+	size_t size = obs->audio.frames_per_tick * sizeof(float);
+
+	for (size_t ch = 0; ch < channels; ch++)
+		memset(source->audio_output_buf[mix][ch], 0, size);
+}
+
 static inline void multiply_output_audio(obs_source_t *source, size_t mix,
 					 size_t channels, float vol)
 {
-	register float *out = source->audio_output_buf[mix][0];
-	register float *end = out + AUDIO_OUTPUT_FRAMES * channels;
+	for (size_t ch = 0; ch < channels; ch++) {
+		register float *out = source->audio_output_buf[mix][ch];
+		register float *end = out + obs->audio.frames_per_tick;
 
-	while (out < end)
-		*(out++) *= vol;
+		while (out < end)
+			*(out++) *= vol;
+	}
 }
 
 static inline void multiply_vol_data(obs_source_t *source, size_t mix,
@@ -5226,7 +5281,7 @@ static inline void multiply_vol_data(obs_source_t *source, size_t mix,
 {
 	for (size_t ch = 0; ch < channels; ch++) {
 		register float *out = source->audio_output_buf[mix][ch];
-		register float *end = out + AUDIO_OUTPUT_FRAMES;
+		register float *end = out + obs->audio.frames_per_tick;
 		register float *vol = vol_data;
 
 		while (out < end)
@@ -5258,6 +5313,7 @@ static void apply_audio_actions(obs_source_t *source, size_t channels,
 {
 	float vol_data[AUDIO_OUTPUT_FRAMES];
 	float cur_vol = get_source_volume(source, source->audio_ts);
+	size_t frames = obs->audio.frames_per_tick;
 	size_t frame_num = 0;
 
 	pthread_mutex_lock(&source->audio_actions_mutex);
@@ -5273,7 +5329,7 @@ static void apply_audio_actions(obs_source_t *source, size_t channels,
 		new_frame_num = conv_time_to_frames(
 			sample_rate, timestamp - source->audio_ts);
 
-		if (new_frame_num >= AUDIO_OUTPUT_FRAMES)
+		if (new_frame_num >= frames)
 			break;
 
 		da_erase(source->audio_actions, i--);
@@ -5288,7 +5344,7 @@ static void apply_audio_actions(obs_source_t *source, size_t channels,
 		cur_vol = get_source_volume(source, timestamp);
 	}
 
-	for (; frame_num < AUDIO_OUTPUT_FRAMES; frame_num++)
+	for (; frame_num < frames; frame_num++)
 		vol_data[frame_num] = cur_vol;
 
 	pthread_mutex_unlock(&source->audio_actions_mutex);
@@ -5315,8 +5371,8 @@ static void apply_audio_volume(obs_source_t *source, uint32_t mixers,
 	pthread_mutex_unlock(&source->audio_actions_mutex);
 
 	if (actions_pending) {
-		uint64_t duration =
-			conv_frames_to_time(sample_rate, AUDIO_OUTPUT_FRAMES);
+		uint64_t duration = conv_frames_to_time(
+			sample_rate, obs->audio.frames_per_tick);
 
 		if (action.timestamp < (source->audio_ts + duration)) {
 			apply_audio_actions(source, channels, sample_rate);
@@ -5356,10 +5412,8 @@ static void custom_audio_render(obs_source_t *source, uint32_t mixers,
 				source->audio_output_buf[mix][ch];
 		}
 
-		if ((source->audio_mixers & mixers & (1 << mix)) != 0) {
-			memset(source->audio_output_buf[mix][0], 0,
-			       sizeof(float) * AUDIO_OUTPUT_FRAMES * channels);
-		}
+		if ((source->audio_mixers & mixers & (1 << mix)) != 0)
+			clear_output_audio(source, mix, channels);
 	}
 
 	success = source->info.audio_render(source->context.data, &ts,
@@ -5377,10 +5431,8 @@ static void custom_audio_render(obs_source_t *source, uint32_t mixers,
 		if ((mixers & mix_bit) == 0)
 			continue;
 
-		if ((source->audio_mixers & mix_bit) == 0) {
-			memset(source->audio_output_buf[mix][0], 0,
-			       sizeof(float) * AUDIO_OUTPUT_FRAMES * channels);
-		}
+		if ((source->audio_mixers & mix_bit) == 0)
+			clear_output_audio(source, mix, channels);
 	}
 
 	apply_audio_volume(source, mixers, channels, sample_rate);
@@ -5396,11 +5448,10 @@ static void audio_submix(obs_source_t *source, size_t channels,
 
 	for (size_t ch = 0; ch < channels; ch++) {
 		audio_data.data[ch] = source->audio_mix_buf[ch];
+		memset(audio_data.data[ch], 0,
+		       sizeof(float) * obs->audio.frames_per_tick);
 	}
 
-	memset(source->audio_mix_buf[0], 0,
-	       sizeof(float) * AUDIO_OUTPUT_FRAMES * channels);
-
 	success = source->info.audio_mix(source->context.data, &ts, &audio_data,
 					 channels, sample_rate);
 
@@ -5411,7 +5462,7 @@ static void audio_submix(obs_source_t *source, size_t channels,
 		audio.data[i] = (const uint8_t *)audio_data.data[i];
 
 	audio.samples_per_sec = (uint32_t)sample_rate;
-	audio.frames = AUDIO_OUTPUT_FRAMES;
+	audio.frames = obs->audio.frames_per_tick;
 	audio.format = AUDIO_FORMAT_FLOAT_PLANAR;
 	audio.speakers = (enum speaker_layout)channels;
 	audio.timestamp = ts;
@@ -5452,8 +5503,7 @@ static inline void process_audio_source_tick(obs_source_t *source,
 
 		if ((source->audio_mixers & mix_and_val) == 0 ||
 		    (mixers & mix_and_val) == 0) {
-			memset(source->audio_output_buf[mix][0], 0,
-			       size * channels);
+			clear_output_audio(source, mix, channels);
 			continue;
 		}
 
@@ -5468,7 +5518,7 @@ static inline void process_audio_source_tick(obs_source_t *source,
 	}
 
 	if ((source->audio_mixers & 1) == 0 || (mixers & 1) == 0)
-		memset(source->audio_output_buf[0][0], 0, size * channels);
+		clear_output_audio(source, 0, channels);
 
 	apply_audio_volume(source, mixers, channels, sample_rate);
 	source->audio_pending = false;
@@ -18,6 +18,7 @@
 #include <inttypes.h>
 
 #include "graphics/matrix4.h"
+#include "graphics/image-file.h"
 #include "callback/calldata.h"
 
 #include "obs.h"
@@ -744,6 +745,8 @@ static void obs_free_graphics(void)
 
 		gs_texture_destroy(video->transparent_texture);
 
+		gs_image_cache_purge();
+
 		gs_samplerstate_destroy(video->point_sampler);
 
 		gs_effect_destroy(video->default_effect);
@@ -1080,6 +1083,14 @@ static bool obs_init(const char *locale, const char *module_config_path,
 	if (!obs->destruction_task_thread)
 		return false;
 
+	/* the calling thread is one of the workers, and there are never more
+	 * jobs than channels.  without the pool the jobs just run inline. */
+	int cores = os_get_physical_cores();
+	if (cores > MAX_AUDIO_CHANNELS)
+		cores = MAX_AUDIO_CHANNELS;
+	if (cores > 1)
+		obs->audio_task_pool = os_task_pool_create((size_t)cores - 1);
+
 	if (module_config_path)
 		obs->module_config_path = bstrdup(module_config_path);
 	obs->locale = bstrdup(locale);
@@ -1253,6 +1264,7 @@ void obs_shutdown(void)
 	obs_free_audio();
 	obs_free_video();
 	os_task_queue_destroy(obs->destruction_task_thread);
+	os_task_pool_destroy(obs->audio_task_pool);
 	obs_free_hotkeys();
 	obs_free_graphics();
 	proc_handler_destroy(obs->procs);
@@ -1412,38 +1424,52 @@ bool obs_reset_audio2(const struct obs_audio_info2 *oai)
 	if (!obs || (audio->audio && audio_output_active(audio->audio)))
 		return false;
 
+	if (oai && oai->frames_per_tick &&
+	    !valid_audio_frames_per_tick(oai->frames_per_tick)) {
+		blog(LOG_ERROR, "Invalid audio frames per tick: %" PRIu32,
+		     oai->frames_per_tick);
+		return false;
+	}
+
 	obs_free_audio();
 	if (!oai)
 		return true;
 
+	uint32_t frames = oai->frames_per_tick ? oai->frames_per_tick
+					       : AUDIO_OUTPUT_FRAMES;
+	audio->frames_per_tick = frames;
+
 	if (oai->max_buffering_ms) {
 		uint32_t max_frames = oai->max_buffering_ms *
 				      oai->samples_per_sec / SEC_TO_MSEC;
-		max_frames += (AUDIO_OUTPUT_FRAMES - 1);
-		audio->max_buffering_ticks = max_frames / AUDIO_OUTPUT_FRAMES;
+		max_frames += (frames - 1);
+		audio->max_buffering_ticks = max_frames / frames;
 	} else {
-		audio->max_buffering_ticks = 45;
+		/* 45 ticks of AUDIO_OUTPUT_FRAMES, regardless of tick size */
+		audio->max_buffering_ticks = 45 * AUDIO_OUTPUT_FRAMES / frames;
 	}
 	audio->fixed_buffer = oai->fixed_buffering;
 
-	int max_buffering_ms = audio->max_buffering_ticks *
-			       AUDIO_OUTPUT_FRAMES * SEC_TO_MSEC /
-			       (int)oai->samples_per_sec;
+	int max_buffering_ms = audio->max_buffering_ticks * (int)frames *
+			       SEC_TO_MSEC / (int)oai->samples_per_sec;
 
 	ai.name = "Audio";
 	ai.samples_per_sec = oai->samples_per_sec;
 	ai.format = AUDIO_FORMAT_FLOAT_PLANAR;
 	ai.speakers = oai->speakers;
 	ai.input_callback = audio_callback;
+	ai.frames_per_tick = frames;
 
 	blog(LOG_INFO, "---------------------------------");
 	blog(LOG_INFO,
 	     "audio settings reset:\n"
 	     "\tsamples per sec: %d\n"
 	     "\tspeakers:        %d\n"
+	     "\tframes per tick: %d\n"
 	     "\tmax buffering:   %d milliseconds\n"
 	     "\tbuffering type:  %s",
-	     (int)ai.samples_per_sec, (int)ai.speakers, max_buffering_ms,
+	     (int)ai.samples_per_sec, (int)ai.speakers, (int)frames,
+	     max_buffering_ms,
 	     oai->fixed_buffering ? "fixed" : "dynamically increasing");
 
 	return obs_init_audio(&ai);
@@ -1506,6 +1532,14 @@ bool obs_get_audio_info(struct obs_audio_info *oai)
 	return true;
 }
 
+void obs_run_audio_jobs(obs_audio_job_t job, void *param, size_t count)
+{
+	if (!obs_ptr_valid(job, "obs_run_audio_jobs"))
+		return;
+
+	os_task_pool_run(obs ? obs->audio_task_pool : NULL, job, param, count);
+}
+
 bool obs_enum_source_types(size_t idx, const char **id)
 {
 	if (idx >= obs->source_types.num)
@@ -2107,6 +2141,11 @@ static obs_source_t *obs_load_source_type(obs_data_t *source_data,
 	sync = obs_data_get_int(source_data, "sync");
 	obs_source_set_sync_offset(source, sync);
 
+	obs_data_set_default_int(source_data, "jitter_max",
+				 (long long)DEFAULT_AUDIO_JITTER_MAX_NS);
+	obs_source_set_audio_jitter_max(
+		source, (uint64_t)obs_data_get_int(source_data, "jitter_max"));
+
 	obs_data_set_default_int(source_data, "mixers", 0x3F);
 	mixers = (uint32_t)obs_data_get_int(source_data, "mixers");
 	obs_source_set_audio_mixers(source, mixers);
@@ -2258,6 +2297,7 @@ obs_data_t *obs_save_source(obs_source_t *source)
 	float balance = obs_source_get_balance_value(source);
 	uint32_t mixers = obs_source_get_audio_mixers(source);
 	int64_t sync = obs_source_get_sync_offset(source);
+	uint64_t jitter_max = obs_source_get_audio_jitter_max(source);
 	uint32_t flags = obs_source_get_flags(source);
 	const char *name = obs_source_get_name(source);
 	const char *id = source->info.unversioned_id;
@@ -2289,6 +2329,7 @@ obs_data_t *obs_save_source(obs_source_t *source)
 	obs_data_set_obj(source_data, "settings", settings);
 	obs_data_set_int(source_data, "mixers", mixers);
 	obs_data_set_int(source_data, "sync", sync);
+	obs_data_set_int(source_data, "jitter_max", (long long)jitter_max);
 	obs_data_set_int(source_data, "flags", flags);
 	obs_data_set_double(source_data, "volume", volume);
 	obs_data_set_double(source_data, "balance", balance);
@@ -2626,6 +2667,28 @@ void obs_get_audio_monitoring_device(const char **name, const char **id)
 		*id = obs->audio.monitoring_device_id;
 }
 
+void obs_set_audio_monitoring_latency(uint32_t ms)
+{
+	if (ms && ms < MIN_AUDIO_MONITORING_LATENCY_MS)
+		ms = MIN_AUDIO_MONITORING_LATENCY_MS;
+
+	pthread_mutex_lock(&obs->audio.monitoring_mutex);
+
+	if (obs->audio.monitoring_latency_ms != ms) {
+		obs->audio.monitoring_latency_ms = ms;
+
+		for (size_t i = 0; i < obs->audio.monitors.num; i++)
+			audio_monitor_reset(obs->audio.monitors.array[i]);
+	}
+
+	pthread_mutex_unlock(&obs->audio.monitoring_mutex);
+}
+
+uint32_t obs_get_audio_monitoring_latency(void)
+{
+	return obs->audio.monitoring_latency_ms;
+}
+
 void obs_add_tick_callback(void (*tick)(void *param, float seconds),
 			   void *param)
 {
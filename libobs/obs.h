@@ -51,6 +51,7 @@ struct obs_service;
 struct obs_module;
 struct obs_fader;
 struct obs_volmeter;
+struct obs_audio_tap;
 
 typedef struct obs_context_data obs_object_t;
 typedef struct obs_display obs_display_t;
@@ -64,6 +65,7 @@ typedef struct obs_service obs_service_t;
 typedef struct obs_module obs_module_t;
 typedef struct obs_fader obs_fader_t;
 typedef struct obs_volmeter obs_volmeter_t;
+typedef struct obs_audio_tap obs_audio_tap_t;
 
 typedef struct obs_weak_object obs_weak_object_t;
 typedef struct obs_weak_source obs_weak_source_t;
@@ -212,6 +214,9 @@ struct obs_audio_info2 {
 
 	uint32_t max_buffering_ms;
 	bool fixed_buffering;
+
+	/* audio frames per mix tick, 0 for AUDIO_OUTPUT_FRAMES */
+	uint32_t frames_per_tick;
 };
 
 /**
@@ -440,6 +445,19 @@ EXPORT void obs_set_video_levels(float sdr_white_level,
 /** Gets the current audio settings, returns false if no audio */
 EXPORT bool obs_get_audio_info(struct obs_audio_info *oai);
 
+typedef void (*obs_audio_job_t)(void *param, size_t idx);
+
+/**
+ * Runs job(param, idx) for every idx below count on the shared audio worker
+ * threads, and returns once all of them have finished.  Meant for audio
+ * filters that process the channels of a source independently, with one job
+ * per channel.
+ *
+ * The jobs run on the calling thread if there are no worker threads, or if
+ * the workers are busy with the jobs of another call.
+ */
+EXPORT void obs_run_audio_jobs(obs_audio_job_t job, void *param, size_t count);
+
 /**
  * Opens a plugin module directly from a specific path.
  *
@@ -794,6 +812,17 @@ EXPORT void obs_enum_audio_monitoring_devices(obs_enum_audio_device_cb cb,
 EXPORT bool obs_set_audio_monitoring_device(const char *name, const char *id);
 EXPORT void obs_get_audio_monitoring_device(const char **name, const char **id);
 
+#define MIN_AUDIO_MONITORING_LATENCY_MS 5
+
+/**
+ * Sets the buffer length the monitoring devices are asked for, in
+ * milliseconds.  0 uses the default of the monitoring backend, other values
+ * are raised to MIN_AUDIO_MONITORING_LATENCY_MS.  Only used by the
+ * PulseAudio backend.
+ */
+EXPORT void obs_set_audio_monitoring_latency(uint32_t ms);
+EXPORT uint32_t obs_get_audio_monitoring_latency(void);
+
 EXPORT void obs_add_tick_callback(void (*tick)(void *param, float seconds),
 				  void *param);
 EXPORT void obs_remove_tick_callback(void (*tick)(void *param, float seconds),
@@ -1120,6 +1149,21 @@ EXPORT void obs_source_set_sync_offset(obs_source_t *source, int64_t offset);
 /** Gets the audio sync offset (in nanoseconds) for a source */
 EXPORT int64_t obs_source_get_sync_offset(const obs_source_t *source);
 
+/**
+ * Sets the maximum delay (in nanoseconds) the audio of a source may be given
+ * when it arrives late, instead of increasing the audio buffering of every
+ * source.  0 disables the per-source jitter buffer, the default is 60 ms.
+ */
+EXPORT void obs_source_set_audio_jitter_max(obs_source_t *source,
+					    uint64_t max);
+
+/** Gets the maximum jitter buffer delay (in nanoseconds) of a source */
+EXPORT uint64_t obs_source_get_audio_jitter_max(const obs_source_t *source);
+
+/** Gets the delay (in nanoseconds) currently added to the audio of a source
+ * by its jitter buffer */
+EXPORT uint64_t obs_source_get_audio_jitter_delay(const obs_source_t *source);
+
 /** Enumerates active child sources used by this source */
 EXPORT void obs_source_enum_active_sources(obs_source_t *source,
 					   obs_source_enum_proc_t enum_callback,
@@ -1248,6 +1292,35 @@ EXPORT void obs_source_add_audio_capture_callback(
 EXPORT void obs_source_remove_audio_capture_callback(
 	obs_source_t *source, obs_source_audio_capture_t callback, void *param);
 
+/**
+ * Audio tap of a source, receives the audio of the source after its filters
+ * in a reference counted buffer that is copied once per call and shared by
+ * all taps of the source.  Synchronous taps are called on the audio thread
+ * of the source, the tap is only valid during the call unless a reference is
+ * added.  Asynchronous taps are called on separate threads and never block
+ * the audio of the source.  Every asynchronous tap has its own queue, only
+ * its own audio is dropped if it falls behind, and its callback is never
+ * called from two threads at once.
+ */
+typedef void (*obs_source_audio_tap_t)(void *param, obs_source_t *source,
+				       obs_audio_tap_t *tap);
+
+EXPORT void obs_source_add_audio_tap(obs_source_t *source,
+				     obs_source_audio_tap_t callback,
+				     void *param, bool async);
+EXPORT void obs_source_remove_audio_tap(obs_source_t *source,
+					obs_source_audio_tap_t callback,
+					void *param);
+
+EXPORT void obs_audio_tap_addref(obs_audio_tap_t *tap);
+EXPORT void obs_audio_tap_release(obs_audio_tap_t *tap);
+
+/** Read-only float planar audio data and timestamp of an audio tap */
+EXPORT const struct audio_data *
+obs_audio_tap_get_data(const obs_audio_tap_t *tap);
+EXPORT size_t obs_audio_tap_get_channels(const obs_audio_tap_t *tap);
+EXPORT bool obs_audio_tap_muted(const obs_audio_tap_t *tap);
+
 typedef void (*obs_source_caption_t)(void *param, obs_source_t *source,
 				     const struct obs_source_cea_708 *captions);
 
@@ -2283,6 +2356,17 @@ EXPORT void obs_encoder_set_scaled_size(obs_encoder_t *encoder, uint32_t width,
 /** For video encoders, returns true if pre-encode scaling is enabled */
 EXPORT bool obs_encoder_scaling_enabled(const obs_encoder_t *encoder);
 
+/**
+ * For raw video encoders with pre-encode scaling, gets the size the encoder's
+ * frames are scaled from and the time spent scaling them.  Encoders scaled to
+ * smaller sizes from the same video output share a downscale pyramid, so the
+ * source may be another encoder's scaled image.
+ *
+ * @return  false if the encoder is not active or not a raw video encoder
+ */
+EXPORT bool obs_encoder_get_scale_stats(const obs_encoder_t *encoder,
+					struct video_scale_stats *stats);
+
 /** For video encoders, returns the width of the encoded image */
 EXPORT uint32_t obs_encoder_get_width(const obs_encoder_t *encoder);
 
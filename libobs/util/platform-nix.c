@@ -50,10 +50,17 @@
 #include <spawn.h>
 #endif
 
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#endif
+
 #include "darray.h"
 #include "dstr.h"
 #include "platform.h"
 #include "threading.h"
+#include "task.h"
 
 void *os_dlopen(const char *path)
 {
@@ -1057,3 +1064,372 @@ uint64_t os_get_free_disk_space(const char *dir)
 
 	return (uint64_t)info.f_frsize * (uint64_t)info.f_bavail;
 }
+
+#if defined(__linux__)
+
+/* a file that is written in several chunks only triggers one callback once
+ * it has been quiet for this long */
+#define FILE_WATCH_COALESCE_NS 50000000ULL
+#define FILE_WATCH_MASK                                                  \
+	(IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_TO | \
+	 IN_MOVED_FROM)
+
+struct watch_dir {
+	int wd;
+	long refs;
+};
+
+/* one inotify instance shared by all watches, its thread exits by itself
+ * once the last watch is destroyed */
+struct file_watch_service {
+	int fd;
+	int wake_fd;
+	pthread_t thread;
+	os_task_queue_t *tq;
+	DARRAY(struct watch_dir) dirs;
+};
+
+struct os_file_watch {
+	struct file_watch_service *service;
+	char *name;
+	int wd;
+
+	os_file_watch_cb_t callback;
+	void *param;
+
+	/* held while the callback runs, so destroying the watch can wait for
+	 * it without blocking on the callbacks of other watches */
+	pthread_mutex_t callback_mutex;
+
+	bool pending;
+	bool removed;
+	uint64_t last_event_ts;
+	volatile long refs;
+};
+
+static pthread_mutex_t file_watch_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct file_watch_service *file_watch_service = NULL;
+static DARRAY(struct os_file_watch *) file_watches;
+
+static void file_watch_release(struct os_file_watch *watch)
+{
+	if (os_atomic_dec_long(&watch->refs) == 0) {
+		pthread_mutex_destroy(&watch->callback_mutex);
+		bfree(watch->name);
+		bfree(watch);
+	}
+}
+
+static void file_watch_deliver(void *param)
+{
+	struct os_file_watch *watch = param;
+	bool removed;
+
+	pthread_mutex_lock(&watch->callback_mutex);
+
+	pthread_mutex_lock(&file_watch_mutex);
+	removed = watch->removed;
+	pthread_mutex_unlock(&file_watch_mutex);
+
+	if (!removed)
+		watch->callback(watch->param);
+
+	pthread_mutex_unlock(&watch->callback_mutex);
+
+	file_watch_release(watch);
+}
+
+static void file_watch_read_events(struct file_watch_service *service)
+{
+	char buf[4096]
+		__attribute__((aligned(__alignof__(struct inotify_event))));
+	uint64_t ts = os_gettime_ns();
+	ssize_t len;
+
+	while ((len = read(service->fd, buf, sizeof(buf))) > 0) {
+		pthread_mutex_lock(&file_watch_mutex);
+
+		for (char *ptr = buf; ptr < buf + len;) {
+			const struct inotify_event *event = (void *)ptr;
+			ptr += sizeof(struct inotify_event) + event->len;
+
+			/* events were lost, treat everything as changed */
+			bool overflow = (event->mask & IN_Q_OVERFLOW) != 0;
+			if (!overflow && !event->len)
+				continue;
+
+			for (size_t i = 0; i < file_watches.num; i++) {
+				struct os_file_watch *watch =
+					file_watches.array[i];
+
+				if (overflow ||
+				    (watch->wd == event->wd &&
+				     strcmp(watch->name, event->name) == 0)) {
+					watch->pending = true;
+					watch->last_event_ts = ts;
+				}
+			}
+		}
+
+		pthread_mutex_unlock(&file_watch_mutex);
+	}
+}
+
+/* returns false if changes are still settling */
+static bool file_watch_flush(struct file_watch_service *service)
+{
+	uint64_t ts = os_gettime_ns();
+	bool settled = true;
+
+	for (size_t i = 0; i < file_watches.num; i++) {
+		struct os_file_watch *watch = file_watches.array[i];
+		if (!watch->pending)
+			continue;
+
+		if (ts - watch->last_event_ts < FILE_WATCH_COALESCE_NS) {
+			settled = false;
+			continue;
+		}
+
+		watch->pending = false;
+		os_atomic_inc_long(&watch->refs);
+		os_task_queue_queue_task(service->tq, file_watch_deliver,
+					 watch);
+	}
+
+	return settled;
+}
+
+static void file_watch_service_free(struct file_watch_service *service)
+{
+	/* runs the remaining deliveries, which skip removed watches */
+	os_task_queue_destroy(service->tq);
+
+	if (service->wake_fd != -1)
+		close(service->wake_fd);
+	if (service->fd != -1)
+		close(service->fd);
+	da_free(service->dirs);
+	bfree(service);
+}
+
+static void *file_watch_thread(void *param)
+{
+	struct file_watch_service *service = param;
+	bool settled = true;
+
+	os_set_thread_name("libobs: file watch thread");
+
+	for (;;) {
+		struct pollfd fds[2] = {
+			{service->fd, POLLIN, 0},
+			{service->wake_fd, POLLIN, 0},
+		};
+		int timeout = settled ? -1 : (int)(FILE_WATCH_COALESCE_NS /
+						   1000000ULL);
+
+		if (poll(fds, 2, timeout) < 0 && errno != EINTR)
+			break;
+
+		if (fds[1].revents & POLLIN) {
+			uint64_t val;
+			if (read(service->wake_fd, &val, sizeof(val)) < 0)
+				break;
+		}
+		if (fds[0].revents & POLLIN)
+			file_watch_read_events(service);
+
+		pthread_mutex_lock(&file_watch_mutex);
+		if (!file_watches.num) {
+			da_free(file_watches);
+			file_watch_service = NULL;
+			pthread_mutex_unlock(&file_watch_mutex);
+			break;
+		}
+		settled = file_watch_flush(service);
+		pthread_mutex_unlock(&file_watch_mutex);
+	}
+
+	pthread_mutex_lock(&file_watch_mutex);
+	if (file_watch_service == service)
+		file_watch_service = NULL;
+	pthread_mutex_unlock(&file_watch_mutex);
+
+	file_watch_service_free(service);
+	return NULL;
+}
+
+static struct file_watch_service *file_watch_service_create(void)
+{
+	struct file_watch_service *service = bzalloc(sizeof(*service));
+	service->wake_fd = -1;
+
+	service->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (service->fd == -1) {
+		blog(LOG_WARNING, "%s: inotify_init1 failed: %s", __FUNCTION__,
+		     strerror(errno));
+		goto fail;
+	}
+
+	service->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (service->wake_fd == -1)
+		goto fail;
+
+	service->tq = os_task_queue_create();
+	if (!service->tq)
+		goto fail;
+
+	if (pthread_create(&service->thread, NULL, file_watch_thread,
+			   service) != 0)
+		goto fail;
+
+	pthread_detach(service->thread);
+	return service;
+
+fail:
+	file_watch_service_free(service);
+	return NULL;
+}
+
+static void file_watch_wake(struct file_watch_service *service)
+{
+	uint64_t val = 1;
+	if (write(service->wake_fd, &val, sizeof(val)) < 0)
+		blog(LOG_DEBUG, "%s: failed to wake thread", __FUNCTION__);
+}
+
+static int file_watch_add_dir(struct file_watch_service *service,
+			      const char *dir)
+{
+	int wd = inotify_add_watch(service->fd, dir, FILE_WATCH_MASK);
+	if (wd == -1)
+		return -1;
+
+	/* paths leading to the same directory share a watch descriptor */
+	for (size_t i = 0; i < service->dirs.num; i++) {
+		if (service->dirs.array[i].wd == wd) {
+			service->dirs.array[i].refs++;
+			return wd;
+		}
+	}
+
+	struct watch_dir *wdir = da_push_back_new(service->dirs);
+	wdir->wd = wd;
+	wdir->refs = 1;
+	return wd;
+}
+
+static void file_watch_remove_dir(struct file_watch_service *service, int wd)
+{
+	for (size_t i = 0; i < service->dirs.num; i++) {
+		struct watch_dir *wdir = service->dirs.array + i;
+		if (wdir->wd != wd)
+			continue;
+
+		if (--wdir->refs == 0) {
+			inotify_rm_watch(service->fd, wd);
+			da_erase(service->dirs, i);
+		}
+		break;
+	}
+}
+
+os_file_watch_t *os_file_watch_create(const char *path,
+				      os_file_watch_cb_t callback, void *param)
+{
+	struct os_file_watch *watch = NULL;
+	struct dstr dir = {0};
+	const char *slash;
+	const char *name;
+	int wd;
+
+	if (!path || !*path || !callback)
+		return NULL;
+
+	slash = strrchr(path, '/');
+	name = slash ? slash + 1 : path;
+	if (!*name)
+		return NULL;
+
+	/* directories are watched rather than the files themselves, so
+	 * files that are replaced by renaming over them keep working */
+	if (!slash)
+		dstr_copy(&dir, ".");
+	else if (slash == path)
+		dstr_copy(&dir, "/");
+	else
+		dstr_ncopy(&dir, path, slash - path);
+
+	pthread_mutex_lock(&file_watch_mutex);
+
+	if (!file_watch_service)
+		file_watch_service = file_watch_service_create();
+
+	if (file_watch_service) {
+		wd = file_watch_add_dir(file_watch_service, dir.array);
+		if (wd != -1) {
+			watch = bzalloc(sizeof(*watch));
+			pthread_mutex_init(&watch->callback_mutex, NULL);
+			watch->service = file_watch_service;
+			watch->name = bstrdup(name);
+			watch->wd = wd;
+			watch->callback = callback;
+			watch->param = param;
+			watch->refs = 1;
+			da_push_back(file_watches, &watch);
+		}
+	}
+
+	pthread_mutex_unlock(&file_watch_mutex);
+
+	dstr_free(&dir);
+	return watch;
+}
+
+void os_file_watch_destroy(os_file_watch_t *watch)
+{
+	bool inside;
+
+	if (!watch)
+		return;
+
+	pthread_mutex_lock(&file_watch_mutex);
+
+	inside = os_task_queue_inside(watch->service->tq);
+
+	da_erase_item(file_watches, &watch);
+	file_watch_remove_dir(watch->service, watch->wd);
+	watch->removed = true;
+
+	if (!file_watches.num)
+		file_watch_wake(watch->service);
+
+	pthread_mutex_unlock(&file_watch_mutex);
+
+	/* wait for a callback of this watch that is currently running,
+	 * unless the watch is destroyed from a callback */
+	if (!inside) {
+		pthread_mutex_lock(&watch->callback_mutex);
+		pthread_mutex_unlock(&watch->callback_mutex);
+	}
+
+	file_watch_release(watch);
+}
+
+#else
+
+os_file_watch_t *os_file_watch_create(const char *path,
+				      os_file_watch_cb_t callback, void *param)
+{
+	UNUSED_PARAMETER(path);
+	UNUSED_PARAMETER(callback);
+	UNUSED_PARAMETER(param);
+	return NULL;
+}
+
+void os_file_watch_destroy(os_file_watch_t *watch)
+{
+	UNUSED_PARAMETER(watch);
+}
+
+#endif
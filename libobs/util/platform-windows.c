@@ -1341,3 +1341,17 @@ uint64_t os_get_free_disk_space(const char *dir)
 
 	return success ? free.QuadPart : 0;
 }
+
+os_file_watch_t *os_file_watch_create(const char *path,
+				      os_file_watch_cb_t callback, void *param)
+{
+	UNUSED_PARAMETER(path);
+	UNUSED_PARAMETER(callback);
+	UNUSED_PARAMETER(param);
+	return NULL;
+}
+
+void os_file_watch_destroy(os_file_watch_t *watch)
+{
+	UNUSED_PARAMETER(watch);
+}
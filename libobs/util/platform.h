@@ -162,6 +162,25 @@ EXPORT int os_chdir(const char *path);
 
 EXPORT uint64_t os_get_free_disk_space(const char *dir);
 
+struct os_file_watch;
+typedef struct os_file_watch os_file_watch_t;
+typedef void (*os_file_watch_cb_t)(void *param);
+
+/**
+ * Watches a file for changes without polling it.
+ *
+ * Bursts of changes are coalesced, and the callback is called from a shared
+ * task queue thread, never from the caller's thread.  Returns NULL if file
+ * watching is not supported on this platform or for this path, in which case
+ * the caller should fall back to polling the file's modification time.
+ */
+EXPORT os_file_watch_t *os_file_watch_create(const char *path,
+					     os_file_watch_cb_t callback,
+					     void *param);
+
+/** No callback for the watch is running or called after this returns. */
+EXPORT void os_file_watch_destroy(os_file_watch_t *watch);
+
 #define MKDIR_EXISTS 1
 #define MKDIR_SUCCESS 0
 #define MKDIR_ERROR -1
@@ -163,3 +163,146 @@ static void *tiny_tubular_task_thread(void *param)
 
 	return NULL;
 }
+
+/* ------------------------------------------------------------------------- */
+
+struct os_task_pool {
+	pthread_t *threads;
+	size_t num_threads;
+	os_sem_t *sem;
+	os_event_t *done_event;
+	volatile bool stop;
+
+	/* held for the whole of os_task_pool_run, only one set of tasks is
+	 * handed to the worker threads at a time */
+	pthread_mutex_t run_mutex;
+
+	os_task_range_t task;
+	void *param;
+	long count;
+	volatile long next;
+	volatile long active;
+};
+
+static void run_pool_tasks(struct os_task_pool *tp)
+{
+	long idx;
+
+	while ((idx = os_atomic_inc_long(&tp->next) - 1) < tp->count)
+		tp->task(tp->param, (size_t)idx);
+}
+
+static void *task_pool_thread(void *param)
+{
+	struct os_task_pool *tp = param;
+
+	os_set_thread_name("libobs: task pool");
+
+	while (os_sem_wait(tp->sem) == 0) {
+		if (os_atomic_load_bool(&tp->stop))
+			break;
+
+		run_pool_tasks(tp);
+
+		/* the caller waits until every thread it woke is done with the
+		 * task data, so a late wake up never sees the next set */
+		if (os_atomic_dec_long(&tp->active) == 0)
+			os_event_signal(tp->done_event);
+	}
+
+	return NULL;
+}
+
+os_task_pool_t *os_task_pool_create(size_t threads)
+{
+	struct os_task_pool *tp;
+
+	if (!threads)
+		return NULL;
+
+	tp = bzalloc(sizeof(*tp));
+	tp->threads = bzalloc(sizeof(pthread_t) * threads);
+
+	if (pthread_mutex_init(&tp->run_mutex, NULL) != 0)
+		goto fail1;
+	if (os_sem_init(&tp->sem, 0) != 0)
+		goto fail2;
+	if (os_event_init(&tp->done_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail3;
+
+	for (; tp->num_threads < threads; tp->num_threads++) {
+		if (pthread_create(&tp->threads[tp->num_threads], NULL,
+				   task_pool_thread, tp) != 0)
+			break;
+	}
+
+	if (!tp->num_threads)
+		goto fail4;
+
+	return tp;
+
+fail4:
+	os_event_destroy(tp->done_event);
+fail3:
+	os_sem_destroy(tp->sem);
+fail2:
+	pthread_mutex_destroy(&tp->run_mutex);
+fail1:
+	bfree(tp->threads);
+	bfree(tp);
+	return NULL;
+}
+
+void os_task_pool_destroy(os_task_pool_t *tp)
+{
+	if (!tp)
+		return;
+
+	os_atomic_store_bool(&tp->stop, true);
+	for (size_t i = 0; i < tp->num_threads; i++)
+		os_sem_post(tp->sem);
+	for (size_t i = 0; i < tp->num_threads; i++)
+		pthread_join(tp->threads[i], NULL);
+
+	os_event_destroy(tp->done_event);
+	os_sem_destroy(tp->sem);
+	pthread_mutex_destroy(&tp->run_mutex);
+	bfree(tp->threads);
+	bfree(tp);
+}
+
+size_t os_task_pool_threads(const os_task_pool_t *tp)
+{
+	return tp ? tp->num_threads : 0;
+}
+
+void os_task_pool_run(os_task_pool_t *tp, os_task_range_t task, void *param,
+		      size_t count)
+{
+	if (!count)
+		return;
+
+	if (!tp || count == 1 || pthread_mutex_trylock(&tp->run_mutex) != 0) {
+		for (size_t i = 0; i < count; i++)
+			task(param, i);
+		return;
+	}
+
+	size_t helpers = count - 1;
+	if (helpers > tp->num_threads)
+		helpers = tp->num_threads;
+
+	tp->task = task;
+	tp->param = param;
+	tp->count = (long)count;
+	os_atomic_store_long(&tp->next, 0);
+	os_atomic_store_long(&tp->active, (long)helpers);
+
+	for (size_t i = 0; i < helpers; i++)
+		os_sem_post(tp->sem);
+
+	run_pool_tasks(tp);
+	os_event_wait(tp->done_event);
+
+	pthread_mutex_unlock(&tp->run_mutex);
+}
@@ -18,6 +18,22 @@ EXPORT void os_task_queue_destroy(os_task_queue_t *tt);
 EXPORT bool os_task_queue_wait(os_task_queue_t *tt);
 EXPORT bool os_task_queue_inside(os_task_queue_t *tt);
 
+/* a fixed set of worker threads that run a number of indexed tasks in
+ * parallel.  os_task_pool_run runs task(param, i) for every i below count,
+ * using the calling thread as one of the workers, and returns once all of
+ * them have finished.  concurrent calls from different threads do not wait
+ * for each other, the later one just runs its tasks on the calling thread. */
+struct os_task_pool;
+typedef struct os_task_pool os_task_pool_t;
+
+typedef void (*os_task_range_t)(void *param, size_t idx);
+
+EXPORT os_task_pool_t *os_task_pool_create(size_t threads);
+EXPORT void os_task_pool_destroy(os_task_pool_t *tp);
+EXPORT size_t os_task_pool_threads(const os_task_pool_t *tp);
+EXPORT void os_task_pool_run(os_task_pool_t *tp, os_task_range_t task,
+			     void *param, size_t count);
+
 #ifdef __cplusplus
 }
 #endif
@@ -2,6 +2,7 @@
 #include <graphics/image-file.h>
 #include <util/platform.h>
 #include <util/dstr.h>
+#include <util/threading.h>
 #include <sys/stat.h>
 
 #define blog(log_level, format, ...)                    \
@@ -12,6 +13,13 @@
 #define info(format, ...) blog(LOG_INFO, format, ##__VA_ARGS__)
 #define warn(format, ...) blog(LOG_WARNING, format, ##__VA_ARGS__)
 
+/* static images are shared with every other user of the same file through
+ * the graphics image cache, animated GIFs are decoded per source */
+struct image_data {
+	gs_image_file4_t if4;
+	gs_shared_image_t *shared;
+};
+
 struct image_source {
 	obs_source_t *source;
 
@@ -24,7 +32,18 @@ struct image_source {
 	bool active;
 	bool restart_gif;
 
-	gs_image_file4_t if4;
+	/* static images larger than this are downscaled, 0 if unlimited */
+	uint32_t max_cx;
+	uint32_t max_cy;
+
+	struct image_data image;
+
+	/* when the file can be watched, changes are decoded on the watch
+	 * thread and swapped in on the next tick instead of polling */
+	os_file_watch_t *watch;
+	pthread_mutex_t reload_mutex;
+	struct image_data reload;
+	bool reload_ready;
 };
 
 static time_t get_modified_timestamp(const char *filename)
@@ -35,6 +54,60 @@ static time_t get_modified_timestamp(const char *filename)
 	return stats.st_mtime;
 }
 
+static void image_data_init(struct image_data *data, const char *file,
+			    enum gs_image_alpha_mode alpha_mode,
+			    uint32_t max_cx, uint32_t max_cy)
+{
+	memset(data, 0, sizeof(*data));
+
+	if (gs_image_file_is_gif(file))
+		gs_image_file4_init(&data->if4, file, alpha_mode);
+	else if (max_cx || max_cy)
+		data->shared = gs_shared_image_get_scaled(file, alpha_mode,
+							  max_cx, max_cy);
+	else
+		data->shared = gs_shared_image_get(file, alpha_mode);
+}
+
+/* graphics context required for the functions below */
+static void image_data_init_texture(struct image_data *data)
+{
+	if (data->shared)
+		gs_shared_image_get_texture(data->shared);
+	else
+		gs_image_file4_init_texture(&data->if4);
+}
+
+static void image_data_free(struct image_data *data)
+{
+	gs_shared_image_release(data->shared);
+	data->shared = NULL;
+	gs_image_file4_free(&data->if4);
+}
+
+static inline bool image_data_loaded(const struct image_data *data)
+{
+	return data->shared || data->if4.image3.image2.image.loaded;
+}
+
+static inline gs_texture_t *image_data_texture(struct image_data *data)
+{
+	return data->shared ? gs_shared_image_get_texture(data->shared)
+			    : data->if4.image3.image2.image.texture;
+}
+
+static inline uint32_t image_data_width(const struct image_data *data)
+{
+	return data->shared ? gs_shared_image_get_width(data->shared)
+			    : data->if4.image3.image2.image.cx;
+}
+
+static inline uint32_t image_data_height(const struct image_data *data)
+{
+	return data->shared ? gs_shared_image_get_height(data->shared)
+			    : data->if4.image3.image2.image.cy;
+}
+
 static const char *image_source_get_name(void *unused)
 {
 	UNUSED_PARAMETER(unused);
@@ -46,23 +119,24 @@ static void image_source_load(struct image_source *context)
 	char *file = context->file;
 
 	obs_enter_graphics();
-	gs_image_file4_free(&context->if4);
+	image_data_free(&context->image);
 	obs_leave_graphics();
 
 	if (file && *file) {
 		debug("loading texture '%s'", file);
 		context->file_timestamp = get_modified_timestamp(file);
-		gs_image_file4_init(&context->if4, file,
-				    context->linear_alpha
-					    ? GS_IMAGE_ALPHA_PREMULTIPLY_SRGB
-					    : GS_IMAGE_ALPHA_PREMULTIPLY);
+		image_data_init(&context->image, file,
+				context->linear_alpha
+					? GS_IMAGE_ALPHA_PREMULTIPLY_SRGB
+					: GS_IMAGE_ALPHA_PREMULTIPLY,
+				context->max_cx, context->max_cy);
 		context->update_time_elapsed = 0;
 
 		obs_enter_graphics();
-		gs_image_file4_init_texture(&context->if4);
+		image_data_init_texture(&context->image);
 		obs_leave_graphics();
 
-		if (!context->if4.image3.image2.image.loaded)
+		if (!image_data_loaded(&context->image))
 			warn("failed to load texture '%s'", file);
 	}
 }
@@ -70,8 +144,87 @@ static void image_source_load(struct image_source *context)
 static void image_source_unload(struct image_source *context)
 {
 	obs_enter_graphics();
-	gs_image_file4_free(&context->if4);
+	image_data_free(&context->image);
+	obs_leave_graphics();
+}
+
+static void image_source_file_changed(void *data)
+{
+	struct image_source *context = data;
+	struct image_data image;
+
+	if (!context->persistent && !obs_source_showing(context->source))
+		return;
+
+	debug("file changed, decoding '%s'", context->file);
+	image_data_init(&image, context->file,
+			context->linear_alpha ? GS_IMAGE_ALPHA_PREMULTIPLY_SRGB
+					      : GS_IMAGE_ALPHA_PREMULTIPLY,
+			context->max_cx, context->max_cy);
+
+	pthread_mutex_lock(&context->reload_mutex);
+	struct image_data old = context->reload;
+	bool had_old = context->reload_ready;
+	context->reload = image;
+	context->reload_ready = true;
+	pthread_mutex_unlock(&context->reload_mutex);
+
+	if (had_old) {
+		obs_enter_graphics();
+		image_data_free(&old);
+		obs_leave_graphics();
+	}
+}
+
+static void image_source_reload_apply(struct image_source *context)
+{
+	struct image_data image;
+
+	pthread_mutex_lock(&context->reload_mutex);
+	bool ready = context->reload_ready;
+	image = context->reload;
+	context->reload_ready = false;
+	memset(&context->reload, 0, sizeof(context->reload));
+	pthread_mutex_unlock(&context->reload_mutex);
+
+	if (!ready)
+		return;
+
+	obs_enter_graphics();
+	image_data_free(&context->image);
+	context->image = image;
+	image_data_init_texture(&context->image);
 	obs_leave_graphics();
+
+	context->file_timestamp = get_modified_timestamp(context->file);
+
+	if (!image_data_loaded(&context->image))
+		warn("failed to load texture '%s'", context->file);
+}
+
+static void image_source_reload_discard(struct image_source *context)
+{
+	pthread_mutex_lock(&context->reload_mutex);
+	bool ready = context->reload_ready;
+	context->reload_ready = false;
+	pthread_mutex_unlock(&context->reload_mutex);
+
+	if (ready) {
+		obs_enter_graphics();
+		image_data_free(&context->reload);
+		obs_leave_graphics();
+	}
+}
+
+static void image_source_watch(struct image_source *context)
+{
+	os_file_watch_destroy(context->watch);
+	context->watch = NULL;
+	image_source_reload_discard(context);
+
+	if (context->file && *context->file)
+		context->watch = os_file_watch_create(
+			context->file, image_source_file_changed, context);
 }
 
 static void image_source_update(void *data, obs_data_t *settings)
@@ -81,6 +234,14 @@ static void image_source_update(void *data, obs_data_t *settings)
 	const bool unload = obs_data_get_bool(settings, "unload");
 	const bool linear_alpha = obs_data_get_bool(settings, "linear_alpha");
 
+	/* not shown in the properties, set by the slideshow */
+	context->max_cx = (uint32_t)obs_data_get_int(settings, "max_width");
+	context->max_cy = (uint32_t)obs_data_get_int(settings, "max_height");
+
+	/* stops pending reloads of the previous file */
+	os_file_watch_destroy(context->watch);
+	context->watch = NULL;
+
 	if (context->file)
 		bfree(context->file);
 	context->file = bstrdup(file);
@@ -92,6 +253,8 @@ static void image_source_update(void *data, obs_data_t *settings)
 		image_source_load(data);
 	else
 		image_source_unload(data);
+
+	image_source_watch(context);
 }
 
 static void image_source_defaults(obs_data_t *settings)
@@ -120,13 +283,13 @@ static void restart_gif(void *data)
 {
 	struct image_source *context = data;
 
-	if (context->if4.image3.image2.image.is_animated_gif) {
-		context->if4.image3.image2.image.cur_frame = 0;
-		context->if4.image3.image2.image.cur_loop = 0;
-		context->if4.image3.image2.image.cur_time = 0;
+	if (context->image.if4.image3.image2.image.is_animated_gif) {
+		context->image.if4.image3.image2.image.cur_frame = 0;
+		context->image.if4.image3.image2.image.cur_loop = 0;
+		context->image.if4.image3.image2.image.cur_time = 0;
 
 		obs_enter_graphics();
-		gs_image_file4_update_texture(&context->if4);
+		gs_image_file4_update_texture(&context->image.if4);
 		obs_leave_graphics();
 
 		context->restart_gif = false;
@@ -143,6 +306,11 @@ static void *image_source_create(obs_data_t *settings, obs_source_t *source)
 {
 	struct image_source *context = bzalloc(sizeof(struct image_source));
 	context->source = source;
+	pthread_mutex_init_value(&context->reload_mutex);
+	if (pthread_mutex_init(&context->reload_mutex, NULL) != 0) {
+		bfree(context);
+		return NULL;
+	}
 
 	image_source_update(context, settings);
 	return context;
@@ -152,7 +320,10 @@ static void image_source_destroy(void *data)
 {
 	struct image_source *context = data;
 
+	os_file_watch_destroy(context->watch);
+	image_source_reload_discard(context);
 	image_source_unload(context);
+	pthread_mutex_destroy(&context->reload_mutex);
 
 	if (context->file)
 		bfree(context->file);
@@ -162,21 +333,20 @@ static void image_source_destroy(void *data)
 static uint32_t image_source_getwidth(void *data)
 {
 	struct image_source *context = data;
-	return context->if4.image3.image2.image.cx;
+	return image_data_width(&context->image);
 }
 
 static uint32_t image_source_getheight(void *data)
 {
 	struct image_source *context = data;
-	return context->if4.image3.image2.image.cy;
+	return image_data_height(&context->image);
 }
 
 static void image_source_render(void *data, gs_effect_t *effect)
 {
 	struct image_source *context = data;
 
-	struct gs_image_file *const image = &context->if4.image3.image2.image;
-	gs_texture_t *const texture = image->texture;
+	gs_texture_t *const texture = image_data_texture(&context->image);
 	if (!texture)
 		return;
 
@@ -189,7 +359,8 @@ static void image_source_render(void *data, gs_effect_t *effect)
 	gs_eparam_t *const param = gs_effect_get_param_by_name(effect, "image");
 	gs_effect_set_texture_srgb(param, texture);
 
-	gs_draw_sprite(texture, 0, image->cx, image->cy);
+	gs_draw_sprite(texture, 0, image_data_width(&context->image),
+		       image_data_height(&context->image));
 
 	gs_blend_state_pop();
 
@@ -203,7 +374,9 @@ static void image_source_tick(void *data, float seconds)
 
 	context->update_time_elapsed += seconds;
 
-	if (obs_source_showing(context->source)) {
+	if (context->watch) {
+		image_source_reload_apply(context);
+	} else if (obs_source_showing(context->source)) {
 		if (context->update_time_elapsed >= 1.0f) {
 			time_t t = get_modified_timestamp(context->file);
 			context->update_time_elapsed = 0.0f;
@@ -216,7 +389,7 @@ static void image_source_tick(void *data, float seconds)
 
 	if (obs_source_showing(context->source)) {
 		if (!context->active) {
-			if (context->if4.image3.image2.image.is_animated_gif)
+			if (context->image.if4.image3.image2.image.is_animated_gif)
 				context->last_time = frame_time;
 			context->active = true;
 		}
@@ -234,13 +407,13 @@ static void image_source_tick(void *data, float seconds)
 	}
 
 	if (context->last_time &&
-	    context->if4.image3.image2.image.is_animated_gif) {
+	    context->image.if4.image3.image2.image.is_animated_gif) {
 		uint64_t elapsed = frame_time - context->last_time;
-		bool updated = gs_image_file4_tick(&context->if4, elapsed);
+		bool updated = gs_image_file4_tick(&context->image.if4, elapsed);
 
 		if (updated) {
 			obs_enter_graphics();
-			gs_image_file4_update_texture(&context->if4);
+			gs_image_file4_update_texture(&context->image.if4);
 			obs_leave_graphics();
 		}
 	}
@@ -297,7 +470,9 @@ static obs_properties_t *image_source_properties(void *data)
 uint64_t image_source_get_memory_usage(void *data)
 {
 	struct image_source *s = data;
-	return s->if4.image3.image2.mem_usage;
+	if (s->image.shared)
+		return gs_shared_image_get_mem_usage(s->image.shared);
+	return s->image.if4.image3.image2.mem_usage;
 }
 
 static void missing_file_callback(void *src, const char *new_path, void *data)
@@ -336,7 +511,10 @@ image_source_get_color_space(void *data, size_t count,
 			     const enum gs_color_space *preferred_spaces)
 {
 	struct image_source *const s = data;
-	gs_image_file4_t *const if4 = &s->if4;
+	if (s->image.shared)
+		return gs_shared_image_get_space(s->image.shared);
+
+	gs_image_file4_t *const if4 = &s->image.if4;
 	return if4->image3.image2.image.texture ? if4->space : GS_CS_SRGB;
 }
 
@@ -66,9 +66,18 @@ extern uint64_t image_source_get_memory_usage(void *data);
 #define BYTES_TO_MBYTES (1024 * 1024)
 #define MAX_MEM_USAGE (400 * BYTES_TO_MBYTES)
 
+/* number of slides loaded ahead of the current one */
+#define PREFETCH_COUNT 3
+
 struct image_file_data {
 	char *path;
+	uint32_t cx;
+	uint32_t cy;
+
+	/* NULL until loaded by the prefetch thread */
 	obs_source_t *source;
+	uint64_t mem_usage;
+	uint64_t last_used;
 };
 
 enum behavior {
@@ -105,6 +114,21 @@ struct slideshow {
 	pthread_mutex_t mutex;
 	DARRAY(struct image_file_data) files;
 
+	/* images are loaded on the prefetch thread in the order they will be
+	 * shown, downscaled to the output size.  slides only change to images
+	 * that are ready, loaded images that are not about to be shown are
+	 * released least recently used first when over MAX_MEM_USAGE. */
+	pthread_t prefetch_thread;
+	bool prefetch_thread_created;
+	os_sem_t *prefetch_sem;
+	volatile bool prefetch_stop;
+	uint64_t files_gen;
+	uint64_t use_counter;
+	uint32_t max_cx;
+	uint32_t max_cy;
+	DARRAY(size_t) upcoming;
+	bool transition_pending;
+
 	enum behavior behavior;
 
 	obs_hotkey_id play_pause_hotkey;
@@ -139,32 +163,16 @@ static obs_source_t *get_transition(struct slideshow *ss)
 	return tr;
 }
 
-static obs_source_t *get_source(struct darray *array, const char *path)
-{
-	DARRAY(struct image_file_data) files;
-	obs_source_t *source = NULL;
-
-	files.da = *array;
-
-	for (size_t i = 0; i < files.num; i++) {
-		const char *cur_path = files.array[i].path;
-
-		if (strcmp(path, cur_path) == 0) {
-			source = obs_source_get_ref(files.array[i].source);
-			break;
-		}
-	}
-
-	return source;
-}
-
-static obs_source_t *create_source_from_file(const char *file)
+static obs_source_t *create_source_from_file(const char *file, uint32_t max_cx,
+					     uint32_t max_cy)
 {
 	obs_data_t *settings = obs_data_create();
 	obs_source_t *source;
 
 	obs_data_set_string(settings, "file", file);
 	obs_data_set_bool(settings, "unload", false);
+	obs_data_set_int(settings, "max_width", max_cx);
+	obs_data_set_int(settings, "max_height", max_cy);
 	source = obs_source_create_private("image_source", NULL, settings);
 
 	obs_data_release(settings);
@@ -189,6 +197,134 @@ static inline size_t random_file(struct slideshow *ss)
 	return (size_t)rand() % ss->files.num;
 }
 
+/* ------------------------------------------------------------------------- */
+/* image size probing                                                        */
+
+/* reads the image size from the file header so the slideshow size is known
+ * without decoding every image up front */
+
+static inline uint32_t get_le16(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+static inline uint32_t get_le24(const uint8_t *p)
+{
+	return get_le16(p) | ((uint32_t)p[2] << 16);
+}
+
+static inline uint32_t get_le32(const uint8_t *p)
+{
+	return get_le24(p) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint32_t get_be16(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 8) | (uint32_t)p[1];
+}
+
+static inline uint32_t get_be32(const uint8_t *p)
+{
+	return (get_be16(p) << 16) | get_be16(p + 2);
+}
+
+static bool get_jpeg_size(FILE *file, uint32_t *cx, uint32_t *cy)
+{
+	uint8_t buf[9];
+	int64_t offset = 2;
+
+	for (;;) {
+		if (os_fseeki64(file, offset, SEEK_SET) != 0 ||
+		    fread(buf, 1, 4, file) != 4 || buf[0] != 0xFF)
+			return false;
+
+		uint8_t marker = buf[1];
+		uint32_t size = get_be16(buf + 2);
+
+		/* padding */
+		if (marker == 0xFF) {
+			offset++;
+			continue;
+		}
+
+		/* SOFn, other than DHT, JPG and DAC */
+		if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 &&
+		    marker != 0xC8 && marker != 0xCC) {
+			if (fread(buf, 1, 5, file) != 5)
+				return false;
+
+			*cy = get_be16(buf + 1);
+			*cx = get_be16(buf + 3);
+			return *cx && *cy;
+		}
+
+		if (marker == 0xD9 || marker == 0xDA || size < 2)
+			return false;
+
+		offset += 2 + size;
+	}
+}
+
+static bool get_image_size(const char *path, uint32_t *cx, uint32_t *cy)
+{
+	const char *ext = os_get_path_extension(path);
+	uint8_t hdr[32] = {0};
+	bool success = false;
+	FILE *file;
+	size_t size;
+
+	file = os_fopen(path, "rb");
+	if (!file)
+		return false;
+
+	size = fread(hdr, 1, sizeof(hdr), file);
+	*cx = 0;
+	*cy = 0;
+
+	if (size >= 24 && memcmp(hdr, "\x89PNG\r\n\x1A\n", 8) == 0) {
+		*cx = get_be32(hdr + 16);
+		*cy = get_be32(hdr + 20);
+
+	} else if (size >= 10 && memcmp(hdr, "GIF8", 4) == 0) {
+		*cx = get_le16(hdr + 6);
+		*cy = get_le16(hdr + 8);
+
+	} else if (size >= 26 && memcmp(hdr, "BM", 2) == 0) {
+		if (get_le32(hdr + 14) == 12) {
+			*cx = get_le16(hdr + 18);
+			*cy = get_le16(hdr + 20);
+		} else {
+			int32_t height = (int32_t)get_le32(hdr + 22);
+			*cx = get_le32(hdr + 18);
+			*cy = (uint32_t)(height < 0 ? -height : height);
+		}
+
+	} else if (size >= 30 && memcmp(hdr, "RIFF", 4) == 0 &&
+		   memcmp(hdr + 8, "WEBP", 4) == 0) {
+		if (memcmp(hdr + 12, "VP8 ", 4) == 0) {
+			*cx = get_le16(hdr + 26) & 0x3FFF;
+			*cy = get_le16(hdr + 28) & 0x3FFF;
+		} else if (memcmp(hdr + 12, "VP8L", 4) == 0) {
+			uint32_t bits = get_le32(hdr + 21);
+			*cx = (bits & 0x3FFF) + 1;
+			*cy = ((bits >> 14) & 0x3FFF) + 1;
+		} else if (memcmp(hdr + 12, "VP8X", 4) == 0) {
+			*cx = get_le24(hdr + 24) + 1;
+			*cy = get_le24(hdr + 27) + 1;
+		}
+
+	} else if (size >= 4 && hdr[0] == 0xFF && hdr[1] == 0xD8) {
+		success = get_jpeg_size(file, cx, cy);
+
+	} else if (size >= 18 && ext && astrcmpi(ext, ".tga") == 0) {
+		*cx = get_le16(hdr + 12);
+		*cy = get_le16(hdr + 14);
+	}
+
+	fclose(file);
+	return success || (*cx && *cy);
+}
+
 /* ------------------------------------------------------------------------- */
 
 static const char *ss_getname(void *unused)
@@ -197,42 +333,53 @@ static const char *ss_getname(void *unused)
 	return obs_module_text("SlideShow");
 }
 
-static void add_file(struct slideshow *ss, struct darray *array,
-		     const char *path, uint32_t *cx, uint32_t *cy)
+static void add_file(struct darray *array, const char *path, uint32_t *cx,
+		     uint32_t *cy)
 {
 	DARRAY(struct image_file_data) new_files;
-	struct image_file_data data;
-	obs_source_t *new_source;
+	struct image_file_data data = {0};
 
 	new_files.da = *array;
 
-	pthread_mutex_lock(&ss->mutex);
-	new_source = get_source(&ss->files.da, path);
-	pthread_mutex_unlock(&ss->mutex);
+	data.path = bstrdup(path);
+	if (get_image_size(path, &data.cx, &data.cy)) {
+		if (data.cx > *cx)
+			*cx = data.cx;
+		if (data.cy > *cy)
+			*cy = data.cy;
+	}
+
+	da_push_back(new_files, &data);
+
+	*array = new_files.da;
+}
 
-	if (!new_source)
-		new_source = get_source(&new_files.da, path);
-	if (!new_source)
-		new_source = create_source_from_file(path);
+/* keeps images that are already loaded at the same size, call with the
+ * mutex held */
+static uint64_t reuse_loaded_images(struct slideshow *ss, struct darray *array)
+{
+	DARRAY(struct image_file_data) new_files;
+	uint64_t mem_usage = 0;
 
-	if (new_source) {
-		uint32_t new_cx = obs_source_get_width(new_source);
-		uint32_t new_cy = obs_source_get_height(new_source);
+	new_files.da = *array;
 
-		data.path = bstrdup(path);
-		data.source = new_source;
-		da_push_back(new_files, &data);
+	for (size_t i = 0; i < new_files.num; i++) {
+		struct image_file_data *file = &new_files.array[i];
 
-		if (new_cx > *cx)
-			*cx = new_cx;
-		if (new_cy > *cy)
-			*cy = new_cy;
+		for (size_t j = 0; j < ss->files.num; j++) {
+			struct image_file_data *old = &ss->files.array[j];
 
-		void *source_data = obs_obj_get_data(new_source);
-		ss->mem_usage += image_source_get_memory_usage(source_data);
+			if (old->source && strcmp(file->path, old->path) == 0) {
+				file->source = obs_source_get_ref(old->source);
+				file->mem_usage = old->mem_usage;
+				file->last_used = old->last_used;
+				mem_usage += file->mem_usage;
+				break;
+			}
+		}
 	}
 
-	*array = new_files.da;
+	return mem_usage;
 }
 
 static bool valid_extension(const char *ext)
@@ -241,7 +388,8 @@ static bool valid_extension(const char *ext)
 		return false;
 	return astrcmpi(ext, ".bmp") == 0 || astrcmpi(ext, ".tga") == 0 ||
 	       astrcmpi(ext, ".png") == 0 || astrcmpi(ext, ".jpeg") == 0 ||
-	       astrcmpi(ext, ".jpg") == 0 || astrcmpi(ext, ".gif") == 0;
+	       astrcmpi(ext, ".jpg") == 0 || astrcmpi(ext, ".gif") == 0 ||
+	       astrcmpi(ext, ".webp") == 0;
 }
 
 static inline bool item_valid(struct slideshow *ss)
@@ -249,19 +397,289 @@ static inline bool item_valid(struct slideshow *ss)
 	return ss->files.num && ss->cur_item < ss->files.num;
 }
 
+/* ------------------------------------------------------------------------- */
+/* prefetching                                                               */
+
+static inline void request_prefetch(struct slideshow *ss)
+{
+	if (ss->prefetch_sem)
+		os_sem_post(ss->prefetch_sem);
+}
+
+static inline size_t prev_item(struct slideshow *ss, size_t item)
+{
+	return item ? item - 1 : ss->files.num - 1;
+}
+
+/* queues the slides that will be shown after the current one, call with the
+ * mutex held */
+static void fill_upcoming(struct slideshow *ss)
+{
+	bool randomize = ss->randomize && !ss->manual;
+
+	if (!ss->files.num) {
+		da_resize(ss->upcoming, 0);
+		return;
+	}
+
+	while (ss->upcoming.num < PREFETCH_COUNT) {
+		size_t *last = da_end(ss->upcoming);
+		size_t prev = last ? *last : ss->cur_item;
+		size_t next = prev;
+
+		if (randomize) {
+			if (ss->files.num > 1) {
+				while (next == prev)
+					next = random_file(ss);
+			}
+		} else if (++next >= ss->files.num) {
+			next = 0;
+		}
+
+		da_push_back(ss->upcoming, &next);
+	}
+}
+
+static void set_cur_item(struct slideshow *ss, size_t item)
+{
+	pthread_mutex_lock(&ss->mutex);
+	ss->cur_item = item;
+	da_resize(ss->upcoming, 0);
+	fill_upcoming(ss);
+	pthread_mutex_unlock(&ss->mutex);
+
+	request_prefetch(ss);
+}
+
+static bool next_item_ready(struct slideshow *ss)
+{
+	bool ready = false;
+
+	pthread_mutex_lock(&ss->mutex);
+	fill_upcoming(ss);
+	if (ss->upcoming.num) {
+		size_t next = ss->upcoming.array[0];
+		ready = next < ss->files.num && ss->files.array[next].source;
+	}
+	pthread_mutex_unlock(&ss->mutex);
+
+	return ready;
+}
+
+static void advance_item(struct slideshow *ss)
+{
+	pthread_mutex_lock(&ss->mutex);
+	if (ss->upcoming.num) {
+		ss->cur_item = ss->upcoming.array[0];
+		da_erase(ss->upcoming, 0);
+	}
+	fill_upcoming(ss);
+	pthread_mutex_unlock(&ss->mutex);
+
+	request_prefetch(ss);
+}
+
+static obs_source_t *get_cur_source(struct slideshow *ss)
+{
+	obs_source_t *source = NULL;
+
+	pthread_mutex_lock(&ss->mutex);
+	if (ss->cur_item < ss->files.num) {
+		struct image_file_data *file = &ss->files.array[ss->cur_item];
+
+		source = obs_source_get_ref(file->source);
+		file->last_used = ++ss->use_counter;
+	}
+	pthread_mutex_unlock(&ss->mutex);
+
+	return source;
+}
+
+/* call with the mutex held */
+static bool slide_wanted(struct slideshow *ss, size_t item)
+{
+	if (item == ss->cur_item || item == prev_item(ss, ss->cur_item))
+		return true;
+
+	for (size_t i = 0; i < ss->upcoming.num; i++) {
+		if (ss->upcoming.array[i] == item)
+			return true;
+	}
+
+	return false;
+}
+
+/* the current slide first, then upcoming slides in order, then the previous
+ * slide for manual navigation.  call with the mutex held. */
+static bool get_prefetch_item(struct slideshow *ss, size_t *item)
+{
+	size_t order[PREFETCH_COUNT + 2];
+	size_t count = 0;
+
+	if (!ss->files.num)
+		return false;
+
+	order[count++] = ss->cur_item;
+	for (size_t i = 0; i < ss->upcoming.num && i < PREFETCH_COUNT; i++)
+		order[count++] = ss->upcoming.array[i];
+	order[count++] = prev_item(ss, ss->cur_item);
+
+	for (size_t i = 0; i < count; i++) {
+		if (order[i] < ss->files.num && !ss->files.array[order[i]].source) {
+			*item = order[i];
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void prefetch_images(struct slideshow *ss)
+{
+	while (!os_atomic_load_bool(&ss->prefetch_stop)) {
+		obs_source_t *source;
+		uint32_t max_cx;
+		uint32_t max_cy;
+		uint64_t gen;
+		size_t item;
+		char *path;
+
+		pthread_mutex_lock(&ss->mutex);
+		if (!get_prefetch_item(ss, &item)) {
+			pthread_mutex_unlock(&ss->mutex);
+			break;
+		}
+
+		path = bstrdup(ss->files.array[item].path);
+		max_cx = ss->max_cx;
+		max_cy = ss->max_cy;
+		gen = ss->files_gen;
+		pthread_mutex_unlock(&ss->mutex);
+
+		/* decodes and uploads the image */
+		source = create_source_from_file(path, max_cx, max_cy);
+		bfree(path);
+
+		if (!source)
+			break;
+
+		uint64_t mem_usage =
+			image_source_get_memory_usage(obs_obj_get_data(source));
+
+		pthread_mutex_lock(&ss->mutex);
+		if (gen == ss->files_gen && !ss->files.array[item].source) {
+			struct image_file_data *file = &ss->files.array[item];
+
+			file->source = source;
+			file->mem_usage = mem_usage;
+			file->last_used = ++ss->use_counter;
+			ss->mem_usage += mem_usage;
+			source = NULL;
+		}
+		pthread_mutex_unlock(&ss->mutex);
+
+		/* the file list changed while loading */
+		obs_source_release(source);
+	}
+}
+
+static int cmp_last_used(const void *a, const void *b)
+{
+	const struct image_file_data *fa =
+		*(const struct image_file_data *const *)a;
+	const struct image_file_data *fb =
+		*(const struct image_file_data *const *)b;
+
+	if (fa->last_used == fb->last_used)
+		return 0;
+	return fa->last_used < fb->last_used ? -1 : 1;
+}
+
+static void release_unused_images(struct slideshow *ss)
+{
+	DARRAY(struct image_file_data *) loaded;
+	DARRAY(obs_source_t *) released;
+
+	da_init(loaded);
+	da_init(released);
+
+	pthread_mutex_lock(&ss->mutex);
+
+	if (ss->mem_usage > MAX_MEM_USAGE) {
+		for (size_t i = 0; i < ss->files.num; i++) {
+			struct image_file_data *file = &ss->files.array[i];
+
+			if (file->source && !slide_wanted(ss, i))
+				da_push_back(loaded, &file);
+		}
+
+		qsort(loaded.array, loaded.num,
+		      sizeof(struct image_file_data *), cmp_last_used);
+
+		for (size_t i = 0;
+		     i < loaded.num && ss->mem_usage > MAX_MEM_USAGE; i++) {
+			struct image_file_data *file = loaded.array[i];
+
+			da_push_back(released, &file->source);
+			ss->mem_usage -= file->mem_usage;
+			file->source = NULL;
+			file->mem_usage = 0;
+		}
+	}
+
+	pthread_mutex_unlock(&ss->mutex);
+
+	for (size_t i = 0; i < released.num; i++)
+		obs_source_release(released.array[i]);
+
+	da_free(loaded);
+	da_free(released);
+}
+
+static void *prefetch_thread(void *data)
+{
+	struct slideshow *ss = data;
+
+	os_set_thread_name("slideshow: prefetch");
+
+	while (os_sem_wait(ss->prefetch_sem) == 0) {
+		if (os_atomic_load_bool(&ss->prefetch_stop))
+			break;
+
+		prefetch_images(ss);
+		release_unused_images(ss);
+	}
+
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
 static void do_transition(void *data, bool to_null)
 {
 	struct slideshow *ss = data;
 	bool valid = item_valid(ss);
+	obs_source_t *source = NULL;
+
+	if (valid && (ss->use_cut || !to_null)) {
+		source = get_cur_source(ss);
+
+		/* the slide is shown once the prefetch thread has loaded it */
+		if (!source) {
+			ss->transition_pending = true;
+			request_prefetch(ss);
+			return;
+		}
+	}
+
+	ss->transition_pending = false;
 
 	if (valid && ss->use_cut) {
-		obs_transition_set(ss->transition,
-				   ss->files.array[ss->cur_item].source);
+		obs_transition_set(ss->transition, source);
 
 	} else if (valid && !to_null) {
 		obs_transition_start(ss->transition, OBS_TRANSITION_MODE_AUTO,
-				     ss->tr_speed,
-				     ss->files.array[ss->cur_item].source);
+				     ss->tr_speed, source);
 
 	} else {
 		obs_transition_start(ss->transition, OBS_TRANSITION_MODE_AUTO,
@@ -269,6 +687,8 @@ static void do_transition(void *data, bool to_null)
 		set_media_state(ss, OBS_MEDIA_STATE_ENDED);
 		obs_source_media_ended(ss->source);
 	}
+
+	obs_source_release(source);
 }
 
 static void ss_update(void *data, obs_data_t *settings)
@@ -330,9 +750,8 @@ static void ss_update(void *data, obs_data_t *settings)
 	count = obs_data_array_count(array);
 
 	/* ------------------------------------- */
-	/* create new list of sources */
-
-	ss->mem_usage = 0;
+	/* create new list of files, images are loaded on the prefetch
+	 * thread */
 
 	for (size_t i = 0; i < count; i++) {
 		obs_data_t *item = obs_data_array_item(array, i);
@@ -359,60 +778,29 @@ static void ss_update(void *data, obs_data_t *settings)
 				dstr_copy(&dir_path, path);
 				dstr_cat_ch(&dir_path, '/');
 				dstr_cat(&dir_path, ent->d_name);
-				add_file(ss, &new_files.da, dir_path.array, &cx,
+				add_file(&new_files.da, dir_path.array, &cx,
 					 &cy);
-
-				if (ss->mem_usage >= MAX_MEM_USAGE)
-					break;
 			}
 
 			dstr_free(&dir_path);
 			os_closedir(dir);
 		} else {
-			add_file(ss, &new_files.da, path, &cx, &cy);
+			add_file(&new_files.da, path, &cx, &cy);
 		}
 
 		obs_data_release(item);
-
-		if (ss->mem_usage >= MAX_MEM_USAGE)
-			break;
 	}
 
-	/* ------------------------------------- */
-	/* update settings data */
-
-	pthread_mutex_lock(&ss->mutex);
+	/* no image size could be read, size to the canvas */
+	if (!cx || !cy) {
+		struct obs_video_info ovi;
 
-	old_files.da = ss->files.da;
-	ss->files.da = new_files.da;
-	if (new_tr) {
-		old_tr = ss->transition;
-		ss->transition = new_tr;
-	}
-
-	if (strcmp(tr_name, "cut_transition") != 0) {
-		if (new_duration < 100)
-			new_duration = 100;
-
-		new_duration += new_speed;
-	} else {
-		if (new_duration < 50)
-			new_duration = 50;
+		if (obs_get_video_info(&ovi)) {
+			cx = ovi.base_width;
+			cy = ovi.base_height;
+		}
 	}
 
-	ss->tr_speed = new_speed;
-	ss->tr_name = tr_name;
-	ss->slide_time = (float)new_duration / 1000.0f;
-
-	pthread_mutex_unlock(&ss->mutex);
-
-	/* ------------------------------------- */
-	/* clean up and restart transition */
-
-	if (old_tr)
-		obs_source_release(old_tr);
-	free_files(&old_files.da);
-
 	/* ------------------------- */
 
 	const char *res_str = obs_data_get_string(settings, S_CUSTOM_SIZE);
@@ -453,19 +841,78 @@ static void ss_update(void *data, obs_data_t *settings)
 		}
 	}
 
+	/* ------------------------- */
+	/* no point in loading more pixels than the canvas can show */
+
+	struct obs_video_info ovi;
+	uint32_t max_cx = cx;
+	uint32_t max_cy = cy;
+
+	if (obs_get_video_info(&ovi) && cx && cy &&
+	    (cx > ovi.base_width || cy > ovi.base_height)) {
+		double scale_x = (double)ovi.base_width / (double)cx;
+		double scale_y = (double)ovi.base_height / (double)cy;
+		double scale = scale_x < scale_y ? scale_x : scale_y;
+
+		max_cx = (uint32_t)((double)cx * scale);
+		max_cy = (uint32_t)((double)cy * scale);
+	}
+
+	/* ------------------------------------- */
+	/* update settings data */
+
+	pthread_mutex_lock(&ss->mutex);
+
+	if (max_cx == ss->max_cx && max_cy == ss->max_cy)
+		ss->mem_usage = reuse_loaded_images(ss, &new_files.da);
+	else
+		ss->mem_usage = 0;
+
+	old_files.da = ss->files.da;
+	ss->files.da = new_files.da;
+	ss->files_gen++;
+	ss->max_cx = max_cx;
+	ss->max_cy = max_cy;
+	da_resize(ss->upcoming, 0);
+	if (new_tr) {
+		old_tr = ss->transition;
+		ss->transition = new_tr;
+	}
+
+	if (strcmp(tr_name, "cut_transition") != 0) {
+		if (new_duration < 100)
+			new_duration = 100;
+
+		new_duration += new_speed;
+	} else {
+		if (new_duration < 50)
+			new_duration = 50;
+	}
+
+	ss->tr_speed = new_speed;
+	ss->tr_name = tr_name;
+	ss->slide_time = (float)new_duration / 1000.0f;
+
+	pthread_mutex_unlock(&ss->mutex);
+
+	/* ------------------------------------- */
+	/* clean up and restart transition */
+
+	if (old_tr)
+		obs_source_release(old_tr);
+	free_files(&old_files.da);
+
 	/* ------------------------- */
 
 	ss->cx = cx;
 	ss->cy = cy;
-	ss->cur_item = 0;
 	ss->elapsed = 0.0f;
 	obs_transition_set_size(ss->transition, cx, cy);
 	obs_transition_set_alignment(ss->transition, OBS_ALIGN_CENTER);
 	obs_transition_set_scale_type(ss->transition,
 				      OBS_TRANSITION_SCALE_ASPECT);
 
-	if (ss->randomize && ss->files.num)
-		ss->cur_item = random_file(ss);
+	set_cur_item(ss, ss->randomize && ss->files.num ? random_file(ss) : 0);
 	if (new_tr)
 		obs_source_add_active_child(ss->source, new_tr);
 	if (ss->files.num) {
@@ -506,7 +953,7 @@ static void ss_restart(void *data)
 	struct slideshow *ss = data;
 
 	ss->elapsed = 0.0f;
-	ss->cur_item = 0;
+	set_cur_item(ss, 0);
 	ss->stop = false;
 	ss->paused = false;
 	do_transition(ss, false);
@@ -519,7 +966,7 @@ static void ss_stop(void *data)
 	struct slideshow *ss = data;
 
 	ss->elapsed = 0.0f;
-	ss->cur_item = 0;
+	set_cur_item(ss, 0);
 
 	do_transition(ss, true);
 	ss->stop = true;
@@ -535,8 +982,10 @@ static void ss_next_slide(void *data)
 	if (!ss->files.num || obs_transition_get_time(ss->transition) < 1.0f)
 		return;
 
-	if (++ss->cur_item >= ss->files.num)
-		ss->cur_item = 0;
+	if (ss->cur_item + 1 >= ss->files.num)
+		set_cur_item(ss, 0);
+	else
+		set_cur_item(ss, ss->cur_item + 1);
 
 	do_transition(ss, false);
 }
@@ -548,10 +997,7 @@ static void ss_previous_slide(void *data)
 	if (!ss->files.num || obs_transition_get_time(ss->transition) < 1.0f)
 		return;
 
-	if (ss->cur_item == 0)
-		ss->cur_item = ss->files.num - 1;
-	else
-		--ss->cur_item;
+	set_cur_item(ss, prev_item(ss, ss->cur_item));
 
 	do_transition(ss, false);
 }
@@ -626,8 +1072,16 @@ static void ss_destroy(void *data)
 {
 	struct slideshow *ss = data;
 
+	if (ss->prefetch_thread_created) {
+		os_atomic_set_bool(&ss->prefetch_stop, true);
+		os_sem_post(ss->prefetch_sem);
+		pthread_join(ss->prefetch_thread, NULL);
+	}
+
+	os_sem_destroy(ss->prefetch_sem);
 	obs_source_release(ss->transition);
 	free_files(&ss->files.da);
+	da_free(ss->upcoming);
 	pthread_mutex_destroy(&ss->mutex);
 	bfree(ss);
 }
@@ -666,6 +1120,13 @@ static void *ss_create(obs_data_t *settings, obs_source_t *source)
 	pthread_mutex_init_value(&ss->mutex);
 	if (pthread_mutex_init(&ss->mutex, NULL) != 0)
 		goto error;
+	if (os_sem_init(&ss->prefetch_sem, 0) != 0)
+		goto error;
+	if (pthread_create(&ss->prefetch_thread, NULL, prefetch_thread, ss) !=
+	    0)
+		goto error;
+
+	ss->prefetch_thread_created = true;
 
 	obs_source_update(source, NULL);
 
@@ -699,7 +1160,7 @@ static void ss_video_tick(void *data, float seconds)
 
 	if (ss->restart_on_activate && ss->use_cut) {
 		ss->elapsed = 0.0f;
-		ss->cur_item = ss->randomize ? random_file(ss) : 0;
+		set_cur_item(ss, ss->randomize ? random_file(ss) : 0);
 		do_transition(ss, false);
 		ss->restart_on_activate = false;
 		ss->use_cut = false;
@@ -707,6 +1168,9 @@ static void ss_video_tick(void *data, float seconds)
 		return;
 	}
 
+	if (ss->transition_pending && !ss->stop)
+		do_transition(ss, false);
+
 	if (ss->pause_on_deactivate || ss->manual || ss->stop || ss->paused)
 		return;
 
@@ -727,9 +1191,9 @@ static void ss_video_tick(void *data, float seconds)
 	ss->elapsed += seconds;
 
 	if (ss->elapsed > ss->slide_time) {
-		ss->elapsed -= ss->slide_time;
-
 		if (!ss->loop && ss->cur_item == ss->files.num - 1) {
+			ss->elapsed -= ss->slide_time;
+
 			if (ss->hide)
 				do_transition(ss, true);
 			else
@@ -738,18 +1202,16 @@ static void ss_video_tick(void *data, float seconds)
 			return;
 		}
 
-		if (ss->randomize) {
-			size_t next = ss->cur_item;
-			if (ss->files.num > 1) {
-				while (next == ss->cur_item)
-					next = random_file(ss);
-			}
-			ss->cur_item = next;
-
-		} else if (++ss->cur_item >= ss->files.num) {
-			ss->cur_item = 0;
+		/* never wait on loading, keep showing the current slide until
+		 * the next one is ready */
+		if (!next_item_ready(ss)) {
+			ss->elapsed = ss->slide_time;
+			return;
 		}
 
+		ss->elapsed -= ss->slide_time;
+		advance_item(ss);
+
 		if (ss->files.num)
 			do_transition(ss, false);
 	}
@@ -770,6 +1232,9 @@ static inline bool ss_audio_render_(obs_source_t *transition, uint64_t *ts_out,
 	if (!source_ts)
 		return false;
 
+	size_t size = audio_output_get_frames_per_tick(obs_get_audio()) *
+		      sizeof(float);
+
 	obs_source_get_audio_mix(transition, &child_audio);
 	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
 		if ((mixers & (1 << mix)) == 0)
@@ -779,9 +1244,7 @@ static inline bool ss_audio_render_(obs_source_t *transition, uint64_t *ts_out,
 			float *out = audio_output->output[mix].data[ch];
 			float *in = child_audio.output[mix].data[ch];
 
-			memcpy(out, in,
-			       AUDIO_OUTPUT_FRAMES * MAX_AUDIO_CHANNELS *
-				       sizeof(float));
+			memcpy(out, in, size);
 		}
 	}
 
@@ -22,9 +22,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <xcb/shm.h>
 #include <xcb/xfixes.h>
 #include <xcb/xinerama.h>
+#include <xcb/damage.h>
 
 #include <obs-module.h>
 #include <util/dstr.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <util/util_uint64.h>
 #include "xcursor-xcb.h"
 #include "xhelpers.h"
 
@@ -32,14 +36,46 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #define blog(level, msg, ...) blog(level, "xshm-input: " msg, ##__VA_ARGS__)
 
+/* staging texture sizes are rounded up to this to avoid recreating it for
+ * every differently sized damage area */
+#define XSHM_STAGING_ALIGN 256
+
+struct xshm_rect {
+	int_fast32_t x;
+	int_fast32_t y;
+	int_fast32_t w;
+	int_fast32_t h;
+};
+
 struct xshm_data {
 	obs_source_t *source;
 
 	xcb_connection_t *xcb;
 	xcb_screen_t *xcb_screen;
-	xcb_shm_t *xshm;
 	xcb_xcursor_t *cursor;
 
+	/* the capture thread fetches changed areas into one segment while the
+	 * graphics thread may still upload from the other one */
+	xcb_shm_t *xshm[2];
+	pthread_t thread;
+	os_event_t *stop_event;
+	bool thread_active;
+
+	/* change tracking, the whole area is fetched if unavailable */
+	bool use_damage;
+	xcb_damage_damage_t damage;
+	xcb_xfixes_region_t damage_region;
+
+	pthread_mutex_t mutex;
+	bool ready;
+	int ready_buf;
+	int busy_buf;
+	struct xshm_rect ready_rect;
+
+	uint64_t bytes_fetched;
+	uint64_t bytes_uploaded;
+	uint64_t capture_start_ns;
+
 	char *server;
 	uint_fast32_t screen_id;
 	int_fast32_t x_org;
@@ -48,6 +84,7 @@ struct xshm_data {
 	int_fast32_t height;
 
 	gs_texture_t *texture;
+	gs_texture_t *staging;
 
 	int_fast32_t cut_top;
 	int_fast32_t cut_left;
@@ -76,8 +113,15 @@ static inline void xshm_resize_texture(struct xshm_data *data)
 {
 	if (data->texture)
 		gs_texture_destroy(data->texture);
+	if (data->staging) {
+		gs_texture_destroy(data->staging);
+		data->staging = NULL;
+	}
+
+	/* changed areas are uploaded to a dynamic staging texture and copied
+	 * into this one on the GPU */
 	data->texture = gs_texture_create(data->adj_width, data->adj_height,
-					  GS_BGRA, 1, NULL, GS_DYNAMIC);
+					  GS_BGRA, 1, NULL, 0);
 }
 
 /**
@@ -98,6 +142,9 @@ static bool xshm_check_extensions(xcb_connection_t *xcb)
 	if (!xcb_get_extension_data(xcb, &xcb_randr_id)->present)
 		blog(LOG_INFO, "Missing Randr extension !");
 
+	if (!xcb_get_extension_data(xcb, &xcb_damage_id)->present)
+		blog(LOG_INFO, "Missing Damage extension !");
+
 	return ok;
 }
 
@@ -183,17 +230,241 @@ static const char *xshm_getname(void *unused)
 	return obs_module_text("X11SharedMemoryScreenInput");
 }
 
+static inline struct xshm_rect xshm_rect_union(const struct xshm_rect *a,
+					       const struct xshm_rect *b)
+{
+	if (!a->w || !a->h)
+		return *b;
+	if (!b->w || !b->h)
+		return *a;
+
+	struct xshm_rect r;
+	r.x = a->x < b->x ? a->x : b->x;
+	r.y = a->y < b->y ? a->y : b->y;
+	r.w = (a->x + a->w > b->x + b->w ? a->x + a->w : b->x + b->w) - r.x;
+	r.h = (a->y + a->h > b->y + b->h ? a->y + a->h : b->y + b->h) - r.y;
+	return r;
+}
+
+/**
+ * Set up damage tracking for the root window
+ */
+static bool xshm_damage_init(struct xshm_data *data)
+{
+	if (!xcb_get_extension_data(data->xcb, &xcb_damage_id)->present)
+		return false;
+
+	xcb_damage_query_version_cookie_t dmg_c =
+		xcb_damage_query_version_unchecked(data->xcb,
+						   XCB_DAMAGE_MAJOR_VERSION,
+						   XCB_DAMAGE_MINOR_VERSION);
+	xcb_damage_query_version_reply_t *dmg_r =
+		xcb_damage_query_version_reply(data->xcb, dmg_c, NULL);
+	if (!dmg_r)
+		return false;
+	free(dmg_r);
+
+	xcb_xfixes_query_version_cookie_t fix_c =
+		xcb_xfixes_query_version_unchecked(data->xcb,
+						   XCB_XFIXES_MAJOR_VERSION,
+						   XCB_XFIXES_MINOR_VERSION);
+	free(xcb_xfixes_query_version_reply(data->xcb, fix_c, NULL));
+
+	data->damage = xcb_generate_id(data->xcb);
+	xcb_damage_create(data->xcb, data->damage, data->xcb_screen->root,
+			  XCB_DAMAGE_REPORT_LEVEL_NON_EMPTY);
+
+	data->damage_region = xcb_generate_id(data->xcb);
+	xcb_xfixes_create_region(data->xcb, data->damage_region, 0, NULL);
+
+	return true;
+}
+
+static void xshm_damage_free(struct xshm_data *data)
+{
+	if (!data->use_damage)
+		return;
+
+	xcb_damage_destroy(data->xcb, data->damage);
+	xcb_xfixes_destroy_region(data->xcb, data->damage_region);
+	data->use_damage = false;
+}
+
+/**
+ * Get the area that changed since the last call, relative to the capture
+ *
+ * @return false if nothing changed
+ */
+static bool xshm_get_damage(struct xshm_data *data, struct xshm_rect *rect)
+{
+	xcb_generic_event_t *event;
+
+	/* damage notifications are only used to wake up the server side, the
+	 * actual area is taken from the region below */
+	while ((event = xcb_poll_for_event(data->xcb)))
+		free(event);
+
+	if (!data->use_damage) {
+		*rect = (struct xshm_rect){0, 0, data->adj_width,
+					   data->adj_height};
+		return true;
+	}
+
+	xcb_damage_subtract(data->xcb, data->damage, XCB_NONE,
+			    data->damage_region);
+
+	xcb_xfixes_fetch_region_cookie_t reg_c =
+		xcb_xfixes_fetch_region_unchecked(data->xcb,
+						  data->damage_region);
+	xcb_xfixes_fetch_region_reply_t *reg_r =
+		xcb_xfixes_fetch_region_reply(data->xcb, reg_c, NULL);
+	if (!reg_r)
+		return false;
+
+	int_fast32_t x0 = reg_r->extents.x - data->adj_x_org;
+	int_fast32_t y0 = reg_r->extents.y - data->adj_y_org;
+	int_fast32_t x1 = x0 + reg_r->extents.width;
+	int_fast32_t y1 = y0 + reg_r->extents.height;
+	free(reg_r);
+
+	if (x0 < 0)
+		x0 = 0;
+	if (y0 < 0)
+		y0 = 0;
+	if (x1 > data->adj_width)
+		x1 = data->adj_width;
+	if (y1 > data->adj_height)
+		y1 = data->adj_height;
+
+	if (x1 <= x0 || y1 <= y0)
+		return false;
+
+	*rect = (struct xshm_rect){x0, y0, x1 - x0, y1 - y0};
+	return true;
+}
+
+/**
+ * Fetch the changed area into a free shared memory segment and hand it to
+ * the graphics thread
+ */
+static void xshm_capture_frame(struct xshm_data *data,
+			       const struct xshm_rect *changed)
+{
+	struct xshm_rect rect = *changed;
+	int buf;
+
+	pthread_mutex_lock(&data->mutex);
+	buf = data->busy_buf == 0 ? 1 : 0;
+
+	/* an area that has not been uploaded yet has to be fetched again,
+	 * since its segment is about to be reused */
+	if (data->ready) {
+		rect = xshm_rect_union(&rect, &data->ready_rect);
+		data->ready = false;
+	}
+	pthread_mutex_unlock(&data->mutex);
+
+	xcb_shm_get_image_cookie_t img_c;
+	xcb_shm_get_image_reply_t *img_r;
+
+	img_c = xcb_shm_get_image_unchecked(
+		data->xcb, data->xcb_screen->root, data->adj_x_org + rect.x,
+		data->adj_y_org + rect.y, rect.w, rect.h, ~0,
+		XCB_IMAGE_FORMAT_Z_PIXMAP, data->xshm[buf]->seg, 0);
+
+	img_r = xcb_shm_get_image_reply(data->xcb, img_c, NULL);
+	if (!img_r)
+		return;
+	free(img_r);
+
+	data->bytes_fetched += (uint64_t)rect.w * rect.h * 4;
+
+	pthread_mutex_lock(&data->mutex);
+	data->ready = true;
+	data->ready_buf = buf;
+	data->ready_rect = rect;
+	pthread_mutex_unlock(&data->mutex);
+}
+
+static void *xshm_capture_thread(void *vptr)
+{
+	XSHM_DATA(vptr);
+	struct obs_video_info ovi;
+	uint64_t interval = 16666667;
+	uint64_t next_ns;
+
+	os_set_thread_name("xshm: capture");
+
+	if (obs_get_video_info(&ovi))
+		interval = util_mul_div64(1000000000ULL, ovi.fps_den,
+					  ovi.fps_num);
+
+	/* everything is "damaged" to begin with */
+	struct xshm_rect pending = {0, 0, data->adj_width, data->adj_height};
+	next_ns = os_gettime_ns();
+
+	while (os_event_try(data->stop_event) == EAGAIN) {
+		struct xshm_rect rect;
+
+		if (xshm_get_damage(data, &rect))
+			pending = xshm_rect_union(&pending, &rect);
+
+		if (pending.w && pending.h &&
+		    obs_source_showing(data->source)) {
+			xshm_capture_frame(data, &pending);
+			pending = (struct xshm_rect){0};
+		}
+
+		next_ns += interval;
+		if (!os_sleepto_ns(next_ns))
+			next_ns = os_gettime_ns();
+	}
+
+	return NULL;
+}
+
+static void xshm_log_stats(struct xshm_data *data)
+{
+	double seconds =
+		(double)(os_gettime_ns() - data->capture_start_ns) / 1e9;
+	if (seconds <= 0.0)
+		return;
+
+	blog(LOG_INFO,
+	     "Capture stopped, copied %.2f MB/s from the X server, "
+	     "uploaded %.2f MB/s",
+	     (double)data->bytes_fetched / seconds / 1000000.0,
+	     (double)data->bytes_uploaded / seconds / 1000000.0);
+}
+
 /**
  * Stop the capture
  */
 static void xshm_capture_stop(struct xshm_data *data)
 {
+	if (data->thread_active) {
+		os_event_signal(data->stop_event);
+		pthread_join(data->thread, NULL);
+		os_event_destroy(data->stop_event);
+		pthread_mutex_destroy(&data->mutex);
+		data->thread_active = false;
+
+		xshm_log_stats(data);
+	}
+
+	if (data->xcb)
+		xshm_damage_free(data);
+
 	obs_enter_graphics();
 
 	if (data->texture) {
 		gs_texture_destroy(data->texture);
 		data->texture = NULL;
 	}
+	if (data->staging) {
+		gs_texture_destroy(data->staging);
+		data->staging = NULL;
+	}
 	if (data->cursor) {
 		xcb_xcursor_destroy(data->cursor);
 		data->cursor = NULL;
@@ -201,9 +472,11 @@ static void xshm_capture_stop(struct xshm_data *data)
 
 	obs_leave_graphics();
 
-	if (data->xshm) {
-		xshm_xcb_detach(data->xshm);
-		data->xshm = NULL;
+	for (size_t i = 0; i < 2; i++) {
+		if (data->xshm[i]) {
+			xshm_xcb_detach(data->xshm[i]);
+			data->xshm[i] = NULL;
+		}
 	}
 
 	if (data->xcb) {
@@ -242,22 +515,49 @@ static void xshm_capture_start(struct xshm_data *data)
 		goto fail;
 	}
 
-	data->xshm =
-		xshm_xcb_attach(data->xcb, data->adj_width, data->adj_height);
-	if (!data->xshm) {
-		blog(LOG_ERROR, "failed to attach shm !");
-		goto fail;
+	for (size_t i = 0; i < 2; i++) {
+		data->xshm[i] = xshm_xcb_attach(data->xcb, data->adj_width,
+						data->adj_height);
+		if (!data->xshm[i]) {
+			blog(LOG_ERROR, "failed to attach shm !");
+			goto fail;
+		}
 	}
 
 	data->cursor = xcb_xcursor_init(data->xcb);
 	xcb_xcursor_offset(data->cursor, data->adj_x_org, data->adj_y_org);
 
+	data->use_damage = xshm_damage_init(data);
+	if (!data->use_damage)
+		blog(LOG_INFO, "damage tracking unavailable, capturing the "
+			       "full screen every frame");
+
 	obs_enter_graphics();
 
 	xshm_resize_texture(data);
 
 	obs_leave_graphics();
 
+	data->ready = false;
+	data->busy_buf = -1;
+	data->bytes_fetched = 0;
+	data->bytes_uploaded = 0;
+	data->capture_start_ns = os_gettime_ns();
+
+	if (pthread_mutex_init(&data->mutex, NULL) != 0)
+		goto fail;
+	if (os_event_init(&data->stop_event, OS_EVENT_TYPE_MANUAL) != 0) {
+		pthread_mutex_destroy(&data->mutex);
+		goto fail;
+	}
+	if (pthread_create(&data->thread, NULL, xshm_capture_thread, data) !=
+	    0) {
+		os_event_destroy(data->stop_event);
+		pthread_mutex_destroy(&data->mutex);
+		goto fail;
+	}
+	data->thread_active = true;
+
 	return;
 fail:
 	xshm_capture_stop(data);
@@ -466,6 +766,59 @@ static void *xshm_create(obs_data_t *settings, obs_source_t *source)
 	return data;
 }
 
+static inline uint32_t xshm_staging_size(int_fast32_t size,
+					 int_fast32_t max_size)
+{
+	int_fast32_t aligned = (size + XSHM_STAGING_ALIGN - 1) &
+			       ~(XSHM_STAGING_ALIGN - 1);
+	return (uint32_t)(aligned < max_size ? aligned : max_size);
+}
+
+/**
+ * Upload a changed area to the texture
+ *
+ * The area is written into the top left corner of a mapped staging texture
+ * and then copied into place on the GPU. Only the rows of the area are copied
+ * from the segment; the backend may still transfer the whole (aligned)
+ * staging texture from its upload buffer, but that happens on the GPU side.
+ *
+ * @note requires to be called within the obs graphics context
+ */
+static void xshm_upload_rect(struct xshm_data *data, const uint8_t *pixels,
+			     const struct xshm_rect *rect)
+{
+	uint32_t width = xshm_staging_size(rect->w, data->adj_width);
+	uint32_t height = xshm_staging_size(rect->h, data->adj_height);
+	uint32_t row_size = (uint32_t)rect->w * 4;
+	uint32_t linesize;
+	uint8_t *ptr;
+
+	if (!data->staging || gs_texture_get_width(data->staging) != width ||
+	    gs_texture_get_height(data->staging) != height) {
+		if (data->staging)
+			gs_texture_destroy(data->staging);
+		data->staging = gs_texture_create(width, height, GS_BGRA, 1,
+						  NULL, GS_DYNAMIC);
+		if (!data->staging)
+			return;
+	}
+
+	if (!gs_texture_map(data->staging, &ptr, &linesize))
+		return;
+
+	for (int_fast32_t y = 0; y < rect->h; ++y) {
+		memcpy(ptr, pixels, row_size);
+		ptr += linesize;
+		pixels += row_size;
+	}
+
+	gs_texture_unmap(data->staging);
+	gs_copy_texture_region(data->texture, rect->x, rect->y, data->staging,
+			       0, 0, rect->w, rect->h);
+
+	data->bytes_uploaded += (uint64_t)rect->w * rect->h * 4;
+}
+
 /**
  * Prepare the capture data
  */
@@ -479,30 +832,33 @@ static void xshm_video_tick(void *vptr, float seconds)
 	if (!obs_source_showing(data->source))
 		return;
 
-	xcb_shm_get_image_cookie_t img_c;
-	xcb_shm_get_image_reply_t *img_r;
-
-	img_c = xcb_shm_get_image_unchecked(data->xcb, data->xcb_screen->root,
-					    data->adj_x_org, data->adj_y_org,
-					    data->adj_width, data->adj_height,
-					    ~0, XCB_IMAGE_FORMAT_Z_PIXMAP,
-					    data->xshm->seg, 0);
-
-	img_r = xcb_shm_get_image_reply(data->xcb, img_c, NULL);
-
-	if (!img_r)
-		goto exit;
+	struct xshm_rect rect;
+	bool ready;
+	int buf;
+
+	pthread_mutex_lock(&data->mutex);
+	ready = data->ready;
+	if (ready) {
+		buf = data->ready_buf;
+		rect = data->ready_rect;
+		data->busy_buf = buf;
+		data->ready = false;
+	}
+	pthread_mutex_unlock(&data->mutex);
 
 	obs_enter_graphics();
 
-	gs_texture_set_image(data->texture, (void *)data->xshm->data,
-			     data->adj_width * 4, false);
+	if (ready)
+		xshm_upload_rect(data, data->xshm[buf]->data, &rect);
 	xcb_xcursor_update(data->xcb, data->cursor);
 
 	obs_leave_graphics();
 
-exit:
-	free(img_r);
+	if (ready) {
+		pthread_mutex_lock(&data->mutex);
+		data->busy_buf = -1;
+		pthread_mutex_unlock(&data->mutex);
+	}
 }
 
 /**
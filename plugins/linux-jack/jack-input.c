@@ -18,6 +18,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "jack-wrapper.h"
 
 #include <obs-module.h>
+#include <util/dstr.h>
 
 /**
  * Returns the name of the plugin
@@ -123,9 +124,9 @@ static void jack_input_defaults(obs_data_t *settings)
 /**
  * Get plugin properties
  */
-static obs_properties_t *jack_input_properties(void *unused)
+static obs_properties_t *jack_input_properties(void *vptr)
 {
-	(void)unused;
+	struct jack_data *data = (struct jack_data *)vptr;
 
 	obs_properties_t *props = obs_properties_create();
 
@@ -134,6 +135,15 @@ static obs_properties_t *jack_input_properties(void *unused)
 	obs_properties_add_bool(props, "startjack",
 				obs_module_text("StartJACKServer"));
 
+	if (data) {
+		struct dstr xruns = {0};
+		dstr_printf(&xruns, "%s: %ld", obs_module_text("XRuns"),
+			    os_atomic_load_long(&data->xruns));
+		obs_properties_add_text(props, "xruns", xruns.array,
+					OBS_TEXT_INFO);
+		dstr_free(&xruns);
+	}
+
 	return props;
 }
 
@@ -19,11 +19,18 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <util/threading.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <util/platform.h>
+#include <util/util_uint64.h>
 
 #define blog(level, msg, ...) blog(level, "jack-input: " msg, ##__VA_ARGS__)
 
+/* ring positions go up to twice the number of packets, so that a full ring
+ * can be told apart from an empty one */
+#define RING_POS_MASK (JACK_RING_PACKETS * 2 - 1)
+#define RING_SLOT(pos) ((pos) & (JACK_RING_PACKETS - 1))
+
 /**
  * Get obs speaker layout from number of channels
  *
@@ -58,48 +65,175 @@ static enum speaker_layout jack_channels_to_obs_speakers(uint_fast32_t channels)
 	return SPEAKERS_UNKNOWN;
 }
 
+static inline uint64_t frames_to_ns(uint64_t frames, uint_fast32_t rate)
+{
+	return util_mul_div64(frames, 1000000000ULL, rate);
+}
+
+/**
+ * Realtime process callback, copies the port buffers into the packet ring
+ *
+ * The first frame of the buffers was captured one period before the start of
+ * this cycle.  The JACK time of the cycle start is converted to the obs clock
+ * by the offset between the two clocks measured right now, so the timestamps
+ * follow the JACK frame time rather than the time at which the callback runs.
+ */
 int jack_process_callback(jack_nframes_t nframes, void *arg)
 {
 	struct jack_data *data = (struct jack_data *)arg;
+	jack_default_audio_sample_t *buffers[MAX_AUDIO_CHANNELS];
 	jack_nframes_t current_frames;
 	jack_time_t current_usecs, next_usecs;
 	float period_usecs;
+	uint64_t timestamp;
 
 	uint64_t now = os_gettime_ns();
+	jack_time_t jack_now = jack_get_time();
 
 	if (data == 0)
 		return 0;
 
-	struct obs_source_audio out;
-	out.speakers = jack_channels_to_obs_speakers(data->channels);
-	out.samples_per_sec = jack_get_sample_rate(data->jack_client);
-	/* format is always 32 bit float for jack */
-	out.format = AUDIO_FORMAT_FLOAT_PLANAR;
-
-	for (unsigned int i = 0; i < data->channels; ++i) {
-		jack_default_audio_sample_t *jack_buffer =
-			(jack_default_audio_sample_t *)jack_port_get_buffer(
-				data->jack_ports[i], nframes);
-		out.data[i] = (uint8_t *)jack_buffer;
-	}
-
-	out.frames = nframes;
 	if (!jack_get_cycle_times(data->jack_client, &current_frames,
 				  &current_usecs, &next_usecs, &period_usecs)) {
-		out.timestamp = now - (int64_t)(period_usecs * 1000);
+		int64_t offset = (int64_t)now - (int64_t)jack_now * 1000;
+		int64_t start = (int64_t)current_usecs * 1000 -
+				(int64_t)(period_usecs * 1000.0f);
+
+		timestamp = (uint64_t)(start + offset);
 	} else {
-		out.timestamp = now - util_mul_div64(nframes, 1000000000ULL,
-						     data->samples_per_sec);
-		blog(LOG_WARNING,
-		     "jack_get_cycle_times error: guessing timestamp");
+		/* no logging here, this runs every cycle in the realtime
+		 * thread */
+		timestamp = now - frames_to_ns(nframes, data->samples_per_sec);
+	}
+
+	for (unsigned int i = 0; i < data->channels; ++i)
+		buffers[i] = jack_port_get_buffer(data->jack_ports[i], nframes);
+
+	long pos = os_atomic_load_long(&data->write_pos);
+
+	for (jack_nframes_t offset = 0; offset < nframes;
+	     offset += JACK_PACKET_FRAMES) {
+		long read_pos = os_atomic_load_long(&data->read_pos);
+		if (((pos - read_pos) & RING_POS_MASK) == JACK_RING_PACKETS) {
+			os_atomic_inc_long(&data->dropped_packets);
+			break;
+		}
+
+		struct jack_packet *packet = &data->ring[RING_SLOT(pos)];
+		uint32_t frames = nframes - offset;
+		if (frames > JACK_PACKET_FRAMES)
+			frames = JACK_PACKET_FRAMES;
+
+		for (unsigned int i = 0; i < data->channels; ++i)
+			memcpy(packet->data + i * JACK_PACKET_FRAMES,
+			       buffers[i] + offset, frames * sizeof(float));
+
+		packet->frames = frames;
+		packet->timestamp =
+			timestamp + frames_to_ns(offset, data->samples_per_sec);
+
+		pos = (pos + 1) & RING_POS_MASK;
+		os_atomic_store_long(&data->write_pos, pos);
 	}
 
-	/* FIXME: this function is not realtime-safe, we should do something
-	 * about this */
-	obs_source_output_audio(data->source, &out);
+	/* unlike events, posting a semaphore does not take a lock */
+	os_sem_post(data->feeder_sem);
+	return 0;
+}
+
+static int jack_xrun_callback(void *arg)
+{
+	struct jack_data *data = (struct jack_data *)arg;
+
+	os_atomic_inc_long(&data->xruns);
 	return 0;
 }
 
+/**
+ * Feeder thread, outputs the packets of the ring to obs
+ */
+static void *jack_feeder_thread(void *arg)
+{
+	struct jack_data *data = (struct jack_data *)arg;
+
+	os_set_thread_name("jack: feeder");
+
+	while (os_sem_wait(data->feeder_sem) == 0) {
+		if (os_atomic_load_bool(&data->feeder_stop))
+			break;
+
+		long pos = os_atomic_load_long(&data->read_pos);
+
+		while (pos != os_atomic_load_long(&data->write_pos)) {
+			struct jack_packet *packet =
+				&data->ring[RING_SLOT(pos)];
+			float *packet_data = packet->data;
+
+			struct obs_source_audio out = {0};
+			out.speakers =
+				jack_channels_to_obs_speakers(data->channels);
+			out.samples_per_sec = data->samples_per_sec;
+			/* format is always 32 bit float for jack */
+			out.format = AUDIO_FORMAT_FLOAT_PLANAR;
+			out.frames = packet->frames;
+			out.timestamp = packet->timestamp;
+
+			for (unsigned int i = 0; i < data->channels; ++i) {
+				out.data[i] = (uint8_t *)packet_data;
+				packet_data += JACK_PACKET_FRAMES;
+			}
+
+			obs_source_output_audio(data->source, &out);
+
+			pos = (pos + 1) & RING_POS_MASK;
+			os_atomic_store_long(&data->read_pos, pos);
+		}
+	}
+
+	return NULL;
+}
+
+static bool start_feeder(struct jack_data *data)
+{
+	size_t packet_floats = (size_t)data->channels * JACK_PACKET_FRAMES;
+
+	data->ring_buffer = bmalloc(JACK_RING_PACKETS * packet_floats *
+				    sizeof(float));
+	for (size_t i = 0; i < JACK_RING_PACKETS; i++)
+		data->ring[i].data = data->ring_buffer + i * packet_floats;
+
+	data->write_pos = 0;
+	data->read_pos = 0;
+	data->feeder_stop = false;
+	data->xruns = 0;
+	data->dropped_packets = 0;
+
+	if (os_sem_init(&data->feeder_sem, 0) != 0)
+		return false;
+	if (pthread_create(&data->feeder_thread, NULL, jack_feeder_thread,
+			   data) != 0)
+		return false;
+
+	data->feeder_active = true;
+	return true;
+}
+
+static void stop_feeder(struct jack_data *data)
+{
+	if (data->feeder_active) {
+		os_atomic_store_bool(&data->feeder_stop, true);
+		os_sem_post(data->feeder_sem);
+		pthread_join(data->feeder_thread, NULL);
+		data->feeder_active = false;
+	}
+
+	os_sem_destroy(data->feeder_sem);
+	data->feeder_sem = NULL;
+
+	bfree(data->ring_buffer);
+	data->ring_buffer = NULL;
+}
+
 int_fast32_t jack_init(struct jack_data *data)
 {
 	pthread_mutex_lock(&data->jack_mutex);
@@ -137,12 +271,23 @@ int_fast32_t jack_init(struct jack_data *data)
 		}
 	}
 
+	data->samples_per_sec = jack_get_sample_rate(data->jack_client);
+
+	if (!start_feeder(data)) {
+		blog(LOG_ERROR, "Could not start the feeder thread");
+		goto error;
+	}
+
 	if (jack_set_process_callback(data->jack_client, jack_process_callback,
 				      data) != 0) {
 		blog(LOG_ERROR, "jack_set_process_callback Error");
 		goto error;
 	}
 
+	if (jack_set_xrun_callback(data->jack_client, jack_xrun_callback,
+				   data) != 0)
+		blog(LOG_WARNING, "jack_set_xrun_callback Error");
+
 	if (jack_activate(data->jack_client) != 0) {
 		blog(LOG_ERROR, "jack_activate Error:"
 				"Could not activate JACK client!");
@@ -169,6 +314,16 @@ void deactivate_jack(struct jack_data *data)
 			data->jack_ports = NULL;
 		}
 		data->jack_client = NULL;
+
+		/* the process callback does not run anymore */
+		stop_feeder(data);
+
+		long dropped = os_atomic_load_long(&data->dropped_packets);
+		if (dropped)
+			blog(LOG_WARNING,
+			     "Dropped %ld packets, the feeder thread could "
+			     "not keep up",
+			     dropped);
 	}
 	pthread_mutex_unlock(&data->jack_mutex);
 }
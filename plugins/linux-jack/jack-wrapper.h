@@ -21,6 +21,21 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <obs.h>
 #include <util/threading.h>
 
+/*
+ * The process callback runs in the JACK realtime thread and must not block,
+ * so it only copies the port buffers into a single producer, single consumer
+ * ring of fixed size packets.  A feeder thread passes the packets straight
+ * from the ring to obs_source_output_audio.
+ */
+#define JACK_PACKET_FRAMES 1024
+#define JACK_RING_PACKETS 16
+
+struct jack_packet {
+	float *data;
+	uint32_t frames;
+	uint64_t timestamp;
+};
+
 struct jack_data {
 	obs_source_t *source;
 
@@ -38,6 +53,22 @@ struct jack_data {
 	jack_port_t **jack_ports;
 
 	pthread_mutex_t jack_mutex;
+
+	/* packet ring, write_pos is only changed by the process callback and
+	 * read_pos only by the feeder thread */
+	float *ring_buffer;
+	struct jack_packet ring[JACK_RING_PACKETS];
+	volatile long write_pos;
+	volatile long read_pos;
+
+	pthread_t feeder_thread;
+	os_sem_t *feeder_sem;
+	volatile bool feeder_stop;
+	bool feeder_active;
+
+	/* statistics */
+	volatile long xruns;
+	volatile long dropped_packets;
 };
 
 /**
@@ -15,8 +15,11 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <stdlib.h>
 #include <util/platform.h>
 #include <util/bmem.h>
+#include <util/dstr.h>
+#include <util/threading.h>
 #include <util/util_uint64.h>
 #include <obs-module.h>
 
@@ -24,6 +27,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #define NSEC_PER_SEC 1000000000LL
 #define NSEC_PER_MSEC 1000000L
+#define NSEC_PER_USEC 1000L
+
+#define DEFAULT_FRAGMENT_MS 25
+#define MIN_FRAGMENT_MS 5
 
 #define PULSE_DATA(voidptr) struct pulse_data *data = voidptr;
 #define blog(level, msg, ...) blog(level, "pulse-input: " msg, ##__VA_ARGS__)
@@ -35,6 +42,8 @@ struct pulse_data {
 	/* user settings */
 	char *device;
 	bool input;
+	bool low_latency;
+	uint_fast32_t fragment_ms;
 
 	/* server info */
 	enum speaker_layout speakers;
@@ -44,9 +53,15 @@ struct pulse_data {
 	uint_fast8_t channels;
 	uint64_t first_ts;
 
+	/* smoothed timestamps in low latency mode */
+	uint64_t ts_base;
+	uint64_t ts_frames;
+
 	/* statistics */
 	uint_fast32_t packets;
 	uint_fast64_t frames;
+	pa_usec_t avg_latency;
+	volatile long latency_us;
 };
 
 static void pulse_stop_recording(struct pulse_data *data);
@@ -165,12 +180,68 @@ static inline uint64_t samples_to_ns(size_t frames, uint_fast32_t rate)
 	return util_mul_div64(frames, NSEC_PER_SEC, rate);
 }
 
-static inline uint64_t get_sample_time(size_t frames, uint_fast32_t rate)
+#define STARTUP_TIMEOUT_NS (500 * NSEC_PER_MSEC)
+#define TS_RESET_NS (50 * NSEC_PER_MSEC)
+#define TS_SMOOTHING 16
+
+/**
+ * Get the timestamp of the first frame of a packet
+ *
+ * Pulse reports the capture latency as the latency of the source plus the data
+ * waiting in our record buffer, which is the age of the packet we just peeked.
+ *
+ * With small fragments the read callback jitters by a good part of a packet,
+ * so in low latency mode the timestamps advance by the packet length, and are
+ * only pulled towards the measured time by a fraction of the difference.  This
+ * also follows the drift between the sound card and the system clock.  Larger
+ * differences (xruns, suspended sources) restart the timestamps.
+ */
+static uint64_t pulse_get_timestamp(struct pulse_data *data, size_t frames)
 {
-	return os_gettime_ns() - samples_to_ns(frames, rate);
-}
+	uint64_t now = os_gettime_ns();
+	uint64_t measured = now - samples_to_ns(frames, data->samples_per_sec);
+	pa_usec_t latency;
+	int negative;
+
+	if (pa_stream_get_latency(data->stream, &latency, &negative) == 0) {
+		if (negative)
+			latency = 0;
+
+		if (data->low_latency)
+			measured = now - latency * NSEC_PER_USEC;
+
+		if (data->avg_latency)
+			latency = (data->avg_latency * 7 + latency) / 8;
+		data->avg_latency = latency;
+		os_atomic_store_long(&data->latency_us,
+				     (long)data->avg_latency);
+	}
 
-#define STARTUP_TIMEOUT_NS (500 * NSEC_PER_MSEC)
+	if (!data->low_latency)
+		return measured;
+
+	uint64_t ts = data->ts_base +
+		      samples_to_ns(data->ts_frames, data->samples_per_sec);
+	int64_t error = (int64_t)(measured - ts);
+
+	if (!data->ts_base || llabs(error) > TS_RESET_NS) {
+		data->ts_base = measured;
+		data->ts_frames = 0;
+		ts = measured;
+	} else {
+		data->ts_base += error / TS_SMOOTHING;
+		ts += error / TS_SMOOTHING;
+	}
+
+	data->ts_frames += frames;
+	if (data->ts_frames >= data->samples_per_sec) {
+		data->ts_base += samples_to_ns(data->ts_frames,
+					       data->samples_per_sec);
+		data->ts_frames = 0;
+	}
+
+	return ts;
+}
 
 /**
  * Callback for pulse which gets executed when new audio data is available
@@ -208,7 +279,7 @@ static void pulse_stream_read(pa_stream *p, size_t nbytes, void *userdata)
 	out.format = pulse_to_obs_audio_format(data->format);
 	out.data[0] = (uint8_t *)frames;
 	out.frames = bytes / data->bytes_per_frame;
-	out.timestamp = get_sample_time(out.frames, out.samples_per_sec);
+	out.timestamp = pulse_get_timestamp(data, out.frames);
 
 	if (!data->first_ts)
 		data->first_ts = out.timestamp + STARTUP_TIMEOUT_NS;
@@ -322,9 +393,9 @@ skip:
  * We request the default format used by pulse here because the data will be
  * converted and possibly re-sampled by obs anyway.
  *
- * For now we request a buffer length of 25ms although pulse seems to ignore
+ * By default we request a buffer length of 25ms although pulse seems to ignore
  * this setting for monitor streams. For "real" input streams this should work
- * fine though.
+ * fine though.  Low latency mode requests the fragment length set by the user.
  */
 static int_fast32_t pulse_start_recording(struct pulse_data *data)
 {
@@ -371,14 +442,19 @@ static int_fast32_t pulse_start_recording(struct pulse_data *data)
 				    (void *)data);
 	pulse_unlock();
 
+	uint_fast32_t fragment_ms = data->low_latency ? data->fragment_ms
+						      : DEFAULT_FRAGMENT_MS;
+
 	pa_buffer_attr attr;
-	attr.fragsize = pa_usec_to_bytes(25000, &spec);
+	attr.fragsize = pa_usec_to_bytes(fragment_ms * 1000, &spec);
 	attr.maxlength = (uint32_t)-1;
 	attr.minreq = (uint32_t)-1;
 	attr.prebuf = (uint32_t)-1;
 	attr.tlength = (uint32_t)-1;
 
-	pa_stream_flags_t flags = PA_STREAM_ADJUST_LATENCY;
+	pa_stream_flags_t flags = PA_STREAM_ADJUST_LATENCY |
+				  PA_STREAM_INTERPOLATE_TIMING |
+				  PA_STREAM_AUTO_TIMING_UPDATE;
 
 	pulse_lock();
 	int_fast32_t ret = pa_stream_connect_record(data->stream, data->device,
@@ -390,7 +466,13 @@ static int_fast32_t pulse_start_recording(struct pulse_data *data)
 		return -1;
 	}
 
-	blog(LOG_INFO, "Started recording from '%s'", data->device);
+	if (data->low_latency)
+		blog(LOG_INFO,
+		     "Started recording from '%s' (low latency, "
+		     "%" PRIuFAST32 "ms fragments)",
+		     data->device, fragment_ms);
+	else
+		blog(LOG_INFO, "Started recording from '%s'", data->device);
 	return 0;
 }
 
@@ -413,8 +495,12 @@ static void pulse_stop_recording(struct pulse_data *data)
 	     data->packets, data->frames);
 
 	data->first_ts = 0;
+	data->ts_base = 0;
+	data->ts_frames = 0;
 	data->packets = 0;
 	data->frames = 0;
+	data->avg_latency = 0;
+	os_atomic_store_long(&data->latency_us, 0);
 }
 
 /**
@@ -451,15 +537,46 @@ skip:
 	pulse_signal(0);
 }
 
+static bool low_latency_modified(obs_properties_t *props, obs_property_t *p,
+				 obs_data_t *settings)
+{
+	bool low_latency = obs_data_get_bool(settings, "low_latency");
+
+	obs_property_set_visible(obs_properties_get(props, "fragment_ms"),
+				 low_latency);
+
+	UNUSED_PARAMETER(p);
+	return true;
+}
+
+static void add_latency_info(obs_properties_t *props, struct pulse_data *data)
+{
+	long latency_us = data ? os_atomic_load_long(&data->latency_us) : 0;
+	struct dstr info = {0};
+
+	if (latency_us > 0)
+		dstr_printf(&info, "%s: %.1f ms",
+			    obs_module_text("CaptureLatency"),
+			    (double)latency_us / 1000.0);
+	else
+		dstr_printf(&info, "%s: %s", obs_module_text("CaptureLatency"),
+			    obs_module_text("CaptureLatency.Unknown"));
+
+	obs_properties_add_text(props, "latency_info", info.array,
+				OBS_TEXT_INFO);
+	dstr_free(&info);
+}
+
 /**
  * Get plugin properties
  */
-static obs_properties_t *pulse_properties(bool input)
+static obs_properties_t *pulse_properties(struct pulse_data *data, bool input)
 {
 	obs_properties_t *props = obs_properties_create();
 	obs_property_t *devices = obs_properties_add_list(
 		props, "device_id", obs_module_text("Device"),
 		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+	obs_property_t *p;
 
 	pulse_init();
 	if (input)
@@ -474,21 +591,28 @@ static obs_properties_t *pulse_properties(bool input)
 		obs_property_list_insert_string(
 			devices, 0, obs_module_text("Default"), "default");
 
+	p = obs_properties_add_bool(props, "low_latency",
+				    obs_module_text("LowLatency"));
+	obs_property_set_modified_callback(p, low_latency_modified);
+
+	p = obs_properties_add_int_slider(props, "fragment_ms",
+					  obs_module_text("FragmentLength"),
+					  MIN_FRAGMENT_MS, DEFAULT_FRAGMENT_MS,
+					  1);
+	obs_property_int_set_suffix(p, " ms");
+
+	add_latency_info(props, data);
 	return props;
 }
 
-static obs_properties_t *pulse_input_properties(void *unused)
+static obs_properties_t *pulse_input_properties(void *vptr)
 {
-	UNUSED_PARAMETER(unused);
-
-	return pulse_properties(true);
+	return pulse_properties(vptr, true);
 }
 
-static obs_properties_t *pulse_output_properties(void *unused)
+static obs_properties_t *pulse_output_properties(void *vptr)
 {
-	UNUSED_PARAMETER(unused);
-
-	return pulse_properties(false);
+	return pulse_properties(vptr, false);
 }
 
 /**
@@ -497,6 +621,8 @@ static obs_properties_t *pulse_output_properties(void *unused)
 static void pulse_defaults(obs_data_t *settings)
 {
 	obs_data_set_default_string(settings, "device_id", "default");
+	obs_data_set_default_bool(settings, "low_latency", false);
+	obs_data_set_default_int(settings, "fragment_ms", 10);
 }
 
 /**
@@ -541,6 +667,8 @@ static void pulse_update(void *vptr, obs_data_t *settings)
 	PULSE_DATA(vptr);
 	bool restart = false;
 	const char *new_device;
+	bool low_latency;
+	uint_fast32_t fragment_ms;
 
 	new_device = obs_data_get_string(settings, "device_id");
 	if (!data->device || strcmp(data->device, new_device) != 0) {
@@ -550,6 +678,20 @@ static void pulse_update(void *vptr, obs_data_t *settings)
 		restart = true;
 	}
 
+	low_latency = obs_data_get_bool(settings, "low_latency");
+	fragment_ms = (uint_fast32_t)obs_data_get_int(settings, "fragment_ms");
+	if (fragment_ms < MIN_FRAGMENT_MS)
+		fragment_ms = MIN_FRAGMENT_MS;
+	else if (fragment_ms > DEFAULT_FRAGMENT_MS)
+		fragment_ms = DEFAULT_FRAGMENT_MS;
+
+	if (low_latency != data->low_latency ||
+	    (low_latency && fragment_ms != data->fragment_ms)) {
+		data->low_latency = low_latency;
+		data->fragment_ms = fragment_ms;
+		restart = true;
+	}
+
 	if (!restart)
 		return;
 
@@ -16,6 +16,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <obs-module.h>
+#include <util/platform.h>
 #include <linux/videodev2.h>
 
 #include "v4l2-decoder.h"
@@ -23,6 +24,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define blog(level, msg, ...) \
 	blog(level, "v4l2-input: decoder: " msg, ##__VA_ARGS__)
 
+/* Every frame thread adds a frame of latency, so only use a few; that is
+ * enough to keep up with 1080p60/4K30 MJPEG on USB capture devices. */
+#define MAX_DECODE_THREADS 4
+
 int v4l2_init_decoder(struct v4l2_decoder *decoder, int pixfmt)
 {
 	if (pixfmt == V4L2_PIX_FMT_MJPEG) {
@@ -56,12 +61,27 @@ int v4l2_init_decoder(struct v4l2_decoder *decoder, int pixfmt)
 
 	decoder->context->flags2 |= AV_CODEC_FLAG2_FAST;
 
+	/* H.264 from cameras is usually sliced and can be decoded without any
+	 * added latency, MJPEG can only be spread over frames */
+	int threads = os_get_logical_cores();
+	if (threads > MAX_DECODE_THREADS)
+		threads = MAX_DECODE_THREADS;
+	decoder->context->thread_count = threads;
+	decoder->context->thread_type = pixfmt == V4L2_PIX_FMT_H264
+						? FF_THREAD_SLICE
+						: FF_THREAD_FRAME;
+
 	if (avcodec_open2(decoder->context, decoder->codec, NULL) < 0) {
 		blog(LOG_ERROR, "failed to open codec");
 		return -1;
 	}
 
-	blog(LOG_DEBUG, "initialized avcodec");
+	const int active = decoder->context->active_thread_type;
+	blog(LOG_DEBUG, "initialized avcodec, %d threads (%s)",
+	     decoder->context->thread_count,
+	     (active & FF_THREAD_FRAME)   ? "frame"
+	     : (active & FF_THREAD_SLICE) ? "slice"
+					  : "none");
 
 	return 0;
 }
@@ -84,20 +104,30 @@ void v4l2_destroy_decoder(struct v4l2_decoder *decoder)
 }
 
 int v4l2_decode_frame(struct obs_source_frame *out, uint8_t *data,
-		      size_t length, struct v4l2_decoder *decoder)
+		      size_t length, uint64_t timestamp,
+		      struct v4l2_decoder *decoder)
 {
+	int ret;
+
 	decoder->packet->data = data;
 	decoder->packet->size = length;
+	decoder->packet->pts = (int64_t)timestamp;
 	if (avcodec_send_packet(decoder->context, decoder->packet) < 0) {
 		blog(LOG_ERROR, "failed to send frame to codec");
 		return -1;
 	}
 
-	if (avcodec_receive_frame(decoder->context, decoder->frame) < 0) {
+	ret = avcodec_receive_frame(decoder->context, decoder->frame);
+	if (ret == AVERROR(EAGAIN)) {
+		/* frame threads are still filling up */
+		return 1;
+	} else if (ret < 0) {
 		blog(LOG_ERROR, "failed to receive frame from codec");
 		return -1;
 	}
 
+	out->timestamp = (uint64_t)decoder->frame->pts;
+
 	for (uint_fast32_t i = 0; i < MAX_AV_PLANES; ++i) {
 		out->data[i] = decoder->frame->data[i];
 		out->linesize[i] = decoder->frame->linesize[i];
@@ -55,14 +55,20 @@ void v4l2_destroy_decoder(struct v4l2_decoder *decoder);
 /**
  * Decode a jpeg or h264 frame into an obs frame
  *
+ * The decoder may be frame threaded, in which case the decoded frame lags
+ * behind the data that was passed in.  The timestamp of the returned frame
+ * is the one that was passed in with its data.
+ *
  * @param out the obs frame to decode into
  * @param data the codec data
  * @param length length of the data
+ * @param timestamp timestamp of the data
  * @param decoder the decoder as initialized by v4l2_init_decoder
- * @return non-zero on failure
+ * @return negative on failure, positive if no frame is available yet
  */
 int v4l2_decode_frame(struct obs_source_frame *out, uint8_t *data,
-		      size_t length, struct v4l2_decoder *decoder);
+		      size_t length, uint64_t timestamp,
+		      struct v4l2_decoder *decoder);
 
 #ifdef __cplusplus
 }
@@ -34,6 +34,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <util/dstr.h>
 #include <util/platform.h>
 #include <obs-module.h>
+#include <obs-avc.h>
 
 #include "v4l2-controls.h"
 #include "v4l2-helpers.h"
@@ -63,6 +64,19 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #define blog(level, msg, ...) blog(level, "v4l2-input: " msg, ##__VA_ARGS__)
 
+/* number of compressed frames that can wait for the decoder */
+#define V4L2_DECODE_QUEUE_SIZE 4
+
+/**
+ * Compressed frame copied out of a device buffer
+ */
+struct v4l2_packet {
+	uint8_t *data;
+	size_t size;
+	size_t capacity;
+	uint64_t timestamp;
+};
+
 /**
  * Data structure for the v4l2 source
  */
@@ -93,6 +107,23 @@ struct v4l2_data {
 
 	bool auto_reset;
 	int timeout_frames;
+
+	/* decode pipeline for compressed formats: the capture thread copies
+	 * the frame out and re-queues the device buffer right away, the
+	 * decode thread picks frames up from here */
+	pthread_t decode_thread;
+	os_sem_t *decode_sem;
+	pthread_mutex_t decode_mutex;
+	struct v4l2_packet decode_queue[V4L2_DECODE_QUEUE_SIZE];
+	size_t decode_queue_start;
+	size_t decode_queue_num;
+	bool decode_wait_keyframe;
+	bool decode_stop;
+
+	/* statistics */
+	volatile long dropped_sequences;
+	volatile long dropped_queue;
+	volatile long decode_errors;
 };
 
 /* forward declarations */
@@ -158,6 +189,187 @@ static void v4l2_prep_obs_frame(struct v4l2_data *data,
 	}
 }
 
+static inline void v4l2_swap_packets(struct v4l2_packet *a,
+				     struct v4l2_packet *b)
+{
+	struct v4l2_packet tmp = *a;
+	*a = *b;
+	*b = tmp;
+}
+
+static void v4l2_packet_copy(struct v4l2_packet *packet, const uint8_t *data,
+			     size_t size, uint64_t timestamp)
+{
+	if (packet->capacity < size) {
+		packet->data = brealloc(packet->data, size);
+		packet->capacity = size;
+	}
+
+	memcpy(packet->data, data, size);
+	packet->size = size;
+	packet->timestamp = timestamp;
+}
+
+/**
+ * Hand a compressed frame to the decode thread.
+ *
+ * The packet is swapped into the queue, so the caller gets an unused buffer
+ * back.  If the decoder is lagging frames are dropped to keep latency
+ * bounded: for MJPEG the oldest waiting frame, for H.264 the new frame and
+ * every following one up to the next keyframe, since later frames reference
+ * the dropped one.
+ */
+static void v4l2_queue_packet(struct v4l2_data *data,
+			      struct v4l2_packet *packet)
+{
+	const bool h264 = data->pixfmt == V4L2_PIX_FMT_H264;
+	const bool keyframe =
+		h264 && obs_avc_keyframe(packet->data, packet->size);
+	size_t idx;
+
+	pthread_mutex_lock(&data->decode_mutex);
+
+	if (keyframe)
+		data->decode_wait_keyframe = false;
+
+	if (data->decode_wait_keyframe) {
+		os_atomic_inc_long(&data->dropped_queue);
+		goto unlock;
+	}
+
+	if (data->decode_queue_num == V4L2_DECODE_QUEUE_SIZE) {
+		if (!h264) {
+			idx = data->decode_queue_start;
+			data->decode_queue_start =
+				(idx + 1) % V4L2_DECODE_QUEUE_SIZE;
+			os_atomic_inc_long(&data->dropped_queue);
+
+		} else if (keyframe) {
+			/* the waiting frames are not needed to decode a
+			 * keyframe, the semaphore count left over from them
+			 * only causes empty wakeups */
+			idx = data->decode_queue_start;
+			data->decode_queue_num = 1;
+			os_atomic_set_long(
+				&data->dropped_queue,
+				os_atomic_load_long(&data->dropped_queue) +
+					V4L2_DECODE_QUEUE_SIZE);
+
+		} else {
+			data->decode_wait_keyframe = true;
+			os_atomic_inc_long(&data->dropped_queue);
+			goto unlock;
+		}
+	} else {
+		idx = (data->decode_queue_start + data->decode_queue_num) %
+		      V4L2_DECODE_QUEUE_SIZE;
+		data->decode_queue_num++;
+		os_sem_post(data->decode_sem);
+	}
+
+	v4l2_swap_packets(&data->decode_queue[idx], packet);
+
+unlock:
+	pthread_mutex_unlock(&data->decode_mutex);
+}
+
+static bool v4l2_dequeue_packet(struct v4l2_data *data,
+				struct v4l2_packet *packet)
+{
+	bool success = false;
+
+	pthread_mutex_lock(&data->decode_mutex);
+
+	if (data->decode_queue_num) {
+		v4l2_swap_packets(&data->decode_queue[data->decode_queue_start],
+				  packet);
+		data->decode_queue_start =
+			(data->decode_queue_start + 1) % V4L2_DECODE_QUEUE_SIZE;
+		data->decode_queue_num--;
+		success = true;
+	}
+
+	pthread_mutex_unlock(&data->decode_mutex);
+
+	return success;
+}
+
+/*
+ * Worker thread to decode compressed video data
+ */
+static void *v4l2_decode_thread(void *vptr)
+{
+	V4L2_DATA(vptr);
+	struct v4l2_packet packet = {0};
+	struct obs_source_frame out;
+	size_t plane_offsets[MAX_AV_PLANES];
+
+	os_set_thread_name("v4l2: decode");
+
+	v4l2_prep_obs_frame(data, &out, plane_offsets);
+
+	while (os_sem_wait(data->decode_sem) == 0) {
+		if (data->decode_stop)
+			break;
+
+		if (!v4l2_dequeue_packet(data, &packet))
+			continue;
+
+		int ret = v4l2_decode_frame(&out, packet.data, packet.size,
+					    packet.timestamp, &data->decoder);
+		if (ret < 0) {
+			os_atomic_inc_long(&data->decode_errors);
+			continue;
+		} else if (ret > 0) {
+			continue;
+		}
+
+		obs_source_output_video(data->source, &out);
+	}
+
+	bfree(packet.data);
+	return NULL;
+}
+
+static bool v4l2_start_decode_thread(struct v4l2_data *data)
+{
+	memset(data->decode_queue, 0, sizeof(data->decode_queue));
+	data->decode_queue_start = 0;
+	data->decode_queue_num = 0;
+	data->decode_wait_keyframe = false;
+	data->decode_stop = false;
+
+	if (pthread_mutex_init(&data->decode_mutex, NULL) != 0)
+		return false;
+	if (os_sem_init(&data->decode_sem, 0) != 0)
+		goto fail_sem;
+	if (pthread_create(&data->decode_thread, NULL, v4l2_decode_thread,
+			   data) != 0)
+		goto fail_thread;
+
+	return true;
+
+fail_thread:
+	os_sem_destroy(data->decode_sem);
+fail_sem:
+	pthread_mutex_destroy(&data->decode_mutex);
+	return false;
+}
+
+static void v4l2_stop_decode_thread(struct v4l2_data *data)
+{
+	data->decode_stop = true;
+	os_sem_post(data->decode_sem);
+	pthread_join(data->decode_thread, NULL);
+
+	os_sem_destroy(data->decode_sem);
+	pthread_mutex_destroy(&data->decode_mutex);
+
+	for (size_t i = 0; i < V4L2_DECODE_QUEUE_SIZE; i++)
+		bfree(data->decode_queue[i].data);
+	memset(data->decode_queue, 0, sizeof(data->decode_queue));
+}
+
 /*
  * Worker thread to get video data
  */
@@ -176,6 +388,11 @@ static void *v4l2_thread(void *vptr)
 	int fps_num, fps_denom;
 	float ffps;
 	uint64_t timeout_usec;
+	uint32_t last_sequence = 0;
+	long dropped_sequences = 0;
+	struct v4l2_packet packet = {0};
+	const bool decode = data->pixfmt == V4L2_PIX_FMT_MJPEG ||
+			    data->pixfmt == V4L2_PIX_FMT_H264;
 
 	blog(LOG_DEBUG, "%s: new capture thread", data->device_id);
 	os_set_thread_name("v4l2: capture");
@@ -190,6 +407,16 @@ static void *v4l2_thread(void *vptr)
 	     "%s: select timeout set to %" PRIu64 " (%dx frame periods)",
 	     data->device_id, timeout_usec, data->timeout_frames);
 
+	os_atomic_store_long(&data->dropped_sequences, 0);
+	os_atomic_store_long(&data->dropped_queue, 0);
+	os_atomic_store_long(&data->decode_errors, 0);
+
+	if (decode && !v4l2_start_decode_thread(data)) {
+		blog(LOG_ERROR, "%s: failed to start decode thread",
+		     data->device_id);
+		return NULL;
+	}
+
 	if (v4l2_start_capture(data->dev, &data->buffers) < 0)
 		goto exit;
 
@@ -261,6 +488,14 @@ static void *v4l2_thread(void *vptr)
 		     data->device_id, buf.timestamp.tv_usec, buf.index,
 		     buf.flags, buf.sequence, buf.length, buf.bytesused);
 
+		/* sequence numbers restart when the stream is reset */
+		if (frames && buf.sequence > last_sequence + 1) {
+			dropped_sequences += buf.sequence - last_sequence - 1;
+			os_atomic_store_long(&data->dropped_sequences,
+					     dropped_sequences);
+		}
+		last_sequence = buf.sequence;
+
 		out.timestamp = timeval2ns(buf.timestamp);
 		if (!frames)
 			first_ts = out.timestamp;
@@ -268,19 +503,16 @@ static void *v4l2_thread(void *vptr)
 
 		start = (uint8_t *)data->buffers.info[buf.index].start;
 
-		if (data->pixfmt == V4L2_PIX_FMT_MJPEG ||
-		    data->pixfmt == V4L2_PIX_FMT_H264) {
-			if (v4l2_decode_frame(&out, start, buf.bytesused,
-					      &data->decoder) < 0) {
-				blog(LOG_ERROR,
-				     "failed to unpack jpeg or h264");
-				break;
-			}
+		if (decode) {
+			/* copy the compressed frame so the buffer can go back
+			 * to the device before decoding */
+			v4l2_packet_copy(&packet, start, buf.bytesused,
+					 out.timestamp);
 		} else {
 			for (uint_fast32_t i = 0; i < MAX_AV_PLANES; ++i)
 				out.data[i] = start + plane_offsets[i];
+			obs_source_output_video(data->source, &out);
 		}
-		obs_source_output_video(data->source, &out);
 
 		if (v4l2_ioctl(data->dev, VIDIOC_QBUF, &buf) < 0) {
 			blog(LOG_ERROR, "%s: failed to enqueue buffer",
@@ -288,6 +520,9 @@ static void *v4l2_thread(void *vptr)
 			break;
 		}
 
+		if (decode)
+			v4l2_queue_packet(data, &packet);
+
 		frames++;
 	}
 
@@ -296,6 +531,18 @@ static void *v4l2_thread(void *vptr)
 
 exit:
 	v4l2_stop_capture(data->dev);
+
+	if (decode) {
+		v4l2_stop_decode_thread(data);
+		bfree(packet.data);
+	}
+
+	blog(LOG_INFO,
+	     "%s: %ld frames dropped by the device, %ld dropped waiting "
+	     "for the decoder, %ld failed to decode",
+	     data->device_id, os_atomic_load_long(&data->dropped_sequences),
+	     os_atomic_load_long(&data->dropped_queue),
+	     os_atomic_load_long(&data->decode_errors));
 	return NULL;
 }
 
@@ -1152,6 +1399,17 @@ static void v4l2_update(void *vptr, obs_data_t *settings)
 		v4l2_init(data);
 }
 
+static void v4l2_get_dropped_frames(void *vptr, calldata_t *cd)
+{
+	V4L2_DATA(vptr);
+
+	calldata_set_int(cd, "device",
+			 os_atomic_load_long(&data->dropped_sequences));
+	calldata_set_int(cd, "decoder",
+			 os_atomic_load_long(&data->dropped_queue) +
+				 os_atomic_load_long(&data->decode_errors));
+}
+
 static void *v4l2_create(obs_data_t *settings, obs_source_t *source)
 {
 	struct v4l2_data *data = bzalloc(sizeof(struct v4l2_data));
@@ -1168,6 +1426,12 @@ static void *v4l2_create(obs_data_t *settings, obs_source_t *source)
 	blog(LOG_WARNING, "Plugin built without dv-timing support!");
 #endif
 
+	proc_handler_t *ph = obs_source_get_proc_handler(source);
+	proc_handler_add(ph,
+			 "void get_dropped_frames(out int device, "
+			 "out int decoder)",
+			 v4l2_get_dropped_frames, data);
+
 	v4l2_update(data, settings);
 
 #if HAVE_UDEV
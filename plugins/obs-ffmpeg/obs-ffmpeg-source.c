@@ -59,6 +59,9 @@ struct ffmpeg_source {
 	bool restart_on_activate;
 	bool close_when_inactive;
 	bool seekable;
+	bool is_hot_clip;
+	bool is_full_decode;
+	bool is_cache_compressed;
 
 	pthread_t reconnect_thread;
 	bool stop_reconnect;
@@ -91,6 +94,7 @@ static bool is_local_file_modified(obs_properties_t *props,
 	obs_property_t *buffering = obs_properties_get(props, "buffering_mb");
 	obs_property_t *seekable = obs_properties_get(props, "seekable");
 	obs_property_t *speed = obs_properties_get(props, "speed_percent");
+	obs_property_t *hot_clip = obs_properties_get(props, "hot_clip");
 	obs_property_t *reconnect_delay_sec =
 		obs_properties_get(props, "reconnect_delay_sec");
 	obs_property_set_visible(input, !enabled);
@@ -99,6 +103,7 @@ static bool is_local_file_modified(obs_properties_t *props,
 	obs_property_set_visible(local_file, enabled);
 	obs_property_set_visible(looping, enabled);
 	obs_property_set_visible(speed, enabled);
+	obs_property_set_visible(hot_clip, enabled);
 	obs_property_set_visible(seekable, !enabled);
 	obs_property_set_visible(reconnect_delay_sec, !enabled);
 
@@ -171,6 +176,11 @@ static obs_properties_t *ffmpeg_source_getproperties(void *data)
 	obs_properties_add_bool(props, "restart_on_activate",
 				obs_module_text("RestartWhenActivated"));
 
+	prop = obs_properties_add_bool(props, "hot_clip",
+				       obs_module_text("HotClip"));
+	obs_property_set_long_description(prop,
+					  obs_module_text("HotClip.ToolTip"));
+
 	prop = obs_properties_add_int_slider(props, "buffering_mb",
 					     obs_module_text("BufferingMB"), 0,
 					     16, 1);
@@ -303,9 +313,16 @@ static void media_stopped(void *opaque)
 	obs_source_media_ended(s->source);
 }
 
+/* about a second of video, enough to hide the decoder catching up */
+#define HOT_CLIP_PREROLL_FRAMES 30
+
 static void ffmpeg_source_open(struct ffmpeg_source *s)
 {
 	if (s->input && *s->input) {
+		char *index_dir = NULL;
+		if (s->is_local_file)
+			index_dir = obs_module_config_path("keyframe-index");
+
 		struct mp_media_info info = {
 			.opaque = s,
 			.v_cb = get_frame,
@@ -323,9 +340,16 @@ static void ffmpeg_source_open(struct ffmpeg_source *s)
 			.ffmpeg_options = s->ffmpeg_options,
 			.is_local_file = s->is_local_file || s->seekable,
 			.reconnecting = s->reconnecting,
+			.index_cache_dir = index_dir,
+			.preroll_frames = s->is_hot_clip
+						  ? HOT_CLIP_PREROLL_FRAMES
+						  : 0,
+			.full_decode = s->is_full_decode,
+			.compress_cache = s->is_cache_compressed,
 		};
 
 		s->media_valid = mp_media_init(&s->media, &info);
+		bfree(index_dir);
 	}
 }
 
@@ -464,6 +488,12 @@ static void ffmpeg_source_update(void *data, obs_data_t *settings)
 	s->speed_percent = (int)obs_data_get_int(settings, "speed_percent");
 	s->is_local_file = is_local_file;
 	s->seekable = obs_data_get_bool(settings, "seekable");
+	s->is_hot_clip = is_local_file &&
+			 obs_data_get_bool(settings, "hot_clip");
+	/* internal settings used by the stinger transition */
+	s->is_full_decode = is_local_file &&
+			    obs_data_get_bool(settings, "full_decode");
+	s->is_cache_compressed = obs_data_get_bool(settings, "compress_cache");
 	s->ffmpeg_options = ffmpeg_options ? bstrdup(ffmpeg_options) : NULL;
 
 	if (s->speed_percent < 1 || s->speed_percent > 200)
@@ -519,6 +549,17 @@ static void get_duration(void *data, calldata_t *cd)
 	calldata_set_int(cd, "duration", dur * 1000);
 }
 
+static void get_cache_size(void *data, calldata_t *cd)
+{
+	struct ffmpeg_source *s = data;
+	uint64_t size = 0;
+
+	if (s->media_valid)
+		size = mp_media_get_cache_size(&s->media);
+
+	calldata_set_int(cd, "size", (long long)size);
+}
+
 static void get_nb_frames(void *data, calldata_t *cd)
 {
 	struct ffmpeg_source *s = data;
@@ -636,6 +677,8 @@ static void *ffmpeg_source_create(obs_data_t *settings, obs_source_t *source)
 			 get_duration, s);
 	proc_handler_add(ph, "void get_nb_frames(out int num_frames)",
 			 get_nb_frames, s);
+	proc_handler_add(ph, "void get_cache_size(out int size)",
+			 get_cache_size, s);
 
 	ffmpeg_source_update(s, settings);
 	return s;
@@ -4,6 +4,7 @@
 
 #include <obs-module.h>
 #include <media-io/audio-math.h>
+#include <media-io/audio-dsp.h>
 #include <util/platform.h>
 #include <util/circlebuf.h>
 #include <util/threading.h>
@@ -65,6 +66,10 @@ struct compressor_data {
 	float *envelope_buf;
 	size_t envelope_buf_len;
 
+	/* envelopes of the other groups of four channels, they are computed
+	 * in parallel and merged into envelope_buf */
+	float *group_env_bufs[MAX_AUDIO_CHANNELS / 4];
+
 	float ratio;
 	float threshold;
 	float attack_gain;
@@ -129,6 +134,10 @@ static void resize_env_buffer(struct compressor_data *cd, size_t len)
 	cd->envelope_buf_len = len;
 	cd->envelope_buf = brealloc(cd->envelope_buf, len * sizeof(float));
 
+	for (size_t i = 1; i < MAX_AUDIO_CHANNELS / 4; i++)
+		cd->group_env_bufs[i] =
+			brealloc(cd->group_env_bufs[i], len * sizeof(float));
+
 	for (size_t i = 0; i < cd->num_channels; i++)
 		cd->sidechain_buf[i] =
 			brealloc(cd->sidechain_buf[i], len * sizeof(float));
@@ -302,6 +311,8 @@ static void compressor_destroy(void *data)
 		circlebuf_free(&cd->sidechain_data[i]);
 		bfree(cd->sidechain_buf[i]);
 	}
+	for (size_t i = 0; i < MAX_AUDIO_CHANNELS / 4; i++)
+		bfree(cd->group_env_bufs[i]);
 	pthread_mutex_destroy(&cd->sidechain_mutex);
 	pthread_mutex_destroy(&cd->sidechain_update_mutex);
 
@@ -310,6 +321,55 @@ static void compressor_destroy(void *data)
 	bfree(cd);
 }
 
+struct envelope_job {
+	struct compressor_data *cd;
+	float **samples;
+	uint32_t num_samples;
+};
+
+static void envelope_group_job(void *param, size_t idx)
+{
+	struct envelope_job *job = param;
+	struct compressor_data *cd = job->cd;
+	float *env_buf = idx ? cd->group_env_bufs[idx] : cd->envelope_buf;
+	size_t first = idx * 4;
+	size_t channels = cd->num_channels - first;
+
+	if (channels > 4)
+		channels = 4;
+
+	audio_dsp_peak_envelope(env_buf, job->samples + first, channels,
+				job->num_samples, cd->envelope,
+				cd->attack_gain, cd->release_gain);
+}
+
+/* the envelope kernel already processes four channels at once, so surround
+ * sources get one job per group of four channels, which are merged after */
+static void peak_envelope(struct compressor_data *cd, float **samples,
+			  const uint32_t num_samples)
+{
+	size_t groups = (cd->num_channels + 3) / 4;
+	float *env_buf = cd->envelope_buf;
+
+	if (groups <= 1) {
+		audio_dsp_peak_envelope(env_buf, samples, cd->num_channels,
+					num_samples, cd->envelope,
+					cd->attack_gain, cd->release_gain);
+	} else {
+		struct envelope_job job = {cd, samples, num_samples};
+		obs_run_audio_jobs(envelope_group_job, &job, groups);
+
+		for (size_t g = 1; g < groups; g++) {
+			const float *group_env = cd->group_env_bufs[g];
+
+			for (uint32_t i = 0; i < num_samples; i++)
+				env_buf[i] = fmaxf(env_buf[i], group_env[i]);
+		}
+	}
+
+	cd->envelope = env_buf[num_samples - 1];
+}
+
 static void analyze_envelope(struct compressor_data *cd, float **samples,
 			     const uint32_t num_samples)
 {
@@ -317,27 +377,7 @@ static void analyze_envelope(struct compressor_data *cd, float **samples,
 		resize_env_buffer(cd, num_samples);
 	}
 
-	const float attack_gain = cd->attack_gain;
-	const float release_gain = cd->release_gain;
-
-	memset(cd->envelope_buf, 0, num_samples * sizeof(cd->envelope_buf[0]));
-	for (size_t chan = 0; chan < cd->num_channels; ++chan) {
-		if (!samples[chan])
-			continue;
-
-		float *envelope_buf = cd->envelope_buf;
-		float env = cd->envelope;
-		for (uint32_t i = 0; i < num_samples; ++i) {
-			const float env_in = fabsf(samples[chan][i]);
-			if (env < env_in) {
-				env = env_in + attack_gain * (env - env_in);
-			} else {
-				env = env_in + release_gain * (env - env_in);
-			}
-			envelope_buf[i] = fmaxf(envelope_buf[i], env);
-		}
-	}
-	cd->envelope = cd->envelope_buf[num_samples - 1];
+	peak_envelope(cd, samples, num_samples);
 }
 
 static void analyze_sidechain(struct compressor_data *cd,
@@ -348,46 +388,18 @@ static void analyze_sidechain(struct compressor_data *cd,
 	}
 
 	get_sidechain_data(cd, num_samples);
-
-	const float attack_gain = cd->attack_gain;
-	const float release_gain = cd->release_gain;
-	float **sidechain_buf = cd->sidechain_buf;
-
-	memset(cd->envelope_buf, 0, num_samples * sizeof(cd->envelope_buf[0]));
-	for (size_t chan = 0; chan < cd->num_channels; ++chan) {
-		if (!sidechain_buf[chan])
-			continue;
-
-		float *envelope_buf = cd->envelope_buf;
-		float env = cd->envelope;
-		for (uint32_t i = 0; i < num_samples; ++i) {
-			const float env_in = fabsf(sidechain_buf[chan][i]);
-
-			if (env < env_in) {
-				env = env_in + attack_gain * (env - env_in);
-			} else {
-				env = env_in + release_gain * (env - env_in);
-			}
-			envelope_buf[i] = fmaxf(envelope_buf[i], env);
-		}
-	}
-	cd->envelope = cd->envelope_buf[num_samples - 1];
+	peak_envelope(cd, cd->sidechain_buf, num_samples);
 }
 
-static inline void process_compression(const struct compressor_data *cd,
+static inline void process_compression(struct compressor_data *cd,
 				       float **samples, uint32_t num_samples)
 {
-	for (size_t i = 0; i < num_samples; ++i) {
-		const float env_db = mul_to_db(cd->envelope_buf[i]);
-		float gain = cd->slope * (cd->threshold - env_db);
-		gain = db_to_mul(fminf(0, gain));
-
-		for (size_t c = 0; c < cd->num_channels; ++c) {
-			if (samples[c]) {
-				samples[c][i] *= gain * cd->output_gain;
-			}
-		}
-	}
+	/* the envelope is not needed anymore, so the gain replaces it */
+	float *gain = cd->envelope_buf;
+
+	audio_dsp_compressor_gain(gain, cd->envelope_buf, num_samples,
+				  cd->threshold, cd->slope, cd->output_gain);
+	audio_dsp_apply_gain(samples, cd->num_channels, gain, num_samples);
 }
 
 static void compressor_tick(void *data, float seconds)
@@ -36,6 +36,7 @@ struct mask_filter_data {
 
 	gs_texture_t *target;
 	gs_image_file_t image;
+	gs_shared_image_t *shared_image;
 	struct vec4 color;
 	bool lock_aspect;
 };
@@ -58,6 +59,8 @@ static void mask_filter_image_unload(struct mask_filter_data *filter)
 {
 	obs_enter_graphics();
 	gs_image_file_free(&filter->image);
+	gs_shared_image_release(filter->shared_image);
+	filter->shared_image = NULL;
 	obs_leave_graphics();
 }
 
@@ -69,15 +72,26 @@ static void mask_filter_image_load(struct mask_filter_data *filter)
 
 	if (path && *path) {
 		filter->image_file_timestamp = get_modified_timestamp(path);
-		gs_image_file_init(&filter->image, path);
 		filter->update_time_elapsed = 0;
 
+		/* masks are often reused, only animated ones need their own
+		 * copy */
+		if (gs_image_file_is_gif(path))
+			gs_image_file_init(&filter->image, path);
+		else
+			filter->shared_image = gs_shared_image_get(
+				path, GS_IMAGE_ALPHA_STRAIGHT);
+
 		obs_enter_graphics();
 		gs_image_file_init_texture(&filter->image);
+		if (filter->shared_image)
+			filter->target =
+				gs_shared_image_get_texture(filter->shared_image);
 		obs_leave_graphics();
 	}
 
-	filter->target = filter->image.texture;
+	if (!filter->shared_image)
+		filter->target = filter->image.texture;
 }
 
 static void mask_filter_update_internal(void *data, obs_data_t *settings,
@@ -227,6 +241,7 @@ static void mask_filter_destroy(void *data)
 	obs_enter_graphics();
 	gs_effect_destroy(filter->effect);
 	gs_image_file_free(&filter->image);
+	gs_shared_image_release(filter->shared_image);
 	obs_leave_graphics();
 
 	bfree(filter);
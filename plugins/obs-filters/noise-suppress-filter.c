@@ -14,6 +14,7 @@
 #endif
 #include <rnnoise.h>
 #include <media-io/audio-resampler.h>
+#include <util/sse-intrin.h>
 #endif
 
 bool nvafx_loaded = false;
@@ -628,43 +629,79 @@ static void *noise_suppress_create(obs_data_t *settings, obs_source_t *filter)
 	return ng;
 }
 
-static inline void process_speexdsp(struct noise_suppress_data *ng)
-{
 #ifdef LIBSPEEXDSP_ENABLED
+/* channels are independent, each one runs as an audio job */
+static void speexdsp_channel_job(void *param, size_t i)
+{
+	struct noise_suppress_data *ng = param;
+	float *copy_buffer = ng->copy_buffers[i];
+	spx_int16_t *segment_buffer = ng->spx_segment_buffers[i];
+
 	/* Set args */
-	for (size_t i = 0; i < ng->channels; i++)
-		speex_preprocess_ctl(ng->spx_states[i],
-				     SPEEX_PREPROCESS_SET_NOISE_SUPPRESS,
-				     &ng->suppress_level);
+	speex_preprocess_ctl(ng->spx_states[i],
+			     SPEEX_PREPROCESS_SET_NOISE_SUPPRESS,
+			     &ng->suppress_level);
 
 	/* Convert to 16bit */
-	for (size_t i = 0; i < ng->channels; i++)
-		for (size_t j = 0; j < ng->frames; j++) {
-			float s = ng->copy_buffers[i][j];
-			if (s > 1.0f)
-				s = 1.0f;
-			else if (s < -1.0f)
-				s = -1.0f;
-			ng->spx_segment_buffers[i][j] =
-				(spx_int16_t)(s * c_32_to_16);
-		}
+	for (size_t j = 0; j < ng->frames; j++) {
+		float s = copy_buffer[j];
+		if (s > 1.0f)
+			s = 1.0f;
+		else if (s < -1.0f)
+			s = -1.0f;
+		segment_buffer[j] = (spx_int16_t)(s * c_32_to_16);
+	}
 
 	/* Execute */
-	for (size_t i = 0; i < ng->channels; i++)
-		speex_preprocess_run(ng->spx_states[i],
-				     ng->spx_segment_buffers[i]);
+	speex_preprocess_run(ng->spx_states[i], segment_buffer);
 
 	/* Convert back to 32bit */
-	for (size_t i = 0; i < ng->channels; i++)
-		for (size_t j = 0; j < ng->frames; j++)
-			ng->copy_buffers[i][j] =
-				(float)ng->spx_segment_buffers[i][j] /
-				c_16_to_32;
+	for (size_t j = 0; j < ng->frames; j++)
+		copy_buffer[j] = (float)segment_buffer[j] / c_16_to_32;
+}
+#endif
+
+static inline void process_speexdsp(struct noise_suppress_data *ng)
+{
+#ifdef LIBSPEEXDSP_ENABLED
+	obs_run_audio_jobs(speexdsp_channel_job, ng, ng->channels);
 #else
 	UNUSED_PARAMETER(ng);
 #endif
 }
 
+#ifdef LIBRNNOISE_ENABLED
+/* Copies the last dst_frames frames of src multiplied by scale, the start of
+ * dst is zeroed if src is shorter */
+static void scale_frames(float *dst, size_t dst_frames, const float *src,
+			 size_t src_frames, float scale)
+{
+	const __m128 s = _mm_set1_ps(scale);
+	size_t i = 0;
+
+	if (src_frames < dst_frames) {
+		i = dst_frames - src_frames;
+		memset(dst, 0, i * sizeof(float));
+		src -= i;
+	} else {
+		src += src_frames - dst_frames;
+	}
+
+	for (; i + 4 <= dst_frames; i += 4)
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(src + i), s));
+	for (; i < dst_frames; i++)
+		dst[i] = src[i] * scale;
+}
+
+static void rnnoise_channel_job(void *param, size_t i)
+{
+	struct noise_suppress_data *ng = param;
+
+	rnnoise_process_frame(ng->rnn_states[i], ng->rnn_segment_buffers[i],
+			      ng->rnn_segment_buffers[i]);
+}
+#endif
+
 static inline void process_rnnoise(struct noise_suppress_data *ng)
 {
 #ifdef LIBRNNOISE_ENABLED
@@ -678,33 +715,19 @@ static inline void process_rnnoise(struct noise_suppress_data *ng)
 					 (const uint8_t **)ng->copy_buffers,
 					 (uint32_t)ng->frames);
 
-		for (size_t i = 0; i < ng->channels; i++) {
-			for (ssize_t j = 0, k = (ssize_t)out_frames -
-						RNNOISE_FRAME_SIZE;
-			     j < RNNOISE_FRAME_SIZE; ++j, ++k) {
-				if (k >= 0) {
-					ng->rnn_segment_buffers[i][j] =
-						output[i][k] * 32768.0f;
-				} else {
-					ng->rnn_segment_buffers[i][j] = 0;
-				}
-			}
-		}
+		for (size_t i = 0; i < ng->channels; i++)
+			scale_frames(ng->rnn_segment_buffers[i],
+				     RNNOISE_FRAME_SIZE, output[i], out_frames,
+				     32768.0f);
 	} else {
-		for (size_t i = 0; i < ng->channels; i++) {
-			for (size_t j = 0; j < RNNOISE_FRAME_SIZE; ++j) {
-				ng->rnn_segment_buffers[i][j] =
-					ng->copy_buffers[i][j] * 32768.0f;
-			}
-		}
+		for (size_t i = 0; i < ng->channels; i++)
+			scale_frames(ng->rnn_segment_buffers[i],
+				     RNNOISE_FRAME_SIZE, ng->copy_buffers[i],
+				     RNNOISE_FRAME_SIZE, 32768.0f);
 	}
 
-	/* Execute */
-	for (size_t i = 0; i < ng->channels; i++) {
-		rnnoise_process_frame(ng->rnn_states[i],
-				      ng->rnn_segment_buffers[i],
-				      ng->rnn_segment_buffers[i]);
-	}
+	/* Execute, one audio job per channel */
+	obs_run_audio_jobs(rnnoise_channel_job, ng, ng->channels);
 
 	/* Revert signal level adjustment, resample back if necessary */
 	if (ng->rnn_resampler) {
@@ -716,26 +739,14 @@ static inline void process_rnnoise(struct noise_suppress_data *ng)
 			&ts_offset, (const uint8_t **)ng->rnn_segment_buffers,
 			RNNOISE_FRAME_SIZE);
 
-		for (size_t i = 0; i < ng->channels; i++) {
-			for (ssize_t j = 0,
-				     k = (ssize_t)out_frames - ng->frames;
-			     j < (ssize_t)ng->frames; ++j, ++k) {
-				if (k >= 0) {
-					ng->copy_buffers[i][j] =
-						output[i][k] / 32768.0f;
-				} else {
-					ng->copy_buffers[i][j] = 0;
-				}
-			}
-		}
+		for (size_t i = 0; i < ng->channels; i++)
+			scale_frames(ng->copy_buffers[i], ng->frames,
+				     output[i], out_frames, 1.0f / 32768.0f);
 	} else {
-		for (size_t i = 0; i < ng->channels; i++) {
-			for (size_t j = 0; j < RNNOISE_FRAME_SIZE; ++j) {
-				ng->copy_buffers[i][j] =
-					ng->rnn_segment_buffers[i][j] /
-					32768.0f;
-			}
-		}
+		for (size_t i = 0; i < ng->channels; i++)
+			scale_frames(ng->copy_buffers[i], RNNOISE_FRAME_SIZE,
+				     ng->rnn_segment_buffers[i],
+				     RNNOISE_FRAME_SIZE, 1.0f / 32768.0f);
 	}
 #else
 	UNUSED_PARAMETER(ng);
@@ -42,6 +42,7 @@
 #include "arch.h"
 #include "rnn.h"
 #include "rnn_data.h"
+#include "rnn_simd.h"
 
 #define FRAME_SIZE_SHIFT 2
 #define FRAME_SIZE (120<<FRAME_SIZE_SHIFT)
@@ -107,6 +108,11 @@ void compute_band_energy(float *bandE, const kiss_fft_cpx *X) {
     int j;
     int band_size;
     band_size = (eband5ms[i+1]-eband5ms[i])<<FRAME_SIZE_SHIFT;
+    if (rnn_simd_get_level() != RNN_SIMD_NONE) {
+      const kiss_fft_cpx *band = &X[eband5ms[i]<<FRAME_SIZE_SHIFT];
+      rnn_band_accum(&sum[i], &sum[i+1], band, band, band_size);
+      continue;
+    }
     for (j=0;j<band_size;j++) {
       float tmp;
       float frac = (float)j/band_size;
@@ -132,6 +138,11 @@ void compute_band_corr(float *bandE, const kiss_fft_cpx *X, const kiss_fft_cpx *
     int j;
     int band_size;
     band_size = (eband5ms[i+1]-eband5ms[i])<<FRAME_SIZE_SHIFT;
+    if (rnn_simd_get_level() != RNN_SIMD_NONE) {
+      rnn_band_accum(&sum[i], &sum[i+1], &X[eband5ms[i]<<FRAME_SIZE_SHIFT],
+                     &P[eband5ms[i]<<FRAME_SIZE_SHIFT], band_size);
+      continue;
+    }
     for (j=0;j<band_size;j++) {
       float tmp;
       float frac = (float)j/band_size;
@@ -260,6 +271,9 @@ int rnnoise_get_size() {
 }
 
 int rnnoise_init(DenoiseState *st, RNNModel *model) {
+  /* initialize the shared tables here instead of on the first frame, the
+     channels of a source may be processed on different threads */
+  check_init();
   memset(st, 0, sizeof(*st));
   if (model)
     st->rnn.model = model;
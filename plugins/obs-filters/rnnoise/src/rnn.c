@@ -36,6 +36,7 @@
 #include "tansig_table.h"
 #include "rnn.h"
 #include "rnn_data.h"
+#include "rnn_simd.h"
 #include <stdio.h>
 
 static OPUS_INLINE float tansig_approx(float x)
@@ -84,13 +85,21 @@ static void compute_dense(const DenseLayer *layer, float *output, const float *i
    M = layer->nb_inputs;
    N = layer->nb_neurons;
    stride = N;
-   for (i=0;i<N;i++)
-   {
-      /* Compute update gate. */
-      float sum = layer->bias[i];
-      for (j=0;j<M;j++)
-         sum += layer->input_weights[j*stride + i]*input[j];
-      output[i] = WEIGHTS_SCALE*sum;
+   if (rnn_simd_get_level() != RNN_SIMD_NONE) {
+      for (i=0;i<N;i++)
+         output[i] = layer->bias[i];
+      rnn_gemv_accum(output, layer->input_weights, N, M, stride, input);
+      for (i=0;i<N;i++)
+         output[i] *= WEIGHTS_SCALE;
+   } else {
+      for (i=0;i<N;i++)
+      {
+         /* Compute update gate. */
+         float sum = layer->bias[i];
+         for (j=0;j<M;j++)
+            sum += layer->input_weights[j*stride + i]*input[j];
+         output[i] = WEIGHTS_SCALE*sum;
+      }
    }
    if (layer->activation == ACTIVATION_SIGMOID) {
       for (i=0;i<N;i++)
@@ -106,6 +115,51 @@ static void compute_dense(const DenseLayer *layer, float *output, const float *i
    }
 }
 
+static float activation(int type, float x)
+{
+   if (type == ACTIVATION_SIGMOID) return sigmoid_approx(x);
+   else if (type == ACTIVATION_TANH) return tansig_approx(x);
+   else if (type == ACTIVATION_RELU) return relu(x);
+   else *(int*)0=0;
+   return 0;
+}
+
+/* Same as compute_gru() with the matrix products done by rnn_gemv_accum().
+   The update and reset gates are next to each other in the weight tables,
+   so they are computed together. */
+static void compute_gru_simd(const GRULayer *gru, float *state, const float *input)
+{
+   int i;
+   int N, M;
+   int stride;
+   float zr[2*MAX_NEURONS];
+   float h[MAX_NEURONS];
+   float reset_state[MAX_NEURONS];
+   float *z = zr;
+   float *r = zr + gru->nb_neurons;
+   M = gru->nb_inputs;
+   N = gru->nb_neurons;
+   stride = 3*N;
+   for (i=0;i<2*N;i++)
+      zr[i] = gru->bias[i];
+   rnn_gemv_accum(zr, gru->input_weights, 2*N, M, stride, input);
+   rnn_gemv_accum(zr, gru->recurrent_weights, 2*N, N, stride, state);
+   for (i=0;i<N;i++)
+   {
+      z[i] = sigmoid_approx(WEIGHTS_SCALE*z[i]);
+      r[i] = sigmoid_approx(WEIGHTS_SCALE*r[i]);
+      reset_state[i] = state[i]*r[i];
+      h[i] = gru->bias[2*N + i];
+   }
+   rnn_gemv_accum(h, gru->input_weights + 2*N, N, M, stride, input);
+   rnn_gemv_accum(h, gru->recurrent_weights + 2*N, N, N, stride, reset_state);
+   for (i=0;i<N;i++)
+   {
+      float sum = activation(gru->activation, WEIGHTS_SCALE*h[i]);
+      state[i] = z[i]*state[i] + (1-z[i])*sum;
+   }
+}
+
 static void compute_gru(const GRULayer *gru, float *state, const float *input)
 {
    int i, j;
@@ -114,6 +168,10 @@ static void compute_gru(const GRULayer *gru, float *state, const float *input)
    float z[MAX_NEURONS];
    float r[MAX_NEURONS];
    float h[MAX_NEURONS];
+   if (rnn_simd_get_level() != RNN_SIMD_NONE) {
+      compute_gru_simd(gru, state, input);
+      return;
+   }
    M = gru->nb_inputs;
    N = gru->nb_neurons;
    stride = 3*N;
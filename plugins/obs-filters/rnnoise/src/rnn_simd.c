@@ -0,0 +1,261 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include "opus_types.h"
+#include "common.h"
+#include "rnn_simd.h"
+
+#if (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || \
+     defined(_M_IX86)) && !defined(_M_ARM64EC)
+#define RNN_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(RNN_X86) && (defined(__GNUC__) || defined(__clang__))
+#define RNN_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define RNN_TARGET_AVX2
+#endif
+
+static int simd_level = -1;
+
+static void gemv_scalar(float *out, const rnn_weight *weights, int rows,
+                        int cols, int stride, const float *x)
+{
+   int i, j;
+   for (i=0;i<rows;i++)
+   {
+      float sum = out[i];
+      for (j=0;j<cols;j++)
+         sum += weights[j*stride + i]*x[j];
+      out[i] = sum;
+   }
+}
+
+static void band_accum_scalar(float *lo, float *hi, const kiss_fft_cpx *X,
+                              const kiss_fft_cpx *P, int band_size)
+{
+   int j;
+   for (j=0;j<band_size;j++) {
+      float frac = (float)j/band_size;
+      float tmp = X[j].r*P[j].r + X[j].i*P[j].i;
+      *lo += (1-frac)*tmp;
+      *hi += frac*tmp;
+   }
+}
+
+#ifdef RNN_X86
+
+/* ------------------------------------------------------------------------ */
+/* SSE2                                                                     */
+
+static OPUS_INLINE __m128 load_weights_sse2(const rnn_weight *w)
+{
+   int v;
+   __m128i b;
+   memcpy(&v, w, sizeof(v));
+   b = _mm_cvtsi32_si128(v);
+   /* sign extend the bytes to 32 bits */
+   b = _mm_unpacklo_epi8(b, b);
+   b = _mm_unpacklo_epi16(b, b);
+   return _mm_cvtepi32_ps(_mm_srai_epi32(b, 24));
+}
+
+/* Every lane sums its inputs in the same order as the scalar code, so the
+   results are identical. */
+static void gemv_sse2(float *out, const rnn_weight *weights, int rows,
+                      int cols, int stride, const float *x)
+{
+   int i = 0, j;
+   for (;i+8<=rows;i+=8)
+   {
+      __m128 acc0 = _mm_loadu_ps(out + i);
+      __m128 acc1 = _mm_loadu_ps(out + i + 4);
+      for (j=0;j<cols;j++)
+      {
+         const rnn_weight *w = weights + j*stride + i;
+         __m128 xj = _mm_set1_ps(x[j]);
+         acc0 = _mm_add_ps(acc0, _mm_mul_ps(load_weights_sse2(w), xj));
+         acc1 = _mm_add_ps(acc1, _mm_mul_ps(load_weights_sse2(w + 4), xj));
+      }
+      _mm_storeu_ps(out + i, acc0);
+      _mm_storeu_ps(out + i + 4, acc1);
+   }
+   for (;i+4<=rows;i+=4)
+   {
+      __m128 acc = _mm_loadu_ps(out + i);
+      for (j=0;j<cols;j++)
+      {
+         __m128 w = load_weights_sse2(weights + j*stride + i);
+         acc = _mm_add_ps(acc, _mm_mul_ps(w, _mm_set1_ps(x[j])));
+      }
+      _mm_storeu_ps(out + i, acc);
+   }
+   if (i < rows)
+      gemv_scalar(out + i, weights + i, rows - i, cols, stride, x);
+}
+
+static OPUS_INLINE float hsum_sse2(__m128 v)
+{
+   v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+   v = _mm_add_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+   return _mm_cvtss_f32(v);
+}
+
+static void band_accum_sse2(float *lo, float *hi, const kiss_fft_cpx *X,
+                            const kiss_fft_cpx *P, int band_size)
+{
+   const __m128 inv_size = _mm_set1_ps(1.f/band_size);
+   __m128 idx = _mm_set_ps(3, 2, 1, 0);
+   __m128 sum_lo = _mm_setzero_ps();
+   __m128 sum_hi = _mm_setzero_ps();
+   int j;
+   for (j=0;j<band_size;j+=4)
+   {
+      /* r0 i0 r1 i1, r2 i2 r3 i3 */
+      __m128 x0 = _mm_loadu_ps(&X[j].r);
+      __m128 x1 = _mm_loadu_ps(&X[j + 2].r);
+      __m128 p0 = _mm_loadu_ps(&P[j].r);
+      __m128 p1 = _mm_loadu_ps(&P[j + 2].r);
+      __m128 m0 = _mm_mul_ps(x0, p0);
+      __m128 m1 = _mm_mul_ps(x1, p1);
+      __m128 tmp = _mm_add_ps(
+            _mm_shuffle_ps(m0, m1, _MM_SHUFFLE(2, 0, 2, 0)),
+            _mm_shuffle_ps(m0, m1, _MM_SHUFFLE(3, 1, 3, 1)));
+      __m128 frac = _mm_mul_ps(idx, inv_size);
+      __m128 hi_part = _mm_mul_ps(frac, tmp);
+      sum_hi = _mm_add_ps(sum_hi, hi_part);
+      sum_lo = _mm_add_ps(sum_lo, _mm_sub_ps(tmp, hi_part));
+      idx = _mm_add_ps(idx, _mm_set1_ps(4));
+   }
+   *lo += hsum_sse2(sum_lo);
+   *hi += hsum_sse2(sum_hi);
+}
+
+/* ------------------------------------------------------------------------ */
+/* AVX2 + FMA                                                               */
+
+static OPUS_INLINE RNN_TARGET_AVX2 __m256
+load_weights_avx2(const rnn_weight *w)
+{
+   __m128i b = _mm_loadl_epi64((const __m128i *)w);
+   return _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(b));
+}
+
+static RNN_TARGET_AVX2 void gemv_avx2(float *out, const rnn_weight *weights,
+                                      int rows, int cols, int stride,
+                                      const float *x)
+{
+   int i = 0, j;
+   for (;i+16<=rows;i+=16)
+   {
+      __m256 acc0 = _mm256_loadu_ps(out + i);
+      __m256 acc1 = _mm256_loadu_ps(out + i + 8);
+      for (j=0;j<cols;j++)
+      {
+         const rnn_weight *w = weights + j*stride + i;
+         __m256 xj = _mm256_set1_ps(x[j]);
+         acc0 = _mm256_fmadd_ps(load_weights_avx2(w), xj, acc0);
+         acc1 = _mm256_fmadd_ps(load_weights_avx2(w + 8), xj, acc1);
+      }
+      _mm256_storeu_ps(out + i, acc0);
+      _mm256_storeu_ps(out + i + 8, acc1);
+   }
+   for (;i+8<=rows;i+=8)
+   {
+      __m256 acc = _mm256_loadu_ps(out + i);
+      for (j=0;j<cols;j++)
+      {
+         __m256 w = load_weights_avx2(weights + j*stride + i);
+         acc = _mm256_fmadd_ps(w, _mm256_set1_ps(x[j]), acc);
+      }
+      _mm256_storeu_ps(out + i, acc);
+   }
+   if (i < rows)
+      gemv_sse2(out + i, weights + i, rows - i, cols, stride, x);
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int detect_level(void)
+{
+   int level = RNN_SIMD_SSE2;
+#if defined(_MSC_VER)
+   int regs[4];
+   __cpuid(regs, 0);
+   if (regs[0] >= 7) {
+      int avx2, fma, osxsave;
+      __cpuid(regs, 1);
+      fma = (regs[2] & (1 << 12)) != 0;
+      osxsave = (regs[2] & (1 << 27)) != 0;
+      __cpuidex(regs, 7, 0);
+      avx2 = (regs[1] & (1 << 5)) != 0;
+      /* the OS has to save the AVX registers as well */
+      if (avx2 && fma && osxsave && (_xgetbv(0) & 6) == 6)
+         level = RNN_SIMD_AVX2;
+   }
+#elif defined(__GNUC__) || defined(__clang__)
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+      level = RNN_SIMD_AVX2;
+#endif
+   return level;
+}
+
+#else
+
+static int detect_level(void)
+{
+   return RNN_SIMD_NONE;
+}
+
+#endif
+
+int rnn_simd_get_level(void)
+{
+   /* racing threads detect the same value */
+   if (simd_level < 0)
+      simd_level = detect_level();
+   return simd_level;
+}
+
+int rnn_simd_set_level(int level)
+{
+   int supported = detect_level();
+   simd_level = level < supported ? level : supported;
+   return simd_level;
+}
+
+void rnn_gemv_accum(float *out, const rnn_weight *weights, int rows,
+                    int cols, int stride, const float *x)
+{
+   switch (rnn_simd_get_level()) {
+#ifdef RNN_X86
+   case RNN_SIMD_AVX2:
+      gemv_avx2(out, weights, rows, cols, stride, x);
+      break;
+   case RNN_SIMD_SSE2:
+      gemv_sse2(out, weights, rows, cols, stride, x);
+      break;
+#endif
+   default:
+      gemv_scalar(out, weights, rows, cols, stride, x);
+   }
+}
+
+void rnn_band_accum(float *lo, float *hi, const kiss_fft_cpx *X,
+                    const kiss_fft_cpx *P, int band_size)
+{
+#ifdef RNN_X86
+   if (rnn_simd_get_level() != RNN_SIMD_NONE) {
+      band_accum_sse2(lo, hi, X, P, band_size);
+      return;
+   }
+#endif
+   band_accum_scalar(lo, hi, X, P, band_size);
+}
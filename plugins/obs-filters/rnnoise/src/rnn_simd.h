@@ -0,0 +1,32 @@
+#ifndef RNN_SIMD_H_
+#define RNN_SIMD_H_
+
+#include "rnn.h"
+#include "kiss_fft.h"
+
+/* Vectorized kernels for the network layers and the band computations.
+   The SIMD level is detected at runtime, RNN_SIMD_NONE runs the original
+   scalar code. */
+
+#define RNN_SIMD_NONE 0
+#define RNN_SIMD_SSE2 1
+#define RNN_SIMD_AVX2 2
+
+/** Returns the SIMD level in use. */
+int rnn_simd_get_level(void);
+
+/** Forces a SIMD level, clamped to what the CPU supports. Returns the level
+    that is used. Meant for tests and benchmarks. */
+int rnn_simd_set_level(int level);
+
+/** out[i] += sum(weights[j*stride + i]*x[j]) for i < rows, j < cols */
+void rnn_gemv_accum(float *out, const rnn_weight *weights, int rows,
+                    int cols, int stride, const float *x);
+
+/** Accumulates X*conj(P) of one band into the current band (weighted by
+    1 - frac) and the next one (weighted by frac). band_size must be a
+    multiple of 4. */
+void rnn_band_accum(float *lo, float *hi, const kiss_fft_cpx *X,
+                    const kiss_fft_cpx *P, int band_size);
+
+#endif
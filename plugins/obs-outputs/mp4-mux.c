@@ -0,0 +1,413 @@
+#include <obs.h>
+#include <util/dstr.h>
+#include <util/array-serializer.h>
+#include "mp4-mux.h"
+
+#define MP4_TIMESCALE 1000
+
+/* trun sample flags */
+#define SAMPLE_FLAGS_SYNC 0x02000000
+#define SAMPLE_FLAGS_NON_SYNC 0x01010000
+
+#define TRUN_DATA_OFFSET 0x000001
+#define TRUN_SAMPLE_DURATION 0x000100
+#define TRUN_SAMPLE_SIZE 0x000200
+#define TRUN_SAMPLE_FLAGS 0x000400
+#define TRUN_SAMPLE_CTO 0x000800
+
+#define TFHD_DEFAULT_BASE_IS_MOOF 0x020000
+
+/* ------------------------------------------------------------------------- */
+/* box helpers                                                               */
+
+static inline size_t box_start(struct serializer *s, const char *type)
+{
+	size_t pos = (size_t)serializer_get_pos(s);
+	s_wb32(s, 0);
+	s_write(s, type, 4);
+	return pos;
+}
+
+static inline size_t full_box_start(struct serializer *s, const char *type,
+				    uint8_t version, uint32_t flags)
+{
+	size_t pos = box_start(s, type);
+	s_w8(s, version);
+	s_wb24(s, flags);
+	return pos;
+}
+
+static inline void patch_wb32(struct array_output_data *out, size_t pos,
+			      uint32_t val)
+{
+	uint8_t *p = out->bytes.array + pos;
+	p[0] = (uint8_t)(val >> 24);
+	p[1] = (uint8_t)(val >> 16);
+	p[2] = (uint8_t)(val >> 8);
+	p[3] = (uint8_t)val;
+}
+
+static inline void box_end(struct array_output_data *out, size_t pos)
+{
+	patch_wb32(out, pos, (uint32_t)(out->bytes.num - pos));
+}
+
+static inline void s_wzero(struct serializer *s, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		s_w8(s, 0);
+}
+
+static void s_matrix(struct serializer *s)
+{
+	s_wb32(s, 0x00010000);
+	s_wb32(s, 0);
+	s_wb32(s, 0);
+	s_wb32(s, 0);
+	s_wb32(s, 0x00010000);
+	s_wb32(s, 0);
+	s_wb32(s, 0);
+	s_wb32(s, 0);
+	s_wb32(s, 0x40000000);
+}
+
+/* ------------------------------------------------------------------------- */
+/* init segment                                                              */
+
+static void write_ftyp(struct serializer *s, struct array_output_data *out)
+{
+	size_t box = box_start(s, "ftyp");
+	s_write(s, "iso6", 4);
+	s_wb32(s, 0);
+	s_write(s, "iso6", 4);
+	s_write(s, "cmfc", 4);
+	s_write(s, "avc1", 4);
+	s_write(s, "mp41", 4);
+	box_end(out, box);
+}
+
+static void write_mvhd(struct serializer *s, struct array_output_data *out,
+		       uint32_t next_track_id)
+{
+	size_t box = full_box_start(s, "mvhd", 0, 0);
+	s_wb32(s, 0); /* creation time */
+	s_wb32(s, 0); /* modification time */
+	s_wb32(s, MP4_TIMESCALE);
+	s_wb32(s, 0); /* duration, unknown for fragmented files */
+	s_wb32(s, 0x00010000);
+	s_wb16(s, 0x0100);
+	s_wzero(s, 10);
+	s_matrix(s);
+	s_wzero(s, 24);
+	s_wb32(s, next_track_id);
+	box_end(out, box);
+}
+
+static void write_tkhd(struct serializer *s, struct array_output_data *out,
+		       struct mp4_track *track)
+{
+	bool video = track->type == OBS_ENCODER_VIDEO;
+	size_t box = full_box_start(s, "tkhd", 0, 0x000003);
+	s_wb32(s, 0);
+	s_wb32(s, 0);
+	s_wb32(s, track->track_id);
+	s_wb32(s, 0);
+	s_wb32(s, 0); /* duration */
+	s_wzero(s, 8);
+	s_wb16(s, 0); /* layer */
+	s_wb16(s, video ? 0 : 1);
+	s_wb16(s, video ? 0 : 0x0100);
+	s_wb16(s, 0);
+	s_matrix(s);
+	s_wb32(s, video ? track->width << 16 : 0);
+	s_wb32(s, video ? track->height << 16 : 0);
+	box_end(out, box);
+}
+
+static void write_mdhd(struct serializer *s, struct array_output_data *out,
+		       struct mp4_track *track)
+{
+	size_t box = full_box_start(s, "mdhd", 0, 0);
+	s_wb32(s, 0);
+	s_wb32(s, 0);
+	s_wb32(s, track->timescale);
+	s_wb32(s, 0);
+	s_wb16(s, 0x55c4); /* "und" */
+	s_wb16(s, 0);
+	box_end(out, box);
+}
+
+static void write_hdlr(struct serializer *s, struct array_output_data *out,
+		       struct mp4_track *track)
+{
+	bool video = track->type == OBS_ENCODER_VIDEO;
+	const char *name = video ? "VideoHandler" : "SoundHandler";
+
+	size_t box = full_box_start(s, "hdlr", 0, 0);
+	s_wb32(s, 0);
+	s_write(s, video ? "vide" : "soun", 4);
+	s_wzero(s, 12);
+	s_write(s, name, strlen(name) + 1);
+	box_end(out, box);
+}
+
+static void write_avc1(struct serializer *s, struct array_output_data *out,
+		       struct mp4_track *track)
+{
+	size_t box = box_start(s, "avc1");
+	s_wzero(s, 6);
+	s_wb16(s, 1); /* data reference index */
+	s_wzero(s, 16);
+	s_wb16(s, (uint16_t)track->width);
+	s_wb16(s, (uint16_t)track->height);
+	s_wb32(s, 0x00480000);
+	s_wb32(s, 0x00480000);
+	s_wb32(s, 0);
+	s_wb16(s, 1); /* frame count */
+	s_wzero(s, 32);
+	s_wb16(s, 0x0018);
+	s_wb16(s, 0xffff);
+
+	size_t avcc = box_start(s, "avcC");
+	s_write(s, track->config, track->config_size);
+	box_end(out, avcc);
+
+	box_end(out, box);
+}
+
+static inline void s_descriptor(struct serializer *s, uint8_t tag, size_t size)
+{
+	s_w8(s, tag);
+	s_w8(s, 0x80 | (uint8_t)((size >> 21) & 0x7f));
+	s_w8(s, 0x80 | (uint8_t)((size >> 14) & 0x7f));
+	s_w8(s, 0x80 | (uint8_t)((size >> 7) & 0x7f));
+	s_w8(s, (uint8_t)(size & 0x7f));
+}
+
+static void write_mp4a(struct serializer *s, struct array_output_data *out,
+		       struct mp4_track *track)
+{
+	size_t dsi_size = track->config_size;
+	size_t dcd_size = 13 + 5 + dsi_size;
+	size_t es_size = 3 + 5 + dcd_size + 5 + 1;
+
+	size_t box = box_start(s, "mp4a");
+	s_wzero(s, 6);
+	s_wb16(s, 1);
+	s_wzero(s, 8);
+	s_wb16(s, (uint16_t)track->channels);
+	s_wb16(s, 16);
+	s_wb32(s, 0);
+	s_wb32(s, track->sample_rate << 16);
+
+	size_t esds = full_box_start(s, "esds", 0, 0);
+	s_descriptor(s, 0x03, es_size);
+	s_wb16(s, (uint16_t)track->track_id);
+	s_w8(s, 0);
+
+	s_descriptor(s, 0x04, dcd_size);
+	s_w8(s, 0x40); /* AAC */
+	s_w8(s, 0x15); /* audio stream */
+	s_wb24(s, 0);
+	s_wb32(s, 0);
+	s_wb32(s, 0);
+
+	s_descriptor(s, 0x05, dsi_size);
+	s_write(s, track->config, dsi_size);
+
+	s_descriptor(s, 0x06, 1);
+	s_w8(s, 0x02);
+	box_end(out, esds);
+
+	box_end(out, box);
+}
+
+static void write_empty_sample_tables(struct serializer *s,
+				      struct array_output_data *out)
+{
+	size_t box;
+
+	box = full_box_start(s, "stts", 0, 0);
+	s_wb32(s, 0);
+	box_end(out, box);
+
+	box = full_box_start(s, "stsc", 0, 0);
+	s_wb32(s, 0);
+	box_end(out, box);
+
+	box = full_box_start(s, "stsz", 0, 0);
+	s_wb32(s, 0);
+	s_wb32(s, 0);
+	box_end(out, box);
+
+	box = full_box_start(s, "stco", 0, 0);
+	s_wb32(s, 0);
+	box_end(out, box);
+}
+
+static void write_minf(struct serializer *s, struct array_output_data *out,
+		       struct mp4_track *track)
+{
+	size_t minf = box_start(s, "minf");
+	size_t box;
+
+	if (track->type == OBS_ENCODER_VIDEO) {
+		box = full_box_start(s, "vmhd", 0, 1);
+		s_wzero(s, 8);
+	} else {
+		box = full_box_start(s, "smhd", 0, 0);
+		s_wzero(s, 4);
+	}
+	box_end(out, box);
+
+	size_t dinf = box_start(s, "dinf");
+	size_t dref = full_box_start(s, "dref", 0, 0);
+	s_wb32(s, 1);
+	box = full_box_start(s, "url ", 0, 1);
+	box_end(out, box);
+	box_end(out, dref);
+	box_end(out, dinf);
+
+	size_t stbl = box_start(s, "stbl");
+	size_t stsd = full_box_start(s, "stsd", 0, 0);
+	s_wb32(s, 1);
+	if (track->type == OBS_ENCODER_VIDEO)
+		write_avc1(s, out, track);
+	else
+		write_mp4a(s, out, track);
+	box_end(out, stsd);
+	write_empty_sample_tables(s, out);
+	box_end(out, stbl);
+
+	box_end(out, minf);
+}
+
+static void write_trak(struct serializer *s, struct array_output_data *out,
+		       struct mp4_track *track)
+{
+	size_t trak = box_start(s, "trak");
+	write_tkhd(s, out, track);
+
+	size_t mdia = box_start(s, "mdia");
+	write_mdhd(s, out, track);
+	write_hdlr(s, out, track);
+	write_minf(s, out, track);
+	box_end(out, mdia);
+
+	box_end(out, trak);
+}
+
+static void write_mvex(struct serializer *s, struct array_output_data *out,
+		       struct mp4_track *tracks, size_t num_tracks)
+{
+	size_t mvex = box_start(s, "mvex");
+
+	for (size_t i = 0; i < num_tracks; i++) {
+		size_t trex = full_box_start(s, "trex", 0, 0);
+		s_wb32(s, tracks[i].track_id);
+		s_wb32(s, 1);
+		s_wb32(s, 0);
+		s_wb32(s, 0);
+		s_wb32(s, 0);
+		box_end(out, trex);
+	}
+
+	box_end(out, mvex);
+}
+
+void mp4_write_init_segment(struct serializer *s, struct array_output_data *out,
+			    struct mp4_track *tracks, size_t num_tracks)
+{
+	write_ftyp(s, out);
+
+	size_t moov = box_start(s, "moov");
+	write_mvhd(s, out, (uint32_t)num_tracks + 1);
+	for (size_t i = 0; i < num_tracks; i++)
+		write_trak(s, out, &tracks[i]);
+	write_mvex(s, out, tracks, num_tracks);
+	box_end(out, moov);
+}
+
+/* ------------------------------------------------------------------------- */
+/* fragments                                                                 */
+
+static size_t write_traf(struct serializer *s, struct array_output_data *out,
+			 struct mp4_track *track)
+{
+	bool video = track->type == OBS_ENCODER_VIDEO;
+	uint32_t trun_flags = TRUN_DATA_OFFSET | TRUN_SAMPLE_DURATION |
+			      TRUN_SAMPLE_SIZE;
+	size_t data_offset_pos;
+
+	if (video)
+		trun_flags |= TRUN_SAMPLE_FLAGS | TRUN_SAMPLE_CTO;
+
+	size_t traf = box_start(s, "traf");
+
+	size_t box = full_box_start(s, "tfhd", 0, TFHD_DEFAULT_BASE_IS_MOOF);
+	s_wb32(s, track->track_id);
+	box_end(out, box);
+
+	box = full_box_start(s, "tfdt", 1, 0);
+	s_wb64(s, (uint64_t)track->frag_start_dts);
+	box_end(out, box);
+
+	box = full_box_start(s, "trun", 1, trun_flags);
+	s_wb32(s, (uint32_t)track->samples.num);
+	data_offset_pos = out->bytes.num;
+	s_wb32(s, 0);
+
+	for (size_t i = 0; i < track->samples.num; i++) {
+		struct mp4_sample *sample = &track->samples.array[i];
+
+		s_wb32(s, sample->duration);
+		s_wb32(s, sample->size);
+		if (video) {
+			s_wb32(s, sample->keyframe ? SAMPLE_FLAGS_SYNC
+						   : SAMPLE_FLAGS_NON_SYNC);
+			s_wb32(s, (uint32_t)sample->cto);
+		}
+	}
+	box_end(out, box);
+
+	box_end(out, traf);
+	return data_offset_pos;
+}
+
+void mp4_write_fragment(struct serializer *s, struct array_output_data *out,
+			uint32_t sequence, struct mp4_track *tracks,
+			size_t num_tracks)
+{
+	size_t offset_pos[MAX_AUDIO_MIXES + 1];
+	size_t moof_start = out->bytes.num;
+	size_t data_offset;
+	size_t box;
+
+	size_t moof = box_start(s, "moof");
+
+	box = full_box_start(s, "mfhd", 0, 0);
+	s_wb32(s, sequence);
+	box_end(out, box);
+
+	for (size_t i = 0; i < num_tracks; i++) {
+		if (tracks[i].samples.num)
+			offset_pos[i] = write_traf(s, out, &tracks[i]);
+	}
+
+	box_end(out, moof);
+
+	/* trun data offsets are relative to the start of the moof box */
+	data_offset = out->bytes.num - moof_start + 8;
+	for (size_t i = 0; i < num_tracks; i++) {
+		if (!tracks[i].samples.num)
+			continue;
+
+		patch_wb32(out, offset_pos[i], (uint32_t)data_offset);
+		data_offset += tracks[i].data.num;
+	}
+
+	size_t mdat = box_start(s, "mdat");
+	for (size_t i = 0; i < num_tracks; i++)
+		s_write(s, tracks[i].data.array, tracks[i].data.num);
+	box_end(out, mdat);
+}
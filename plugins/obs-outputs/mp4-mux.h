@@ -0,0 +1,48 @@
+#pragma once
+
+#include <obs.h>
+#include <util/array-serializer.h>
+
+/*
+ * Fragmented MP4 (ISO BMFF / CMAF) muxing helpers.
+ *
+ * The file consists of an init segment (ftyp + moov with empty sample
+ * tables) followed by self-contained moof + mdat fragments, so everything
+ * that has been written before a crash stays playable.
+ */
+
+struct mp4_sample {
+	uint32_t size;
+	uint32_t duration;
+	int32_t cto;
+	bool keyframe;
+};
+
+struct mp4_track {
+	enum obs_encoder_type type;
+	uint32_t track_id;
+	uint32_t timescale;
+
+	/* codec configuration (avcC record / AudioSpecificConfig) */
+	uint8_t *config;
+	size_t config_size;
+
+	uint32_t default_duration;
+	uint32_t width;
+	uint32_t height;
+	uint32_t channels;
+	uint32_t sample_rate;
+
+	/* samples of the fragment currently being built */
+	DARRAY(struct mp4_sample) samples;
+	DARRAY(uint8_t) data;
+	int64_t frag_start_dts;
+	int64_t last_dts;
+};
+
+extern void mp4_write_init_segment(struct serializer *s,
+				   struct array_output_data *out,
+				   struct mp4_track *tracks, size_t num_tracks);
+extern void mp4_write_fragment(struct serializer *s,
+			       struct array_output_data *out, uint32_t sequence,
+			       struct mp4_track *tracks, size_t num_tracks);
@@ -0,0 +1,501 @@
+#include <stdio.h>
+#include <obs-module.h>
+#include <obs-avc.h>
+#include <util/platform.h>
+#include <util/dstr.h>
+#include <util/threading.h>
+#include <util/util_uint64.h>
+#include <inttypes.h>
+#include "mp4-mux.h"
+
+#define do_log(level, format, ...)                \
+	blog(level, "[mp4 output: '%s'] " format, \
+	     obs_output_get_name(stream->output), ##__VA_ARGS__)
+
+#define warn(format, ...) do_log(LOG_WARNING, format, ##__VA_ARGS__)
+#define info(format, ...) do_log(LOG_INFO, format, ##__VA_ARGS__)
+
+#define OPT_PATH "path"
+#define OPT_FRAGMENT_DURATION_MS "fragment_duration_ms"
+
+/* initial size of the reusable fragment buffer, grows if needed */
+#define FRAGMENT_BUFFER_SIZE (4 * 1024 * 1024)
+
+struct mp4_output {
+	obs_output_t *output;
+	struct dstr path;
+	FILE *file;
+	volatile bool active;
+	volatile bool stopping;
+	uint64_t stop_ts;
+	bool sent_headers;
+
+	pthread_mutex_t mutex;
+
+	struct mp4_track tracks[MAX_AUDIO_MIXES + 1];
+	size_t num_tracks;
+
+	bool got_first_video;
+	int64_t start_dts_usec;
+
+	int64_t fragment_duration_usec;
+	uint32_t sequence;
+
+	/* preallocated once per recording and reused for every fragment */
+	struct serializer s;
+	struct array_output_data buf;
+
+	uint64_t total_bytes;
+	uint64_t mux_time_ns;
+};
+
+static inline bool stopping(struct mp4_output *stream)
+{
+	return os_atomic_load_bool(&stream->stopping);
+}
+
+static inline bool active(struct mp4_output *stream)
+{
+	return os_atomic_load_bool(&stream->active);
+}
+
+static const char *mp4_output_getname(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return obs_module_text("MP4Output");
+}
+
+static void free_tracks(struct mp4_output *stream)
+{
+	for (size_t i = 0; i < stream->num_tracks; i++) {
+		struct mp4_track *track = &stream->tracks[i];
+		bfree(track->config);
+		da_free(track->samples);
+		da_free(track->data);
+	}
+
+	memset(stream->tracks, 0, sizeof(stream->tracks));
+	stream->num_tracks = 0;
+}
+
+static void *mp4_output_create(obs_data_t *settings, obs_output_t *output)
+{
+	struct mp4_output *stream = bzalloc(sizeof(struct mp4_output));
+	stream->output = output;
+	pthread_mutex_init(&stream->mutex, NULL);
+	array_output_serializer_init(&stream->s, &stream->buf);
+
+	UNUSED_PARAMETER(settings);
+	return stream;
+}
+
+static bool write_buffer(struct mp4_output *stream)
+{
+	size_t size = stream->buf.bytes.num;
+	size_t written =
+		fwrite(stream->buf.bytes.array, 1, size, stream->file);
+
+	/* push each fragment to the OS right away so that a crash loses
+	 * at most the fragment that is currently being built */
+	if (written == size && fflush(stream->file) != 0)
+		written = 0;
+
+	stream->total_bytes += written;
+	stream->buf.bytes.num = 0;
+
+	if (written != size) {
+		warn("Failed to write %zu bytes to '%s'", size,
+		     stream->path.array);
+		return false;
+	}
+	return true;
+}
+
+static bool init_tracks(struct mp4_output *stream)
+{
+	obs_output_t *context = stream->output;
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(context);
+	const struct video_output_info *voi =
+		video_output_get_info(obs_encoder_video(vencoder));
+	struct mp4_track *track = &stream->tracks[0];
+	uint8_t *header;
+	size_t size;
+
+	if (!obs_encoder_get_extra_data(vencoder, &header, &size))
+		return false;
+
+	track->type = OBS_ENCODER_VIDEO;
+	track->track_id = 1;
+	track->timescale = voi->fps_num;
+	track->default_duration = voi->fps_den;
+	track->width = obs_encoder_get_width(vencoder);
+	track->height = obs_encoder_get_height(vencoder);
+	track->config_size = obs_parse_avc_header(&track->config, header, size);
+	stream->num_tracks = 1;
+
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+		obs_encoder_t *aencoder = obs_output_get_audio_encoder(context,
+								       i);
+		if (!aencoder)
+			break;
+		if (!obs_encoder_get_extra_data(aencoder, &header, &size))
+			return false;
+
+		track = &stream->tracks[stream->num_tracks++];
+		track->type = OBS_ENCODER_AUDIO;
+		track->track_id = (uint32_t)stream->num_tracks;
+		track->sample_rate = obs_encoder_get_sample_rate(aencoder);
+		track->timescale = track->sample_rate;
+		track->default_duration =
+			(uint32_t)obs_encoder_get_frame_size(aencoder);
+		track->channels = (uint32_t)audio_output_get_channels(
+			obs_encoder_audio(aencoder));
+		track->config = bmemdup(header, size);
+		track->config_size = size;
+	}
+
+	return true;
+}
+
+static bool write_headers(struct mp4_output *stream)
+{
+	if (!init_tracks(stream)) {
+		warn("Failed to get encoder headers");
+		return false;
+	}
+
+	mp4_write_init_segment(&stream->s, &stream->buf, stream->tracks,
+			       stream->num_tracks);
+	return write_buffer(stream);
+}
+
+/* the samples are dropped even if the write fails, the output is stopped
+ * with an error in that case */
+static bool flush_fragment(struct mp4_output *stream)
+{
+	bool success;
+	bool has_samples = false;
+	uint64_t start = os_gettime_ns();
+
+	for (size_t i = 0; i < stream->num_tracks; i++) {
+		if (stream->tracks[i].samples.num) {
+			has_samples = true;
+			break;
+		}
+	}
+
+	if (!has_samples)
+		return true;
+
+	mp4_write_fragment(&stream->s, &stream->buf, ++stream->sequence,
+			   stream->tracks, stream->num_tracks);
+	success = write_buffer(stream);
+
+	for (size_t i = 0; i < stream->num_tracks; i++) {
+		da_resize(stream->tracks[i].samples, 0);
+		da_resize(stream->tracks[i].data, 0);
+	}
+
+	stream->mux_time_ns += os_gettime_ns() - start;
+	return success;
+}
+
+/* writes the pending fragment and closes the file, the file is closed even
+ * if the fragment can't be written */
+static bool close_file(struct mp4_output *stream)
+{
+	bool success = true;
+
+	if (!stream->file)
+		return true;
+
+	if (stream->sent_headers)
+		success = flush_fragment(stream);
+
+	fclose(stream->file);
+	stream->file = NULL;
+	return success;
+}
+
+static void mp4_output_destroy(void *data)
+{
+	struct mp4_output *stream = data;
+
+	/* destroyed while still recording, keep what was captured so far */
+	pthread_mutex_lock(&stream->mutex);
+	if (active(stream)) {
+		os_atomic_set_bool(&stream->active, false);
+		close_file(stream);
+	}
+	pthread_mutex_unlock(&stream->mutex);
+
+	free_tracks(stream);
+	array_output_serializer_free(&stream->buf);
+	pthread_mutex_destroy(&stream->mutex);
+	dstr_free(&stream->path);
+	bfree(stream);
+}
+
+static inline int64_t rescale_ts(struct encoder_packet *packet, int64_t val,
+				 uint32_t timescale)
+{
+	int64_t scaled = (int64_t)util_mul_div64(
+		(uint64_t)llabs(val) * (uint64_t)packet->timebase_num,
+		timescale, (uint64_t)packet->timebase_den);
+	return val < 0 ? -scaled : scaled;
+}
+
+/* decode time in track timescale, relative to the first video frame */
+static inline int64_t track_dts(struct mp4_output *stream,
+				struct mp4_track *track,
+				struct encoder_packet *packet)
+{
+	int64_t dts = rescale_ts(packet, packet->dts, track->timescale) -
+		      (int64_t)util_mul_div64((uint64_t)stream->start_dts_usec,
+					      track->timescale, 1000000);
+
+	/* the first frame can land a tick early from rounding */
+	return dts < 0 ? 0 : dts;
+}
+
+static inline struct mp4_track *get_track(struct mp4_output *stream,
+					  struct encoder_packet *packet)
+{
+	size_t idx = packet->type == OBS_ENCODER_VIDEO ? 0
+						       : packet->track_idx + 1;
+	return idx < stream->num_tracks ? &stream->tracks[idx] : NULL;
+}
+
+static bool fragment_full(struct mp4_output *stream,
+			  struct encoder_packet *packet)
+{
+	struct mp4_track *video = &stream->tracks[0];
+	int64_t duration_usec;
+
+	if (!video->samples.num)
+		return false;
+
+	duration_usec = (int64_t)util_mul_div64(
+		(uint64_t)(video->last_dts - video->frag_start_dts), 1000000,
+		video->timescale);
+
+	/* cut on keyframes only so every fragment is independently
+	 * decodable, a long GOP makes the fragment longer */
+	return packet->keyframe &&
+	       duration_usec >= stream->fragment_duration_usec;
+}
+
+static void add_sample(struct mp4_output *stream, struct mp4_track *track,
+		       struct encoder_packet *packet)
+{
+	int64_t dts = track_dts(stream, track, packet);
+	struct mp4_sample *sample;
+
+	/* set the duration of the previous sample now that it's known */
+	if (track->samples.num) {
+		struct mp4_sample *last = da_end(track->samples);
+		if (dts > track->last_dts)
+			last->duration = (uint32_t)(dts - track->last_dts);
+	} else {
+		track->frag_start_dts = dts;
+	}
+
+	sample = da_push_back_new(track->samples);
+	sample->size = (uint32_t)packet->size;
+	sample->duration = track->default_duration;
+	sample->cto = (int32_t)rescale_ts(packet, packet->pts - packet->dts,
+					  track->timescale);
+	sample->keyframe = packet->keyframe;
+
+	da_push_back_array(track->data, packet->data, packet->size);
+	track->last_dts = dts;
+}
+
+static bool mp4_output_start(void *data)
+{
+	struct mp4_output *stream = data;
+	obs_data_t *settings;
+	const char *path;
+
+	if (!obs_output_can_begin_data_capture(stream->output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(stream->output, 0))
+		return false;
+
+	stream->got_first_video = false;
+	stream->sent_headers = false;
+	stream->sequence = 0;
+	stream->total_bytes = 0;
+	stream->mux_time_ns = 0;
+	os_atomic_set_bool(&stream->stopping, false);
+	free_tracks(stream);
+
+	settings = obs_output_get_settings(stream->output);
+	path = obs_data_get_string(settings, OPT_PATH);
+	dstr_copy(&stream->path, path);
+	stream->fragment_duration_usec =
+		obs_data_get_int(settings, OPT_FRAGMENT_DURATION_MS) * 1000;
+	obs_data_release(settings);
+
+	stream->file = os_fopen(stream->path.array, "wb");
+	if (!stream->file) {
+		warn("Unable to open MP4 file '%s'", stream->path.array);
+		return false;
+	}
+
+	/* fragments are written with a single fwrite each, so stdio
+	 * buffering would only add another copy */
+	setvbuf(stream->file, NULL, _IONBF, 0);
+	da_reserve(stream->buf.bytes, FRAGMENT_BUFFER_SIZE);
+
+	os_atomic_set_bool(&stream->active, true);
+	obs_output_begin_data_capture(stream->output, 0);
+
+	info("Writing fragmented MP4 file '%s'...", stream->path.array);
+	return true;
+}
+
+static void mp4_output_stop(void *data, uint64_t ts)
+{
+	struct mp4_output *stream = data;
+	stream->stop_ts = ts / 1000;
+	os_atomic_set_bool(&stream->stopping, true);
+}
+
+static void mp4_output_actual_stop(struct mp4_output *stream, int code)
+{
+	os_atomic_set_bool(&stream->active, false);
+
+	if (!close_file(stream) && !code)
+		code = OBS_OUTPUT_ERROR;
+
+	if (code) {
+		obs_output_signal_stop(stream->output, code);
+	} else {
+		obs_output_end_data_capture(stream->output);
+	}
+
+	info("MP4 file output complete: %u fragments, %" PRIu64
+	     " bytes written, %.3f ms spent muxing",
+	     stream->sequence, stream->total_bytes,
+	     (double)stream->mux_time_ns / 1000000.0);
+}
+
+static void mp4_output_data(void *data, struct encoder_packet *packet)
+{
+	struct mp4_output *stream = data;
+	struct encoder_packet parsed_packet;
+	struct mp4_track *track;
+
+	pthread_mutex_lock(&stream->mutex);
+
+	if (!active(stream))
+		goto unlock;
+
+	if (!packet) {
+		mp4_output_actual_stop(stream, OBS_OUTPUT_ENCODE_ERROR);
+		goto unlock;
+	}
+
+	if (stopping(stream)) {
+		if (packet->sys_dts_usec >= (int64_t)stream->stop_ts) {
+			mp4_output_actual_stop(stream, 0);
+			goto unlock;
+		}
+	}
+
+	if (!stream->sent_headers) {
+		if (!write_headers(stream)) {
+			mp4_output_actual_stop(stream, OBS_OUTPUT_ERROR);
+			goto unlock;
+		}
+		stream->sent_headers = true;
+	}
+
+	if (packet->type == OBS_ENCODER_VIDEO) {
+		if (!stream->got_first_video) {
+			stream->start_dts_usec = packet->dts_usec;
+			stream->got_first_video = true;
+		}
+	} else if (!stream->got_first_video ||
+		   packet->dts_usec < stream->start_dts_usec) {
+		/* fragments can't start before the first video frame */
+		goto unlock;
+	}
+
+	track = get_track(stream, packet);
+	if (!track)
+		goto unlock;
+
+	if (packet->type == OBS_ENCODER_VIDEO) {
+		obs_parse_avc_packet(&parsed_packet, packet);
+
+		if (fragment_full(stream, &parsed_packet)) {
+			/* close the last video sample with the real duration
+			 * before the fragment is written out */
+			struct mp4_sample *last = da_end(track->samples);
+			int64_t dts =
+				track_dts(stream, track, &parsed_packet);
+			if (dts > track->last_dts)
+				last->duration =
+					(uint32_t)(dts - track->last_dts);
+
+			if (!flush_fragment(stream)) {
+				obs_encoder_packet_release(&parsed_packet);
+				mp4_output_actual_stop(stream,
+						       OBS_OUTPUT_ERROR);
+				goto unlock;
+			}
+		}
+
+		add_sample(stream, track, &parsed_packet);
+		obs_encoder_packet_release(&parsed_packet);
+	} else {
+		add_sample(stream, track, packet);
+	}
+
+unlock:
+	pthread_mutex_unlock(&stream->mutex);
+}
+
+static void mp4_output_defaults(obs_data_t *defaults)
+{
+	obs_data_set_default_int(defaults, OPT_FRAGMENT_DURATION_MS, 2000);
+}
+
+static obs_properties_t *mp4_output_properties(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+
+	obs_properties_t *props = obs_properties_create();
+
+	obs_properties_add_text(props, OPT_PATH,
+				obs_module_text("MP4Output.FilePath"),
+				OBS_TEXT_DEFAULT);
+	obs_properties_add_int(props, OPT_FRAGMENT_DURATION_MS,
+			       obs_module_text("MP4Output.FragmentDuration"),
+			       100, 10000, 100);
+	return props;
+}
+
+static uint64_t mp4_output_total_bytes(void *data)
+{
+	struct mp4_output *stream = data;
+	return stream->total_bytes;
+}
+
+struct obs_output_info mp4_output_info = {
+	.id = "mp4_output",
+	.flags = OBS_OUTPUT_AV | OBS_OUTPUT_ENCODED | OBS_OUTPUT_MULTI_TRACK,
+	.encoded_video_codecs = "h264",
+	.encoded_audio_codecs = "aac",
+	.get_name = mp4_output_getname,
+	.create = mp4_output_create,
+	.destroy = mp4_output_destroy,
+	.start = mp4_output_start,
+	.stop = mp4_output_stop,
+	.encoded_packet = mp4_output_data,
+	.get_defaults = mp4_output_defaults,
+	.get_properties = mp4_output_properties,
+	.get_total_bytes = mp4_output_total_bytes,
+};
@@ -0,0 +1,1062 @@
+/*
+ * Multi-destination RTMP output.
+ *
+ * Every encoder packet is serialized to an FLV tag exactly once.  The tag is
+ * reference counted and handed to each destination's queue, and every
+ * destination has its own connection, send thread and frame dropping state,
+ * so a slow endpoint only drops its own frames and never stalls the others.
+ */
+
+#include <obs-module.h>
+#include <obs-avc.h>
+#include <util/platform.h>
+#include <util/array-serializer.h>
+#include <util/circlebuf.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/threading.h>
+#include <inttypes.h>
+#include "librtmp/rtmp.h"
+#include "librtmp/log.h"
+#include "flv-mux.h"
+#include "net-if.h"
+
+#define do_log(level, format, ...)                       \
+	blog(level, "[rtmp multi stream: '%s'] " format, \
+	     obs_output_get_name(stream->output), ##__VA_ARGS__)
+
+#define warn(format, ...) do_log(LOG_WARNING, format, ##__VA_ARGS__)
+#define info(format, ...) do_log(LOG_INFO, format, ##__VA_ARGS__)
+#define debug(format, ...) do_log(LOG_DEBUG, format, ##__VA_ARGS__)
+
+#define dest_log(level, format, ...)                               \
+	blog(level, "[rtmp multi stream: '%s' #%d] " format,       \
+	     obs_output_get_name(dest->stream->output), (int)dest->idx, \
+	     ##__VA_ARGS__)
+
+#define OPT_DESTINATIONS "destinations"
+#define OPT_DEST_SERVER "server"
+#define OPT_DEST_KEY "key"
+#define OPT_DEST_USERNAME "username"
+#define OPT_DEST_PASSWORD "password"
+#define OPT_DROP_THRESHOLD "drop_threshold_ms"
+#define OPT_PFRAME_DROP_THRESHOLD "pframe_drop_threshold_ms"
+#define OPT_MAX_SHUTDOWN_TIME_SEC "max_shutdown_time_sec"
+#define OPT_BIND_IP "bind_ip"
+
+/* ------------------------------------------------------------------------- */
+/* shared FLV tags                                                           */
+
+struct flv_tag {
+	volatile long refs;
+
+	uint8_t *data;
+	size_t size;
+
+	bool is_header;
+	enum obs_encoder_type type;
+	int drop_priority;
+	int64_t dts_usec;
+	int64_t sys_dts_usec;
+};
+
+static struct flv_tag *flv_tag_create(uint8_t *data, size_t size)
+{
+	struct flv_tag *tag = bzalloc(sizeof(struct flv_tag));
+	tag->refs = 1;
+	tag->data = data;
+	tag->size = size;
+	return tag;
+}
+
+static inline struct flv_tag *flv_tag_addref(struct flv_tag *tag)
+{
+	os_atomic_inc_long(&tag->refs);
+	return tag;
+}
+
+static inline void flv_tag_release(struct flv_tag *tag)
+{
+	if (tag && os_atomic_dec_long(&tag->refs) == 0) {
+		bfree(tag->data);
+		bfree(tag);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* destinations                                                              */
+
+struct rtmp_multi_stream;
+
+struct rtmp_dest {
+	struct rtmp_multi_stream *stream;
+	size_t idx;
+
+	RTMP rtmp;
+	struct dstr path, key;
+	struct dstr username, password;
+
+	pthread_mutex_t tags_mutex;
+	struct circlebuf tags;
+	os_sem_t *send_sem;
+
+	pthread_t send_thread;
+	bool send_thread_active;
+
+	volatile bool connected;
+	volatile bool failed;
+
+	/* frame drop variables, tracked per destination */
+	int64_t last_dts_usec;
+	int min_priority;
+	float congestion;
+
+	/* read by the stats getters from other threads, total_bytes_sent is
+	 * protected by tags_mutex as there are no 64-bit atomics */
+	volatile long dropped_frames;
+	uint64_t total_bytes_sent;
+};
+
+struct rtmp_multi_stream {
+	obs_output_t *output;
+
+	/* rebuilt by the connect thread, dests_mutex protects the array
+	 * against the stats getters */
+	pthread_mutex_t dests_mutex;
+	DARRAY(struct rtmp_dest *) dests;
+	volatile long active_dests;
+
+	bool got_first_video;
+	int32_t start_dts_offset;
+	struct flv_tag *headers;
+
+	volatile bool connecting;
+	pthread_t connect_thread;
+
+	volatile bool active;
+	volatile bool encode_error;
+
+	int max_shutdown_time_sec;
+	os_event_t *stop_event;
+	uint64_t stop_ts;
+	uint64_t shutdown_timeout_ts;
+
+	struct dstr encoder_name;
+	struct dstr bind_ip;
+
+	int64_t drop_threshold_usec;
+	int64_t pframe_drop_threshold_usec;
+};
+
+static const char *rtmp_multi_stream_getname(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return obs_module_text("RTMPMultiStream");
+}
+
+static void log_rtmp(int level, const char *format, va_list args)
+{
+	if (level > RTMP_LOGWARNING)
+		return;
+
+	blogva(LOG_INFO, format, args);
+}
+
+static inline bool stopping(struct rtmp_multi_stream *stream)
+{
+	return os_event_try(stream->stop_event) != EAGAIN;
+}
+
+static inline bool connecting(struct rtmp_multi_stream *stream)
+{
+	return os_atomic_load_bool(&stream->connecting);
+}
+
+static inline bool active(struct rtmp_multi_stream *stream)
+{
+	return os_atomic_load_bool(&stream->active);
+}
+
+static inline size_t num_buffered_tags(struct rtmp_dest *dest)
+{
+	return dest->tags.size / sizeof(struct flv_tag *);
+}
+
+static void dest_free_tags(struct rtmp_dest *dest)
+{
+	pthread_mutex_lock(&dest->tags_mutex);
+	while (dest->tags.size) {
+		struct flv_tag *tag;
+		circlebuf_pop_front(&dest->tags, &tag, sizeof(tag));
+		flv_tag_release(tag);
+	}
+	pthread_mutex_unlock(&dest->tags_mutex);
+}
+
+static void dest_destroy(struct rtmp_dest *dest)
+{
+	if (!dest)
+		return;
+
+	RTMP_TLS_Free(&dest->rtmp);
+	dest_free_tags(dest);
+	circlebuf_free(&dest->tags);
+	pthread_mutex_destroy(&dest->tags_mutex);
+	os_sem_destroy(dest->send_sem);
+	dstr_free(&dest->path);
+	dstr_free(&dest->key);
+	dstr_free(&dest->username);
+	dstr_free(&dest->password);
+	bfree(dest);
+}
+
+static struct rtmp_dest *dest_create(struct rtmp_multi_stream *stream,
+				     const char *url, const char *key,
+				     const char *username, const char *password)
+{
+	struct rtmp_dest *dest = bzalloc(sizeof(struct rtmp_dest));
+	dest->stream = stream;
+	dest->idx = stream->dests.num;
+	pthread_mutex_init_value(&dest->tags_mutex);
+
+	RTMP_Init(&dest->rtmp);
+
+	if (pthread_mutex_init(&dest->tags_mutex, NULL) != 0)
+		goto fail;
+	if (os_sem_init(&dest->send_sem, 0) != 0)
+		goto fail;
+
+	dstr_copy(&dest->path, url);
+	dstr_copy(&dest->key, key);
+	dstr_copy(&dest->username, username);
+	dstr_copy(&dest->password, password);
+	dstr_depad(&dest->path);
+	dstr_depad(&dest->key);
+	return dest;
+
+fail:
+	dest_destroy(dest);
+	return NULL;
+}
+
+static void join_dests(struct rtmp_multi_stream *stream)
+{
+	for (size_t i = 0; i < stream->dests.num; i++) {
+		struct rtmp_dest *dest = stream->dests.array[i];
+		if (dest->send_thread_active) {
+			os_sem_post(dest->send_sem);
+			pthread_join(dest->send_thread, NULL);
+			dest->send_thread_active = false;
+		}
+	}
+}
+
+static void free_dests(struct rtmp_multi_stream *stream)
+{
+	DARRAY(struct rtmp_dest *) dests;
+
+	join_dests(stream);
+
+	pthread_mutex_lock(&stream->dests_mutex);
+	da_move(dests, stream->dests);
+	pthread_mutex_unlock(&stream->dests_mutex);
+
+	for (size_t i = 0; i < dests.num; i++)
+		dest_destroy(dests.array[i]);
+	da_free(dests);
+
+	flv_tag_release(stream->headers);
+	stream->headers = NULL;
+}
+
+static void rtmp_multi_stream_destroy(void *data)
+{
+	struct rtmp_multi_stream *stream = data;
+
+	if (connecting(stream))
+		pthread_join(stream->connect_thread, NULL);
+
+	stream->stop_ts = 0;
+	os_event_signal(stream->stop_event);
+
+	free_dests(stream);
+	dstr_free(&stream->encoder_name);
+	dstr_free(&stream->bind_ip);
+	os_event_destroy(stream->stop_event);
+	pthread_mutex_destroy(&stream->dests_mutex);
+	bfree(stream);
+}
+
+static void *rtmp_multi_stream_create(obs_data_t *settings,
+				      obs_output_t *output)
+{
+	struct rtmp_multi_stream *stream =
+		bzalloc(sizeof(struct rtmp_multi_stream));
+	stream->output = output;
+	pthread_mutex_init_value(&stream->dests_mutex);
+
+	RTMP_LogSetCallback(log_rtmp);
+	RTMP_LogSetLevel(RTMP_LOGWARNING);
+
+	if (pthread_mutex_init(&stream->dests_mutex, NULL) != 0)
+		goto fail;
+	if (os_event_init(&stream->stop_event, OS_EVENT_TYPE_MANUAL) != 0)
+		goto fail;
+
+	UNUSED_PARAMETER(settings);
+	return stream;
+
+fail:
+	rtmp_multi_stream_destroy(stream);
+	return NULL;
+}
+
+static void rtmp_multi_stream_stop(void *data, uint64_t ts)
+{
+	struct rtmp_multi_stream *stream = data;
+
+	if (stopping(stream) && ts != 0)
+		return;
+
+	if (connecting(stream))
+		pthread_join(stream->connect_thread, NULL);
+
+	stream->stop_ts = ts / 1000ULL;
+
+	if (ts)
+		stream->shutdown_timeout_ts =
+			ts +
+			(uint64_t)stream->max_shutdown_time_sec * 1000000000ULL;
+
+	if (active(stream)) {
+		os_event_signal(stream->stop_event);
+		for (size_t i = 0; i < stream->dests.num; i++)
+			os_sem_post(stream->dests.array[i]->send_sem);
+	} else {
+		obs_output_signal_stop(stream->output, OBS_OUTPUT_SUCCESS);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* send thread (one per destination)                                         */
+
+static inline bool get_next_tag(struct rtmp_dest *dest, struct flv_tag **tag)
+{
+	bool new_tag = false;
+
+	pthread_mutex_lock(&dest->tags_mutex);
+	if (dest->tags.size) {
+		circlebuf_pop_front(&dest->tags, tag, sizeof(*tag));
+		new_tag = true;
+	}
+	pthread_mutex_unlock(&dest->tags_mutex);
+
+	return new_tag;
+}
+
+static inline bool can_shutdown_stream(struct rtmp_multi_stream *stream,
+				       struct flv_tag *tag)
+{
+	uint64_t cur_time = os_gettime_ns();
+	bool timeout = cur_time >= stream->shutdown_timeout_ts;
+
+	if (timeout)
+		info("Stream shutdown timeout reached (%d second(s))",
+		     stream->max_shutdown_time_sec);
+
+	return timeout || tag->sys_dts_usec >= (int64_t)stream->stop_ts;
+}
+
+static bool send_meta_data(struct rtmp_dest *dest)
+{
+	obs_output_t *context = dest->stream->output;
+	uint8_t *meta_data;
+	size_t meta_data_size;
+	bool success;
+
+	flv_meta_data(context, &meta_data, &meta_data_size, false);
+	success = RTMP_Write(&dest->rtmp, (char *)meta_data,
+			     (int)meta_data_size, 0) >= 0;
+	bfree(meta_data);
+
+	if (success && obs_output_get_audio_encoder(context, 1)) {
+		flv_additional_meta_data(context, &meta_data, &meta_data_size);
+		success = RTMP_Write(&dest->rtmp, (char *)meta_data,
+				     (int)meta_data_size, 0) >= 0;
+		bfree(meta_data);
+	}
+
+	return success;
+}
+
+static inline void dest_finish(struct rtmp_dest *dest)
+{
+	struct rtmp_multi_stream *stream = dest->stream;
+
+	if (os_atomic_dec_long(&stream->active_dests) != 0)
+		return;
+
+	/* last destination out reports the state of the whole output */
+	bool encode_error = os_atomic_load_bool(&stream->encode_error);
+
+	if (!stopping(stream)) {
+		obs_output_signal_stop(stream->output, OBS_OUTPUT_DISCONNECTED);
+	} else if (encode_error) {
+		obs_output_signal_stop(stream->output, OBS_OUTPUT_ENCODE_ERROR);
+	} else {
+		obs_output_end_data_capture(stream->output);
+	}
+
+	os_event_reset(stream->stop_event);
+	os_atomic_set_bool(&stream->active, false);
+}
+
+static void *send_thread(void *data)
+{
+	struct rtmp_dest *dest = data;
+	struct rtmp_multi_stream *stream = dest->stream;
+	bool sent_meta_data = false;
+
+	os_set_thread_name("rtmp-multi-stream: send_thread");
+
+	while (os_sem_wait(dest->send_sem) == 0) {
+		struct flv_tag *tag;
+
+		if (stopping(stream) && stream->stop_ts == 0)
+			break;
+
+		if (!get_next_tag(dest, &tag))
+			continue;
+
+		if (stopping(stream) && !tag->is_header &&
+		    can_shutdown_stream(stream, tag)) {
+			flv_tag_release(tag);
+			break;
+		}
+
+		if (!sent_meta_data) {
+			if (!send_meta_data(dest)) {
+				flv_tag_release(tag);
+				os_atomic_set_bool(&dest->failed, true);
+				break;
+			}
+			sent_meta_data = true;
+		}
+
+		int ret = RTMP_Write(&dest->rtmp, (char *)tag->data,
+				     (int)tag->size, 0);
+		pthread_mutex_lock(&dest->tags_mutex);
+		dest->total_bytes_sent += tag->size;
+		pthread_mutex_unlock(&dest->tags_mutex);
+		flv_tag_release(tag);
+
+		if (ret < 0) {
+			os_atomic_set_bool(&dest->failed, true);
+			break;
+		}
+	}
+
+	if (os_atomic_load_bool(&dest->failed))
+		dest_log(LOG_INFO, "Disconnected from %s", dest->path.array);
+	else
+		dest_log(LOG_INFO, "Stream stopped");
+
+	os_atomic_set_bool(&dest->connected, false);
+	RTMP_Close(&dest->rtmp);
+	dest_free_tags(dest);
+
+	dest_finish(dest);
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+/* connecting                                                                */
+
+static inline void set_rtmp_dstr(AVal *val, struct dstr *str)
+{
+	bool valid = !dstr_is_empty(str);
+	val->av_val = valid ? str->array : NULL;
+	val->av_len = valid ? (int)str->len : 0;
+}
+
+static void add_connect_data(char **penc, char *pend)
+{
+	const AVal val = AVC("supportsGoAway");
+	*penc = AMF_EncodeNamedBoolean(*penc, pend, &val, true);
+}
+
+static int dest_try_connect(struct rtmp_dest *dest)
+{
+	struct rtmp_multi_stream *stream = dest->stream;
+	RTMP *rtmp = &dest->rtmp;
+
+	if (dstr_is_empty(&dest->path)) {
+		dest_log(LOG_WARNING, "URL is empty");
+		return OBS_OUTPUT_BAD_PATH;
+	}
+
+	dest_log(LOG_INFO, "Connecting to RTMP URL %s...", dest->path.array);
+
+	RTMP_Reset(rtmp);
+	RTMP_TLS_Free(rtmp);
+	RTMP_TLS_Init(rtmp);
+
+	memset(&rtmp->Link, 0, sizeof(rtmp->Link));
+	rtmp->last_error_code = 0;
+
+	if (!RTMP_SetupURL(rtmp, dest->path.array))
+		return OBS_OUTPUT_BAD_PATH;
+
+	RTMP_EnableWrite(rtmp);
+
+	set_rtmp_dstr(&rtmp->Link.pubUser, &dest->username);
+	set_rtmp_dstr(&rtmp->Link.pubPasswd, &dest->password);
+	set_rtmp_dstr(&rtmp->Link.flashVer, &stream->encoder_name);
+	rtmp->Link.swfUrl = rtmp->Link.tcUrl;
+	rtmp->Link.customConnectEncode = add_connect_data;
+
+	if (dstr_is_empty(&stream->bind_ip) ||
+	    dstr_cmp(&stream->bind_ip, "default") == 0) {
+		memset(&rtmp->m_bindIP, 0, sizeof(rtmp->m_bindIP));
+	} else {
+		netif_str_to_addr(&rtmp->m_bindIP.addr, &rtmp->m_bindIP.addrLen,
+				  stream->bind_ip.array);
+	}
+
+	RTMP_AddStream(rtmp, dest->key.array);
+
+	rtmp->m_outChunkSize = 4096;
+	rtmp->m_bSendChunkSizeInfo = true;
+	rtmp->m_bUseNagle = true;
+
+	if (!RTMP_Connect(rtmp, NULL))
+		return OBS_OUTPUT_CONNECT_FAILED;
+
+	if (!RTMP_ConnectStream(rtmp, 0))
+		return OBS_OUTPUT_INVALID_STREAM;
+
+	dest_log(LOG_INFO, "Connection to %s successful", dest->path.array);
+	return OBS_OUTPUT_SUCCESS;
+}
+
+static void add_dest(struct rtmp_multi_stream *stream, const char *url,
+		     const char *key, const char *username,
+		     const char *password)
+{
+	struct rtmp_dest *dest;
+
+	if (!url || !*url)
+		return;
+
+	dest = dest_create(stream, url, key, username, password);
+	if (!dest)
+		return;
+
+	pthread_mutex_lock(&stream->dests_mutex);
+	da_push_back(stream->dests, &dest);
+	pthread_mutex_unlock(&stream->dests_mutex);
+}
+
+static bool init_connect(struct rtmp_multi_stream *stream)
+{
+	obs_service_t *service = obs_output_get_service(stream->output);
+	obs_data_t *settings;
+	obs_data_array_t *array;
+	int64_t drop_p;
+	int64_t drop_b;
+
+	free_dests(stream);
+
+	os_atomic_set_bool(&stream->encode_error, false);
+	stream->got_first_video = false;
+
+	settings = obs_output_get_settings(stream->output);
+
+	if (service)
+		add_dest(stream, obs_service_get_url(service),
+			 obs_service_get_key(service),
+			 obs_service_get_username(service),
+			 obs_service_get_password(service));
+
+	array = obs_data_get_array(settings, OPT_DESTINATIONS);
+	for (size_t i = 0; i < obs_data_array_count(array); i++) {
+		obs_data_t *item = obs_data_array_item(array, i);
+		add_dest(stream, obs_data_get_string(item, OPT_DEST_SERVER),
+			 obs_data_get_string(item, OPT_DEST_KEY),
+			 obs_data_get_string(item, OPT_DEST_USERNAME),
+			 obs_data_get_string(item, OPT_DEST_PASSWORD));
+		obs_data_release(item);
+	}
+	obs_data_array_release(array);
+
+	drop_b = (int64_t)obs_data_get_int(settings, OPT_DROP_THRESHOLD);
+	drop_p = (int64_t)obs_data_get_int(settings, OPT_PFRAME_DROP_THRESHOLD);
+	stream->max_shutdown_time_sec =
+		(int)obs_data_get_int(settings, OPT_MAX_SHUTDOWN_TIME_SEC);
+
+	if (drop_p < (drop_b + 200))
+		drop_p = drop_b + 200;
+
+	stream->drop_threshold_usec = 1000 * drop_b;
+	stream->pframe_drop_threshold_usec = 1000 * drop_p;
+
+	dstr_copy(&stream->bind_ip,
+		  obs_data_get_string(settings, OPT_BIND_IP));
+	dstr_copy(&stream->encoder_name, "FMLE/3.0 (compatible; FMSc/1.0)");
+
+	obs_data_release(settings);
+	return stream->dests.num > 0;
+}
+
+static void *connect_thread(void *data)
+{
+	struct rtmp_multi_stream *stream = data;
+	int first_error = OBS_OUTPUT_SUCCESS;
+	long connected = 0;
+
+	os_set_thread_name("rtmp-multi-stream: connect_thread");
+
+	if (!init_connect(stream)) {
+		warn("No destinations configured");
+		obs_output_signal_stop(stream->output, OBS_OUTPUT_BAD_PATH);
+		os_atomic_set_bool(&stream->connecting, false);
+		return NULL;
+	}
+
+	/* a destination that fails to connect is skipped, the output only
+	 * fails if none of them could connect */
+	for (size_t i = 0; i < stream->dests.num; i++) {
+		struct rtmp_dest *dest = stream->dests.array[i];
+		int ret = dest_try_connect(dest);
+
+		if (ret != OBS_OUTPUT_SUCCESS) {
+			dest_log(LOG_INFO, "Connection to %s failed: %d",
+				 dest->path.array, ret);
+			if (first_error == OBS_OUTPUT_SUCCESS)
+				first_error = ret;
+			RTMP_Close(&dest->rtmp);
+			os_atomic_set_bool(&dest->failed, true);
+			continue;
+		}
+
+		os_atomic_set_bool(&dest->connected, true);
+		connected++;
+	}
+
+	if (!connected) {
+		obs_output_signal_stop(stream->output, first_error);
+		goto finish;
+	}
+
+	os_atomic_set_long(&stream->active_dests, connected);
+	os_atomic_set_bool(&stream->active, true);
+
+	for (size_t i = 0; i < stream->dests.num; i++) {
+		struct rtmp_dest *dest = stream->dests.array[i];
+		if (!os_atomic_load_bool(&dest->connected))
+			continue;
+
+		if (pthread_create(&dest->send_thread, NULL, send_thread,
+				   dest) != 0) {
+			dest_log(LOG_WARNING, "Failed to create send thread");
+			RTMP_Close(&dest->rtmp);
+			os_atomic_set_bool(&dest->connected, false);
+			os_atomic_set_bool(&dest->failed, true);
+			dest_finish(dest);
+			continue;
+		}
+
+		dest->send_thread_active = true;
+	}
+
+	if (active(stream))
+		obs_output_begin_data_capture(stream->output, 0);
+
+finish:
+	if (!stopping(stream))
+		pthread_detach(stream->connect_thread);
+
+	os_atomic_set_bool(&stream->connecting, false);
+	return NULL;
+}
+
+static bool rtmp_multi_stream_start(void *data)
+{
+	struct rtmp_multi_stream *stream = data;
+
+	if (!obs_output_can_begin_data_capture(stream->output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(stream->output, 0))
+		return false;
+
+	join_dests(stream);
+
+	os_atomic_set_bool(&stream->connecting, true);
+	return pthread_create(&stream->connect_thread, NULL, connect_thread,
+			      stream) == 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* muxing and per-destination frame dropping                                 */
+
+static void mux_header_packet(struct array_output_data *out,
+			      struct encoder_packet *packet, size_t idx)
+{
+	uint8_t *data;
+	size_t size;
+
+	if (idx > 0)
+		flv_additional_packet_mux(packet, 0, &data, &size, true, idx);
+	else
+		flv_packet_mux(packet, 0, &data, &size, true);
+
+	da_push_back_array(out->bytes, data, size);
+	bfree(data);
+}
+
+static bool build_headers(struct rtmp_multi_stream *stream)
+{
+	obs_output_t *context = stream->output;
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(context);
+	struct array_output_data out = {0};
+	uint8_t *header;
+	size_t size;
+
+	/* same order as rtmp_output: first audio track, video, then the
+	 * remaining audio tracks */
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+		obs_encoder_t *aencoder = obs_output_get_audio_encoder(context,
+								       i);
+		struct encoder_packet packet = {.type = OBS_ENCODER_AUDIO,
+						.timebase_den = 1};
+
+		if (!aencoder)
+			break;
+		if (!obs_encoder_get_extra_data(aencoder, &packet.data,
+						&packet.size))
+			goto fail;
+
+		mux_header_packet(&out, &packet, i);
+
+		if (i == 0) {
+			struct encoder_packet vpacket = {
+				.type = OBS_ENCODER_VIDEO,
+				.timebase_den = 1,
+				.keyframe = true};
+
+			if (!obs_encoder_get_extra_data(vencoder, &header,
+							&size))
+				goto fail;
+
+			vpacket.size = obs_parse_avc_header(&vpacket.data,
+							    header, size);
+			mux_header_packet(&out, &vpacket, 0);
+			bfree(vpacket.data);
+		}
+	}
+
+	stream->headers = flv_tag_create(out.bytes.array, out.bytes.num);
+	stream->headers->is_header = true;
+	return true;
+
+fail:
+	da_free(out.bytes);
+	return false;
+}
+
+static void drop_frames(struct rtmp_dest *dest, int highest_priority)
+{
+	struct circlebuf new_buf = {0};
+	int num_frames_dropped = 0;
+
+	circlebuf_reserve(&new_buf, sizeof(struct flv_tag *) * 8);
+
+	while (dest->tags.size) {
+		struct flv_tag *tag;
+		circlebuf_pop_front(&dest->tags, &tag, sizeof(tag));
+
+		/* do not drop headers, audio data or video keyframes */
+		if (tag->is_header || tag->type == OBS_ENCODER_AUDIO ||
+		    tag->drop_priority >= highest_priority) {
+			circlebuf_push_back(&new_buf, &tag, sizeof(tag));
+		} else {
+			num_frames_dropped++;
+			flv_tag_release(tag);
+		}
+	}
+
+	circlebuf_free(&dest->tags);
+	dest->tags = new_buf;
+
+	if (dest->min_priority < highest_priority)
+		dest->min_priority = highest_priority;
+
+	/* only written with tags_mutex held */
+	os_atomic_store_long(&dest->dropped_frames,
+			     os_atomic_load_long(&dest->dropped_frames) +
+				     num_frames_dropped);
+}
+
+static bool find_first_video_tag(struct rtmp_dest *dest,
+				 struct flv_tag **first)
+{
+	size_t count = num_buffered_tags(dest);
+
+	for (size_t i = 0; i < count; i++) {
+		struct flv_tag **cur =
+			circlebuf_data(&dest->tags, i * sizeof(*first));
+		if (!(*cur)->is_header &&
+		    (*cur)->type == OBS_ENCODER_VIDEO &&
+		    (*cur)->drop_priority < OBS_NAL_PRIORITY_HIGHEST) {
+			*first = *cur;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void check_to_drop_frames(struct rtmp_dest *dest, bool pframes)
+{
+	struct rtmp_multi_stream *stream = dest->stream;
+	struct flv_tag *first;
+	int64_t buffer_duration_usec;
+	int priority = pframes ? OBS_NAL_PRIORITY_HIGHEST
+			       : OBS_NAL_PRIORITY_HIGH;
+	int64_t drop_threshold = pframes ? stream->pframe_drop_threshold_usec
+					 : stream->drop_threshold_usec;
+
+	if (num_buffered_tags(dest) < 5) {
+		if (!pframes)
+			dest->congestion = 0.0f;
+		return;
+	}
+
+	if (!find_first_video_tag(dest, &first))
+		return;
+
+	buffer_duration_usec = dest->last_dts_usec - first->dts_usec;
+
+	if (!pframes)
+		dest->congestion =
+			(float)buffer_duration_usec / (float)drop_threshold;
+
+	if (buffer_duration_usec > drop_threshold)
+		drop_frames(dest, priority);
+}
+
+static void dest_add_tag(struct rtmp_dest *dest, struct flv_tag *tag)
+{
+	bool added = true;
+
+	pthread_mutex_lock(&dest->tags_mutex);
+
+	if (tag->type == OBS_ENCODER_VIDEO && !tag->is_header) {
+		check_to_drop_frames(dest, false);
+		check_to_drop_frames(dest, true);
+
+		if (tag->drop_priority < dest->min_priority) {
+			os_atomic_inc_long(&dest->dropped_frames);
+			added = false;
+		} else {
+			dest->min_priority = 0;
+			dest->last_dts_usec = tag->dts_usec;
+		}
+	}
+
+	/* the send thread can pop the tag as soon as it is queued */
+	if (added) {
+		flv_tag_addref(tag);
+		circlebuf_push_back(&dest->tags, &tag, sizeof(tag));
+	}
+
+	pthread_mutex_unlock(&dest->tags_mutex);
+
+	if (added)
+		os_sem_post(dest->send_sem);
+}
+
+static void fan_out_tag(struct rtmp_multi_stream *stream,
+			struct flv_tag *tag)
+{
+	for (size_t i = 0; i < stream->dests.num; i++) {
+		struct rtmp_dest *dest = stream->dests.array[i];
+		if (os_atomic_load_bool(&dest->connected) &&
+		    !os_atomic_load_bool(&dest->failed))
+			dest_add_tag(dest, tag);
+	}
+}
+
+static void rtmp_multi_stream_data(void *data, struct encoder_packet *packet)
+{
+	struct rtmp_multi_stream *stream = data;
+	struct encoder_packet new_packet;
+	struct flv_tag *tag;
+	uint8_t *tag_data;
+	size_t tag_size;
+
+	if (!active(stream))
+		return;
+
+	/* encoder fail */
+	if (!packet) {
+		os_atomic_set_bool(&stream->encode_error, true);
+		stream->stop_ts = 0;
+		os_event_signal(stream->stop_event);
+		for (size_t i = 0; i < stream->dests.num; i++)
+			os_sem_post(stream->dests.array[i]->send_sem);
+		return;
+	}
+
+	if (!stream->headers) {
+		if (!build_headers(stream)) {
+			warn("Failed to get encoder headers");
+			return;
+		}
+		fan_out_tag(stream, stream->headers);
+	}
+
+	if (packet->type == OBS_ENCODER_VIDEO) {
+		if (!stream->got_first_video) {
+			stream->start_dts_offset =
+				get_ms_time(packet, packet->dts);
+			stream->got_first_video = true;
+		}
+
+		obs_parse_avc_packet(&new_packet, packet);
+	} else {
+		obs_encoder_packet_ref(&new_packet, packet);
+	}
+
+	/* serialize once, shared by every destination */
+	if (new_packet.track_idx > 0)
+		flv_additional_packet_mux(&new_packet, stream->start_dts_offset,
+					  &tag_data, &tag_size, false,
+					  new_packet.track_idx);
+	else
+		flv_packet_mux(&new_packet, stream->start_dts_offset,
+			       &tag_data, &tag_size, false);
+
+	tag = flv_tag_create(tag_data, tag_size);
+	tag->type = new_packet.type;
+	tag->drop_priority = new_packet.drop_priority;
+	tag->dts_usec = new_packet.dts_usec;
+	tag->sys_dts_usec = new_packet.sys_dts_usec;
+
+	obs_encoder_packet_release(&new_packet);
+
+	fan_out_tag(stream, tag);
+	flv_tag_release(tag);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void rtmp_multi_stream_defaults(obs_data_t *defaults)
+{
+	obs_data_set_default_int(defaults, OPT_DROP_THRESHOLD, 700);
+	obs_data_set_default_int(defaults, OPT_PFRAME_DROP_THRESHOLD, 900);
+	obs_data_set_default_int(defaults, OPT_MAX_SHUTDOWN_TIME_SEC, 30);
+	obs_data_set_default_string(defaults, OPT_BIND_IP, "default");
+}
+
+static obs_properties_t *rtmp_multi_stream_properties(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+
+	obs_properties_t *props = obs_properties_create();
+
+	obs_properties_add_int(props, OPT_DROP_THRESHOLD,
+			       obs_module_text("RTMPStream.DropThreshold"), 200,
+			       10000, 100);
+
+	return props;
+}
+
+static uint64_t rtmp_multi_stream_total_bytes_sent(void *data)
+{
+	struct rtmp_multi_stream *stream = data;
+	uint64_t total = 0;
+
+	pthread_mutex_lock(&stream->dests_mutex);
+	for (size_t i = 0; i < stream->dests.num; i++) {
+		struct rtmp_dest *dest = stream->dests.array[i];
+
+		pthread_mutex_lock(&dest->tags_mutex);
+		total += dest->total_bytes_sent;
+		pthread_mutex_unlock(&dest->tags_mutex);
+	}
+	pthread_mutex_unlock(&stream->dests_mutex);
+	return total;
+}
+
+static int rtmp_multi_stream_dropped_frames(void *data)
+{
+	struct rtmp_multi_stream *stream = data;
+	long dropped = 0;
+
+	pthread_mutex_lock(&stream->dests_mutex);
+	for (size_t i = 0; i < stream->dests.num; i++)
+		dropped += os_atomic_load_long(
+			&stream->dests.array[i]->dropped_frames);
+	pthread_mutex_unlock(&stream->dests_mutex);
+	return (int)dropped;
+}
+
+static float rtmp_multi_stream_congestion(void *data)
+{
+	struct rtmp_multi_stream *stream = data;
+	float congestion = 0.0f;
+
+	/* report the most congested destination that is still live */
+	pthread_mutex_lock(&stream->dests_mutex);
+	for (size_t i = 0; i < stream->dests.num; i++) {
+		struct rtmp_dest *dest = stream->dests.array[i];
+		float val;
+
+		if (!os_atomic_load_bool(&dest->connected))
+			continue;
+
+		val = dest->min_priority > 0 ? 1.0f : dest->congestion;
+		if (val > congestion)
+			congestion = val;
+	}
+	pthread_mutex_unlock(&stream->dests_mutex);
+
+	return congestion;
+}
+
+static int rtmp_multi_stream_connect_time(void *data)
+{
+	struct rtmp_multi_stream *stream = data;
+	int connect_time = 0;
+
+	pthread_mutex_lock(&stream->dests_mutex);
+	for (size_t i = 0; i < stream->dests.num; i++) {
+		int val = stream->dests.array[i]->rtmp.connect_time_ms;
+		if (val > connect_time)
+			connect_time = val;
+	}
+	pthread_mutex_unlock(&stream->dests_mutex);
+
+	return connect_time;
+}
+
+struct obs_output_info rtmp_multi_output_info = {
+	.id = "rtmp_multi_output",
+	.flags = OBS_OUTPUT_AV | OBS_OUTPUT_ENCODED | OBS_OUTPUT_SERVICE |
+		 OBS_OUTPUT_MULTI_TRACK,
+	.encoded_video_codecs = "h264",
+	.encoded_audio_codecs = "aac",
+	.get_name = rtmp_multi_stream_getname,
+	.create = rtmp_multi_stream_create,
+	.destroy = rtmp_multi_stream_destroy,
+	.start = rtmp_multi_stream_start,
+	.stop = rtmp_multi_stream_stop,
+	.encoded_packet = rtmp_multi_stream_data,
+	.get_defaults = rtmp_multi_stream_defaults,
+	.get_properties = rtmp_multi_stream_properties,
+	.get_total_bytes = rtmp_multi_stream_total_bytes_sent,
+	.get_congestion = rtmp_multi_stream_congestion,
+	.get_connect_time_ms = rtmp_multi_stream_connect_time,
+	.get_dropped_frames = rtmp_multi_stream_dropped_frames,
+};
@@ -69,11 +69,16 @@ static void stinger_update(void *data, obs_data_t *settings)
 	struct stinger_info *s = data;
 	const char *path = obs_data_get_string(settings, "path");
 	bool hw_decode = obs_data_get_bool(settings, "hw_decode");
+	bool preload = obs_data_get_bool(settings, "preload");
+	bool compress = obs_data_get_bool(settings, "preload_compress");
 
 	obs_data_t *media_settings = obs_data_create();
 	obs_data_set_string(media_settings, "local_file", path);
 	obs_data_set_bool(media_settings, "hw_decode", hw_decode);
 	obs_data_set_bool(media_settings, "looping", false);
+	obs_data_set_bool(media_settings, "hot_clip", !preload);
+	obs_data_set_bool(media_settings, "full_decode", preload);
+	obs_data_set_bool(media_settings, "compress_cache", compress);
 
 	obs_source_release(s->media_source);
 	struct dstr name;
@@ -121,6 +126,10 @@ static void stinger_update(void *data, obs_data_t *settings)
 		obs_data_t *tm_media_settings = obs_data_create();
 		obs_data_set_string(tm_media_settings, "local_file", tm_path);
 		obs_data_set_bool(tm_media_settings, "looping", false);
+		obs_data_set_bool(tm_media_settings, "hot_clip", !preload);
+		obs_data_set_bool(tm_media_settings, "full_decode", preload);
+		obs_data_set_bool(tm_media_settings, "compress_cache",
+				  compress);
 
 		s->matte_source = obs_source_create_private(
 			"ffmpeg_source", NULL, tm_media_settings);
@@ -225,6 +234,8 @@ static void stinger_destroy(void *data)
 static void stinger_defaults(obs_data_t *settings)
 {
 	obs_data_set_default_bool(settings, "hw_decode", true);
+	obs_data_set_default_bool(settings, "preload", false);
+	obs_data_set_default_bool(settings, "preload_compress", true);
 }
 
 static void stinger_matte_render(void *data, gs_texture_t *a, gs_texture_t *b,
@@ -446,6 +457,8 @@ static bool stinger_audio_render(void *data, uint64_t *ts_out,
 	struct obs_source_audio_mix child_audio;
 	obs_source_get_audio_mix(s->media_source, &child_audio);
 
+	uint32_t frames = audio_output_get_frames_per_tick(obs_get_audio());
+
 	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
 		if ((mixers & (1 << mix)) == 0)
 			continue;
@@ -453,7 +466,7 @@ static bool stinger_audio_render(void *data, uint64_t *ts_out,
 		for (size_t ch = 0; ch < channels; ch++) {
 			register float *out = audio->output[mix].data[ch];
 			register float *in = child_audio.output[mix].data[ch];
-			register float *end = in + AUDIO_OUTPUT_FRAMES;
+			register float *end = in + frames;
 
 			while (in < end)
 				*(out++) += *(in++);
@@ -629,8 +642,39 @@ static bool track_matte_enabled_modified(obs_properties_t *ppts,
 	return true;
 }
 
+static uint64_t get_cache_size(obs_source_t *media_source)
+{
+	if (!media_source)
+		return 0;
+
+	proc_handler_t *ph = obs_source_get_proc_handler(media_source);
+	calldata_t cd = {0};
+	uint64_t size = 0;
+
+	if (proc_handler_call(ph, "get_cache_size", &cd))
+		size = (uint64_t)calldata_int(&cd, "size");
+
+	calldata_free(&cd);
+	return size;
+}
+
+static bool preload_modified(obs_properties_t *ppts, obs_property_t *p,
+			     obs_data_t *s)
+{
+	bool preload = obs_data_get_bool(s, "preload");
+	obs_property_t *compress = obs_properties_get(ppts, "preload_compress");
+	obs_property_t *usage = obs_properties_get(ppts, "preload_usage");
+
+	obs_property_set_visible(compress, preload);
+	obs_property_set_visible(usage, preload);
+
+	UNUSED_PARAMETER(p);
+	return true;
+}
+
 static obs_properties_t *stinger_properties(void *data)
 {
+	struct stinger_info *s = data;
 	obs_properties_t *ppts = obs_properties_create();
 	struct dstr filter = {0};
 
@@ -661,6 +705,35 @@ static obs_properties_t *stinger_properties(void *data)
 			       obs_module_text("TransitionPoint"), 0, 120000,
 			       1);
 
+	// preload settings
+	p = obs_properties_add_bool(ppts, "preload",
+				    obs_module_text("Preload"));
+	obs_property_set_long_description(p,
+					  obs_module_text("Preload.ToolTip"));
+	obs_property_set_modified_callback(p, preload_modified);
+
+	obs_properties_add_bool(ppts, "preload_compress",
+				obs_module_text("Preload.Compress"));
+
+	if (s) {
+		uint64_t size = get_cache_size(s->media_source) +
+				get_cache_size(s->matte_source);
+		struct dstr usage = {0};
+
+		if (size) {
+			dstr_printf(&usage, "%s %.1f MB",
+				    obs_module_text("Preload.MemoryUsage"),
+				    (double)size / (1024.0 * 1024.0));
+		} else {
+			dstr_copy(&usage,
+				  obs_module_text("Preload.NotLoaded"));
+		}
+
+		p = obs_properties_add_text(ppts, "preload_usage", usage.array,
+					    OBS_TEXT_INFO);
+		dstr_free(&usage);
+	}
+
 	// track matte properties
 	{
 		obs_properties_t *track_matte_group = obs_properties_create();
@@ -734,7 +807,6 @@ static obs_properties_t *stinger_properties(void *data)
 				  obs_module_text("AudioFadeStyle.CrossFade"),
 				  FADE_STYLE_CROSS_FADE);
 
-	UNUSED_PARAMETER(data);
 	return ppts;
 }
 
@@ -0,0 +1,533 @@
+#include <obs-module.h>
+#include <util/darray.h>
+#include <util/threading.h>
+#include "text-freetype2.h"
+#include "font-cache.h"
+
+#define ATLAS_START_SIZE 1024
+#define ATLAS_MAX_SIZE 4096
+
+struct ft2_font {
+	char *path;
+	FT_Long index;
+	uint16_t size;
+	bool antialiasing;
+	long refs;
+
+	FT_Face face;
+	struct glyph_info **glyphs;
+	size_t num_glyphs;
+	uint32_t max_h;
+};
+
+struct atlas_shelf {
+	uint32_t y;
+	uint32_t h;
+	uint32_t x;
+};
+
+struct ft2_font_cache {
+	pthread_mutex_t mutex;
+	DARRAY(struct ft2_font *) fonts;
+
+	uint8_t *data;
+	uint32_t w, h;
+	DARRAY(struct atlas_shelf) shelves;
+	uint32_t shelf_bottom;
+
+	gs_texture_t *tex;
+	bool dirty;
+	uint64_t generation;
+	uint64_t use_counter;
+	bool warned_full;
+};
+
+static struct ft2_font_cache cache;
+
+void ft2_font_cache_init(void)
+{
+	pthread_mutex_init_recursive(&cache.mutex);
+}
+
+void ft2_font_cache_free(void)
+{
+	/* the texture is released with the last font, sources are gone by
+	 * the time the module unloads */
+	bfree(cache.data);
+	da_free(cache.shelves);
+	da_free(cache.fonts);
+	pthread_mutex_destroy(&cache.mutex);
+	memset(&cache, 0, sizeof(cache));
+}
+
+void ft2_font_cache_lock(void)
+{
+	pthread_mutex_lock(&cache.mutex);
+}
+
+void ft2_font_cache_unlock(void)
+{
+	pthread_mutex_unlock(&cache.mutex);
+}
+
+/* ------------------------------------------------------------------------- */
+/* atlas packing */
+
+static void atlas_reset(uint32_t w, uint32_t h)
+{
+	bfree(cache.data);
+	cache.data = bzalloc((size_t)w * h);
+	cache.w = w;
+	cache.h = h;
+	da_resize(cache.shelves, 0);
+	cache.shelf_bottom = 0;
+	cache.dirty = true;
+}
+
+static inline void update_glyph_uv(struct glyph_info *glyph)
+{
+	glyph->u = (float)glyph->x / (float)cache.w;
+	glyph->u2 = (float)(glyph->x + glyph->w) / (float)cache.w;
+	glyph->v = (float)glyph->y / (float)cache.h;
+	glyph->v2 = (float)(glyph->y + glyph->h) / (float)cache.h;
+}
+
+/* Shelf packing: glyphs go on the shortest row they fit on, rows are added
+ * at the bottom.  One pixel of padding keeps glyphs from bleeding into each
+ * other when sampled. */
+static bool atlas_alloc(uint32_t w, uint32_t h, uint32_t *x, uint32_t *y)
+{
+	struct atlas_shelf *best = NULL;
+
+	w++;
+	h++;
+
+	for (size_t i = 0; i < cache.shelves.num; i++) {
+		struct atlas_shelf *shelf = cache.shelves.array + i;
+		if (shelf->h < h || shelf->x + w > cache.w)
+			continue;
+		if (!best || shelf->h < best->h)
+			best = shelf;
+	}
+
+	/* don't waste a tall row on a short glyph if a new row fits */
+	if (best && best->h > h * 2 && cache.shelf_bottom + h <= cache.h)
+		best = NULL;
+
+	if (!best) {
+		if (cache.shelf_bottom + h > cache.h || w > cache.w)
+			return false;
+
+		best = da_push_back_new(cache.shelves);
+		best->y = cache.shelf_bottom;
+		best->h = h;
+		best->x = 0;
+		cache.shelf_bottom += h;
+	}
+
+	*x = best->x;
+	*y = best->y;
+	best->x += w;
+	return true;
+}
+
+static void atlas_blit(struct glyph_info *glyph)
+{
+	for (int32_t y = 0; y < glyph->h; y++) {
+		uint8_t *row = cache.data + (size_t)(glyph->y + y) * cache.w;
+		memcpy(row + glyph->x, glyph->bitmap + (size_t)y * glyph->w,
+		       glyph->w);
+	}
+}
+
+static bool atlas_place(struct glyph_info *glyph)
+{
+	if (!glyph->w || !glyph->h) {
+		glyph->x = glyph->y = 0;
+		glyph->placed = true;
+		update_glyph_uv(glyph);
+		return true;
+	}
+
+	if (!atlas_alloc(glyph->w, glyph->h, &glyph->x, &glyph->y))
+		return false;
+
+	atlas_blit(glyph);
+	update_glyph_uv(glyph);
+	glyph->placed = true;
+	cache.dirty = true;
+	return true;
+}
+
+static inline void for_each_glyph(void (*cb)(struct glyph_info *, void *),
+				  void *param)
+{
+	for (size_t i = 0; i < cache.fonts.num; i++) {
+		struct ft2_font *font = cache.fonts.array[i];
+		for (size_t j = 0; j < font->num_glyphs; j++) {
+			if (font->glyphs[j])
+				cb(font->glyphs[j], param);
+		}
+	}
+}
+
+static void grow_glyph_cb(struct glyph_info *glyph, void *param)
+{
+	UNUSED_PARAMETER(param);
+	if (glyph->placed)
+		update_glyph_uv(glyph);
+}
+
+/* doubles the atlas, glyphs keep their pixel position */
+static bool atlas_grow(void)
+{
+	uint32_t old_w = cache.w;
+	uint32_t old_h = cache.h;
+	uint8_t *old_data = cache.data;
+
+	if (cache.w >= ATLAS_MAX_SIZE)
+		return false;
+
+	cache.w *= 2;
+	cache.h *= 2;
+	cache.data = bzalloc((size_t)cache.w * cache.h);
+
+	for (uint32_t y = 0; y < old_h; y++)
+		memcpy(cache.data + (size_t)y * cache.w,
+		       old_data + (size_t)y * old_w, old_w);
+	bfree(old_data);
+
+	for_each_glyph(grow_glyph_cb, NULL);
+
+	cache.dirty = true;
+	cache.generation++;
+	return true;
+}
+
+static void collect_glyph_cb(struct glyph_info *glyph, void *param)
+{
+	DARRAY(struct glyph_info *) *glyphs = param;
+
+	/* zero sized glyphs take no space and stay placed */
+	if (glyph->w && glyph->h) {
+		glyph->placed = false;
+		da_push_back((*glyphs), &glyph);
+	}
+}
+
+static int cmp_last_used(const void *a, const void *b)
+{
+	const struct glyph_info *ga = *(const struct glyph_info *const *)a;
+	const struct glyph_info *gb = *(const struct glyph_info *const *)b;
+
+	if (ga->last_used == gb->last_used)
+		return 0;
+	return ga->last_used > gb->last_used ? -1 : 1;
+}
+
+/* evicts the least recently used glyphs by packing the atlas again from
+ * the most recently used one down, until it is full */
+static void atlas_repack(void)
+{
+	DARRAY(struct glyph_info *) glyphs;
+	size_t placed = 0;
+
+	da_init(glyphs);
+	for_each_glyph(collect_glyph_cb, &glyphs);
+
+	qsort(glyphs.array, glyphs.num, sizeof(struct glyph_info *),
+	      cmp_last_used);
+
+	atlas_reset(cache.w, cache.h);
+
+	for (; placed < glyphs.num; placed++) {
+		if (!atlas_place(glyphs.array[placed]))
+			break;
+	}
+
+	blog(LOG_DEBUG,
+	     "FT2-text: glyph atlas full, evicted %zu of %zu glyphs",
+	     glyphs.num - placed, glyphs.num);
+
+	da_free(glyphs);
+	cache.generation++;
+}
+
+static void atlas_place_glyph(struct glyph_info *glyph)
+{
+	if (!cache.data)
+		atlas_reset(ATLAS_START_SIZE, ATLAS_START_SIZE);
+
+	while (!atlas_place(glyph)) {
+		if (!atlas_grow())
+			break;
+	}
+
+	if (!glyph->placed) {
+		/* the glyph is the most recently used one, so it is packed
+		 * first */
+		atlas_repack();
+	}
+
+	if (!glyph->placed && !cache.warned_full) {
+		blog(LOG_WARNING, "FT2-text: Out of space trying to render "
+				  "glyphs");
+		cache.warned_full = true;
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* glyphs */
+
+static inline FT_Render_Mode get_render_mode(const struct ft2_font *font)
+{
+	return font->antialiasing ? FT_RENDER_MODE_NORMAL
+				  : FT_RENDER_MODE_MONO;
+}
+
+static inline uint8_t get_pixel_value(const unsigned char *buf_row,
+				      FT_Render_Mode render_mode,
+				      const uint32_t x)
+{
+	if (render_mode == FT_RENDER_MODE_NORMAL) {
+		return buf_row[x];
+	}
+
+	const uint32_t byte_index = x / 8;
+	const uint8_t bit_index = x % 8;
+	const bool pixel_set = (buf_row[byte_index] >> (7 - bit_index)) & 1;
+	return pixel_set ? 255 : 0;
+}
+
+static struct glyph_info *rasterize_glyph(struct ft2_font *font,
+					  FT_UInt glyph_index)
+{
+	const FT_Render_Mode render_mode = get_render_mode(font);
+	const FT_Int32 load_mode = render_mode == FT_RENDER_MODE_MONO
+					   ? FT_LOAD_TARGET_MONO
+					   : FT_LOAD_DEFAULT;
+	FT_GlyphSlot slot = font->face->glyph;
+
+	FT_Load_Glyph(font->face, glyph_index, load_mode);
+	FT_Render_Glyph(slot, render_mode);
+
+	struct glyph_info *glyph = bzalloc(sizeof(struct glyph_info));
+	glyph->w = slot->bitmap.width;
+	glyph->h = slot->bitmap.rows;
+	glyph->yoff = slot->bitmap_top;
+	glyph->xoff = slot->bitmap_left;
+	glyph->xadv = slot->advance.x >> 6;
+
+	/**
+	 * The pitch's absolute value is the number of bytes taken by one bitmap
+	 * row, including padding.
+	 *
+	 * Source: https://www.freetype.org/freetype2/docs/reference/ft2-basic_types.html
+	 */
+	const int pitch = abs(slot->bitmap.pitch);
+
+	glyph->bitmap = bmalloc((size_t)glyph->w * glyph->h);
+	for (int32_t y = 0; y < glyph->h; y++) {
+		const unsigned char *row = slot->bitmap.buffer + y * pitch;
+		for (int32_t x = 0; x < glyph->w; x++)
+			glyph->bitmap[y * glyph->w + x] =
+				get_pixel_value(row, render_mode, x);
+	}
+
+	if (font->max_h < (uint32_t)glyph->h)
+		font->max_h = glyph->h;
+
+	return glyph;
+}
+
+struct glyph_info *ft2_font_get_glyph(struct ft2_font *font, wchar_t ch)
+{
+	FT_UInt glyph_index = FT_Get_Char_Index(font->face, ch);
+	struct glyph_info *glyph;
+
+	if (glyph_index >= font->num_glyphs)
+		return NULL;
+
+	glyph = font->glyphs[glyph_index];
+	if (!glyph) {
+		glyph = rasterize_glyph(font, glyph_index);
+		font->glyphs[glyph_index] = glyph;
+	}
+
+	glyph->last_used = ++cache.use_counter;
+
+	if (!glyph->placed)
+		atlas_place_glyph(glyph);
+
+	return glyph;
+}
+
+uint32_t ft2_font_get_max_h(const struct ft2_font *font)
+{
+	return font->max_h;
+}
+
+static void cache_standard_glyphs(struct ft2_font *font)
+{
+	const wchar_t *glyphs = L"abcdefghijklmnopqrstuvwxyz"
+				L"ABCDEFGHIJKLMNOPQRSTUVWXYZ1234567890"
+				L"!@#$%^&*()-_=+,<.>/?\\|[]{}`~ \'\"";
+
+	for (const wchar_t *ch = glyphs; *ch; ch++)
+		ft2_font_get_glyph(font, *ch);
+}
+
+/* ------------------------------------------------------------------------- */
+/* faces */
+
+static struct ft2_font *find_font(const char *path, FT_Long index,
+				  uint16_t size, bool antialiasing)
+{
+	for (size_t i = 0; i < cache.fonts.num; i++) {
+		struct ft2_font *font = cache.fonts.array[i];
+		if (font->index == index && font->size == size &&
+		    font->antialiasing == antialiasing &&
+		    strcmp(font->path, path) == 0)
+			return font;
+	}
+
+	return NULL;
+}
+
+static struct ft2_font *load_font(const char *path, FT_Long index,
+				  uint16_t size, bool antialiasing)
+{
+	FT_Face face;
+
+	if (FT_New_Face(ft2_lib, path, index, &face) != 0)
+		return NULL;
+
+	FT_Set_Pixel_Sizes(face, 0, size);
+	FT_Select_Charmap(face, FT_ENCODING_UNICODE);
+
+	struct ft2_font *font = bzalloc(sizeof(struct ft2_font));
+	font->path = bstrdup(path);
+	font->index = index;
+	font->size = size;
+	font->antialiasing = antialiasing;
+	font->refs = 1;
+	font->face = face;
+	font->num_glyphs = (size_t)face->num_glyphs;
+	font->glyphs = bzalloc(sizeof(struct glyph_info *) *
+			       (font->num_glyphs ? font->num_glyphs : 1));
+
+	da_push_back(cache.fonts, &font);
+
+	cache_standard_glyphs(font);
+	return font;
+}
+
+struct ft2_font *ft2_font_get(const char *path, FT_Long index, uint16_t size,
+			      bool antialiasing)
+{
+	struct ft2_font *font;
+
+	if (!path || !ft2_lib)
+		return NULL;
+
+	pthread_mutex_lock(&cache.mutex);
+
+	font = find_font(path, index, size, antialiasing);
+	if (font)
+		font->refs++;
+	else
+		font = load_font(path, index, size, antialiasing);
+
+	pthread_mutex_unlock(&cache.mutex);
+
+	return font;
+}
+
+static void font_destroy(struct ft2_font *font)
+{
+	for (size_t i = 0; i < font->num_glyphs; i++) {
+		if (font->glyphs[i]) {
+			bfree(font->glyphs[i]->bitmap);
+			bfree(font->glyphs[i]);
+		}
+	}
+
+	FT_Done_Face(font->face);
+	bfree(font->glyphs);
+	bfree(font->path);
+	bfree(font);
+}
+
+void ft2_font_release(struct ft2_font *font)
+{
+	gs_texture_t *tex = NULL;
+
+	if (!font)
+		return;
+
+	pthread_mutex_lock(&cache.mutex);
+
+	if (--font->refs == 0) {
+		da_erase_item(cache.fonts, &font);
+		font_destroy(font);
+
+		/* the atlas space of its glyphs is reclaimed on the next
+		 * repack, or all at once when no fonts are left */
+		if (!cache.fonts.num) {
+			tex = cache.tex;
+			cache.tex = NULL;
+			bfree(cache.data);
+			cache.data = NULL;
+			da_resize(cache.shelves, 0);
+			cache.warned_full = false;
+			cache.generation++;
+		}
+	}
+
+	pthread_mutex_unlock(&cache.mutex);
+
+	/* the graphics context is always entered before taking the lock */
+	if (tex) {
+		obs_enter_graphics();
+		gs_texture_destroy(tex);
+		obs_leave_graphics();
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* texture */
+
+uint64_t ft2_atlas_get_generation(void)
+{
+	uint64_t generation;
+
+	pthread_mutex_lock(&cache.mutex);
+	generation = cache.generation;
+	pthread_mutex_unlock(&cache.mutex);
+
+	return generation;
+}
+
+gs_texture_t *ft2_atlas_get_texture(void)
+{
+	if (!cache.data)
+		return NULL;
+
+	if (cache.tex && (gs_texture_get_width(cache.tex) != cache.w ||
+			  gs_texture_get_height(cache.tex) != cache.h)) {
+		gs_texture_destroy(cache.tex);
+		cache.tex = NULL;
+	}
+
+	if (!cache.tex) {
+		cache.tex = gs_texture_create(cache.w, cache.h, GS_A8, 1,
+					      (const uint8_t **)&cache.data,
+					      GS_DYNAMIC);
+		cache.dirty = false;
+	} else if (cache.dirty) {
+		gs_texture_set_image(cache.tex, cache.data, cache.w, false);
+		cache.dirty = false;
+	}
+
+	return cache.tex;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <obs-module.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+/*
+ * Process-wide font face cache and glyph atlas.
+ *
+ * Faces are shared by every text source using the same font file, face
+ * index, size and antialiasing mode.  Rasterized glyphs of all faces live in
+ * one growable A8 atlas texture; when it is full at its maximum size, the
+ * least recently used glyphs are evicted.  Glyph placement can change when
+ * that happens, which bumps the atlas generation so sources know to rebuild
+ * their vertex buffers.
+ */
+
+struct ft2_font;
+
+struct glyph_info {
+	float u, v, u2, v2;
+	int32_t w, h, xoff, yoff;
+	int32_t xadv;
+
+	/* atlas placement, glyphs can be evicted and placed again */
+	bool placed;
+	uint32_t x, y;
+
+	uint8_t *bitmap;
+	uint64_t last_used;
+};
+
+extern void ft2_font_cache_init(void);
+extern void ft2_font_cache_free(void);
+
+/* the functions below that don't take a reference require the lock */
+extern void ft2_font_cache_lock(void);
+extern void ft2_font_cache_unlock(void);
+
+/**
+ * Gets a reference to a cached face, loading it if necessary
+ *
+ * @return NULL if the face could not be loaded
+ */
+extern struct ft2_font *ft2_font_get(const char *path, FT_Long index,
+				     uint16_t size, bool antialiasing);
+extern void ft2_font_release(struct ft2_font *font);
+
+/**
+ * Gets the glyph for a character, rasterizing and placing it in the atlas
+ * if needed.  Only glyphs with placed set can be drawn.
+ */
+extern struct glyph_info *ft2_font_get_glyph(struct ft2_font *font,
+					     wchar_t ch);
+extern uint32_t ft2_font_get_max_h(const struct ft2_font *font);
+
+extern uint64_t ft2_atlas_get_generation(void);
+
+/**
+ * Gets the atlas texture, uploading pending changes
+ *
+ * @note requires to be called within the obs graphics context
+ */
+extern gs_texture_t *ft2_atlas_get_texture(void);
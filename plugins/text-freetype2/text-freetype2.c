@@ -17,6 +17,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <obs-module.h>
 #include <util/platform.h>
+#include <util/threading.h>
 #include <ft2build.h>
 #include FT_FREETYPE_H
 #include <sys/stat.h>
@@ -33,8 +34,6 @@ MODULE_EXPORT const char *obs_module_description(void)
 	return "FreeType2 text source";
 }
 
-uint32_t texbuf_w = 2048, texbuf_h = 2048;
-
 static struct obs_source_info freetype2_source_info_v1 = {
 	.id = "text_ft2_source",
 	.type = OBS_SOURCE_TYPE_INPUT,
@@ -104,6 +103,8 @@ bool obs_module_load()
 		bfree(config_dir);
 	}
 
+	ft2_font_cache_init();
+
 	obs_register_source(&freetype2_source_info_v1);
 	obs_register_source(&freetype2_source_info_v2);
 
@@ -112,6 +113,8 @@ bool obs_module_load()
 
 void obs_module_unload(void)
 {
+	ft2_font_cache_free();
+
 	if (plugin_initialized) {
 		free_os_font_list();
 		FT_Done_FreeType(ft2_lib);
@@ -196,17 +199,11 @@ static void ft2_source_destroy(void *data)
 {
 	struct ft2_source *srcdata = data;
 
-	if (srcdata->font_face != NULL) {
-		FT_Done_Face(srcdata->font_face);
-		srcdata->font_face = NULL;
-	}
+	os_file_watch_destroy(srcdata->watch);
+	srcdata->watch = NULL;
 
-	for (uint32_t i = 0; i < num_cache_slots; i++) {
-		if (srcdata->cacheglyphs[i] != NULL) {
-			bfree(srcdata->cacheglyphs[i]);
-			srcdata->cacheglyphs[i] = NULL;
-		}
-	}
+	ft2_font_release(srcdata->font);
+	srcdata->font = NULL;
 
 	if (srcdata->font_name != NULL)
 		bfree(srcdata->font_name);
@@ -214,8 +211,6 @@ static void ft2_source_destroy(void *data)
 		bfree(srcdata->font_style);
 	if (srcdata->text != NULL)
 		bfree(srcdata->text);
-	if (srcdata->texbuf != NULL)
-		bfree(srcdata->texbuf);
 	if (srcdata->colorbuf != NULL)
 		bfree(srcdata->colorbuf);
 	if (srcdata->text_file != NULL)
@@ -223,10 +218,6 @@ static void ft2_source_destroy(void *data)
 
 	obs_enter_graphics();
 
-	if (srcdata->tex != NULL) {
-		gs_texture_destroy(srcdata->tex);
-		srcdata->tex = NULL;
-	}
 	if (srcdata->vbuf != NULL) {
 		gs_vertexbuffer_destroy(srcdata->vbuf);
 		srcdata->vbuf = NULL;
@@ -247,11 +238,23 @@ static void ft2_source_render(void *data, gs_effect_t *effect)
 	if (srcdata == NULL)
 		return;
 
-	if (srcdata->tex == NULL || srcdata->vbuf == NULL)
+	if (srcdata->font == NULL || srcdata->vbuf == NULL)
 		return;
 	if (srcdata->text == NULL || *srcdata->text == 0)
 		return;
 
+	ft2_font_cache_lock();
+
+	/* glyphs were moved in the atlas since the buffer was filled */
+	if (srcdata->atlas_generation != ft2_atlas_get_generation())
+		fill_vertex_buffer(srcdata);
+
+	srcdata->tex = ft2_atlas_get_texture();
+	ft2_font_cache_unlock();
+
+	if (srcdata->tex == NULL)
+		return;
+
 	gs_reset_blend_state();
 	if (srcdata->outline_text)
 		draw_outlines(srcdata);
@@ -272,6 +275,19 @@ static void ft2_video_tick(void *data, float seconds)
 	if (!srcdata->from_file || !srcdata->text_file)
 		return;
 
+	if (srcdata->watch) {
+		if (os_atomic_exchange_bool(&srcdata->file_changed, false)) {
+			if (srcdata->log_mode)
+				read_from_end(srcdata, srcdata->text_file);
+			else
+				load_text_from_file(srcdata,
+						    srcdata->text_file);
+			cache_glyphs(srcdata, srcdata->text);
+			set_up_vertex_buffer(srcdata);
+		}
+		return;
+	}
+
 	if (os_gettime_ns() - srcdata->last_checked >= 1000000000) {
 		time_t t = get_modified_timestamp(srcdata->text_file);
 		srcdata->last_checked = os_gettime_ns();
@@ -296,21 +312,29 @@ static void ft2_video_tick(void *data, float seconds)
 	UNUSED_PARAMETER(seconds);
 }
 
+static void ft2_file_changed(void *data)
+{
+	struct ft2_source *srcdata = data;
+	os_atomic_set_bool(&srcdata->file_changed, true);
+}
+
 static bool init_font(struct ft2_source *srcdata)
 {
 	FT_Long index;
 	const char *path = get_font_path(srcdata->font_name, srcdata->font_size,
 					 srcdata->font_style,
 					 srcdata->font_flags, &index);
-	if (!path)
-		return false;
+	struct ft2_font *font = NULL;
 
-	if (srcdata->font_face != NULL) {
-		FT_Done_Face(srcdata->font_face);
-		srcdata->font_face = NULL;
-	}
+	if (path)
+		font = ft2_font_get(path, index, srcdata->font_size,
+				    srcdata->antialiasing);
 
-	return FT_New_Face(ft2_lib, path, index, &srcdata->font_face) == 0;
+	/* get the new face first so a shared face isn't reloaded */
+	ft2_font_release(srcdata->font);
+	srcdata->font = font;
+
+	return font != NULL;
 }
 
 static void ft2_source_update(void *data, obs_data_t *settings)
@@ -381,8 +405,6 @@ static void ft2_source_update(void *data, obs_data_t *settings)
 	if (ft2_lib == NULL)
 		goto error;
 
-	const size_t texbuf_size = (size_t)texbuf_w * (size_t)texbuf_h;
-
 	if (srcdata->draw_effect == NULL) {
 		char *effect_file = NULL;
 		char *error_string = NULL;
@@ -408,20 +430,22 @@ static void ft2_source_update(void *data, obs_data_t *settings)
 	const bool aa_changed = srcdata->antialiasing != new_aa_setting;
 	if (aa_changed) {
 		srcdata->antialiasing = new_aa_setting;
-		if (srcdata->texbuf != NULL) {
-			memset(srcdata->texbuf, 0, texbuf_size);
-		}
-		cache_standard_glyphs(srcdata);
+		vbuf_needs_update = true;
 	}
 
 	srcdata->file_load_failed = false;
 	srcdata->from_file = from_file;
 
+	if (!from_file) {
+		os_file_watch_destroy(srcdata->watch);
+		srcdata->watch = NULL;
+	}
+
 	if (srcdata->font_name != NULL) {
 		if (strcmp(font_name, srcdata->font_name) == 0 &&
 		    strcmp(font_style, srcdata->font_style) == 0 &&
 		    font_flags == srcdata->font_flags &&
-		    font_size == srcdata->font_size)
+		    font_size == srcdata->font_size && !aa_changed)
 			goto skip_font_load;
 
 		bfree(srcdata->font_name);
@@ -437,24 +461,12 @@ static void ft2_source_update(void *data, obs_data_t *settings)
 	srcdata->font_size = font_size;
 	srcdata->font_flags = font_flags;
 
-	if (!init_font(srcdata) || srcdata->font_face == NULL) {
+	if (!init_font(srcdata)) {
 		blog(LOG_WARNING, "FT2-text: Failed to load font %s",
 		     srcdata->font_name);
 		goto error;
-	} else {
-		FT_Set_Pixel_Sizes(srcdata->font_face, 0, srcdata->font_size);
-		FT_Select_Charmap(srcdata->font_face, FT_ENCODING_UNICODE);
 	}
 
-	if (srcdata->texbuf != NULL) {
-		bfree(srcdata->texbuf);
-		srcdata->texbuf = NULL;
-	}
-	srcdata->texbuf = bzalloc(texbuf_size);
-
-	if (srcdata->font_face)
-		cache_standard_glyphs(srcdata);
-
 skip_font_load:
 	if (from_file) {
 		const char *tmp = obs_data_get_string(settings, "text_file");
@@ -480,6 +492,12 @@ skip_font_load:
 			bfree(srcdata->text_file);
 
 			srcdata->text_file = bstrdup(tmp);
+
+			/* falls back to polling in the tick if NULL */
+			os_file_watch_destroy(srcdata->watch);
+			srcdata->watch = os_file_watch_create(
+				tmp, ft2_file_changed, srcdata);
+			os_atomic_set_bool(&srcdata->file_changed, false);
 			if (chat_log_mode)
 				read_from_end(srcdata, tmp);
 			else
@@ -499,7 +517,7 @@ skip_font_load:
 		os_utf8_to_wcs_ptr(tmp, strlen(tmp), &srcdata->text);
 	}
 
-	if (srcdata->font_face) {
+	if (srcdata->font) {
 		cache_glyphs(srcdata, srcdata->text);
 		set_up_vertex_buffer(srcdata);
 	}
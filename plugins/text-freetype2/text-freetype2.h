@@ -18,16 +18,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
 #include <obs-module.h>
+#include <util/platform.h>
 #include <ft2build.h>
-
-#define num_cache_slots 65535
-#define src_glyph srcdata->cacheglyphs[glyph_index]
-
-struct glyph_info {
-	float u, v, u2, v2;
-	int32_t w, h, xoff, yoff;
-	int32_t xadv;
-};
+#include "font-cache.h"
 
 struct ft2_source {
 	char *font_name;
@@ -43,22 +36,22 @@ struct ft2_source {
 	time_t m_timestamp;
 	bool update_file;
 	uint64_t last_checked;
+	os_file_watch_t *watch;
+	volatile bool file_changed;
 
 	uint32_t cx, cy, max_h, custom_width;
 	uint32_t outline_width;
-	uint32_t texbuf_x, texbuf_y;
 	uint32_t color[2];
 	uint32_t *colorbuf;
 
 	int32_t cur_scroll, scroll_speed;
 
+	/* shared atlas texture, only valid while rendering */
 	gs_texture_t *tex;
 
-	struct glyph_info *cacheglyphs[num_cache_slots];
-
-	FT_Face font_face;
+	struct ft2_font *font;
+	uint64_t atlas_generation;
 
-	uint8_t *texbuf;
 	gs_vertbuffer_t *vbuf;
 
 	gs_effect_t *draw_effect;
@@ -98,7 +91,6 @@ time_t get_modified_timestamp(char *filename);
 void load_text_from_file(struct ft2_source *srcdata, const char *filename);
 void read_from_end(struct ft2_source *srcdata, const char *filename);
 
-void cache_standard_glyphs(struct ft2_source *srcdata);
 void cache_glyphs(struct ft2_source *srcdata, wchar_t *cache_glyphs);
 
 void set_up_vertex_buffer(struct ft2_source *srcdata);
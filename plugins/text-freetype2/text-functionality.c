@@ -26,8 +26,6 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 float offsets[16] = {-2.0f, 0.0f, 0.0f, -2.0f, 2.0f,  0.0f, 2.0f,  0.0f,
 		     0.0f,  2.0f, 0.0f, 2.0f,  -2.0f, 0.0f, -2.0f, 0.0f};
 
-extern uint32_t texbuf_w, texbuf_h;
-
 void draw_outlines(struct ft2_source *srcdata)
 {
 	// Horrible (hopefully temporary) solution for outlines.
@@ -80,20 +78,25 @@ void draw_drop_shadow(struct ft2_source *srcdata)
 
 void set_up_vertex_buffer(struct ft2_source *srcdata)
 {
-	FT_UInt glyph_index = 0;
+	struct glyph_info *glyph;
 	uint32_t x = 0, space_pos = 0, word_width = 0;
 	size_t len;
 
-	if (!srcdata->text)
+	if (!srcdata->text || !srcdata->font)
 		return;
 
 	if (srcdata->custom_width >= 100)
 		srcdata->cx = srcdata->custom_width;
 	else
 		srcdata->cx = get_ft2_text_width(srcdata->text, srcdata);
-	srcdata->cy = srcdata->max_h;
 
+	/* the graphics context must be entered before locking the cache */
 	obs_enter_graphics();
+	ft2_font_cache_lock();
+
+	srcdata->max_h = ft2_font_get_max_h(srcdata->font);
+	srcdata->cy = srcdata->max_h;
+
 	if (srcdata->vbuf != NULL) {
 		gs_vertbuffer_t *tmpvbuf = srcdata->vbuf;
 		srcdata->vbuf = NULL;
@@ -101,6 +104,7 @@ void set_up_vertex_buffer(struct ft2_source *srcdata)
 	}
 
 	if (*srcdata->text == 0) {
+		ft2_font_cache_unlock();
 		obs_leave_graphics();
 		return;
 	}
@@ -138,27 +142,30 @@ void set_up_vertex_buffer(struct ft2_source *srcdata)
 		if (srcdata->text[i] == L' ')
 			space_pos = i;
 	next_char:;
-		glyph_index =
-			FT_Get_Char_Index(srcdata->font_face, srcdata->text[i]);
-		word_width += src_glyph->xadv;
+		glyph = ft2_font_get_glyph(srcdata->font, srcdata->text[i]);
+		if (glyph)
+			word_width += glyph->xadv;
 	eos_skip:;
 	}
 
 skip_word_wrap:;
 	fill_vertex_buffer(srcdata);
+	ft2_font_cache_unlock();
 	obs_leave_graphics();
 }
 
-void fill_vertex_buffer(struct ft2_source *srcdata)
+static void fill_vertex_buffer_pass(struct ft2_source *srcdata)
 {
 	struct gs_vb_data *vdata = gs_vertexbuffer_get_data(srcdata->vbuf);
-	if (vdata == NULL || !srcdata->text)
+	if (vdata == NULL || !srcdata->text || !srcdata->font)
 		return;
 
 	struct vec2 *tvarray = (struct vec2 *)vdata->tvarray[0].array;
 	uint32_t *col = (uint32_t *)vdata->colors;
 
-	FT_UInt glyph_index = 0;
+	struct glyph_info *glyph;
+
+	srcdata->max_h = ft2_font_get_max_h(srcdata->font);
 
 	uint32_t dx = 0, dy = srcdata->max_h, max_y = dy;
 	uint32_t cur_glyph = 0;
@@ -196,203 +203,83 @@ void fill_vertex_buffer(struct ft2_source *srcdata)
 		if (srcdata->text[i] == L'\r')
 			goto skip_glyph;
 
-		glyph_index =
-			FT_Get_Char_Index(srcdata->font_face, srcdata->text[i]);
-		if (src_glyph == NULL)
+		glyph = ft2_font_get_glyph(srcdata->font, srcdata->text[i]);
+		if (glyph == NULL)
 			goto skip_glyph;
 
 		if (srcdata->custom_width < 100)
 			goto skip_custom_width;
 
-		if (dx + src_glyph->xadv > srcdata->custom_width) {
+		if (dx + glyph->xadv > srcdata->custom_width) {
 			dx = offset;
 			dy += srcdata->max_h + 4;
 		}
 
 	skip_custom_width:;
 
+		/* evicted glyphs that could not be placed again keep their
+		 * spacing but are not drawn */
+		if (!glyph->placed) {
+			dx += glyph->xadv;
+			goto skip_glyph;
+		}
+
 		set_v3_rect(vdata->points + (cur_glyph * 6),
-			    (float)dx + (float)src_glyph->xoff,
-			    (float)dy - (float)src_glyph->yoff,
-			    (float)src_glyph->w, (float)src_glyph->h);
-		set_v2_uv(tvarray + (cur_glyph * 6), src_glyph->u, src_glyph->v,
-			  src_glyph->u2, src_glyph->v2);
+			    (float)dx + (float)glyph->xoff,
+			    (float)dy - (float)glyph->yoff, (float)glyph->w,
+			    (float)glyph->h);
+		set_v2_uv(tvarray + (cur_glyph * 6), glyph->u, glyph->v,
+			  glyph->u2, glyph->v2);
 		set_rect_colors2(col + (cur_glyph * 6), srcdata->color[0],
 				 srcdata->color[1]);
-		dx += src_glyph->xadv;
-		if (dy - (float)src_glyph->yoff + src_glyph->h > max_y)
-			max_y = dy - src_glyph->yoff + src_glyph->h;
+		dx += glyph->xadv;
+		if (dy - (float)glyph->yoff + glyph->h > max_y)
+			max_y = dy - glyph->yoff + glyph->h;
 		cur_glyph++;
 	skip_glyph:;
 	}
 
-	srcdata->cy = max_y;
-}
-
-void cache_standard_glyphs(struct ft2_source *srcdata)
-{
-	for (uint32_t i = 0; i < num_cache_slots; i++) {
-		if (srcdata->cacheglyphs[i] != NULL) {
-			bfree(srcdata->cacheglyphs[i]);
-			srcdata->cacheglyphs[i] = NULL;
-		}
-	}
-
-	srcdata->texbuf_x = 0;
-	srcdata->texbuf_y = 0;
+	/* the buffer is drawn in full, clear what a previous fill left */
+	memset(vdata->points + (cur_glyph * 6), 0,
+	       sizeof(struct vec3) * (len - cur_glyph) * 6);
 
-	cache_glyphs(srcdata, L"abcdefghijklmnopqrstuvwxyz"
-			      L"ABCDEFGHIJKLMNOPQRSTUVWXYZ1234567890"
-			      L"!@#$%^&*()-_=+,<.>/?\\|[]{}`~ \'\"\0");
+	srcdata->cy = max_y;
 }
 
-FT_Render_Mode get_render_mode(struct ft2_source *srcdata)
-{
-	return srcdata->antialiasing ? FT_RENDER_MODE_NORMAL
-				     : FT_RENDER_MODE_MONO;
-}
+/* placing a glyph can repack the atlas and move glyphs that were already
+ * written to the buffer, so the generation is only recorded after a pass
+ * that left the atlas unchanged.  otherwise the next frame fills again. */
+#define MAX_FILL_PASSES 2
 
-void load_glyph(struct ft2_source *srcdata, const FT_UInt glyph_index,
-		const FT_Render_Mode render_mode)
-{
-	const FT_Int32 load_mode = render_mode == FT_RENDER_MODE_MONO
-					   ? FT_LOAD_TARGET_MONO
-					   : FT_LOAD_DEFAULT;
-	FT_Load_Glyph(srcdata->font_face, glyph_index, load_mode);
-}
-
-struct glyph_info *init_glyph(FT_GlyphSlot slot, const uint32_t dx,
-			      const uint32_t dy, const uint32_t g_w,
-			      const uint32_t g_h)
-{
-	struct glyph_info *glyph = bzalloc(sizeof(struct glyph_info));
-	glyph->u = (float)dx / (float)texbuf_w;
-	glyph->u2 = (float)(dx + g_w) / (float)texbuf_w;
-	glyph->v = (float)dy / (float)texbuf_h;
-	glyph->v2 = (float)(dy + g_h) / (float)texbuf_h;
-	glyph->w = g_w;
-	glyph->h = g_h;
-	glyph->yoff = slot->bitmap_top;
-	glyph->xoff = slot->bitmap_left;
-	glyph->xadv = slot->advance.x >> 6;
-
-	return glyph;
-}
-
-uint8_t get_pixel_value(const unsigned char *buf_row,
-			FT_Render_Mode render_mode, const uint32_t x)
+/* requires the graphics context and the font cache lock */
+void fill_vertex_buffer(struct ft2_source *srcdata)
 {
-	if (render_mode == FT_RENDER_MODE_NORMAL) {
-		return buf_row[x];
-	}
+	for (int i = 0; i < MAX_FILL_PASSES; i++) {
+		uint64_t generation = ft2_atlas_get_generation();
 
-	const uint32_t byte_index = x / 8;
-	const uint8_t bit_index = x % 8;
-	const bool pixel_set = (buf_row[byte_index] >> (7 - bit_index)) & 1;
-	return pixel_set ? 255 : 0;
-}
+		fill_vertex_buffer_pass(srcdata);
 
-void rasterize(struct ft2_source *srcdata, FT_GlyphSlot slot,
-	       const FT_Render_Mode render_mode, const uint32_t dx,
-	       const uint32_t dy)
-{
-	/**
-	 * The pitch's absolute value is the number of bytes taken by one bitmap
-	 * row, including padding.
-	 *
-	 * Source: https://www.freetype.org/freetype2/docs/reference/ft2-basic_types.html
-	 */
-	const int pitch = abs(slot->bitmap.pitch);
-
-	for (uint32_t y = 0; y < slot->bitmap.rows; y++) {
-		const uint32_t row_start = y * pitch;
-		const uint32_t row = (dy + y) * texbuf_w;
-
-		for (uint32_t x = 0; x < slot->bitmap.width; x++) {
-			const uint32_t row_pixel_position = dx + x;
-			const uint8_t pixel_value =
-				get_pixel_value(&slot->bitmap.buffer[row_start],
-						render_mode, x);
-			srcdata->texbuf[row_pixel_position + row] = pixel_value;
+		if (generation == ft2_atlas_get_generation()) {
+			srcdata->atlas_generation = generation;
+			break;
 		}
 	}
 }
 
 void cache_glyphs(struct ft2_source *srcdata, wchar_t *cache_glyphs)
 {
-	if (!srcdata->font_face || !cache_glyphs)
+	if (!srcdata->font || !cache_glyphs)
 		return;
 
-	FT_GlyphSlot slot = srcdata->font_face->glyph;
+	ft2_font_cache_lock();
 
-	uint32_t dx = srcdata->texbuf_x;
-	uint32_t dy = srcdata->texbuf_y;
-
-	int32_t cached_glyphs = 0;
 	const size_t len = wcslen(cache_glyphs);
+	for (size_t i = 0; i < len; i++)
+		ft2_font_get_glyph(srcdata->font, cache_glyphs[i]);
 
-	const FT_Render_Mode render_mode = get_render_mode(srcdata);
+	srcdata->max_h = ft2_font_get_max_h(srcdata->font);
 
-	for (size_t i = 0; i < len; i++) {
-		const FT_UInt glyph_index =
-			FT_Get_Char_Index(srcdata->font_face, cache_glyphs[i]);
-
-		if (src_glyph != NULL) {
-			continue;
-		}
-
-		load_glyph(srcdata, glyph_index, render_mode);
-		FT_Render_Glyph(slot, render_mode);
-
-		const uint32_t g_w = slot->bitmap.width;
-		const uint32_t g_h = slot->bitmap.rows;
-
-		if (srcdata->max_h < g_h) {
-			srcdata->max_h = g_h;
-		}
-
-		if (dx + g_w >= texbuf_w) {
-			dx = 0;
-			dy += srcdata->max_h + 1;
-		}
-
-		if (dy + g_h >= texbuf_h) {
-			blog(LOG_WARNING,
-			     "Out of space trying to render glyphs");
-			break;
-		}
-
-		src_glyph = init_glyph(slot, dx, dy, g_w, g_h);
-		rasterize(srcdata, slot, render_mode, dx, dy);
-
-		dx += (g_w + 1);
-		if (dx >= texbuf_w) {
-			dx = 0;
-			dy += srcdata->max_h;
-		}
-
-		cached_glyphs++;
-	}
-
-	srcdata->texbuf_x = dx;
-	srcdata->texbuf_y = dy;
-
-	if (cached_glyphs > 0) {
-
-		obs_enter_graphics();
-
-		if (srcdata->tex != NULL) {
-			gs_texture_t *tmp_texture = srcdata->tex;
-			srcdata->tex = NULL;
-			gs_texture_destroy(tmp_texture);
-		}
-
-		srcdata->tex = gs_texture_create(
-			texbuf_w, texbuf_h, GS_A8, 1,
-			(const uint8_t **)&srcdata->texbuf, 0);
-
-		obs_leave_graphics();
-	}
+	ft2_font_cache_unlock();
 }
 
 time_t get_modified_timestamp(char *filename)
@@ -562,23 +449,29 @@ uint32_t get_ft2_text_width(wchar_t *text, struct ft2_source *srcdata)
 		return 0;
 	}
 
-	FT_GlyphSlot slot = srcdata->font_face->glyph;
+	if (!srcdata->font)
+		return 0;
+
 	uint32_t w = 0, max_w = 0;
 	const size_t len = wcslen(text);
-	for (size_t i = 0; i < len; i++) {
-		const FT_UInt glyph_index =
-			FT_Get_Char_Index(srcdata->font_face, text[i]);
 
-		load_glyph(srcdata, glyph_index, get_render_mode(srcdata));
+	ft2_font_cache_lock();
 
-		if (text[i] == L'\n')
+	for (size_t i = 0; i < len; i++) {
+		if (text[i] == L'\n') {
 			w = 0;
-		else {
-			w += slot->advance.x >> 6;
-			if (w > max_w)
-				max_w = w;
+			continue;
 		}
+
+		struct glyph_info *glyph =
+			ft2_font_get_glyph(srcdata->font, text[i]);
+		if (glyph)
+			w += glyph->xadv;
+		if (w > max_w)
+			max_w = w;
 	}
 
+	ft2_font_cache_unlock();
+
 	return max_w;
 }
@@ -0,0 +1,370 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <util/platform.h>
+#include <media-io/audio-math.h>
+#include <media-io/audio-dsp.h>
+
+#define FRAMES 1024
+#define CHANNELS 6
+
+/* the kernels are compared against the per-sample code the dynamics filters
+ * used before */
+
+static void reference_envelope(float *env_buf, float **samples,
+			       size_t channels, size_t frames, float envelope,
+			       float attack_gain, float release_gain)
+{
+	memset(env_buf, 0, frames * sizeof(float));
+	for (size_t chan = 0; chan < channels; ++chan) {
+		if (!samples[chan])
+			continue;
+
+		float env = envelope;
+		for (size_t i = 0; i < frames; ++i) {
+			const float env_in = fabsf(samples[chan][i]);
+			if (env < env_in) {
+				env = env_in + attack_gain * (env - env_in);
+			} else {
+				env = env_in + release_gain * (env - env_in);
+			}
+			env_buf[i] = fmaxf(env_buf[i], env);
+		}
+	}
+}
+
+static float reference_compressor_gain(float env, float threshold, float slope,
+				       float output_gain)
+{
+	const float env_db = mul_to_db(env);
+	float gain = slope * (threshold - env_db);
+	gain = db_to_mul(fminf(0, gain));
+	return gain * output_gain;
+}
+
+static float reference_expander_gain_db(float env, float threshold,
+					float slope)
+{
+	const float env_db = mul_to_db(env);
+	return threshold - env_db > 0.0f
+		       ? fmaxf(slope * (threshold - env_db), -60.0f)
+		       : 0.0f;
+}
+
+static float random_float(float min, float max)
+{
+	return min + (max - min) * ((float)rand() / (float)RAND_MAX);
+}
+
+/* audio-like signal, a decaying sine with some noise */
+static void fill_signal(float *data, size_t frames, float level)
+{
+	for (size_t i = 0; i < frames; i++) {
+		float t = (float)i / (float)frames;
+		data[i] = level * expf(-3.0f * t) * sinf((float)i * 0.07f) +
+			  random_float(-0.01f, 0.01f) * level;
+	}
+}
+
+static void mul_to_db_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	float src[FRAMES];
+	float dst[FRAMES];
+	float max_error = 0.0f;
+
+	/* -140 dB to +12 dB */
+	for (size_t i = 0; i < FRAMES; i++)
+		src[i] = db_to_mul(-140.0f + 152.0f * (float)i / FRAMES);
+
+	/* an odd count covers the scalar tail as well */
+	audio_dsp_mul_to_db_block(dst, src, FRAMES - 3);
+	for (size_t i = FRAMES - 3; i < FRAMES; i++)
+		dst[i] = audio_dsp_mul_to_db(src[i]);
+
+	for (size_t i = 0; i < FRAMES; i++) {
+		float error = fabsf(dst[i] - mul_to_db(src[i]));
+		if (error > max_error)
+			max_error = error;
+	}
+
+	print_message("mul_to_db max error: %g dB\n", max_error);
+	assert_true(max_error < AUDIO_DSP_DB_MAX_ERROR);
+
+	/* silence does not turn into a gain */
+	assert_true(audio_dsp_mul_to_db(0.0f) < -700.0f);
+}
+
+static void db_to_mul_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	float src[FRAMES];
+	float dst[FRAMES];
+	float max_error = 0.0f;
+
+	/* -140 dB to +32 dB */
+	for (size_t i = 0; i < FRAMES; i++)
+		src[i] = -140.0f + 172.0f * (float)i / FRAMES;
+
+	audio_dsp_db_to_mul_block(dst, src, FRAMES - 1);
+	dst[FRAMES - 1] = audio_dsp_db_to_mul(src[FRAMES - 1]);
+
+	for (size_t i = 0; i < FRAMES; i++) {
+		float ref = db_to_mul(src[i]);
+		float error = fabsf(dst[i] - ref) / ref;
+		if (error > max_error)
+			max_error = error;
+	}
+
+	print_message("db_to_mul max relative error: %g\n", max_error);
+	assert_true(max_error < AUDIO_DSP_MUL_MAX_ERROR);
+
+	assert_true(audio_dsp_db_to_mul(-INFINITY) == 0.0f);
+	assert_true(audio_dsp_db_to_mul(NAN) == 0.0f);
+	assert_true(audio_dsp_db_to_mul(0.0f) == 1.0f);
+}
+
+static void envelope_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	static float data[CHANNELS][FRAMES];
+	float *samples[CHANNELS];
+	float ref[FRAMES];
+	float env[FRAMES];
+
+	for (size_t c = 0; c < CHANNELS; c++) {
+		fill_signal(data[c], FRAMES, 1.0f / (float)(c + 1));
+		samples[c] = data[c];
+	}
+
+	for (size_t channels = 1; channels <= CHANNELS; channels++) {
+		reference_envelope(ref, samples, channels, FRAMES, 0.1f,
+				   0.99f, 0.999f);
+		audio_dsp_peak_envelope(env, samples, channels, FRAMES, 0.1f,
+					0.99f, 0.999f);
+
+		for (size_t i = 0; i < FRAMES; i++)
+			assert_true(fabsf(env[i] - ref[i]) <= 1e-6f);
+	}
+
+	/* muted channels are skipped */
+	samples[1] = NULL;
+	samples[4] = NULL;
+	reference_envelope(ref, samples, CHANNELS, FRAMES, 0.0f, 0.9f, 0.99f);
+	audio_dsp_peak_envelope(env, samples, CHANNELS, FRAMES, 0.0f, 0.9f,
+				0.99f);
+	for (size_t i = 0; i < FRAMES; i++)
+		assert_true(fabsf(env[i] - ref[i]) <= 1e-6f);
+}
+
+static void compressor_gain_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	float env[FRAMES];
+	float gain[FRAMES];
+	float max_error = 0.0f;
+
+	for (int run = 0; run < 64; run++) {
+		float threshold = random_float(-60.0f, 0.0f);
+		float ratio = random_float(1.0f, 32.0f);
+		float slope = 1.0f - 1.0f / ratio;
+		float output_gain = db_to_mul(random_float(-32.0f, 32.0f));
+
+		for (size_t i = 0; i < FRAMES; i++)
+			env[i] = db_to_mul(random_float(-100.0f, 6.0f));
+		env[0] = 0.0f;
+
+		audio_dsp_compressor_gain(gain, env, FRAMES, threshold, slope,
+					  output_gain);
+
+		for (size_t i = 0; i < FRAMES; i++) {
+			float ref = reference_compressor_gain(
+				env[i], threshold, slope, output_gain);
+			float error = fabsf(mul_to_db(gain[i] / ref));
+			if (error > max_error)
+				max_error = error;
+		}
+	}
+
+	print_message("compressor gain max error: %g dB\n", max_error);
+	assert_true(max_error < 0.001f);
+}
+
+static void expander_gain_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	float env[FRAMES];
+	float gain[FRAMES];
+	float max_error = 0.0f;
+
+	for (int run = 0; run < 64; run++) {
+		float threshold = random_float(-60.0f, 0.0f);
+		float slope = 1.0f - random_float(1.0f, 20.0f);
+
+		for (size_t i = 0; i < FRAMES; i++)
+			env[i] = db_to_mul(random_float(-100.0f, 6.0f));
+
+		audio_dsp_mul_to_db_block(gain, env, FRAMES);
+		for (size_t i = 0; i < FRAMES; i++) {
+			const float below = threshold - gain[i];
+			gain[i] = below > 0.0f ? fmaxf(slope * below, -60.0f)
+					       : 0.0f;
+		}
+		audio_dsp_db_to_gain(gain, gain, FRAMES, 1.0f);
+
+		for (size_t i = 0; i < FRAMES; i++) {
+			float ref = db_to_mul(reference_expander_gain_db(
+				env[i], threshold, slope));
+			float error = fabsf(mul_to_db(gain[i] / ref));
+			if (error > max_error)
+				max_error = error;
+		}
+	}
+
+	print_message("expander gain max error: %g dB\n", max_error);
+	assert_true(max_error < 0.01f);
+}
+
+/* ------------------------------------------------------------------------- */
+/* benchmarks, the gain stage of each filter for a stereo block              */
+
+#define BENCH_FRAMES 480
+#define BENCH_RUNS 2000
+
+static float bench_data[2][BENCH_FRAMES];
+static float bench_env[BENCH_FRAMES];
+static float bench_gain[BENCH_FRAMES];
+
+static void bench_compressor_reference(float threshold, float slope)
+{
+	float *samples[2] = {bench_data[0], bench_data[1]};
+
+	reference_envelope(bench_env, samples, 2, BENCH_FRAMES, 0.0f, 0.99f,
+			   0.999f);
+	for (size_t i = 0; i < BENCH_FRAMES; ++i) {
+		float gain = reference_compressor_gain(bench_env[i], threshold,
+						       slope, 1.0f);
+		for (size_t c = 0; c < 2; ++c)
+			samples[c][i] *= gain;
+	}
+}
+
+static void bench_compressor_kernel(float threshold, float slope)
+{
+	float *samples[2] = {bench_data[0], bench_data[1]};
+
+	audio_dsp_peak_envelope(bench_env, samples, 2, BENCH_FRAMES, 0.0f,
+				0.99f, 0.999f);
+	audio_dsp_compressor_gain(bench_env, bench_env, BENCH_FRAMES,
+				  threshold, slope, 1.0f);
+	audio_dsp_apply_gain(samples, 2, bench_env, BENCH_FRAMES);
+}
+
+static void bench_expander_reference(float threshold, float slope)
+{
+	for (size_t c = 0; c < 2; c++) {
+		for (size_t i = 0; i < BENCH_FRAMES; ++i) {
+			float env = fabsf(bench_data[c][i]);
+			float gain_db = reference_expander_gain_db(
+				env, threshold, slope);
+			bench_data[c][i] *= db_to_mul(fminf(0, gain_db));
+		}
+	}
+}
+
+static void bench_expander_kernel(float threshold, float slope)
+{
+	for (size_t c = 0; c < 2; c++) {
+		float *samples = bench_data[c];
+
+		for (size_t i = 0; i < BENCH_FRAMES; ++i)
+			bench_env[i] = fabsf(samples[i]);
+		audio_dsp_mul_to_db_block(bench_gain, bench_env, BENCH_FRAMES);
+		for (size_t i = 0; i < BENCH_FRAMES; ++i) {
+			const float below = threshold - bench_gain[i];
+			bench_gain[i] = below > 0.0f
+						? fmaxf(slope * below, -60.0f)
+						: 0.0f;
+		}
+		audio_dsp_db_to_gain(bench_gain, bench_gain, BENCH_FRAMES,
+				     1.0f);
+		audio_dsp_apply_gain(&samples, 1, bench_gain, BENCH_FRAMES);
+	}
+}
+
+typedef void (*bench_func)(float threshold, float slope);
+
+static uint64_t run_bench(bench_func func, float threshold, float slope)
+{
+	uint64_t start = os_gettime_ns();
+
+	for (int run = 0; run < BENCH_RUNS; run++) {
+		/* keep the signal from decaying to silence */
+		if (run % 16 == 0) {
+			fill_signal(bench_data[0], BENCH_FRAMES, 1.0f);
+			fill_signal(bench_data[1], BENCH_FRAMES, 0.5f);
+		}
+		func(threshold, slope);
+	}
+
+	return os_gettime_ns() - start;
+}
+
+static void print_bench(const char *filter, bench_func reference,
+			bench_func kernel, float threshold, float slope)
+{
+	uint64_t ref_ns = run_bench(reference, threshold, slope);
+	uint64_t kernel_ns = run_bench(kernel, threshold, slope);
+	double samples = (double)BENCH_RUNS * BENCH_FRAMES * 2;
+
+	print_message("%-10s reference: %6.2f ns/sample, kernels: "
+		      "%6.2f ns/sample (%.1fx)\n",
+		      filter, (double)ref_ns / samples,
+		      (double)kernel_ns / samples,
+		      (double)ref_ns / (double)(kernel_ns ? kernel_ns : 1));
+}
+
+/* timings vary with the machine and its load, so the benchmark only runs on
+ * request */
+static void benchmark(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	if (!getenv("OBS_BENCHMARKS"))
+		skip();
+
+	/* compressor at 10:1, limiter is the same with an infinite ratio,
+	 * expander at 2:1 */
+	print_bench("compressor", bench_compressor_reference,
+		    bench_compressor_kernel, -18.0f, 0.9f);
+	print_bench("limiter", bench_compressor_reference,
+		    bench_compressor_kernel, -6.0f, 1.0f);
+	print_bench("expander", bench_expander_reference,
+		    bench_expander_kernel, -40.0f, -1.0f);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(mul_to_db_test),
+		cmocka_unit_test(db_to_mul_test),
+		cmocka_unit_test(envelope_test),
+		cmocka_unit_test(compressor_gain_test),
+		cmocka_unit_test(expander_gain_test),
+		cmocka_unit_test(benchmark),
+	};
+
+	srand(1);
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,333 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <media-io/audio-resampler.h>
+
+#define CHUNK_FRAMES 1024
+#define SECONDS 2
+#define BENCHMARK_SECONDS 10
+
+static const char *type_names[] = {"auto", "native", "swr"};
+
+/* feeds a sine in chunks and returns the output of the first channel as
+ * float, which the caller frees.  also checks that the timestamp offsets
+ * line the output chunks up with the output that came before them. */
+static float *resample_sine(enum audio_resampler_type type, uint32_t in_rate,
+			    uint32_t out_rate, double freq, size_t *out_total)
+{
+	struct resample_info src = {in_rate, AUDIO_FORMAT_FLOAT_PLANAR,
+				    SPEAKERS_STEREO};
+	struct resample_info dst = {out_rate, AUDIO_FORMAT_FLOAT_PLANAR,
+				    SPEAKERS_STEREO};
+	audio_resampler_t *rs = audio_resampler_create_type(&dst, &src, type);
+	size_t in_total = (size_t)in_rate * SECONDS;
+	size_t capacity = (size_t)out_rate * SECONDS + CHUNK_FRAMES;
+	float *output = bmalloc(capacity * sizeof(float));
+	float input[CHUNK_FRAMES];
+	size_t total = 0;
+
+	assert_non_null(rs);
+
+	for (size_t pos = 0; pos < in_total; pos += CHUNK_FRAMES) {
+		const uint8_t *in[2] = {(uint8_t *)input, (uint8_t *)input};
+		uint8_t *out[MAX_AV_PLANES] = {0};
+		uint32_t frames;
+		uint64_t offset;
+
+		for (size_t i = 0; i < CHUNK_FRAMES; i++)
+			input[i] = 0.5f * (float)sin(2.0 * M_PI * freq *
+						     (double)(pos + i) /
+						     in_rate);
+
+		assert_true(audio_resampler_resample(rs, out, &frames, &offset,
+						     in, CHUNK_FRAMES));
+		assert_true(total + frames <= capacity);
+
+		/* the same timestamp handling as obs_source_output_audio */
+		if (type != AUDIO_RESAMPLER_FFMPEG && frames) {
+			double ts = (double)pos * 1e9 / in_rate -
+				    (double)offset;
+			double expected = (double)total * 1e9 / out_rate;
+			assert_true(fabs(ts - expected) < 1000.0);
+		}
+
+		memcpy(output + total, out[0], frames * sizeof(float));
+		total += frames;
+	}
+
+	audio_resampler_destroy(rs);
+	*out_total = total;
+	return output;
+}
+
+/* THD+N of a sine, from a least squares fit at the known frequency.  the
+ * first and last 100 ms are skipped. */
+static double thd_n(const float *data, size_t frames, uint32_t rate,
+		    double freq, double *phase)
+{
+	size_t start = rate / 10;
+	size_t end = frames - rate / 10;
+	double ss = 0.0, sc = 0.0, cc = 0.0, ys = 0.0, yc = 0.0;
+
+	for (size_t i = start; i < end; i++) {
+		double w = 2.0 * M_PI * freq * (double)i / rate;
+		double s = sin(w), c = cos(w);
+		ss += s * s;
+		sc += s * c;
+		cc += c * c;
+		ys += data[i] * s;
+		yc += data[i] * c;
+	}
+
+	double det = ss * cc - sc * sc;
+	double a = (ys * cc - yc * sc) / det;
+	double b = (yc * ss - ys * sc) / det;
+	double signal = 0.0, noise = 0.0;
+
+	for (size_t i = start; i < end; i++) {
+		double w = 2.0 * M_PI * freq * (double)i / rate;
+		double fit = a * sin(w) + b * cos(w);
+		double err = data[i] - fit;
+		signal += fit * fit;
+		noise += err * err;
+	}
+
+	*phase = atan2(b, a);
+	return 10.0 * log10(noise / signal);
+}
+
+static void quality_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	const uint32_t rates[][2] = {
+		{44100, 48000}, {48000, 44100}, {32000, 48000}, {96000, 48000}};
+	const double freqs[] = {1000.0, 10000.0};
+
+	for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+		for (size_t f = 0; f < sizeof(freqs) / sizeof(freqs[0]); f++) {
+			for (int type = AUDIO_RESAMPLER_NATIVE;
+			     type <= AUDIO_RESAMPLER_FFMPEG; type++) {
+				size_t frames;
+				double phase;
+				float *out = resample_sine(type, rates[r][0],
+							   rates[r][1],
+							   freqs[f], &frames);
+				double thd = thd_n(out, frames, rates[r][1],
+						   freqs[f], &phase);
+
+				print_message("%-6s %5u -> %5u Hz, %5.0f Hz: "
+					      "THD+N %6.1f dB\n",
+					      type_names[type], rates[r][0],
+					      rates[r][1], freqs[f], thd);
+
+				/* the output is not delayed or advanced */
+				if (type == AUDIO_RESAMPLER_NATIVE) {
+					assert_true(thd < -80.0);
+					assert_true(fabs(phase) < 0.01);
+				}
+
+				bfree(out);
+			}
+		}
+	}
+}
+
+/* difference in steps of the output format, float counts 16 bit steps */
+static double sample_diff(enum audio_format format, const uint8_t *a,
+			  const uint8_t *b)
+{
+	switch (format) {
+	case AUDIO_FORMAT_U8BIT:
+	case AUDIO_FORMAT_U8BIT_PLANAR:
+		return (double)*a - (double)*b;
+	case AUDIO_FORMAT_16BIT:
+	case AUDIO_FORMAT_16BIT_PLANAR:
+		return (double)*(const int16_t *)a -
+		       (double)*(const int16_t *)b;
+	case AUDIO_FORMAT_32BIT:
+	case AUDIO_FORMAT_32BIT_PLANAR:
+		return (double)*(const int32_t *)a -
+		       (double)*(const int32_t *)b;
+	case AUDIO_FORMAT_FLOAT:
+	case AUDIO_FORMAT_FLOAT_PLANAR:
+		return ((double)*(const float *)a - (double)*(const float *)b) *
+		       32768.0;
+	case AUDIO_FORMAT_UNKNOWN:
+		break;
+	}
+
+	return 0.0;
+}
+
+/* format conversions and mono upmixing without a rate change match
+ * swresample */
+static void conversion_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	const enum audio_format formats[] = {
+		AUDIO_FORMAT_U8BIT,        AUDIO_FORMAT_16BIT,
+		AUDIO_FORMAT_32BIT,        AUDIO_FORMAT_FLOAT,
+		AUDIO_FORMAT_16BIT_PLANAR, AUDIO_FORMAT_FLOAT_PLANAR};
+	const size_t count = sizeof(formats) / sizeof(formats[0]);
+	int16_t s16[CHUNK_FRAMES * 2];
+
+	/* covers the whole 16 bit range */
+	for (size_t i = 0; i < CHUNK_FRAMES * 2; i++)
+		s16[i] = (int16_t)((i * 977) % 65536 - 32768);
+
+	for (size_t in = 0; in < count; in++) {
+		for (size_t out = 0; out < count; out++) {
+			/* planar inputs are mono and upmixed to 5.1 */
+			enum speaker_layout in_speakers =
+				is_audio_planar(formats[in]) ? SPEAKERS_MONO
+							     : SPEAKERS_STEREO;
+			enum speaker_layout out_speakers =
+				is_audio_planar(formats[in]) ? SPEAKERS_5POINT1
+							     : SPEAKERS_STEREO;
+			struct resample_info s16_info = {
+				48000, AUDIO_FORMAT_16BIT, in_speakers};
+			struct resample_info src = {48000, formats[in],
+						    in_speakers};
+			struct resample_info dst = {48000, formats[out],
+						    out_speakers};
+			const uint8_t *s16_data[MAX_AV_PLANES] = {
+				(uint8_t *)s16};
+			uint8_t *in_data[MAX_AV_PLANES] = {0};
+			uint8_t *native_data[MAX_AV_PLANES] = {0};
+			uint8_t *swr_data[MAX_AV_PLANES] = {0};
+			uint32_t in_frames, native_frames, swr_frames;
+			uint64_t offset;
+
+			audio_resampler_t *conv = audio_resampler_create_type(
+				&src, &s16_info, AUDIO_RESAMPLER_AUTO);
+			audio_resampler_t *native = audio_resampler_create_type(
+				&dst, &src, AUDIO_RESAMPLER_NATIVE);
+			audio_resampler_t *swr = audio_resampler_create_type(
+				&dst, &src, AUDIO_RESAMPLER_FFMPEG);
+
+			assert_non_null(conv);
+			assert_non_null(native);
+			assert_non_null(swr);
+
+			assert_true(audio_resampler_resample(
+				conv, in_data, &in_frames, &offset, s16_data,
+				CHUNK_FRAMES));
+			assert_true(audio_resampler_resample(
+				native, native_data, &native_frames, &offset,
+				(const uint8_t *const *)in_data, in_frames));
+			assert_true(audio_resampler_resample(
+				swr, swr_data, &swr_frames, &offset,
+				(const uint8_t *const *)in_data, in_frames));
+			assert_int_equal(native_frames, CHUNK_FRAMES);
+			assert_int_equal(swr_frames, CHUNK_FRAMES);
+
+			size_t planes = get_audio_planes(dst.format,
+							 dst.speakers);
+			size_t size = get_audio_size(dst.format, dst.speakers,
+						     native_frames);
+			size_t bytes = get_audio_bytes_per_channel(dst.format);
+
+			/* allow for a different rounding of a single step */
+			for (size_t p = 0; p < planes; p++) {
+				for (size_t i = 0; i < size; i += bytes) {
+					double diff = sample_diff(
+						dst.format, native_data[p] + i,
+						swr_data[p] + i);
+					assert_true(fabs(diff) <= 1.0);
+				}
+			}
+
+			audio_resampler_destroy(conv);
+			audio_resampler_destroy(native);
+			audio_resampler_destroy(swr);
+		}
+	}
+}
+
+static void benchmark_case(const struct resample_info *dst,
+			   const struct resample_info *src, const char *name)
+{
+	const size_t chunks = (size_t)src->samples_per_sec *
+			      BENCHMARK_SECONDS / CHUNK_FRAMES;
+	size_t size = get_audio_size(src->format, src->speakers, CHUNK_FRAMES);
+	uint8_t *buf = bzalloc(size);
+	const uint8_t *in[MAX_AV_PLANES] = {0};
+
+	for (size_t i = 0; i < get_audio_planes(src->format, src->speakers);
+	     i++)
+		in[i] = buf;
+
+	for (int type = AUDIO_RESAMPLER_NATIVE; type <= AUDIO_RESAMPLER_FFMPEG;
+	     type++) {
+		audio_resampler_t *rs =
+			audio_resampler_create_type(dst, src, type);
+		uint8_t *out[MAX_AV_PLANES];
+		uint32_t frames;
+		uint64_t offset;
+
+		assert_non_null(rs);
+
+		uint64_t start = os_gettime_ns();
+		for (size_t i = 0; i < chunks; i++)
+			audio_resampler_resample(rs, out, &frames, &offset, in,
+						 CHUNK_FRAMES);
+		uint64_t elapsed = os_gettime_ns() - start;
+
+		print_message("%-28s %-6s: %6.1f us per second of audio\n",
+			      name, type_names[type],
+			      (double)elapsed / 1000.0 / BENCHMARK_SECONDS);
+
+		audio_resampler_destroy(rs);
+	}
+
+	bfree(buf);
+}
+
+/* only runs with OBS_BENCHMARKS set */
+static void benchmark(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	if (!getenv("OBS_BENCHMARKS"))
+		skip();
+
+	const struct resample_info f48 = {48000, AUDIO_FORMAT_FLOAT_PLANAR,
+					  SPEAKERS_STEREO};
+	const struct resample_info f44 = {44100, AUDIO_FORMAT_FLOAT_PLANAR,
+					  SPEAKERS_STEREO};
+	const struct resample_info s48 = {48000, AUDIO_FORMAT_16BIT,
+					  SPEAKERS_STEREO};
+	const struct resample_info m48 = {48000, AUDIO_FORMAT_FLOAT_PLANAR,
+					  SPEAKERS_MONO};
+	const struct resample_info s44 = {44100, AUDIO_FORMAT_16BIT,
+					  SPEAKERS_STEREO};
+
+	benchmark_case(&f48, &s48, "s16 -> float planar");
+	benchmark_case(&s48, &f48, "float planar -> s16");
+	benchmark_case(&f48, &m48, "mono -> stereo");
+	benchmark_case(&f48, &f44, "44.1 -> 48 kHz");
+	benchmark_case(&f44, &f48, "48 -> 44.1 kHz");
+	benchmark_case(&f48, &s44, "44.1 kHz s16 -> 48 kHz float");
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(quality_test),
+		cmocka_unit_test(conversion_test),
+		cmocka_unit_test(benchmark),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,228 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <util/threading.h>
+#include <util/platform.h>
+#include <media-io/audio-io.h>
+
+#define SAMPLE_RATE 48000
+#define CHANNELS 2
+#define SOURCES 16
+#define BENCHMARK_MS 1000
+#define TEST_TICKS 8
+#define TEST_TIMEOUT_MS 10000
+
+/* stands in for the per-source work of the libobs audio callback: a lock and
+ * a mix of one tick of audio into every active mix.  the counters are only
+ * touched by the audio thread and read after it has been joined, except for
+ * mixed_ticks which is polled while it runs. */
+struct tick_test {
+	pthread_mutex_t mutex;
+	float source_data[CHANNELS][AUDIO_OUTPUT_FRAMES];
+
+	uint32_t expected_frames;
+	long ticks;
+	volatile long mixed_ticks;
+	long frames;
+	long bad_frames;
+
+	uint64_t tick_start;
+	uint64_t busy_ns;
+};
+
+static bool input_callback(void *param, uint64_t start_ts, uint64_t end_ts,
+			   uint64_t *new_ts, uint32_t active_mixers,
+			   struct audio_output_data *mixes)
+{
+	struct tick_test *test = param;
+	size_t frames = test->expected_frames;
+
+	test->tick_start = os_gettime_ns();
+
+	for (size_t i = 0; i < SOURCES; i++) {
+		pthread_mutex_lock(&test->mutex);
+
+		for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
+			if ((active_mixers & (1 << mix)) == 0)
+				continue;
+
+			for (size_t ch = 0; ch < CHANNELS; ch++) {
+				float *out = mixes[mix].data[ch];
+				const float *in = test->source_data[ch];
+
+				for (size_t f = 0; f < frames; f++)
+					out[f] += in[f];
+			}
+		}
+
+		pthread_mutex_unlock(&test->mutex);
+	}
+
+	test->ticks++;
+	if (active_mixers == (1 << MAX_AUDIO_MIXES) - 1)
+		os_atomic_inc_long(&test->mixed_ticks);
+	*new_ts = start_ts;
+
+	UNUSED_PARAMETER(end_ts);
+	return true;
+}
+
+static void output_callback(void *param, size_t mix_idx,
+			    struct audio_data *data)
+{
+	struct tick_test *test = param;
+
+	if (data->frames != test->expected_frames)
+		test->bad_frames++;
+	test->frames += data->frames;
+
+	/* the mixes are output in order, the last one ends the tick */
+	if (mix_idx == MAX_AUDIO_MIXES - 1)
+		test->busy_ns += os_gettime_ns() - test->tick_start;
+}
+
+static audio_t *open_audio(struct tick_test *test, uint32_t frames_per_tick)
+{
+	struct audio_output_info info = {
+		.name = "test",
+		.samples_per_sec = SAMPLE_RATE,
+		.format = AUDIO_FORMAT_FLOAT_PLANAR,
+		.speakers = SPEAKERS_STEREO,
+		.input_callback = input_callback,
+		.input_param = test,
+		.frames_per_tick = frames_per_tick,
+	};
+	audio_t *audio = NULL;
+
+	if (audio_output_open(&audio, &info) != AUDIO_OUTPUT_SUCCESS)
+		return NULL;
+	return audio;
+}
+
+static void invalid_tick_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	const uint32_t invalid[] = {64, 100, 768, 2048};
+	struct tick_test test = {0};
+
+	for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+		assert_null(open_audio(&test, invalid[i]));
+}
+
+static void default_tick_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct tick_test test = {0};
+	audio_t *audio = open_audio(&test, 0);
+
+	assert_non_null(audio);
+	assert_int_equal(audio_output_get_frames_per_tick(audio),
+			 AUDIO_OUTPUT_FRAMES);
+	assert_int_equal(audio_output_get_info(audio)->frames_per_tick,
+			 AUDIO_OUTPUT_FRAMES);
+	audio_output_close(audio);
+}
+
+static audio_t *start_audio(struct tick_test *test, uint32_t frames)
+{
+	pthread_mutex_init(&test->mutex, NULL);
+	for (size_t ch = 0; ch < CHANNELS; ch++)
+		for (size_t f = 0; f < AUDIO_OUTPUT_FRAMES; f++)
+			test->source_data[ch][f] = 0.001f;
+	test->expected_frames = frames;
+
+	audio_t *audio = open_audio(test, frames);
+	assert_non_null(audio);
+	assert_int_equal(audio_output_get_frames_per_tick(audio), frames);
+
+	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++)
+		audio_output_connect(audio, mix, NULL, output_callback, test);
+	return audio;
+}
+
+/* every mix receives whole ticks of the configured size, no matter how fast
+ * the machine is, so this only waits for a few ticks instead of timing them */
+static void tick_size_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	for (uint32_t frames = AUDIO_OUTPUT_FRAMES;
+	     frames >= MIN_AUDIO_OUTPUT_FRAMES; frames /= 2) {
+		struct tick_test test = {0};
+		audio_t *audio = start_audio(&test, frames);
+
+		for (int ms = 0; ms < TEST_TIMEOUT_MS; ms++) {
+			if (os_atomic_load_long(&test.mixed_ticks) >=
+			    TEST_TICKS)
+				break;
+			os_sleep_ms(1);
+		}
+
+		audio_output_close(audio);
+		pthread_mutex_destroy(&test.mutex);
+
+		long tick_frames = (long)frames * MAX_AUDIO_MIXES;
+		assert_true(test.mixed_ticks >= TEST_TICKS);
+		assert_int_equal(test.bad_frames, 0);
+		assert_true(test.frames >= test.mixed_ticks * tick_frames &&
+			    test.frames <= test.ticks * tick_frames);
+	}
+}
+
+/* runs the audio thread in real time for each tick size, and reports the time
+ * spent mixing and outputting per second of audio, and the process CPU usage,
+ * which also includes the cost of waking up the audio thread.  only runs with
+ * OBS_BENCHMARKS set. */
+static void benchmark(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	if (!getenv("OBS_BENCHMARKS"))
+		skip();
+
+	for (uint32_t frames = AUDIO_OUTPUT_FRAMES;
+	     frames >= MIN_AUDIO_OUTPUT_FRAMES; frames /= 2) {
+		struct tick_test test = {0};
+
+		uint64_t start = os_gettime_ns();
+		audio_t *audio = start_audio(&test, frames);
+
+		os_cpu_usage_info_t *cpu = os_cpu_usage_info_start();
+		os_sleep_ms(BENCHMARK_MS);
+		double usage = os_cpu_usage_info_query(cpu);
+		os_cpu_usage_info_destroy(cpu);
+
+		audio_output_close(audio);
+		uint64_t elapsed = os_gettime_ns() - start;
+		pthread_mutex_destroy(&test.mutex);
+
+		double audio_sec = (double)test.mixed_ticks * frames /
+				   SAMPLE_RATE;
+
+		print_message("%4u frames: %5.2f ms per tick, %4ld ticks/s, "
+			      "%6.1f us busy per second of audio, "
+			      "%5.2f%% CPU\n",
+			      (unsigned)frames, frames * 1000.0 / SAMPLE_RATE,
+			      (long)(test.ticks * 1000000000ULL / elapsed),
+			      (double)test.busy_ns / 1000.0 / audio_sec, usage);
+	}
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(invalid_tick_test),
+		cmocka_unit_test(default_tick_test),
+		cmocka_unit_test(tick_size_test),
+		cmocka_unit_test(benchmark),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,392 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <util/array-serializer.h>
+#include "mp4-mux.h"
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include "ffmpeg-mux.h"
+
+#define FPS 60
+#define GOP_FRAMES (FPS * 2)
+#define SECONDS 20
+#define NUM_FRAMES (FPS * SECONDS)
+#define SAMPLE_RATE 48000
+#define AAC_FRAME_SIZE 1024
+#define KEYFRAME_SIZE (256 * 1024)
+#define FRAME_SIZE (24 * 1024)
+#define AAC_PACKET_SIZE 384
+
+/* baseline profile 1920x1080 */
+static const uint8_t avc_header[] = {
+	0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0xc0, 0x28, 0xda,
+	0x01, 0xe0, 0x08, 0x9f, 0x95, 0x00, 0x00, 0x00, 0x01,
+	0x68, 0xce, 0x3c, 0x80,
+};
+
+/* AAC-LC, 48 kHz, stereo */
+static const uint8_t aac_header[] = {0x11, 0x90};
+
+static inline uint32_t rb32(const uint8_t *data)
+{
+	return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+	       ((uint32_t)data[2] << 8) | (uint32_t)data[3];
+}
+
+static void init_tracks(struct mp4_track tracks[2])
+{
+	memset(tracks, 0, sizeof(struct mp4_track) * 2);
+
+	tracks[0].type = OBS_ENCODER_VIDEO;
+	tracks[0].track_id = 1;
+	tracks[0].timescale = FPS;
+	tracks[0].default_duration = 1;
+	tracks[0].width = 1920;
+	tracks[0].height = 1080;
+	tracks[0].config = bmemdup(avc_header, sizeof(avc_header));
+	tracks[0].config_size = sizeof(avc_header);
+
+	tracks[1].type = OBS_ENCODER_AUDIO;
+	tracks[1].track_id = 2;
+	tracks[1].timescale = SAMPLE_RATE;
+	tracks[1].sample_rate = SAMPLE_RATE;
+	tracks[1].channels = 2;
+	tracks[1].default_duration = AAC_FRAME_SIZE;
+	tracks[1].config = bmemdup(aac_header, sizeof(aac_header));
+	tracks[1].config_size = sizeof(aac_header);
+}
+
+static void free_tracks(struct mp4_track tracks[2])
+{
+	for (size_t i = 0; i < 2; i++) {
+		bfree(tracks[i].config);
+		da_free(tracks[i].samples);
+		da_free(tracks[i].data);
+	}
+}
+
+static void add_sample(struct mp4_track *track, const uint8_t *data,
+		       size_t size, bool keyframe)
+{
+	struct mp4_sample *sample = da_push_back_new(track->samples);
+
+	sample->size = (uint32_t)size;
+	sample->duration = track->default_duration;
+	sample->keyframe = keyframe;
+	da_push_back_array(track->data, data, size);
+}
+
+static void mp4_mux_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct array_output_data out;
+	struct serializer s;
+	struct mp4_track tracks[2];
+	uint8_t video[100];
+	uint8_t audio[10];
+	size_t pos;
+
+	memset(video, 0xab, sizeof(video));
+	memset(audio, 0xcd, sizeof(audio));
+	init_tracks(tracks);
+	array_output_serializer_init(&s, &out);
+
+	mp4_write_init_segment(&s, &out, tracks, 2);
+	assert_memory_equal(out.bytes.array + 4, "ftyp", 4);
+	pos = rb32(out.bytes.array);
+	assert_memory_equal(out.bytes.array + pos + 4, "moov", 4);
+	pos += rb32(out.bytes.array + pos);
+	assert_int_equal(pos, out.bytes.num);
+
+	/* a fragment is a moof box followed by an mdat box with the samples
+	 * of all tracks, video first */
+	out.bytes.num = 0;
+	add_sample(&tracks[0], video, sizeof(video), true);
+	add_sample(&tracks[0], video, sizeof(video) / 2, false);
+	add_sample(&tracks[1], audio, sizeof(audio), true);
+	mp4_write_fragment(&s, &out, 1, tracks, 2);
+
+	assert_memory_equal(out.bytes.array + 4, "moof", 4);
+	pos = rb32(out.bytes.array);
+	assert_memory_equal(out.bytes.array + pos + 4, "mdat", 4);
+	assert_int_equal(rb32(out.bytes.array + pos),
+			 8 + sizeof(video) * 3 / 2 + sizeof(audio));
+	assert_int_equal(out.bytes.array[pos + 8], 0xab);
+	assert_int_equal(out.bytes.array[out.bytes.num - 1], 0xcd);
+
+	array_output_serializer_free(&out);
+	free_tracks(tracks);
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* a synthetic 2 second GOP stream, the payload contains no start codes so
+ * that the muxers see one NAL unit per frame */
+struct stream_data {
+	uint8_t *keyframe;
+	uint8_t *frame;
+	uint8_t *audio;
+	uint64_t payload_bytes;
+	uint64_t packets;
+};
+
+static uint8_t *make_payload(size_t size, uint8_t nal_header)
+{
+	uint8_t *data = bmalloc(size);
+
+	memcpy(data, (uint8_t[]){0, 0, 0, 1, nal_header}, 5);
+	for (size_t i = 5; i < size; i++)
+		data[i] = (uint8_t)(rand() % 255 + 1);
+	return data;
+}
+
+typedef void (*packet_func_t)(void *param, bool video, int64_t ts,
+			      const uint8_t *data, size_t size,
+			      bool keyframe);
+
+static void run_stream(struct stream_data *stream, packet_func_t func,
+		       void *param)
+{
+	int64_t audio_ts = 0;
+
+	stream->payload_bytes = 0;
+	stream->packets = 0;
+
+	for (int64_t i = 0; i < NUM_FRAMES; i++) {
+		bool keyframe = i % GOP_FRAMES == 0;
+		const uint8_t *data = keyframe ? stream->keyframe
+					       : stream->frame;
+		size_t size = keyframe ? KEYFRAME_SIZE : FRAME_SIZE;
+
+		func(param, true, i, data, size, keyframe);
+		stream->payload_bytes += size;
+		stream->packets++;
+
+		while (audio_ts * FPS < (i + 1) * SAMPLE_RATE) {
+			func(param, false, audio_ts, stream->audio,
+			     AAC_PACKET_SIZE, true);
+			audio_ts += AAC_FRAME_SIZE;
+			stream->payload_bytes += AAC_PACKET_SIZE;
+			stream->packets++;
+		}
+	}
+}
+
+/* the muxing of the native fragmented MP4 output, fragments are cut at the
+ * keyframes */
+struct native_mux {
+	struct array_output_data out;
+	struct serializer s;
+	struct mp4_track tracks[2];
+	uint32_t sequence;
+	uint64_t written;
+};
+
+static void native_flush(struct native_mux *mux)
+{
+	if (!mux->tracks[0].samples.num)
+		return;
+
+	mp4_write_fragment(&mux->s, &mux->out, ++mux->sequence, mux->tracks,
+			   2);
+	mux->written += mux->out.bytes.num;
+	mux->out.bytes.num = 0;
+
+	for (size_t i = 0; i < 2; i++) {
+		da_resize(mux->tracks[i].samples, 0);
+		da_resize(mux->tracks[i].data, 0);
+	}
+}
+
+static void native_packet(void *param, bool video, int64_t ts,
+			  const uint8_t *data, size_t size, bool keyframe)
+{
+	struct native_mux *mux = param;
+
+	if (video && keyframe)
+		native_flush(mux);
+	add_sample(&mux->tracks[video ? 0 : 1], data, size, keyframe);
+
+	UNUSED_PARAMETER(ts);
+}
+
+/* what obs-ffmpeg-mux does with the same packets, they first go through
+ * the pipe with an ffm_packet_info header each */
+struct ffmpeg_mux {
+	AVFormatContext *ctx;
+	AVPacket *pkt;
+	uint64_t written;
+};
+
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+static int count_written(void *opaque, const uint8_t *buf, int size)
+#else
+static int count_written(void *opaque, uint8_t *buf, int size)
+#endif
+{
+	struct ffmpeg_mux *mux = opaque;
+	mux->written += (uint64_t)size;
+
+	UNUSED_PARAMETER(buf);
+	return size;
+}
+
+static AVStream *add_stream(AVFormatContext *ctx, enum AVMediaType type,
+			    enum AVCodecID codec_id, const uint8_t *header,
+			    size_t size, int timebase_den)
+{
+	AVStream *stream = avformat_new_stream(ctx, NULL);
+
+	stream->time_base = (AVRational){1, timebase_den};
+	stream->codecpar->codec_type = type;
+	stream->codecpar->codec_id = codec_id;
+	stream->codecpar->extradata =
+		av_mallocz(size + AV_INPUT_BUFFER_PADDING_SIZE);
+	stream->codecpar->extradata_size = (int)size;
+	memcpy(stream->codecpar->extradata, header, size);
+	return stream;
+}
+
+static bool ffmpeg_mux_init(struct ffmpeg_mux *mux)
+{
+	AVDictionary *opts = NULL;
+	AVStream *stream;
+	int ret;
+
+	if (avformat_alloc_output_context2(&mux->ctx, NULL, "mp4", NULL) < 0)
+		return false;
+
+	stream = add_stream(mux->ctx, AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_H264,
+			    avc_header, sizeof(avc_header), FPS);
+	stream->codecpar->width = 1920;
+	stream->codecpar->height = 1080;
+
+	stream = add_stream(mux->ctx, AVMEDIA_TYPE_AUDIO, AV_CODEC_ID_AAC,
+			    aac_header, sizeof(aac_header), SAMPLE_RATE);
+	stream->codecpar->sample_rate = SAMPLE_RATE;
+	stream->codecpar->frame_size = AAC_FRAME_SIZE;
+#if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(59, 24, 100)
+	stream->codecpar->channels = 2;
+	stream->codecpar->channel_layout = AV_CH_LAYOUT_STEREO;
+#else
+	av_channel_layout_default(&stream->codecpar->ch_layout, 2);
+#endif
+
+	mux->ctx->pb = avio_alloc_context(av_malloc(65536), 65536, 1, mux,
+					  NULL, count_written, NULL);
+	mux->pkt = av_packet_alloc();
+
+	av_dict_set(&opts, "movflags",
+		    "frag_keyframe+empty_moov+default_base_moof", 0);
+	ret = avformat_write_header(mux->ctx, &opts);
+	av_dict_free(&opts);
+	return ret >= 0;
+}
+
+static void ffmpeg_mux_free(struct ffmpeg_mux *mux)
+{
+	if (mux->ctx && mux->ctx->pb) {
+		av_freep(&mux->ctx->pb->buffer);
+		avio_context_free(&mux->ctx->pb);
+	}
+	avformat_free_context(mux->ctx);
+	av_packet_free(&mux->pkt);
+}
+
+static void ffmpeg_packet(void *param, bool video, int64_t ts,
+			  const uint8_t *data, size_t size, bool keyframe)
+{
+	struct ffmpeg_mux *mux = param;
+	AVPacket *pkt = mux->pkt;
+	AVRational time_base = {1, video ? FPS : SAMPLE_RATE};
+	AVStream *stream = mux->ctx->streams[video ? 0 : 1];
+
+	pkt->data = (uint8_t *)data;
+	pkt->size = (int)size;
+	pkt->stream_index = stream->index;
+	pkt->pts = av_rescale_q(ts, time_base, stream->time_base);
+	pkt->dts = pkt->pts;
+	pkt->flags = keyframe ? AV_PKT_FLAG_KEY : 0;
+
+	av_interleaved_write_frame(mux->ctx, pkt);
+}
+
+static void print_result(const char *name, const struct stream_data *stream,
+			 uint64_t time_ns, uint64_t written, uint64_t piped)
+{
+	print_message("%-11s: %7.1f us per second of media, %.4f bytes "
+		      "written and %.4f bytes piped per payload byte\n",
+		      name, (double)time_ns / 1000.0 / SECONDS,
+		      (double)written / (double)stream->payload_bytes,
+		      (double)piped / (double)stream->payload_bytes);
+}
+
+/* only runs with OBS_BENCHMARKS set */
+static void benchmark(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	if (!getenv("OBS_BENCHMARKS"))
+		skip();
+
+	struct stream_data stream;
+	struct native_mux native = {0};
+	struct ffmpeg_mux ffmpeg = {0};
+	uint64_t start;
+	uint64_t time_ns;
+
+	srand(1);
+	stream.keyframe = make_payload(KEYFRAME_SIZE, 0x65);
+	stream.frame = make_payload(FRAME_SIZE, 0x41);
+	stream.audio = make_payload(AAC_PACKET_SIZE, 0);
+
+	init_tracks(native.tracks);
+	array_output_serializer_init(&native.s, &native.out);
+
+	start = os_gettime_ns();
+	mp4_write_init_segment(&native.s, &native.out, native.tracks, 2);
+	native.written += native.out.bytes.num;
+	native.out.bytes.num = 0;
+	run_stream(&stream, native_packet, &native);
+	native_flush(&native);
+	time_ns = os_gettime_ns() - start;
+
+	print_result("native mp4", &stream, time_ns, native.written, 0);
+
+	start = os_gettime_ns();
+	assert_true(ffmpeg_mux_init(&ffmpeg));
+	run_stream(&stream, ffmpeg_packet, &ffmpeg);
+	assert_int_equal(av_write_trailer(ffmpeg.ctx), 0);
+	avio_flush(ffmpeg.ctx->pb);
+	time_ns = os_gettime_ns() - start;
+
+	print_result("ffmpeg-mux", &stream, time_ns, ffmpeg.written,
+		     stream.payload_bytes +
+			     stream.packets * sizeof(struct ffm_packet_info));
+
+	ffmpeg_mux_free(&ffmpeg);
+	array_output_serializer_free(&native.out);
+	free_tracks(native.tracks);
+	bfree(stream.keyframe);
+	bfree(stream.frame);
+	bfree(stream.audio);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(mp4_mux_test),
+		cmocka_unit_test(benchmark),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
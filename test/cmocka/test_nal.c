@@ -0,0 +1,200 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <obs-nal.h>
+#include <util/bmem.h>
+#include <util/platform.h>
+
+static const uint8_t *reference_find_startcode(const uint8_t *p,
+					       const uint8_t *end)
+{
+	const uint8_t *start = p;
+
+	for (; end - p >= 3; p++) {
+		if (p[0] == 0 && p[1] == 0 && p[2] == 1) {
+			if (p > start && !p[-1])
+				p--;
+			return p;
+		}
+	}
+
+	return end;
+}
+
+static void nal_startcode_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	uint8_t data[100];
+	uint32_t seed = 1;
+
+	/* place start codes at every offset, in noise with plenty of zeros,
+	 * so that each position in and across the vector blocks is hit */
+	for (size_t pos = 0; pos < sizeof(data); pos++) {
+		for (size_t i = 0; i < sizeof(data); i++) {
+			seed = seed * 1103515245 + 12345;
+			data[i] = (seed >> 16) & 1 ? (uint8_t)(seed >> 24) : 0;
+		}
+		if (pos + 3 <= sizeof(data))
+			memcpy(data + pos, (uint8_t[]){0, 0, 1}, 3);
+
+		for (size_t size = 0; size <= sizeof(data); size++) {
+			const uint8_t *end = data + size;
+			for (size_t start = 0; start <= size; start += 7) {
+				assert_ptr_equal(
+					obs_nal_find_startcode(data + start,
+							       end),
+					reference_find_startcode(data + start,
+								 end));
+			}
+		}
+	}
+}
+
+static void nal_units_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	const uint8_t packet[] = {0, 0, 0, 1, 0x09, 0xf0, /* AUD */
+				  0, 0, 1,    0x65, 0x88, 0x84, 0x00,
+				  0x21, /* IDR */
+				  0, 0, 1,    0x06, 0x05};
+	struct obs_nal_unit units[4];
+
+	assert_int_equal(obs_nal_find_units(packet, sizeof(packet), units, 4),
+			 3);
+	assert_int_equal(units[0].start, 4);
+	assert_int_equal(units[0].end, 6);
+	assert_int_equal(units[1].start, 9);
+	assert_int_equal(units[1].end, 14);
+	assert_int_equal(units[2].start, 17);
+	assert_int_equal(units[2].end, sizeof(packet));
+
+	/* too many units to fit is reported as nothing found */
+	assert_int_equal(obs_nal_find_units(packet, sizeof(packet), units, 2),
+			 0);
+}
+
+/* ------------------------------------------------------------------------- */
+/* benchmark, 30 Mbps at 60 fps sized packets of four slices each            */
+
+#define BENCH_PACKET_SIZE (64 * 1024)
+#define BENCH_SLICES 4
+#define BENCH_RUNS 2000
+
+/* escaped like a real bitstream: zeros are frequent, but never three in a
+ * row or followed by a start code byte */
+static void fill_bench_packet(uint8_t *data, size_t size)
+{
+	size_t slice_size = size / BENCH_SLICES;
+	uint32_t seed = 1;
+	size_t zeros = 0;
+
+	for (size_t i = 0; i < size; i++) {
+		if (i % slice_size == 0 && i + 5 <= size) {
+			memcpy(data + i, (uint8_t[]){0, 0, 0, 1, 0x41}, 5);
+			i += 4;
+			zeros = 0;
+			continue;
+		}
+
+		seed = seed * 1103515245 + 12345;
+		data[i] = (seed >> 16) & 3 ? (uint8_t)(seed >> 24) : 0;
+
+		if (zeros >= 2 && data[i] <= 3)
+			data[i] = 3;
+		zeros = data[i] ? 0 : zeros + 1;
+	}
+}
+
+typedef size_t (*scan_func)(const uint8_t *data, size_t size);
+
+static size_t scan_reference(const uint8_t *data, size_t size)
+{
+	const uint8_t *end = data + size;
+	const uint8_t *p = reference_find_startcode(data, end);
+	size_t count = 0;
+
+	while (p < end) {
+		count++;
+		while (!*(p++))
+			;
+		p = reference_find_startcode(p, end);
+	}
+	return count;
+}
+
+static size_t scan_startcodes(const uint8_t *data, size_t size)
+{
+	const uint8_t *end = data + size;
+	const uint8_t *p = obs_nal_find_startcode(data, end);
+	size_t count = 0;
+
+	while (p < end) {
+		count++;
+		while (!*(p++))
+			;
+		p = obs_nal_find_startcode(p, end);
+	}
+	return count;
+}
+
+static size_t scan_units(const uint8_t *data, size_t size)
+{
+	struct obs_nal_unit units[BENCH_SLICES * 2];
+	return obs_nal_find_units(data, size, units, BENCH_SLICES * 2);
+}
+
+static uint64_t run_bench(scan_func func, const uint8_t *data, size_t size)
+{
+	uint64_t start = os_gettime_ns();
+
+	for (int run = 0; run < BENCH_RUNS; run++)
+		assert_int_equal(func(data, size), BENCH_SLICES);
+
+	return os_gettime_ns() - start;
+}
+
+/* timings vary with the machine and its load, so the benchmark only runs on
+ * request */
+static void benchmark(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	if (!getenv("OBS_BENCHMARKS"))
+		skip();
+
+	uint8_t *data = bmalloc(BENCH_PACKET_SIZE);
+	double bytes = (double)BENCH_RUNS * BENCH_PACKET_SIZE;
+
+	fill_bench_packet(data, BENCH_PACKET_SIZE);
+
+	uint64_t ref_ns = run_bench(scan_reference, data, BENCH_PACKET_SIZE);
+	uint64_t scan_ns = run_bench(scan_startcodes, data, BENCH_PACKET_SIZE);
+	uint64_t units_ns = run_bench(scan_units, data, BENCH_PACKET_SIZE);
+
+	print_message("byte-wise scan: %7.1f MB/s, start code scan: %7.1f "
+		      "MB/s (%.1fx), NAL units: %7.1f MB/s\n",
+		      bytes * 1000.0 / (double)ref_ns,
+		      bytes * 1000.0 / (double)scan_ns,
+		      (double)ref_ns / (double)(scan_ns ? scan_ns : 1),
+		      bytes * 1000.0 / (double)units_ns);
+
+	bfree(data);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(nal_startcode_test),
+		cmocka_unit_test(nal_units_test),
+		cmocka_unit_test(benchmark),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
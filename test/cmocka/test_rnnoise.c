@@ -0,0 +1,141 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <stdlib.h>
+
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <rnnoise.h>
+#include <rnn_simd.h>
+
+#define FRAME_SIZE 480
+#define SAMPLE_RATE 48000
+#define SECONDS 4
+#define NUM_FRAMES (SAMPLE_RATE * SECONDS / FRAME_SIZE)
+
+static const char *level_names[] = {"scalar", "SSE2", "AVX2"};
+
+/* a voiced sound with a changing pitch and noise, in the int16 range RNNoise
+ * expects */
+static float *create_input(void)
+{
+	float *input = bmalloc(NUM_FRAMES * FRAME_SIZE * sizeof(float));
+	float phase = 0.0f;
+
+	srand(1);
+	for (size_t i = 0; i < NUM_FRAMES * FRAME_SIZE; i++) {
+		float t = (float)i / SAMPLE_RATE;
+		float pitch = 120.0f + 40.0f * sinf(t * 2.0f);
+		float voice = 0.0f;
+
+		phase += 2.0f * (float)M_PI * pitch / SAMPLE_RATE;
+		for (int h = 1; h <= 8; h++)
+			voice += sinf(phase * (float)h) / (float)h;
+
+		/* syllables */
+		voice *= fmaxf(sinf(t * 9.0f), 0.0f);
+
+		float noise = (float)rand() / (float)RAND_MAX - 0.5f;
+		input[i] = 6000.0f * voice + 3000.0f * noise;
+	}
+
+	return input;
+}
+
+static void process(float *output, const float *input)
+{
+	DenoiseState *st = rnnoise_create(NULL);
+
+	for (size_t i = 0; i < NUM_FRAMES; i++)
+		rnnoise_process_frame(st, output + i * FRAME_SIZE,
+				      input + i * FRAME_SIZE);
+
+	rnnoise_destroy(st);
+}
+
+static void equivalence_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	const size_t size = NUM_FRAMES * FRAME_SIZE;
+	float *input = create_input();
+	float *reference = bmalloc(size * sizeof(float));
+	float *output = bmalloc(size * sizeof(float));
+
+	rnn_simd_set_level(RNN_SIMD_NONE);
+	process(reference, input);
+
+	for (int level = RNN_SIMD_SSE2; level <= RNN_SIMD_AVX2; level++) {
+		if (rnn_simd_set_level(level) != level)
+			break;
+
+		process(output, input);
+
+		double signal = 0.0;
+		double error = 0.0;
+		float max_error = 0.0f;
+
+		for (size_t i = 0; i < size; i++) {
+			float diff = fabsf(output[i] - reference[i]);
+			signal += (double)reference[i] * reference[i];
+			error += (double)diff * diff;
+			if (diff > max_error)
+				max_error = diff;
+		}
+
+		double snr = 10.0 * log10(signal / fmax(error, 1e-20));
+		print_message("%s: max difference %g, SNR %.1f dB\n",
+			      level_names[level], max_error, snr);
+
+		/* the output is the same as far as int16 samples go */
+		assert_true(snr > 80.0);
+		assert_true(max_error < 2.0f);
+	}
+
+	bfree(input);
+	bfree(reference);
+	bfree(output);
+}
+
+/* only runs with OBS_BENCHMARKS set */
+static void benchmark(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	if (!getenv("OBS_BENCHMARKS"))
+		skip();
+
+	const size_t size = NUM_FRAMES * FRAME_SIZE;
+	float *input = create_input();
+	float *output = bmalloc(size * sizeof(float));
+
+	for (int level = RNN_SIMD_NONE; level <= RNN_SIMD_AVX2; level++) {
+		if (rnn_simd_set_level(level) != level)
+			break;
+
+		uint64_t start = os_gettime_ns();
+		process(output, input);
+		uint64_t elapsed = os_gettime_ns() - start;
+
+		print_message("%-6s: %.2f ms per channel per second of audio\n",
+			      level_names[level],
+			      (double)elapsed / 1000000.0 / SECONDS);
+	}
+
+	bfree(input);
+	bfree(output);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(equivalence_test),
+		cmocka_unit_test(benchmark),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
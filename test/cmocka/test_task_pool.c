@@ -0,0 +1,222 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <util/bmem.h>
+#include <util/task.h>
+#include <util/threading.h>
+#include <util/platform.h>
+#include <media-io/audio-dsp.h>
+
+#ifdef HAVE_RNNOISE
+#include <rnnoise.h>
+#endif
+
+#define CHANNELS 8
+#define THREADS (CHANNELS - 1)
+#define SAMPLE_RATE 48000
+#define FRAME_SIZE 480
+#define SECONDS 2
+#define NUM_FRAMES (SAMPLE_RATE * SECONDS / FRAME_SIZE)
+#define COUNT 1000
+
+/* ------------------------------------------------------------------------- */
+
+struct count_test {
+	os_task_pool_t *pool;
+	volatile long runs[COUNT];
+	volatile long nested;
+};
+
+static void count_task(void *param, size_t idx)
+{
+	struct count_test *test = param;
+	os_atomic_inc_long(&test->runs[idx]);
+}
+
+static void nested_task(void *param, size_t idx)
+{
+	struct count_test *test = param;
+
+	/* the pool is busy with the outer call, so this runs inline */
+	os_task_pool_run(test->pool, count_task, test, COUNT);
+	os_atomic_inc_long(&test->nested);
+
+	UNUSED_PARAMETER(idx);
+}
+
+static void run_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct count_test *test = bzalloc(sizeof(*test));
+
+	assert_null(os_task_pool_create(0));
+	test->pool = os_task_pool_create(THREADS);
+	assert_non_null(test->pool);
+	assert_int_equal(os_task_pool_threads(test->pool), THREADS);
+
+	for (size_t count = 0; count <= COUNT; count = count * 2 + 1) {
+		memset((void *)test->runs, 0, sizeof(test->runs));
+		os_task_pool_run(test->pool, count_task, test, count);
+
+		for (size_t i = 0; i < COUNT; i++)
+			assert_int_equal(test->runs[i], i < count ? 1 : 0);
+	}
+
+	memset((void *)test->runs, 0, sizeof(test->runs));
+	os_task_pool_run(test->pool, nested_task, test, CHANNELS);
+	assert_int_equal(test->nested, CHANNELS);
+	for (size_t i = 0; i < COUNT; i++)
+		assert_int_equal(test->runs[i], CHANNELS);
+
+	/* without a pool everything runs on the calling thread */
+	memset((void *)test->runs, 0, sizeof(test->runs));
+	os_task_pool_run(NULL, count_task, test, COUNT);
+	for (size_t i = 0; i < COUNT; i++)
+		assert_int_equal(test->runs[i], 1);
+
+	os_task_pool_destroy(test->pool);
+	bfree(test);
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* the per-channel work of the compressor filter, one envelope per group of
+ * four channels, and of the RNNoise noise suppression filter, one frame per
+ * channel */
+struct channel_test {
+	float *input[CHANNELS];
+	float *env[CHANNELS / 4];
+	float envelope[CHANNELS / 4];
+	size_t frame;
+
+#ifdef HAVE_RNNOISE
+	DenoiseState *states[CHANNELS];
+	float segment[CHANNELS][FRAME_SIZE];
+#endif
+};
+
+static void envelope_task(void *param, size_t idx)
+{
+	struct channel_test *test = param;
+	float *samples[4];
+	float *env = test->env[idx];
+
+	for (size_t i = 0; i < 4; i++) {
+		samples[i] = test->input[idx * 4 + i];
+		samples[i] += test->frame * FRAME_SIZE;
+	}
+
+	audio_dsp_peak_envelope(env, samples, 4, FRAME_SIZE,
+				test->envelope[idx], 0.99f, 0.999f);
+	test->envelope[idx] = env[FRAME_SIZE - 1];
+}
+
+static void envelope_frame(os_task_pool_t *pool, struct channel_test *test)
+{
+	os_task_pool_run(pool, envelope_task, test, CHANNELS / 4);
+}
+
+#ifdef HAVE_RNNOISE
+static void rnnoise_task(void *param, size_t idx)
+{
+	struct channel_test *test = param;
+	const float *in = test->input[idx] + test->frame * FRAME_SIZE;
+
+	for (size_t i = 0; i < FRAME_SIZE; i++)
+		test->segment[idx][i] = in[i] * 32768.0f;
+
+	rnnoise_process_frame(test->states[idx], test->segment[idx],
+			      test->segment[idx]);
+}
+
+static void rnnoise_frame(os_task_pool_t *pool, struct channel_test *test)
+{
+	os_task_pool_run(pool, rnnoise_task, test, CHANNELS);
+}
+#endif
+
+typedef void (*frame_func_t)(os_task_pool_t *pool, struct channel_test *test);
+
+static double run_frames(os_task_pool_t *pool, struct channel_test *test,
+			 frame_func_t frame_func)
+{
+	uint64_t start = os_gettime_ns();
+
+	for (test->frame = 0; test->frame < NUM_FRAMES; test->frame++)
+		frame_func(pool, test);
+
+	return (double)(os_gettime_ns() - start) / 1000.0 / NUM_FRAMES;
+}
+
+static void benchmark_filter(os_task_pool_t *pool, struct channel_test *test,
+			     const char *name, frame_func_t frame_func)
+{
+	double inline_us = run_frames(NULL, test, frame_func);
+	double pool_us = run_frames(pool, test, frame_func);
+
+	print_message("%-10s: %7.2f us inline, %7.2f us with %d threads per "
+		      "10 ms of %d channel audio\n",
+		      name, inline_us, pool_us, THREADS + 1, CHANNELS);
+}
+
+/* only runs with OBS_BENCHMARKS set */
+static void benchmark(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	if (!getenv("OBS_BENCHMARKS"))
+		skip();
+
+	struct channel_test *test = bzalloc(sizeof(*test));
+	os_task_pool_t *pool = os_task_pool_create(THREADS);
+	assert_non_null(pool);
+
+	srand(1);
+	for (size_t ch = 0; ch < CHANNELS; ch++) {
+		const float freq = 0.01f * (float)(ch + 1);
+		float *input = bmalloc(NUM_FRAMES * FRAME_SIZE * sizeof(float));
+
+		for (size_t i = 0; i < NUM_FRAMES * FRAME_SIZE; i++)
+			input[i] = 0.5f * sinf((float)i * freq) +
+				   0.01f * ((float)rand() / RAND_MAX - 0.5f);
+		test->input[ch] = input;
+	}
+	for (size_t i = 0; i < CHANNELS / 4; i++)
+		test->env[i] = bmalloc(FRAME_SIZE * sizeof(float));
+
+	benchmark_filter(pool, test, "compressor", envelope_frame);
+
+#ifdef HAVE_RNNOISE
+	for (size_t ch = 0; ch < CHANNELS; ch++)
+		test->states[ch] = rnnoise_create(NULL);
+
+	benchmark_filter(pool, test, "rnnoise", rnnoise_frame);
+
+	for (size_t ch = 0; ch < CHANNELS; ch++)
+		rnnoise_destroy(test->states[ch]);
+#endif
+
+	for (size_t i = 0; i < CHANNELS / 4; i++)
+		bfree(test->env[i]);
+	for (size_t ch = 0; ch < CHANNELS; ch++)
+		bfree(test->input[ch]);
+	os_task_pool_destroy(pool);
+	bfree(test);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(run_test),
+		cmocka_unit_test(benchmark),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}